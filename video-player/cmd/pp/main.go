@@ -25,7 +25,7 @@ func main() {
 		noAutoplay  = flag.Bool("no-autoplay", false, "disable autoplay on start")
 		startMuted  = flag.Bool("mute", false, "start muted")
 		noResume    = flag.Bool("no-resume", false, "disable resume (even within this session)")
-		persist     = flag.Bool("persist-resume", false, "persist resume timestamps across runs (writes to ~/.pp_timestamps_go.json)")
+		persist     = flag.Bool("persist-resume", false, "persist resume timestamps across runs (writes to ~/.pp_timestamps_go.log)")
 		mpvPathFlag = flag.String("mpv", "mpv", "mpv executable path")
 		latest      = flag.Bool("latest", false, "order video list by date added (most recent first)")
 	)
@@ -73,6 +73,7 @@ func main() {
 	} else {
 		ts = pp.NewTimestampStore("")
 	}
+	defer ts.Close()
 
 	restoreTTY, err := tty.MakeRaw()
 	if err != nil {
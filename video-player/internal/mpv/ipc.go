@@ -2,6 +2,7 @@ package mpv
 
 import (
 	"bufio"
+	"bytes"
 	"context"
 	"encoding/json"
 	"errors"
@@ -11,30 +12,77 @@ import (
 	"path/filepath"
 	"strconv"
 	"sync"
+	"sync/atomic"
 	"time"
 )
 
 type Client struct {
-	conn    net.Conn
-	br      *bufio.Reader
-	mu      sync.Mutex
-	nextID  int
-	pending map[int]chan response
-	events  chan Event
-	closed  chan struct{}
-	closeOnce  sync.Once
-	eventsOnce sync.Once
+	conn      net.Conn
+	br        *bufio.Reader
+	mu        sync.Mutex
+	nextID    int
+	pending   map[int]*call
+	events    chan Event
+	closed    chan struct{}
+	readDone  chan struct{} // closed when readLoop returns
+	closeOnce sync.Once
+	// observers holds the callbacks registered with Observe, by observe id.
+	observers   map[int]func(data json.RawMessage)
+	nextObserve int
+
+	// Encoded commands wait in wbuf until writeLoop sends everything
+	// queued so far in one write.
+	wmu   sync.Mutex
+	wbuf  []byte
+	wkick chan struct{}
+
+	// Events wait in evq until pumpEvents hands them to the events
+	// channel, so a slow consumer never stalls replies to commands.
+	evmu    sync.Mutex
+	evq     []Event
+	evkick  chan struct{}
+	dropped atomic.Uint64
+}
+
+// maxQueuedEvents bounds the events waiting for the consumer of Events;
+// only past it are events dropped and counted.
+const maxQueuedEvents = 4096
+
+// call carries one reply from readLoop to the CommandData waiting for it.
+type call struct {
+	ch chan response
 }
 
+var callPool = sync.Pool{New: func() any { return &call{ch: make(chan response, 1)} }}
+
 type response struct {
+	Error string
+	Data  json.RawMessage
+}
+
+// message is any line mpv sends: a reply has request_id, an event has
+// event, and a property change also has id, name and data.
+type message struct {
 	RequestID int             `json:"request_id"`
 	Error     string          `json:"error"`
 	Data      json.RawMessage `json:"data"`
+	Event     string          `json:"event"`
+	ID        int             `json:"id"`
+	Name      string          `json:"name"`
 }
 
+// observeIDBase starts the ids Observe hands out, clear of the small ids
+// callers pass to raw observe_property commands, whose changes still
+// arrive on Events.
+const observeIDBase = 1 << 16
+
+// Event is an mpv event. ID, Property and Data are set for property-change;
+// other event fields are not decoded.
 type Event struct {
-	Name string
-	Raw  map[string]json.RawMessage
+	Name     string
+	ID       int
+	Property string
+	Data     json.RawMessage
 }
 
 func TempSocketPath() (string, func(), error) {
@@ -57,13 +105,22 @@ func Dial(ctx context.Context, socketPath string) (*Client, error) {
 		conn, err := d.DialContext(ctx, "unix", socketPath)
 		if err == nil {
 			c := &Client{
-				conn:    conn,
-				br:      bufio.NewReader(conn),
-				nextID:  1,
-				pending: map[int]chan response{},
-				events:  make(chan Event, 128),
-				closed:  make(chan struct{}),
+				conn:     conn,
+				br:       bufio.NewReaderSize(conn, 64<<10),
+				nextID:   1,
+				pending:  map[int]*call{},
+				events:   make(chan Event, 128),
+				closed:   make(chan struct{}),
+				readDone: make(chan struct{}),
+
+				observers:   map[int]func(json.RawMessage){},
+				nextObserve: observeIDBase,
+
+				wkick:  make(chan struct{}, 1),
+				evkick: make(chan struct{}, 1),
 			}
+			go c.writeLoop()
+			go c.pumpEvents()
 			go c.readLoop()
 			return c, nil
 		}
@@ -85,7 +142,7 @@ func (c *Client) Close() error {
 		close(c.closed)
 
 		c.mu.Lock()
-		c.pending = map[int]chan response{}
+		c.pending = map[int]*call{}
 		c.mu.Unlock()
 
 		if c.conn != nil {
@@ -95,91 +152,263 @@ func (c *Client) Close() error {
 	return err
 }
 
-func (c *Client) Events() <-chan Event { return c.events }
+func (c *Client) Events() <-chan Event  { return c.events }
 func (c *Client) Done() <-chan struct{} { return c.closed }
 
+// DroppedEvents reports how many events were discarded because the
+// consumer of Events fell maxQueuedEvents behind.
+func (c *Client) DroppedEvents() uint64 { return c.dropped.Load() }
+
 func (c *Client) readLoop() {
-	defer c.eventsOnce.Do(func() { close(c.events) })
+	defer close(c.readDone)
+	var long []byte
 	for {
-		line, err := c.br.ReadBytes('\n')
+		line, err := c.br.ReadSlice('\n')
+		if err == bufio.ErrBufferFull {
+			long = append(long[:0], line...)
+			for err == bufio.ErrBufferFull {
+				line, err = c.br.ReadSlice('\n')
+				long = append(long, line...)
+			}
+			line = long
+		}
 		if err != nil {
 			_ = c.Close()
 			return
 		}
 
-		var raw map[string]json.RawMessage
-		if err := json.Unmarshal(line, &raw); err != nil {
+		// Data must start out nil: Unmarshal reuses a RawMessage's backing
+		// array, and each one outlives this line.
+		var m message
+		if err := json.Unmarshal(line, &m); err != nil {
 			continue
 		}
 
-		if rid, ok := raw["request_id"]; ok {
-			var id int
-			if err := json.Unmarshal(rid, &id); err != nil {
-				continue
-			}
-
-			var r response
-			_ = json.Unmarshal(line, &r)
-
+		switch {
+		case m.Event == "property-change" && c.notify(m.ID, m.Data):
+		case m.Event != "":
+			c.pushEvent(Event{Name: m.Event, ID: m.ID, Property: m.Name, Data: m.Data})
+		case m.RequestID != 0:
 			c.mu.Lock()
-			ch := c.pending[id]
-			delete(c.pending, id)
+			cl := c.pending[m.RequestID]
+			delete(c.pending, m.RequestID)
 			c.mu.Unlock()
-			if ch != nil {
-				ch <- r
-				close(ch)
+			if cl != nil {
+				cl.ch <- response{Error: m.Error, Data: m.Data}
 			}
+		}
+	}
+}
+
+// writeLoop sends queued commands. Commands issued while a write is in
+// progress go out together in the next one.
+func (c *Client) writeLoop() {
+	var out []byte
+	for {
+		select {
+		case <-c.closed:
+			return
+		case <-c.wkick:
+		}
+		c.wmu.Lock()
+		out, c.wbuf = c.wbuf, out[:0]
+		c.wmu.Unlock()
+		if len(out) == 0 {
 			continue
 		}
+		if _, err := c.conn.Write(out); err != nil {
+			_ = c.Close()
+			return
+		}
+	}
+}
 
-		if ev, ok := raw["event"]; ok {
-			var name string
-			if err := json.Unmarshal(ev, &name); err != nil {
-				continue
-			}
+func (c *Client) enqueue(b []byte) {
+	c.wmu.Lock()
+	c.wbuf = append(c.wbuf, b...)
+	c.wmu.Unlock()
+	select {
+	case c.wkick <- struct{}{}:
+	default:
+	}
+}
 
-			e := Event{Name: name, Raw: raw}
+func (c *Client) pushEvent(e Event) {
+	c.evmu.Lock()
+	if len(c.evq) >= maxQueuedEvents {
+		c.evmu.Unlock()
+		c.dropped.Add(1)
+		return
+	}
+	c.evq = append(c.evq, e)
+	c.evmu.Unlock()
+	select {
+	case c.evkick <- struct{}{}:
+	default:
+	}
+}
 
-			select {
-			case c.events <- e:
-			default:
-			}
+// pumpEvents moves queued events to the events channel in order. Once
+// readLoop has returned it hands over what is still queued, such as the
+// end-file and shutdown mpv sends just before closing the socket, and
+// closes the channel.
+func (c *Client) pumpEvents() {
+	defer close(c.events)
+	var batch []Event
+	for {
+		last := false
+		select {
+		case <-c.readDone:
+			last = true
+		case <-c.evkick:
+		}
+		c.evmu.Lock()
+		batch, c.evq = c.evq, batch[:0]
+		c.evmu.Unlock()
+		for i, e := range batch {
+			c.events <- e
+			batch[i] = Event{}
+		}
+		if last {
+			return
 		}
 	}
 }
 
+// notify passes a property change to its Observe callback, reporting
+// whether the change belonged to one.
+func (c *Client) notify(id int, data json.RawMessage) bool {
+	c.mu.Lock()
+	fn := c.observers[id]
+	c.mu.Unlock()
+	if fn == nil {
+		return false
+	}
+	fn(data)
+	return true
+}
+
+// Observe subscribes to changes of property. mpv reports the current value
+// right away and then each change; fn receives the new value, or nil data
+// when the property is unavailable (no file loaded, say). fn runs on the
+// reader goroutine in the order mpv sent the changes, so it must return
+// quickly and must not issue commands on c. The returned id is for
+// Unobserve.
+func (c *Client) Observe(ctx context.Context, property string, fn func(data json.RawMessage)) (int, error) {
+	c.mu.Lock()
+	id := c.nextObserve
+	c.nextObserve++
+	c.observers[id] = fn
+	c.mu.Unlock()
+
+	if err := c.Command(ctx, "observe_property", id, property); err != nil {
+		c.mu.Lock()
+		delete(c.observers, id)
+		c.mu.Unlock()
+		return 0, err
+	}
+	return id, nil
+}
+
+// Unobserve ends a subscription made with Observe. fn may still see a
+// change that was already in flight.
+func (c *Client) Unobserve(ctx context.Context, id int) error {
+	err := c.Command(ctx, "unobserve_property", id)
+	c.mu.Lock()
+	delete(c.observers, id)
+	c.mu.Unlock()
+	return err
+}
+
 func (c *Client) Command(ctx context.Context, args ...any) error {
 	_, err := c.CommandData(ctx, args...)
 	return err
 }
 
+// encoder renders one command line into a reusable buffer.
+type encoder struct {
+	buf bytes.Buffer
+	enc *json.Encoder
+}
+
+var encoderPool = sync.Pool{New: func() any {
+	e := &encoder{}
+	e.enc = json.NewEncoder(&e.buf)
+	return e
+}}
+
+// encode renders {"command":args,"request_id":id}, leaving out request_id
+// when id is 0. The result is valid until e is returned to the pool.
+func (e *encoder) encode(id int, args []any) ([]byte, error) {
+	e.buf.Reset()
+	e.buf.WriteString(`{"command":`)
+	if err := e.enc.Encode(args); err != nil {
+		return nil, err
+	}
+	e.buf.Truncate(e.buf.Len() - 1) // Encode's newline
+	if id != 0 {
+		e.buf.WriteString(`,"request_id":`)
+		e.buf.WriteString(strconv.Itoa(id))
+	}
+	e.buf.WriteString("}\n")
+	return e.buf.Bytes(), nil
+}
+
+// Send queues a command without waiting for mpv's reply, for commands
+// whose result does not matter, like a seek from a repeating key.
+func (c *Client) Send(args ...any) error {
+	select {
+	case <-c.closed:
+		return errors.New("mpv ipc closed")
+	default:
+	}
+	e := encoderPool.Get().(*encoder)
+	defer encoderPool.Put(e)
+	b, err := e.encode(0, args)
+	if err != nil {
+		return err
+	}
+	c.enqueue(b)
+	return nil
+}
+
 func (c *Client) CommandData(ctx context.Context, args ...any) (json.RawMessage, error) {
+	cl := callPool.Get().(*call)
 	c.mu.Lock()
 	id := c.nextID
 	c.nextID++
-	ch := make(chan response, 1)
-	c.pending[id] = ch
+	c.pending[id] = cl
 	c.mu.Unlock()
 
-	req := map[string]any{
-		"command":    args,
-		"request_id": id,
+	// forget withdraws the request; cl goes back to the pool only if
+	// readLoop can no longer deliver to it.
+	forget := func() {
+		c.mu.Lock()
+		if c.pending[id] == cl {
+			delete(c.pending, id)
+			callPool.Put(cl)
+		}
+		c.mu.Unlock()
 	}
-	b, err := json.Marshal(req)
+
+	e := encoderPool.Get().(*encoder)
+	b, err := e.encode(id, args)
 	if err != nil {
+		encoderPool.Put(e)
+		forget()
 		return nil, err
 	}
-	b = append(b, '\n')
-	if _, err := c.conn.Write(b); err != nil {
-		return nil, err
-	}
+	c.enqueue(b)
+	encoderPool.Put(e)
 
 	select {
 	case <-ctx.Done():
+		forget()
 		return nil, ctx.Err()
 	case <-c.closed:
 		return nil, errors.New("mpv ipc closed")
-	case r := <-ch:
+	case r := <-cl.ch:
+		callPool.Put(cl)
 		if r.Error != "success" && r.Error != "" {
 			return r.Data, fmt.Errorf("mpv error: %s", r.Error)
 		}
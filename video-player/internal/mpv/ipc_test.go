@@ -0,0 +1,53 @@
+package mpv
+
+import (
+	"context"
+	"fmt"
+	"net"
+	"path/filepath"
+	"testing"
+)
+
+// TestEventsDeliveredAfterClose checks that events mpv sends just before
+// closing the socket all reach Events before it is closed.
+func TestEventsDeliveredAfterClose(t *testing.T) {
+	sock := filepath.Join(t.TempDir(), "mpv.sock")
+	ln, err := net.Listen("unix", sock)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer ln.Close()
+	const n = 1000
+	go func() {
+		conn, err := ln.Accept()
+		if err != nil {
+			return
+		}
+		for i := 0; i < n; i++ {
+			fmt.Fprintf(conn, "{\"event\":\"tick\",\"id\":%d}\n", i)
+		}
+		fmt.Fprint(conn, "{\"event\":\"end-file\"}\n{\"event\":\"shutdown\"}\n")
+		conn.Close()
+	}()
+
+	c, err := Dial(context.Background(), sock)
+	if err != nil {
+		t.Fatal(err)
+	}
+	<-c.Done()
+	var got []Event
+	for ev := range c.Events() {
+		got = append(got, ev)
+	}
+	if len(got) != n+2 || c.DroppedEvents() != 0 {
+		t.Fatalf("got %d events, %d dropped; want %d", len(got), c.DroppedEvents(), n+2)
+	}
+	for i := 0; i < n; i++ {
+		if got[i].ID != i {
+			t.Fatalf("event %d has id %d", i, got[i].ID)
+		}
+	}
+	if got[n].Name != "end-file" || got[n+1].Name != "shutdown" {
+		t.Errorf("last events are %q, %q", got[n].Name, got[n+1].Name)
+	}
+}
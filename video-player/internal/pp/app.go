@@ -39,9 +39,9 @@ type App struct {
 	pauseAfterLoad bool
 
 	lastMu         sync.Mutex
+	curPath        string // as last reported by mpv
 	lastSamplePath string
 	lastSamplePos  float64
-	lastSavedAt    time.Time
 
 	clipActive    bool
 	clipStartPath string
@@ -50,6 +50,9 @@ type App struct {
 	trimActive    bool
 	trimStartPath string
 	trimStartPos  float64
+
+	clipsOnce sync.Once
+	clips     *clipExporter
 }
 
 func (a *App) Run() error {
@@ -60,7 +63,7 @@ func (a *App) Run() error {
 	_ = a.MPV.Command(context.Background(), "observe_property", 1, "playlist-pos")
 
 	go a.eventLoop()
-	go a.periodicSaveLoop()
+	go a.trackPosition()
 	in := bufio.NewReader(os.Stdin)
 
 	for {
@@ -89,16 +92,16 @@ func (a *App) Run() error {
 			_ = a.MPV.Command(context.Background(), "cycle", "pause")
 			a.osd("Toggle pause")
 		case tty.KeyLeft:
-			_ = a.MPV.Command(context.Background(), "seek", -a.SeekFineS, "relative")
+			_ = a.MPV.Send("seek", -a.SeekFineS, "relative")
 			a.osd(fmt.Sprintf("◀ %ss", formatSeconds(a.SeekFineS)))
 		case tty.KeyRight:
-			_ = a.MPV.Command(context.Background(), "seek", a.SeekFineS, "relative")
+			_ = a.MPV.Send("seek", a.SeekFineS, "relative")
 			a.osd(fmt.Sprintf("▶ %ss", formatSeconds(a.SeekFineS)))
 		case tty.KeyUp:
-			_ = a.MPV.Command(context.Background(), "seek", a.SeekLongS, "relative")
+			_ = a.MPV.Send("seek", a.SeekLongS, "relative")
 			a.osd(fmt.Sprintf("▶ %.0fs", a.SeekLongS))
 		case tty.KeyDown:
-			_ = a.MPV.Command(context.Background(), "seek", -a.SeekLongS, "relative")
+			_ = a.MPV.Send("seek", -a.SeekLongS, "relative")
 			a.osd(fmt.Sprintf("◀ %.0fs", a.SeekLongS))
 		case tty.KeyRune:
 			quit, err := a.handleRune(key.Rune, in)
@@ -141,35 +144,35 @@ func (a *App) handleRune(r rune, in *bufio.Reader) (quit bool, err error) {
 		_ = a.bumpWindowScale(-0.1)
 		return false, nil
 	case 'z':
-		_ = a.MPV.Command(context.Background(), "seek", -a.SeekFineS, "relative")
+		_ = a.MPV.Send("seek", -a.SeekFineS, "relative")
 		a.osd(fmt.Sprintf("◀ %ss", formatSeconds(a.SeekFineS)))
 		return false, nil
 	case 'c':
-		_ = a.MPV.Command(context.Background(), "seek", a.SeekFineS, "relative")
+		_ = a.MPV.Send("seek", a.SeekFineS, "relative")
 		a.osd(fmt.Sprintf("▶ %ss", formatSeconds(a.SeekFineS)))
 		return false, nil
 	case 'k':
-		_ = a.MPV.Command(context.Background(), "seek", a.SeekLongS, "relative")
+		_ = a.MPV.Send("seek", a.SeekLongS, "relative")
 		a.osd(fmt.Sprintf("▶ %.0fs", a.SeekLongS))
 		return false, nil
 	case 'j':
-		_ = a.MPV.Command(context.Background(), "seek", -a.SeekLongS, "relative")
+		_ = a.MPV.Send("seek", -a.SeekLongS, "relative")
 		a.osd(fmt.Sprintf("◀ %.0fs", a.SeekLongS))
 		return false, nil
 	case 'a':
-		_ = a.MPV.Command(context.Background(), "seek", -a.SeekShortS, "relative")
+		_ = a.MPV.Send("seek", -a.SeekShortS, "relative")
 		a.osd(fmt.Sprintf("◀ %.0fs", a.SeekShortS))
 		return false, nil
 	case 'd':
-		_ = a.MPV.Command(context.Background(), "seek", a.SeekShortS, "relative")
+		_ = a.MPV.Send("seek", a.SeekShortS, "relative")
 		a.osd(fmt.Sprintf("▶ %.0fs", a.SeekShortS))
 		return false, nil
 	case 'w':
-		_ = a.MPV.Command(context.Background(), "seek", a.SeekLongS, "relative")
+		_ = a.MPV.Send("seek", a.SeekLongS, "relative")
 		a.osd(fmt.Sprintf("▶ %.0fs", a.SeekLongS))
 		return false, nil
 	case 's':
-		_ = a.MPV.Command(context.Background(), "seek", -a.SeekLongS, "relative")
+		_ = a.MPV.Send("seek", -a.SeekLongS, "relative")
 		a.osd(fmt.Sprintf("◀ %.0fs", a.SeekLongS))
 		return false, nil
 	case 'm':
@@ -225,8 +228,7 @@ func (a *App) ShowHelpOnce() {
 }
 
 func (a *App) osd(msg string) {
-	ctx := withTimeout(200 * time.Millisecond)
-	_ = a.MPV.Command(ctx, "show-text", msg, 1500)
+	_ = a.MPV.Send("show-text", msg, 1500)
 }
 
 func (a *App) SaveSnapshot(ctx context.Context) error {
@@ -298,6 +300,12 @@ func (a *App) startClip(ctx context.Context) error {
 	a.clipActive = true
 	a.clipStartPath = path
 	a.clipStartPos = pos
+	if !filepath.IsAbs(path) {
+		if wd, err := os.Getwd(); err == nil {
+			path = filepath.Join(wd, path)
+		}
+	}
+	a.clipQueue().prefetch(path)
 	a.osd("Clip start")
 	return nil
 }
@@ -353,6 +361,12 @@ func (a *App) startTrim(ctx context.Context) error {
 	a.trimActive = true
 	a.trimStartPath = path
 	a.trimStartPos = pos
+	if !filepath.IsAbs(path) {
+		if wd, err := os.Getwd(); err == nil {
+			path = filepath.Join(wd, path)
+		}
+	}
+	a.clipQueue().prefetch(path)
 	a.osd("Trim start")
 	return nil
 }
@@ -422,31 +436,20 @@ func (a *App) exportSegment(path string, startPos, endPos float64, label string)
 	if !filepath.IsAbs(inPath) {
 		inPath = filepath.Join(wd, inPath)
 	}
-	startArg := formatSeconds(startPos)
-	durArg := formatSeconds(endPos - startPos)
-
 	a.osd("Saving " + strings.ToLower(label) + "...")
-	go a.renderClip(inPath, outPath, startArg, durArg, label)
-	return nil
+	return a.clipQueue().submit(clipJob{
+		inPath:  inPath,
+		outPath: outPath,
+		start:   startPos,
+		end:     endPos,
+		label:   label,
+	})
 }
 
-func (a *App) renderClip(inPath, outPath, startArg, durArg, label string) {
-	cmd := exec.Command("ffmpeg",
-		"-hide_banner",
-		"-loglevel", "error",
-		"-ss", startArg,
-		"-t", durArg,
-		"-i", inPath,
-		"-c", "copy",
-		"-map", "0",
-		"-avoid_negative_ts", "make_zero",
-		outPath,
-	)
-	if err := cmd.Run(); err != nil {
-		a.osd(label + " failed")
-		return
-	}
-	a.osd("Saved: " + filepath.Base(outPath))
+// clipQueue returns the exporter clips and trims are rendered on.
+func (a *App) clipQueue() *clipExporter {
+	a.clipsOnce.Do(func() { a.clips = newClipExporter(a.osd) })
+	return a.clips
 }
 
 func withTimeout(d time.Duration) context.Context {
@@ -624,14 +627,12 @@ func (a *App) eventLoop() {
 	for ev := range a.MPV.Events() {
 		switch ev.Name {
 		case "property-change":
-			var name string
-			_ = json.Unmarshal(ev.Raw["name"], &name)
-			if name == "playlist-pos" {
+			if ev.Property == "playlist-pos" {
 				// Switching can happen from mpv window keybindings; flush last sampled position
 				// so toggling back/forth resumes instead of starting from 0.
 				_ = a.flushLastSample()
 				var n int
-				_ = json.Unmarshal(ev.Raw["data"], &n)
+				_ = json.Unmarshal(ev.Data, &n)
 				if n >= 0 {
 					a.Index = n
 				}
@@ -785,40 +786,64 @@ func (a *App) syncIndex() {
 	}
 }
 
-func (a *App) periodicSaveLoop() {
+// saveInterval is how long a new position may stay unsaved while playing.
+const saveInterval = 3 * time.Second
+
+// trackPosition follows playback through pushed property changes and saves
+// the latest position at most every saveInterval. Nothing runs while
+// playback is paused.
+func (a *App) trackPosition() {
 	if !a.ResumeState || a.Timestamps == nil {
 		return
 	}
-	t := time.NewTicker(1 * time.Second)
-	defer t.Stop()
-	for range t.C {
-		a.sampleAndMaybeSave()
-	}
-}
-
-func (a *App) sampleAndMaybeSave() {
-	path, err := a.MPV.GetString(withTimeout(200*time.Millisecond), "path")
-	if err != nil || path == "" {
+	sampled := make(chan struct{}, 1)
+	ctx, cancel := context.WithTimeout(context.Background(), time.Second)
+	defer cancel()
+	// The path subscription comes first, so every time-pos change arrives
+	// after the path it belongs to.
+	_, err := a.MPV.Observe(ctx, "path", func(data json.RawMessage) {
+		var path string
+		_ = json.Unmarshal(data, &path)
+		a.lastMu.Lock()
+		a.curPath = path
+		a.lastMu.Unlock()
+	})
+	if err != nil {
 		return
 	}
-	pos, err := a.MPV.GetFloat(withTimeout(200*time.Millisecond), "time-pos")
-	if err != nil || pos < 0 {
+	_, err = a.MPV.Observe(ctx, "time-pos", func(data json.RawMessage) {
+		var pos float64
+		if json.Unmarshal(data, &pos) != nil || pos < 0 {
+			return
+		}
+		a.lastMu.Lock()
+		if a.curPath != "" {
+			a.lastSamplePath = a.curPath
+			a.lastSamplePos = pos
+		}
+		a.lastMu.Unlock()
+		select {
+		case sampled <- struct{}{}:
+		default:
+		}
+	})
+	if err != nil {
 		return
 	}
 
-	a.lastMu.Lock()
-	a.lastSamplePath = path
-	a.lastSamplePos = pos
-	shouldSave := time.Since(a.lastSavedAt) >= 3*time.Second
-	if shouldSave {
-		a.lastSavedAt = time.Now()
-	}
-	a.lastMu.Unlock()
-
-	// Keep in-memory store fresh; persist to disk every few seconds.
-	a.Timestamps.Set(path, pos)
-	if shouldSave {
-		_ = a.Timestamps.Save()
+	var save <-chan time.Time
+	for {
+		select {
+		case <-a.MPV.Done():
+			return
+		case <-sampled:
+			if save == nil {
+				save = time.After(saveInterval)
+			}
+		case <-save:
+			save = nil
+			_ = a.flushLastSample()
+		}
 	}
 }
 
@@ -0,0 +1,312 @@
+package pp
+
+import (
+	"bufio"
+	"bytes"
+	"errors"
+	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+)
+
+const (
+	// clipWorkers is how many clips render at once; further clips wait in
+	// a queue of clipQueueSize and are refused beyond that.
+	clipWorkers   = 2
+	clipQueueSize = 8
+
+	// keyframeSlack is how close a cut may be to a keyframe to be taken as
+	// on it, well under one frame at common rates.
+	keyframeSlack = 0.005
+)
+
+// smartCutCodec is how the parts of a smart cut are made for one source
+// codec. Parts are muxed as MPEG-TS with their parameter sets in-band, since
+// the concat demuxer keeps only the first part's extradata: the edges come
+// from an encoder that repeats its headers at every keyframe, and the copied
+// GOPs get the source's own through annexB.
+type smartCutCodec struct {
+	encoder []string
+	annexB  string // bitstream filter for the copied part
+}
+
+// smartCutCodecs maps the source video codecs that edges can be re-encoded
+// for to a matching encoder.
+var smartCutCodecs = map[string]smartCutCodec{
+	"h264": {
+		encoder: []string{"-c:v", "libx264", "-preset", "veryfast", "-crf", "16", "-x264-params", "repeat-headers=1"},
+		annexB:  "h264_mp4toannexb",
+	},
+	"hevc": {
+		encoder: []string{"-c:v", "libx265", "-preset", "veryfast", "-crf", "18", "-x265-params", "repeat-headers=1"},
+		annexB:  "hevc_mp4toannexb",
+	},
+}
+
+type clipJob struct {
+	inPath, outPath string
+	start, end      float64
+	label           string
+}
+
+// clipExporter renders clips on a few workers. Where the source can be
+// smart-cut, the whole GOPs inside a clip are stream-copied and only the
+// partial GOPs at its edges are re-encoded, so cuts land on the requested
+// frames at close to stream-copy speed.
+type clipExporter struct {
+	jobs chan clipJob
+	osd  func(string)
+
+	mu    sync.Mutex
+	index map[string]*keyframeIndex
+}
+
+// keyframeIndex is the video keyframe times of one file, as of its size
+// and mtime.
+type keyframeIndex struct {
+	ready   chan struct{}
+	size    int64
+	modTime int64
+
+	codec, pixFmt string
+	keyframes     []float64 // sorted, in seconds
+	err           error
+}
+
+func newClipExporter(osd func(string)) *clipExporter {
+	x := &clipExporter{
+		jobs:  make(chan clipJob, clipQueueSize),
+		osd:   osd,
+		index: map[string]*keyframeIndex{},
+	}
+	for i := 0; i < clipWorkers; i++ {
+		go x.worker()
+	}
+	return x
+}
+
+// submit queues a clip, failing when the queue is full.
+func (x *clipExporter) submit(job clipJob) error {
+	select {
+	case x.jobs <- job:
+		return nil
+	default:
+		return fmt.Errorf("%s failed (%d clips already queued)", job.label, clipQueueSize)
+	}
+}
+
+func (x *clipExporter) worker() {
+	for job := range x.jobs {
+		if err := x.render(job); err != nil {
+			x.osd(job.label + " failed")
+			continue
+		}
+		x.osd("Saved: " + filepath.Base(job.outPath))
+	}
+}
+
+func (x *clipExporter) render(job clipJob) error {
+	idx := x.keyframes(job.inPath)
+	<-idx.ready
+	if _, ok := smartCutCodecs[idx.codec]; idx.err == nil && ok {
+		if err := x.smartCut(job, idx); err == nil {
+			return nil
+		}
+		_ = os.Remove(job.outPath)
+	}
+	// Stream copy, with the start snapped to the keyframe before it.
+	return runFFmpeg(
+		"-ss", formatSeconds(job.start),
+		"-t", formatSeconds(job.end-job.start),
+		"-i", job.inPath,
+		"-c", "copy",
+		"-map", "0",
+		"-avoid_negative_ts", "make_zero",
+		job.outPath,
+	)
+}
+
+// prefetch starts probing path's keyframes, so the index is ready by the
+// time a clip being marked on it is exported.
+func (x *clipExporter) prefetch(path string) {
+	x.keyframes(path)
+}
+
+// keyframes returns path's index, starting a probe when there is none for
+// the file as it is now. Wait on ready before reading it.
+func (x *clipExporter) keyframes(path string) *keyframeIndex {
+	var size, modTime int64
+	if info, err := os.Stat(path); err == nil {
+		size, modTime = info.Size(), info.ModTime().UnixNano()
+	}
+	x.mu.Lock()
+	defer x.mu.Unlock()
+	if idx := x.index[path]; idx != nil && idx.size == size && idx.modTime == modTime {
+		return idx
+	}
+	idx := &keyframeIndex{ready: make(chan struct{}), size: size, modTime: modTime}
+	x.index[path] = idx
+	go func() {
+		defer close(idx.ready)
+		idx.codec, idx.pixFmt, idx.keyframes, idx.err = probeKeyframes(path)
+	}()
+	return idx
+}
+
+// probeKeyframes reads the packet index of path's first video stream; no
+// frames are decoded. Times are made relative to the file's start time, as
+// mpv positions and ffmpeg -ss are.
+func probeKeyframes(path string) (codec, pixFmt string, keyframes []float64, err error) {
+	out, err := exec.Command("ffprobe",
+		"-v", "error",
+		"-select_streams", "v:0",
+		"-show_entries", "format=start_time:stream=codec_name,pix_fmt:packet=pts_time,flags",
+		"-of", "csv",
+		path,
+	).Output()
+	if err != nil {
+		return "", "", nil, err
+	}
+	var startTime float64
+	sc := bufio.NewScanner(bytes.NewReader(out))
+	for sc.Scan() {
+		f := strings.Split(sc.Text(), ",")
+		switch {
+		case f[0] == "format" && len(f) >= 2:
+			startTime, _ = strconv.ParseFloat(f[1], 64)
+		case f[0] == "stream" && len(f) >= 3:
+			codec, pixFmt = f[1], f[2]
+		case f[0] == "packet" && len(f) >= 3 && strings.HasPrefix(f[2], "K"):
+			if t, err := strconv.ParseFloat(f[1], 64); err == nil {
+				keyframes = append(keyframes, t)
+			}
+		}
+	}
+	if codec == "" || len(keyframes) == 0 {
+		return "", "", nil, errors.New("no video keyframes")
+	}
+	for i := range keyframes {
+		keyframes[i] -= startTime
+	}
+	sort.Float64s(keyframes)
+	return codec, pixFmt, keyframes, nil
+}
+
+// smartCut renders job as up to three parts joined by the concat demuxer:
+// the frames before the first keyframe in range re-encoded, whole GOPs
+// copied, and the frames after the last keyframe re-encoded. A clip that
+// holds no keyframe is re-encoded whole.
+func (x *clipExporter) smartCut(job clipJob, idx *keyframeIndex) error {
+	kf := idx.keyframes
+	// first: the first keyframe at or after start; last: the last one at
+	// or before end.
+	first := sort.SearchFloat64s(kf, job.start-keyframeSlack)
+	last := sort.SearchFloat64s(kf, job.end+keyframeSlack) - 1
+	if first >= len(kf) || last < first {
+		return encodePart(job.inPath, job.outPath, job.start, job.end, idx)
+	}
+	headEnd, tailStart := kf[first], kf[last]
+	needHead := headEnd-job.start > keyframeSlack
+	needTail := job.end-tailStart > keyframeSlack
+	copyEnd := tailStart
+	if !needTail {
+		copyEnd = job.end
+	}
+	if !needHead && !needTail {
+		return copyPart(job.inPath, job.outPath, headEnd, copyEnd)
+	}
+
+	tmp, err := os.MkdirTemp(filepath.Dir(job.outPath), ".clip-")
+	if err != nil {
+		return err
+	}
+	defer os.RemoveAll(tmp)
+
+	var parts []string
+	part := func() string {
+		p := filepath.Join(tmp, fmt.Sprintf("part%d.ts", len(parts)))
+		parts = append(parts, p)
+		return p
+	}
+	if needHead {
+		if err := encodePart(job.inPath, part(), job.start, headEnd, idx); err != nil {
+			return err
+		}
+	}
+	if copyEnd > headEnd {
+		if err := copyPart(job.inPath, part(), headEnd, copyEnd, "-bsf:v", smartCutCodecs[idx.codec].annexB); err != nil {
+			return err
+		}
+	}
+	if needTail {
+		if err := encodePart(job.inPath, part(), tailStart, job.end, idx); err != nil {
+			return err
+		}
+	}
+
+	var list strings.Builder
+	for _, p := range parts {
+		fmt.Fprintf(&list, "file '%s'\n", strings.ReplaceAll(p, "'", `'\''`))
+	}
+	listPath := filepath.Join(tmp, "parts.txt")
+	if err := os.WriteFile(listPath, []byte(list.String()), 0o644); err != nil {
+		return err
+	}
+	return runFFmpeg(
+		"-f", "concat",
+		"-safe", "0",
+		"-i", listPath,
+		"-c", "copy",
+		"-map", "0",
+		"-avoid_negative_ts", "make_zero",
+		job.outPath,
+	)
+}
+
+// copyPart stream-copies [start, end) of in, where start is a keyframe.
+// Seeking a hair past it keeps float rounding from landing on the GOP
+// before. Durations count from the seek point, and the copy stops
+// keyframeSlack short of end, so a keyframe at end is left to the part
+// after it instead of appearing in both.
+func copyPart(in, out string, start, end float64, extra ...string) error {
+	const nudge = 0.001
+	args := []string{
+		"-ss", formatSeconds(start + nudge),
+		"-i", in,
+		"-t", formatSeconds(end - start - nudge - keyframeSlack),
+		"-map", "0:v:0", "-map", "0:a?",
+		"-c", "copy",
+	}
+	args = append(args, extra...)
+	args = append(args, "-avoid_negative_ts", "make_zero", out)
+	return runFFmpeg(args...)
+}
+
+// encodePart re-encodes the video of [start, end) of in with an encoder
+// matching the source, so the part joins the copied GOPs; audio is copied.
+// Like copyPart it stops keyframeSlack short of end, well inside the gap
+// before the frame at end.
+func encodePart(in, out string, start, end float64, idx *keyframeIndex) error {
+	args := []string{
+		"-ss", formatSeconds(start),
+		"-i", in,
+		"-t", formatSeconds(end - start - keyframeSlack),
+		"-map", "0:v:0", "-map", "0:a?",
+	}
+	args = append(args, smartCutCodecs[idx.codec].encoder...)
+	if idx.pixFmt != "" {
+		args = append(args, "-pix_fmt", idx.pixFmt)
+	}
+	args = append(args, "-c:a", "copy", "-avoid_negative_ts", "make_zero", out)
+	return runFFmpeg(args...)
+}
+
+func runFFmpeg(args ...string) error {
+	args = append([]string{"-hide_banner", "-loglevel", "error"}, args...)
+	return exec.Command("ffmpeg", args...).Run()
+}
@@ -0,0 +1,131 @@
+package pp
+
+import (
+	"bytes"
+	"os/exec"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"testing"
+)
+
+// requireFFmpeg skips the test unless ffmpeg and ffprobe are on PATH with
+// the encoders it needs.
+func requireFFmpeg(t *testing.T, encoders ...string) {
+	t.Helper()
+	for _, tool := range []string{"ffmpeg", "ffprobe"} {
+		if _, err := exec.LookPath(tool); err != nil {
+			t.Skipf("%s not on PATH", tool)
+		}
+	}
+	out, err := exec.Command("ffmpeg", "-hide_banner", "-encoders").Output()
+	if err != nil {
+		t.Skipf("ffmpeg -encoders: %v", err)
+	}
+	for _, enc := range encoders {
+		if !bytes.Contains(out, []byte(" "+enc+" ")) {
+			t.Skipf("ffmpeg has no %s encoder", enc)
+		}
+	}
+}
+
+// makeSource writes a 6s 25 fps H.264 clip with a keyframe every second and
+// AAC audio; every frame of testsrc2 differs from the one before.
+func makeSource(t *testing.T, path string) {
+	t.Helper()
+	if err := runFFmpeg(
+		"-f", "lavfi", "-i", "testsrc2=size=320x240:rate=25",
+		"-f", "lavfi", "-i", "sine=frequency=440:sample_rate=48000",
+		"-t", "6",
+		"-c:v", "libx264", "-preset", "ultrafast", "-g", "25", "-keyint_min", "25", "-sc_threshold", "0",
+		"-pix_fmt", "yuv420p",
+		"-c:a", "aac",
+		path,
+	); err != nil {
+		t.Fatalf("make source: %v", err)
+	}
+}
+
+func TestSmartCutDecodesCleanly(t *testing.T) {
+	requireFFmpeg(t, "libx264")
+	dir := t.TempDir()
+	src := filepath.Join(dir, "src.mp4")
+	makeSource(t, src)
+
+	x := newClipExporter(func(string) {})
+	idx := x.keyframes(src)
+	<-idx.ready
+	if idx.err != nil {
+		t.Fatalf("keyframes: %v", idx.err)
+	}
+	if idx.codec != "h264" || len(idx.keyframes) < 6 {
+		t.Fatalf("index = %s with %d keyframes, want h264 with 6", idx.codec, len(idx.keyframes))
+	}
+
+	// Head [1.4, 2), copied GOPs [2, 4), tail [4, 4.6).
+	out := filepath.Join(dir, "clip.mp4")
+	job := clipJob{inPath: src, outPath: out, start: 1.4, end: 4.6, label: "Clip"}
+	if err := x.smartCut(job, idx); err != nil {
+		t.Fatalf("smartCut: %v", err)
+	}
+
+	// Decoding must not complain: the copied GOPs need the source's
+	// parameter sets, not the edge encoder's.
+	cmd := exec.Command("ffmpeg", "-hide_banner", "-v", "error", "-xerror", "-i", out, "-map", "0:v", "-f", "null", "-")
+	var stderr bytes.Buffer
+	cmd.Stderr = &stderr
+	if err := cmd.Run(); err != nil || stderr.Len() > 0 {
+		t.Fatalf("decoding the clip: %v\n%s", err, stderr.String())
+	}
+
+	// One frame per 40 ms of clip, none of them repeated at a seam.
+	md5s, err := exec.Command("ffmpeg", "-hide_banner", "-v", "error", "-i", out, "-map", "0:v", "-f", "framemd5", "-").Output()
+	if err != nil {
+		t.Fatalf("framemd5: %v", err)
+	}
+	var frames []string
+	for _, line := range strings.Split(string(md5s), "\n") {
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+		fields := strings.Split(line, ",")
+		frames = append(frames, strings.TrimSpace(fields[len(fields)-1]))
+	}
+	if want := 80; len(frames) != want {
+		t.Errorf("clip has %d frames, want %d", len(frames), want)
+	}
+	for i := 1; i < len(frames); i++ {
+		if frames[i] == frames[i-1] {
+			t.Errorf("frame %d repeats frame %d", i, i-1)
+		}
+	}
+
+	dur, err := exec.Command("ffprobe", "-v", "error", "-show_entries", "format=duration", "-of", "csv=p=0", out).Output()
+	if err != nil {
+		t.Fatalf("ffprobe: %v", err)
+	}
+	if d, err := strconv.ParseFloat(strings.TrimSpace(string(dur)), 64); err != nil || d < 3.1 || d > 3.3 {
+		t.Errorf("clip lasts %s s, want about 3.2", strings.TrimSpace(string(dur)))
+	}
+}
+
+func TestCopyPartStopsBeforeEnd(t *testing.T) {
+	requireFFmpeg(t, "libx264")
+	dir := t.TempDir()
+	src := filepath.Join(dir, "src.mp4")
+	makeSource(t, src)
+
+	// [1, 3) copied: 50 frames, not counting the keyframe at 3.
+	out := filepath.Join(dir, "part.ts")
+	if err := copyPart(src, out, 1, 3, "-bsf:v", "h264_mp4toannexb"); err != nil {
+		t.Fatalf("copyPart: %v", err)
+	}
+	n, err := exec.Command("ffprobe", "-v", "error", "-select_streams", "v:0", "-count_packets",
+		"-show_entries", "stream=nb_read_packets", "-of", "csv=p=0", out).Output()
+	if err != nil {
+		t.Fatalf("ffprobe: %v", err)
+	}
+	if got := strings.TrimSpace(string(n)); got != "50" {
+		t.Errorf("copied %s video packets, want 50", got)
+	}
+}
@@ -0,0 +1,9 @@
+//go:build !unix
+
+package pp
+
+import "os"
+
+// lockFile is a no-op where flock is unavailable; players sharing a log
+// there are not kept apart.
+func lockFile(f *os.File) error { return nil }
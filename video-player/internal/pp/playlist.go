@@ -1,11 +1,16 @@
 package pp
 
 import (
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
 	"fmt"
 	"os"
 	"path/filepath"
 	"sort"
 	"strings"
+	"sync"
+	"time"
 )
 
 var videoExts = map[string]bool{
@@ -36,32 +41,32 @@ func BuildPlaylist(path string, latest bool) (files []string, startIndex int, er
 		startFile = path
 	}
 
-	entries, err := os.ReadDir(dir)
+	l, err := listDir(dir, latest)
 	if err != nil {
 		return nil, 0, err
 	}
-	for _, e := range entries {
-		if e.IsDir() {
-			continue
-		}
-		ext := strings.ToLower(filepath.Ext(e.Name()))
-		if !videoExts[ext] {
-			continue
-		}
-		files = append(files, filepath.Join(dir, e.Name()))
+	files = make([]string, len(l.Names))
+	for i, name := range l.Names {
+		files[i] = filepath.Join(dir, name)
 	}
 	if latest {
 		// Sort by modification time, most recent first
-		sort.Slice(files, func(i, j int) bool {
-			infoI, errI := os.Stat(files[i])
-			infoJ, errJ := os.Stat(files[j])
-			if errI != nil || errJ != nil {
-				return files[i] < files[j]
+		order := make([]int, len(files))
+		for i := range order {
+			order[i] = i
+		}
+		sort.SliceStable(order, func(i, j int) bool {
+			a, b := order[i], order[j]
+			if l.MTimes[a] != l.MTimes[b] {
+				return l.MTimes[a] > l.MTimes[b]
 			}
-			return infoI.ModTime().After(infoJ.ModTime())
+			return l.Names[a] < l.Names[b]
 		})
-	} else {
-		sort.Strings(files)
+		sorted := make([]string, len(files))
+		for i, k := range order {
+			sorted[i] = files[k]
+		}
+		files = sorted
 	}
 	if len(files) == 0 {
 		return nil, 0, fmt.Errorf("no video files found in %s", dir)
@@ -75,3 +80,154 @@ func BuildPlaylist(path string, latest bool) (files []string, startIndex int, er
 	}
 	return files, 0, nil
 }
+
+// dirListing is the sorted video files of one directory, kept on disk so a
+// later launch can skip reading the directory while its mtime is unchanged.
+// Adding, removing or renaming a file changes the directory mtime; writing
+// to an existing file does not, so only the names are cached and the files
+// are statted afresh whenever their mtimes are wanted.
+type dirListing struct {
+	Dir     string   `json:"dir"`
+	ModTime int64    `json:"mtime"` // of Dir, in ns, taken before reading it
+	Names   []string `json:"names"`
+	// MTimes parallels Names, in ns. It is filled in only when a listing
+	// is wanted by modification time.
+	MTimes []int64 `json:"-"`
+}
+
+// statWorkers bounds the concurrent stats when a listing needs mtimes;
+// on network filesystems each one is a round trip.
+const statWorkers = 16
+
+// listDir returns dir's video files sorted by name, from the cache when it
+// is current, with MTimes when withMTimes is set. A listing read from the
+// directory is saved to the cache before listDir returns: the write is
+// small, and a save left running would be cut off when the player exits.
+func listDir(dir string, withMTimes bool) (*dirListing, error) {
+	info, err := os.Stat(dir)
+	if err != nil {
+		return nil, err
+	}
+	modTime := info.ModTime().UnixNano()
+	cachePath := listingCachePath(dir)
+	l := loadListing(cachePath, dir, modTime)
+	if l == nil {
+		entries, err := os.ReadDir(dir)
+		if err != nil {
+			return nil, err
+		}
+		l = &dirListing{Dir: dir, ModTime: modTime}
+		for _, e := range entries {
+			if e.IsDir() {
+				continue
+			}
+			ext := strings.ToLower(filepath.Ext(e.Name()))
+			if !videoExts[ext] {
+				continue
+			}
+			l.Names = append(l.Names, e.Name())
+		}
+		sort.Strings(l.Names)
+		if cachePath != "" {
+			l.save(cachePath)
+		}
+	}
+	if withMTimes {
+		l.statAll()
+	}
+	return l, nil
+}
+
+// statAll fills in MTimes, statting each file once. A file that cannot be
+// statted sorts as oldest.
+func (l *dirListing) statAll() {
+	l.MTimes = make([]int64, len(l.Names))
+	idx := make(chan int)
+	var wg sync.WaitGroup
+	for w := 0; w < min(statWorkers, len(l.Names)); w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for i := range idx {
+				if info, err := os.Stat(filepath.Join(l.Dir, l.Names[i])); err == nil {
+					l.MTimes[i] = info.ModTime().UnixNano()
+				}
+			}
+		}()
+	}
+	for i := range l.Names {
+		idx <- i
+	}
+	close(idx)
+	wg.Wait()
+}
+
+// listingCachePath names dir's cache file, or returns "" when there is no
+// user cache directory.
+func listingCachePath(dir string) string {
+	base, err := os.UserCacheDir()
+	if err != nil {
+		return ""
+	}
+	sum := sha256.Sum256([]byte(dir))
+	return filepath.Join(base, "pp", "playlists", hex.EncodeToString(sum[:12])+".json")
+}
+
+// loadListing returns the cached listing of dir if it was taken at
+// modTime, or nil.
+func loadListing(cachePath, dir string, modTime int64) *dirListing {
+	if cachePath == "" {
+		return nil
+	}
+	b, err := os.ReadFile(cachePath)
+	if err != nil {
+		return nil
+	}
+	var l dirListing
+	if json.Unmarshal(b, &l) != nil || l.Dir != dir || l.ModTime != modTime {
+		return nil
+	}
+	return &l
+}
+
+// staleListingTemp is how old a temp file in the cache directory must be
+// before save takes it for the leftover of a player that died mid-write.
+const staleListingTemp = time.Minute
+
+func (l *dirListing) save(cachePath string) {
+	b, err := json.Marshal(l)
+	if err != nil {
+		return
+	}
+	cacheDir := filepath.Dir(cachePath)
+	if err := os.MkdirAll(cacheDir, 0o755); err != nil {
+		return
+	}
+	removeStaleTemps(cacheDir)
+	f, err := os.CreateTemp(cacheDir, ".listing-*")
+	if err != nil {
+		return
+	}
+	_, err = f.Write(b)
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err != nil {
+		_ = os.Remove(f.Name())
+		return
+	}
+	_ = os.Rename(f.Name(), cachePath)
+}
+
+// removeStaleTemps deletes the temp files in dir that save left behind.
+func removeStaleTemps(dir string) {
+	entries, _ := os.ReadDir(dir)
+	for _, e := range entries {
+		if !strings.HasPrefix(e.Name(), ".listing-") {
+			continue
+		}
+		if info, err := e.Info(); err == nil && time.Since(info.ModTime()) > staleListingTemp {
+			_ = os.Remove(filepath.Join(dir, e.Name()))
+		}
+	}
+}
@@ -0,0 +1,58 @@
+package pp
+
+import (
+	"os"
+	"path/filepath"
+	"testing"
+	"time"
+)
+
+func TestBuildPlaylistLatestSeesRewrittenFiles(t *testing.T) {
+	t.Setenv("XDG_CACHE_HOME", t.TempDir())
+	t.Setenv("HOME", t.TempDir())
+	dir := t.TempDir()
+	base := time.Now().Add(-time.Hour)
+	for i, name := range []string{"a.mkv", "b.mkv", "c.mkv"} {
+		p := filepath.Join(dir, name)
+		if err := os.WriteFile(p, nil, 0o644); err != nil {
+			t.Fatal(err)
+		}
+		mt := base.Add(time.Duration(i) * time.Minute)
+		if err := os.Chtimes(p, mt, mt); err != nil {
+			t.Fatal(err)
+		}
+	}
+	files, _, err := BuildPlaylist(dir, true)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got := filepath.Base(files[0]); got != "c.mkv" {
+		t.Fatalf("newest is %s, want c.mkv", got)
+	}
+
+	// Writing to a.mkv leaves the directory mtime, and so the cached
+	// listing, as it was.
+	dirInfo, err := os.Stat(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	now := time.Now()
+	if err := os.Chtimes(filepath.Join(dir, "a.mkv"), now, now); err != nil {
+		t.Fatal(err)
+	}
+	if err := os.Chtimes(dir, dirInfo.ModTime(), dirInfo.ModTime()); err != nil {
+		t.Fatal(err)
+	}
+	files, _, err = BuildPlaylist(dir, true)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got := filepath.Base(files[0]); got != "a.mkv" {
+		t.Errorf("newest is %s after a.mkv was written, want a.mkv", got)
+	}
+
+	tmps, _ := filepath.Glob(filepath.Join(filepath.Dir(listingCachePath(dir)), ".listing-*"))
+	if len(tmps) != 0 {
+		t.Errorf("temp files left in the cache: %v", tmps)
+	}
+}
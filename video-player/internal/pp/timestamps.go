@@ -1,20 +1,66 @@
 package pp
 
 import (
+	"bytes"
+	"encoding/binary"
 	"encoding/json"
+	"math"
 	"os"
 	"path/filepath"
+	"strings"
+	"sync"
+)
+
+// The store file is an append-only log: a magic header, then records.
+//
+//	key: 'K' id:u32 len:u16 path[len]   names a path the first time it is saved
+//	pos: 'P' id:u32 sec:f64             one position update, 13 bytes
+//
+// Integers are little-endian. Load replays the log, keeping the last
+// position per id, and Save appends only entries changed since the last
+// Save. Once the log holds mostly superseded records it is compacted into
+// a fresh file that replaces it by rename.
+//
+// Several players may share the log. Each holds an exclusive lock on
+// <log>.lock while it reads or writes the log (the log itself cannot carry
+// the lock, since compaction replaces it), and before appending replays
+// whatever the others appended since, so ids stay unique and their
+// positions are kept.
+const timestampMagic = "PPTSLOG1"
+
+const (
+	recKey = 'K'
+	recPos = 'P'
+
+	posRecordSize = 1 + 4 + 8
+
+	// compactSlack is how many superseded records the log may carry beyond
+	// one per live entry before Save rewrites it.
+	compactSlack = 4096
 )
 
 type TimestampStore struct {
 	path string // empty => in-memory only (no persistence)
-	m    map[string]float64
+
+	mu      sync.Mutex
+	m       map[string]float64
+	ids     map[string]uint32   // paths that have a key record in the log
+	names   map[uint32]string   // the reverse of ids
+	nextID  uint32              // the id the next new key record gets
+	dirty   map[string]struct{} // changed since the last Save
+	f       *os.File            // log opened for append; nil until first Save
+	size    int64               // bytes of valid log replayed so far
+	records int                 // records in the log
+	compact bool                // rewrite on the next Save (legacy or damaged file)
 }
 
 func NewTimestampStore(path string) *TimestampStore {
 	return &TimestampStore{
-		path: path,
-		m:    map[string]float64{},
+		path:  path,
+		m:     map[string]float64{},
+		ids:   map[string]uint32{},
+		names: map[uint32]string{},
+		dirty: map[string]struct{}{},
 	}
 }
 
@@ -22,51 +68,362 @@ func (t *TimestampStore) Load() error {
 	if t == nil || t.path == "" {
 		return nil
 	}
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	// Without the lock (a read-only directory, say) the read may end in a
+	// record still being written; that only costs a rewrite.
+	if unlock, err := t.lock(); err == nil {
+		defer unlock()
+	}
 	b, err := os.ReadFile(t.path)
 	if err != nil {
+		t.loadLegacy()
 		return nil
 	}
-	_ = json.Unmarshal(b, &t.m)
-	if t.m == nil {
-		t.m = map[string]float64{}
-	}
+	t.replay(b)
 	return nil
 }
 
+// replay applies the records in b. A torn or corrupt tail, left by a crash
+// mid-append, ends the replay; the next Save truncates it away.
+func (t *TimestampStore) replay(b []byte) {
+	if !bytes.HasPrefix(b, []byte(timestampMagic)) {
+		// Not a log: perhaps a JSON store copied into place.
+		if json.Unmarshal(b, &t.m) == nil && t.m != nil {
+			for p := range t.m {
+				t.dirty[p] = struct{}{}
+			}
+		}
+		if t.m == nil {
+			t.m = map[string]float64{}
+		}
+		t.compact = true
+		return
+	}
+	off := len(timestampMagic)
+	n := t.replayRecords(b[off:])
+	t.size = int64(off + n)
+	if off+n < len(b) {
+		t.compact = true
+	}
+}
+
+// replayRecords applies the records at the start of b and returns how many
+// bytes they take; it stops at the first record that is torn or names an
+// unknown id.
+func (t *TimestampStore) replayRecords(b []byte) int {
+	off := 0
+	for off < len(b) {
+		rest := b[off:]
+		switch rest[0] {
+		case recKey:
+			if len(rest) < 7 {
+				break
+			}
+			id := binary.LittleEndian.Uint32(rest[1:])
+			n := int(binary.LittleEndian.Uint16(rest[5:]))
+			if len(rest) < 7+n {
+				break
+			}
+			p := string(rest[7 : 7+n])
+			t.names[id] = p
+			t.ids[p] = id
+			if id >= t.nextID {
+				t.nextID = id + 1
+			}
+			off += 7 + n
+			t.records++
+			continue
+		case recPos:
+			if len(rest) < posRecordSize {
+				break
+			}
+			id := binary.LittleEndian.Uint32(rest[1:])
+			p, ok := t.names[id]
+			if !ok {
+				break
+			}
+			t.m[p] = math.Float64frombits(binary.LittleEndian.Uint64(rest[5:]))
+			off += posRecordSize
+			t.records++
+			continue
+		}
+		break
+	}
+	return off
+}
+
+// loadLegacy imports the JSON store kept beside the log by earlier
+// versions; the first Save writes it out as a log.
+func (t *TimestampStore) loadLegacy() {
+	if filepath.Ext(t.path) != ".log" {
+		return
+	}
+	b, err := os.ReadFile(strings.TrimSuffix(t.path, ".log") + ".json")
+	if err != nil {
+		return
+	}
+	var m map[string]float64
+	if json.Unmarshal(b, &m) != nil {
+		return
+	}
+	for p, sec := range m {
+		t.m[p] = sec
+		t.dirty[p] = struct{}{}
+	}
+	t.compact = true
+}
+
+// Save persists the entries changed since the last Save as one append.
 func (t *TimestampStore) Save() error {
 	if t == nil || t.path == "" {
 		return nil
 	}
-	tmp := t.path + ".tmp"
-	b, err := json.MarshalIndent(t.m, "", "  ")
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	if len(t.dirty) == 0 && !t.compact {
+		return nil
+	}
+	unlock, err := t.lock()
 	if err != nil {
 		return err
 	}
-	if err := os.WriteFile(tmp, b, 0o644); err != nil {
+	defer unlock()
+	if err := t.catchUp(); err != nil {
+		return err
+	}
+	if t.compact || t.records+len(t.dirty) > 2*len(t.m)+compactSlack {
+		return t.rewrite()
+	}
+	if t.f == nil {
+		if err := t.open(); err != nil {
+			return err
+		}
+	}
+	var buf []byte
+	for p := range t.dirty {
+		buf = t.appendEntry(buf, p)
+	}
+	if _, err := t.f.Write(buf); err != nil {
+		// Part of buf may be on disk; rewriting from memory is the way back
+		// to a log that replays cleanly.
+		t.compact = true
 		return err
 	}
-	return os.Rename(tmp, t.path)
+	t.size += int64(len(buf))
+	clear(t.dirty)
+	return nil
+}
+
+// appendEntry encodes p's position, preceded by its key record if the log
+// does not name p yet.
+func (t *TimestampStore) appendEntry(buf []byte, p string) []byte {
+	id, ok := t.ids[p]
+	if !ok {
+		id = t.nextID
+		t.nextID++
+		t.ids[p] = id
+		t.names[id] = p
+		buf = append(buf, recKey)
+		buf = binary.LittleEndian.AppendUint32(buf, id)
+		buf = binary.LittleEndian.AppendUint16(buf, uint16(len(p)))
+		buf = append(buf, p...)
+		t.records++
+	}
+	buf = append(buf, recPos)
+	buf = binary.LittleEndian.AppendUint32(buf, id)
+	buf = binary.LittleEndian.AppendUint64(buf, math.Float64bits(t.m[p]))
+	t.records++
+	return buf
+}
+
+// open opens an existing log for appending, dropping any torn tail, or
+// starts a new one. The caller holds the lock.
+func (t *TimestampStore) open() error {
+	f, err := os.OpenFile(t.path, os.O_RDWR|os.O_CREATE|os.O_APPEND, 0o644)
+	if err != nil {
+		return err
+	}
+	if err := f.Truncate(t.size); err != nil {
+		f.Close()
+		return err
+	}
+	if t.size == 0 {
+		if _, err := f.Write([]byte(timestampMagic)); err != nil {
+			f.Close()
+			return err
+		}
+		t.size = int64(len(timestampMagic))
+	}
+	t.f = f
+	return nil
+}
+
+// catchUp replays what other players appended to the log since this one
+// last read it, or the whole log when one of them has replaced it. Entries
+// changed here since the last Save keep their values. The caller holds the
+// lock.
+func (t *TimestampStore) catchUp() error {
+	dirty := make(map[string]float64, len(t.dirty))
+	for p := range t.dirty {
+		dirty[p] = t.m[p]
+	}
+	defer func() {
+		for p, sec := range dirty {
+			t.m[p] = sec
+		}
+	}()
+
+	st, err := os.Stat(t.path)
+	if os.IsNotExist(err) {
+		if t.f != nil {
+			t.f.Close()
+			t.f = nil
+		}
+		t.size = 0
+		return nil
+	}
+	if err != nil {
+		return err
+	}
+	if t.f != nil {
+		if fst, err := t.f.Stat(); err == nil && os.SameFile(st, fst) && st.Size() >= t.size {
+			if st.Size() == t.size {
+				return nil
+			}
+			b := make([]byte, st.Size()-t.size)
+			if _, err := t.f.ReadAt(b, t.size); err != nil {
+				return err
+			}
+			n := t.replayRecords(b)
+			t.size += int64(n)
+			if n < len(b) {
+				t.compact = true
+			}
+			return nil
+		}
+		t.f.Close()
+		t.f = nil
+	}
+	b, err := os.ReadFile(t.path)
+	if err != nil {
+		return err
+	}
+	clear(t.ids)
+	clear(t.names)
+	t.nextID = 0
+	t.records = 0
+	t.size = 0
+	t.replay(b)
+	return nil
+}
+
+// lock takes the lock on the log, waiting for other players to release it.
+func (t *TimestampStore) lock() (unlock func(), err error) {
+	f, err := os.OpenFile(t.path+".lock", os.O_RDWR|os.O_CREATE, 0o644)
+	if err != nil {
+		return nil, err
+	}
+	if err := lockFile(f); err != nil {
+		f.Close()
+		return nil, err
+	}
+	// Closing the file releases the lock.
+	return func() { f.Close() }, nil
+}
+
+// rewrite writes every live entry to a new log and renames it over the
+// old one. The caller holds the lock.
+func (t *TimestampStore) rewrite() error {
+	if t.f != nil {
+		t.f.Close()
+		t.f = nil
+	}
+	clear(t.ids)
+	clear(t.names)
+	t.nextID = 0
+	t.records = 0
+	buf := []byte(timestampMagic)
+	for p := range t.m {
+		if len(p) > math.MaxUint16 {
+			continue
+		}
+		buf = t.appendEntry(buf, p)
+	}
+	tmp := t.path + ".tmp"
+	if err := writeFileSync(tmp, buf); err != nil {
+		return err
+	}
+	if err := os.Rename(tmp, t.path); err != nil {
+		return err
+	}
+	t.size = int64(len(buf))
+	t.compact = false
+	clear(t.dirty)
+	return t.open()
+}
+
+func writeFileSync(path string, b []byte) error {
+	f, err := os.OpenFile(path, os.O_WRONLY|os.O_CREATE|os.O_TRUNC, 0o644)
+	if err != nil {
+		return err
+	}
+	_, err = f.Write(b)
+	if err == nil {
+		err = f.Sync()
+	}
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	return err
+}
+
+// Close releases the log file. Unsaved changes are not written.
+func (t *TimestampStore) Close() error {
+	if t == nil {
+		return nil
+	}
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	if t.f == nil {
+		return nil
+	}
+	err := t.f.Close()
+	t.f = nil
+	return err
 }
 
 func (t *TimestampStore) Get(path string) (float64, bool) {
 	if t == nil {
 		return 0, false
 	}
+	t.mu.Lock()
+	defer t.mu.Unlock()
 	v, ok := t.m[path]
 	return v, ok
 }
 
+// Set records a position. Setting the value already held is a no-op, so a
+// paused player costs no writes.
 func (t *TimestampStore) Set(path string, sec float64) {
 	if t == nil {
 		return
 	}
+	t.mu.Lock()
+	defer t.mu.Unlock()
 	if t.m == nil {
 		t.m = map[string]float64{}
 	}
+	if old, ok := t.m[path]; ok && old == sec {
+		return
+	}
 	t.m[path] = sec
+	if len(path) <= math.MaxUint16 {
+		t.dirty[path] = struct{}{}
+	}
 }
 
 func DefaultTimestampPath() string {
 	home, _ := os.UserHomeDir()
-	return filepath.Join(home, ".pp_timestamps_go.json")
+	return filepath.Join(home, ".pp_timestamps_go.log")
 }
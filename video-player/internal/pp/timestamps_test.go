@@ -0,0 +1,50 @@
+package pp
+
+import (
+	"path/filepath"
+	"testing"
+)
+
+func TestTimestampStoreShared(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "ts.log")
+	a, b := NewTimestampStore(path), NewTimestampStore(path)
+	for _, s := range []*TimestampStore{a, b} {
+		if err := s.Load(); err != nil {
+			t.Fatal(err)
+		}
+		defer s.Close()
+	}
+
+	save := func(s *TimestampStore, p string, sec float64) {
+		t.Helper()
+		s.Set(p, sec)
+		if err := s.Save(); err != nil {
+			t.Fatal(err)
+		}
+	}
+	save(a, "/a.mkv", 1)
+	save(b, "/b.mkv", 2)
+	save(a, "/a.mkv", 3)
+	save(b, "/c.mkv", 4)
+	// b compacts the log, replacing the file a has open.
+	b.compact = true
+	save(b, "/b.mkv", 5)
+	save(a, "/d.mkv", 6)
+
+	if sec, ok := a.Get("/b.mkv"); !ok || sec != 5 {
+		t.Errorf("a sees /b.mkv at %v, %v; want 5", sec, ok)
+	}
+	c := NewTimestampStore(path)
+	if err := c.Load(); err != nil {
+		t.Fatal(err)
+	}
+	want := map[string]float64{"/a.mkv": 3, "/b.mkv": 5, "/c.mkv": 4, "/d.mkv": 6}
+	for p, sec := range want {
+		if got, ok := c.Get(p); !ok || got != sec {
+			t.Errorf("%s = %v, %v; want %v", p, got, ok, sec)
+		}
+	}
+	if c.compact {
+		t.Error("log does not replay cleanly")
+	}
+}
@@ -0,0 +1,247 @@
+package main
+
+import (
+	"container/heap"
+	"context"
+	"fmt"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+const (
+	// maxBudgetSlots bounds a budget read from a .slots file, since each
+	// slot is an open file in every process sharing it.
+	maxBudgetSlots = 1024
+	// budgetPoll is how often a job waiting on a full shared budget tries
+	// the slot files again, before jitter.
+	budgetPoll = 200 * time.Millisecond
+)
+
+// jobBudget caps how many jobs of one kind run at once. Jobs waiting for a
+// turn are let in highest priority first, then in the order they asked.
+//
+// A budget can also be shared with other processes through a directory of
+// slot files, <dir>/<name>.<i>, the layout url-downloader uses: each
+// running job holds one of them locked, and the lock goes away with the
+// process however it exits. The number of slots is read from
+// <dir>/<name>.slots when that holds a positive number.
+//
+// A nil *jobBudget admits everything.
+type jobBudget struct {
+	mu      sync.Mutex
+	limit   int
+	running int
+	waiters budgetQueue
+	seq     uint64
+
+	slots []*os.File // shared slot files; nil when not shared
+	held  []bool
+	next  int // where the next search of slots starts
+}
+
+func newJobBudget(limit int) *jobBudget {
+	if limit < 1 {
+		limit = 1
+	}
+	return &jobBudget{limit: limit}
+}
+
+// share opens the budget's slot files in dir. Until a slot is free there,
+// an admitted job waits, polling.
+func (b *jobBudget) share(dir, name string) error {
+	if err := os.MkdirAll(dir, 0o755); err != nil {
+		return err
+	}
+	n := b.limit
+	if data, err := os.ReadFile(filepath.Join(dir, name+".slots")); err == nil {
+		if v, err := strconv.Atoi(strings.TrimSpace(string(data))); err == nil && v > 0 {
+			n = min(v, maxBudgetSlots)
+		}
+	}
+	slots := make([]*os.File, 0, n)
+	for i := 0; i < n; i++ {
+		f, err := os.OpenFile(filepath.Join(dir, fmt.Sprintf("%s.%d", name, i)), os.O_RDWR|os.O_CREATE, 0o644)
+		if err != nil {
+			for _, f := range slots {
+				f.Close()
+			}
+			return err
+		}
+		slots = append(slots, f)
+	}
+	b.mu.Lock()
+	b.slots = slots
+	b.held = make([]bool, n)
+	// Processes start their search at different slots, so they rarely try
+	// the same lock first.
+	b.next = os.Getpid() % n
+	b.mu.Unlock()
+	return nil
+}
+
+type budgetWaiter struct {
+	prio  int
+	seq   uint64
+	index int
+	ready chan struct{}
+}
+
+// budgetQueue is a heap of waiters, highest priority and then oldest first.
+type budgetQueue []*budgetWaiter
+
+func (q budgetQueue) Len() int { return len(q) }
+func (q budgetQueue) Less(i, j int) bool {
+	if q[i].prio != q[j].prio {
+		return q[i].prio > q[j].prio
+	}
+	return q[i].seq < q[j].seq
+}
+func (q budgetQueue) Swap(i, j int) {
+	q[i], q[j] = q[j], q[i]
+	q[i].index = i
+	q[j].index = j
+}
+func (q *budgetQueue) Push(x any) {
+	w := x.(*budgetWaiter)
+	w.index = len(*q)
+	*q = append(*q, w)
+}
+func (q *budgetQueue) Pop() any {
+	old := *q
+	w := old[len(old)-1]
+	old[len(old)-1] = nil
+	*q = old[:len(old)-1]
+	w.index = -1
+	return w
+}
+
+// acquire waits for a turn to run one job at priority prio, or for ctx to
+// end. Call release once the job is done.
+func (b *jobBudget) acquire(ctx context.Context, prio int) (release func(), err error) {
+	if b == nil {
+		return func() {}, nil
+	}
+	if err := b.admit(ctx, prio); err != nil {
+		return nil, err
+	}
+	slot, err := b.lockSlot(ctx)
+	if err != nil {
+		b.leave()
+		return nil, err
+	}
+	var once sync.Once
+	return func() {
+		once.Do(func() {
+			b.unlockSlot(slot)
+			b.leave()
+		})
+	}, nil
+}
+
+// admit takes one of the in-process turns.
+func (b *jobBudget) admit(ctx context.Context, prio int) error {
+	b.mu.Lock()
+	if b.running < b.limit && len(b.waiters) == 0 {
+		b.running++
+		b.mu.Unlock()
+		return nil
+	}
+	b.seq++
+	w := &budgetWaiter{prio: prio, seq: b.seq, ready: make(chan struct{})}
+	heap.Push(&b.waiters, w)
+	b.mu.Unlock()
+
+	select {
+	case <-w.ready:
+		return nil
+	case <-ctx.Done():
+		b.mu.Lock()
+		granted := w.index < 0
+		if !granted {
+			heap.Remove(&b.waiters, w.index)
+		}
+		b.mu.Unlock()
+		if granted {
+			// The turn was handed over as ctx ended; pass it on.
+			b.leave()
+		}
+		return ctx.Err()
+	}
+}
+
+// leave gives a turn back, handing it straight to the first waiter.
+func (b *jobBudget) leave() {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+	if len(b.waiters) > 0 {
+		w := heap.Pop(&b.waiters).(*budgetWaiter)
+		close(w.ready)
+		return
+	}
+	b.running--
+}
+
+// lockSlot takes a free shared slot, polling with jitter while every slot
+// is held, and returns its index, or -1 when the budget is not shared.
+func (b *jobBudget) lockSlot(ctx context.Context) (int, error) {
+	for {
+		b.mu.Lock()
+		n := len(b.slots)
+		if n == 0 {
+			b.mu.Unlock()
+			return -1, nil
+		}
+		for i := 0; i < n; i++ {
+			idx := (b.next + i) % n
+			if b.held[idx] || !tryLockFile(b.slots[idx]) {
+				continue
+			}
+			b.held[idx] = true
+			b.next = (idx + 1) % n
+			b.mu.Unlock()
+			return idx, nil
+		}
+		b.mu.Unlock()
+
+		timer := time.NewTimer(budgetPoll + time.Duration(float64(budgetPoll)*randFloat()))
+		select {
+		case <-ctx.Done():
+			timer.Stop()
+			return -1, ctx.Err()
+		case <-timer.C:
+		}
+	}
+}
+
+func (b *jobBudget) unlockSlot(idx int) {
+	if idx < 0 {
+		return
+	}
+	b.mu.Lock()
+	defer b.mu.Unlock()
+	unlockFile(b.slots[idx])
+	b.held[idx] = false
+}
+
+// budgetDir is the shared budget directory named by $JOB_BUDGET_DIR, or
+// empty.
+func budgetDir() string {
+	return os.Getenv("JOB_BUDGET_DIR")
+}
+
+type priorityKey struct{}
+
+// withPriority marks the jobs started under ctx as priority prio; higher
+// runs first.
+func withPriority(ctx context.Context, prio int) context.Context {
+	return context.WithValue(ctx, priorityKey{}, prio)
+}
+
+func priorityOf(ctx context.Context) int {
+	prio, _ := ctx.Value(priorityKey{}).(int)
+	return prio
+}
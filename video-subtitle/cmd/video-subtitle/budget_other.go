@@ -0,0 +1,11 @@
+//go:build !unix
+
+package main
+
+import "os"
+
+// Without flock a shared budget does not limit anything across processes;
+// the in-process limit still applies.
+func tryLockFile(f *os.File) bool { return true }
+
+func unlockFile(f *os.File) {}
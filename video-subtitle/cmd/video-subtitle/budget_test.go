@@ -0,0 +1,105 @@
+package main
+
+import (
+	"context"
+	"errors"
+	"reflect"
+	"testing"
+	"time"
+)
+
+// waitQueued waits until n jobs are queued on b.
+func waitQueued(t *testing.T, b *jobBudget, n int) {
+	t.Helper()
+	deadline := time.Now().Add(5 * time.Second)
+	for {
+		b.mu.Lock()
+		queued := len(b.waiters)
+		b.mu.Unlock()
+		if queued == n {
+			return
+		}
+		if time.Now().After(deadline) {
+			t.Fatalf("%d jobs queued, want %d", queued, n)
+		}
+		time.Sleep(time.Millisecond)
+	}
+}
+
+func TestJobBudgetAdmitsByPriority(t *testing.T) {
+	b := newJobBudget(1)
+	release, err := b.acquire(context.Background(), 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	order := make(chan int, 4)
+	prios := []int{-3, 5, -1, 5}
+	for i, prio := range prios {
+		go func(id, prio int) {
+			release, err := b.acquire(context.Background(), prio)
+			if err != nil {
+				t.Error(err)
+				return
+			}
+			order <- id
+			release()
+		}(i, prio)
+		// Queue them one at a time, so equal priorities keep this order.
+		waitQueued(t, b, i+1)
+	}
+	release()
+
+	var got []int
+	for range prios {
+		got = append(got, <-order)
+	}
+	if want := []int{1, 3, 2, 0}; !reflect.DeepEqual(got, want) {
+		t.Errorf("admitted %v, want %v", got, want)
+	}
+}
+
+func TestJobBudgetCancel(t *testing.T) {
+	b := newJobBudget(1)
+	release, err := b.acquire(context.Background(), 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	ctx, cancel := context.WithCancel(context.Background())
+	errCh := make(chan error, 1)
+	go func() {
+		_, err := b.acquire(ctx, 10)
+		errCh <- err
+	}()
+	waitQueued(t, b, 1)
+	cancel()
+	if err := <-errCh; !errors.Is(err, context.Canceled) {
+		t.Fatalf("cancelled acquire = %v", err)
+	}
+	waitQueued(t, b, 0)
+
+	// The cancelled job took no turn: the next one runs once the first is
+	// released, and releasing twice gives back only one turn.
+	release()
+	release()
+	ctx, cancel = context.WithTimeout(context.Background(), 5*time.Second)
+	defer cancel()
+	next, err := b.acquire(ctx, 0)
+	if err != nil {
+		t.Fatalf("acquire after cancel: %v", err)
+	}
+	if b.running != 1 {
+		t.Errorf("running = %d, want 1", b.running)
+	}
+	next()
+}
+
+func TestNilJobBudgetAdmitsAll(t *testing.T) {
+	var b *jobBudget
+	release, err := b.acquire(context.Background(), 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	release()
+}
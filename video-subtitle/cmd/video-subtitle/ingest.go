@@ -0,0 +1,317 @@
+package main
+
+import (
+	"context"
+	"errors"
+	"fmt"
+	"io"
+	"net/http"
+	"net/url"
+	"os"
+	"os/exec"
+	"path"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"time"
+)
+
+// defaultIngestChunkSeconds is the chunk length for URL input. Chunks are
+// cut at fixed intervals as the download arrives, and shorter ones reach
+// transcription sooner.
+const defaultIngestChunkSeconds = 300
+
+// errNotStreamable reports that ffmpeg could not read the download as it
+// arrived, as with an MP4 whose index is stored at the end. The download
+// is complete when it is returned.
+var errNotStreamable = errors.New("input cannot be read while it downloads")
+
+// isURL reports whether the input names a file to download.
+func isURL(input string) bool {
+	return strings.HasPrefix(input, "http://") || strings.HasPrefix(input, "https://")
+}
+
+// downloadName is the file name rawURL is saved under: the last element of
+// its path, as wget names it.
+func downloadName(rawURL string) string {
+	u, err := url.Parse(rawURL)
+	if err != nil {
+		return "download"
+	}
+	name := path.Base(u.Path)
+	if name == "." || name == "/" {
+		return "download"
+	}
+	return name
+}
+
+// ingestURL downloads rawURL to savePath and transcribes it in the same
+// pass: ffmpeg reads the download from a pipe as it arrives and cuts the
+// audio into chunks of chunkSeconds, and each chunk is uploaded as soon as
+// it is cut, so transcription overlaps the download instead of following
+// it. Only ctx stops the download: when transcription fails, the download
+// still runs to the end and the error says the file is complete.
+func ingestURL(
+	ctx context.Context,
+	client *openAIClient,
+	cache *resultCache,
+	rawURL, savePath, chunkDir string,
+	format audioFormat,
+	chunkSeconds int,
+	model, language string,
+	workers int,
+	onChunk func(index int, segments []Segment) error,
+	logf func(string, ...any),
+) ([]Segment, error) {
+	var downloadErr error
+	segments, err := transcribeChunks(ctx, client, cache, model, language, workers, func(cutCtx context.Context, ready chan<- audioChunk) error {
+		var err error
+		downloadErr, err = streamChunks(ctx, cutCtx, rawURL, savePath, chunkDir, format, chunkSeconds, ready, logf)
+		if downloadErr != nil {
+			return fmt.Errorf("download failed: %w", downloadErr)
+		}
+		return err
+	}, onChunk, logf)
+	if err != nil && downloadErr == nil && ctx.Err() == nil && !errors.Is(err, errNotStreamable) {
+		return nil, fmt.Errorf("%w (the download finished; %s is complete)", err, savePath)
+	}
+	return segments, err
+}
+
+// streamChunks runs the download under ctx and a segmenting ffmpeg fed
+// from it under cutCtx, and sends each chunk on ready once ffmpeg has
+// closed it. The download never waits on ffmpeg or on uploads: should
+// ffmpeg give up, or cutCtx end, the rest of the file is still saved.
+// streamChunks returns once both are done, with the download's error and
+// the segmenter's.
+func streamChunks(
+	ctx, cutCtx context.Context,
+	rawURL, savePath, dir string,
+	format audioFormat,
+	chunkSeconds int,
+	ready chan<- audioChunk,
+	logf func(string, ...any),
+) (downloadErr, err error) {
+	// Should the segmenter not start, the file is still wanted.
+	downloadOnly := func(err error) (error, error) {
+		return download(ctx, rawURL, savePath, io.Discard, logf), err
+	}
+	release, err := ffmpegJobs.acquire(cutCtx, 0)
+	if err != nil {
+		return downloadOnly(err)
+	}
+	defer release()
+
+	if err := os.MkdirAll(dir, 0o755); err != nil {
+		return downloadOnly(err)
+	}
+	listPath := filepath.Join(dir, "chunks.csv")
+	args := []string{
+		"-y",
+		"-i",
+		"pipe:0",
+		"-vn",
+		"-ac",
+		"1",
+		"-ar",
+		"16000",
+	}
+	args = append(args, format.Codec...)
+	args = append(args, bitexactArgs...)
+	args = append(
+		args,
+		"-f",
+		"segment",
+		"-segment_format",
+		format.Muxer,
+		"-segment_time",
+		strconv.Itoa(chunkSeconds),
+		"-reset_timestamps",
+		"1",
+		"-segment_list",
+		listPath,
+		"-segment_list_type",
+		"csv",
+		filepath.Join(dir, "chunk_%04d."+format.Ext),
+	)
+	cmd := exec.CommandContext(cutCtx, "ffmpeg", args...)
+	stdin, err := cmd.StdinPipe()
+	if err != nil {
+		return downloadOnly(err)
+	}
+
+	downloaded := make(chan error, 1)
+	go func() {
+		err := download(ctx, rawURL, savePath, &dropOnError{w: stdin}, logf)
+		stdin.Close()
+		downloaded <- err
+	}()
+
+	list := chunkList{path: listPath, dir: dir}
+	err = followSegments(cutCtx, cmd, &list, ready)
+	release()
+	if downloadErr = <-downloaded; downloadErr != nil {
+		return downloadErr, err
+	}
+	if err != nil && list.next == 0 && cutCtx.Err() == nil {
+		return nil, fmt.Errorf("%w: %v", errNotStreamable, err)
+	}
+	return nil, err
+}
+
+// dropOnError passes writes on to w until one fails and discards the rest,
+// so a reader that stops early does not stop the writer.
+type dropOnError struct {
+	w   io.Writer
+	err error
+}
+
+func (d *dropOnError) Write(p []byte) (int, error) {
+	if d.err == nil {
+		_, d.err = d.w.Write(p)
+	}
+	return len(p), nil
+}
+
+type httpStatusError struct {
+	StatusCode int
+	Status     string
+}
+
+func (e *httpStatusError) Error() string {
+	return "server replied " + e.Status
+}
+
+func isDownloadRetryable(err error) bool {
+	var statusErr *httpStatusError
+	if errors.As(err, &statusErr) {
+		return statusErr.StatusCode == http.StatusRequestTimeout ||
+			statusErr.StatusCode == http.StatusTooManyRequests ||
+			statusErr.StatusCode >= 500
+	}
+	return errors.Is(err, io.ErrUnexpectedEOF) || errors.Is(err, errDownloadStalled) || isRetryable(err)
+}
+
+// downloadClient fetches URL input. It has no overall timeout, since a
+// long video can take hours; a server that stops answering is caught by
+// the header timeout and by downloadIdleTimeout instead.
+var downloadClient = func() *http.Client {
+	transport := http.DefaultTransport.(*http.Transport).Clone()
+	transport.ResponseHeaderTimeout = 30 * time.Second
+	return &http.Client{Transport: transport}
+}()
+
+// downloadIdleTimeout is how long a download may go without receiving a
+// byte before the attempt is dropped and resumed.
+const downloadIdleTimeout = 60 * time.Second
+
+var errDownloadStalled = fmt.Errorf("no data for %s", downloadIdleTimeout)
+
+// idleReader resets timer on every read that returns data.
+type idleReader struct {
+	r     io.Reader
+	timer *time.Timer
+}
+
+func (r *idleReader) Read(p []byte) (int, error) {
+	n, err := r.r.Read(p)
+	if n > 0 {
+		r.timer.Reset(downloadIdleTimeout)
+	}
+	return n, err
+}
+
+// download fetches rawURL into savePath, copying every block to w as well
+// as it arrives. A transfer that breaks off resumes with a Range request
+// from where it stopped, so w sees each byte once. Bytes already in
+// savePath from an earlier run are kept and resumed from; they reach w
+// once the server has agreed to send only the rest, and a 416 for them
+// means the file was already complete.
+func download(ctx context.Context, rawURL, savePath string, w io.Writer, logf func(string, ...any)) error {
+	file, err := os.OpenFile(savePath, os.O_RDWR|os.O_CREATE, 0o644)
+	if err != nil {
+		return err
+	}
+	written, err := file.Seek(0, io.SeekEnd)
+	if err != nil {
+		file.Close()
+		return err
+	}
+	kept := written // bytes from an earlier run not yet copied to w
+	out := io.MultiWriter(file, w)
+	err = retry(
+		ctx,
+		maxRetries,
+		baseRetryDelay,
+		maxRetryDelay,
+		isDownloadRetryable,
+		func(attempt int, delay time.Duration, err error) {
+			logf("Download broke off at %d bytes; resuming in %.1fs (attempt %d). %v", written, delay.Seconds(), attempt, err)
+		},
+		func() error {
+			attemptCtx, cancel := context.WithCancelCause(ctx)
+			defer cancel(nil)
+			req, err := http.NewRequestWithContext(attemptCtx, http.MethodGet, rawURL, nil)
+			if err != nil {
+				return err
+			}
+			req.Header.Set("User-Agent", "video-subtitle/0.1")
+			if written > 0 {
+				req.Header.Set("Range", fmt.Sprintf("bytes=%d-", written))
+			}
+			resp, err := downloadClient.Do(req)
+			if err != nil {
+				return err
+			}
+			defer resp.Body.Close()
+			switch {
+			case written == 0 && resp.StatusCode == http.StatusOK:
+			case written > 0 && resp.StatusCode == http.StatusPartialContent:
+			case written > 0 && resp.StatusCode == http.StatusRequestedRangeNotSatisfiable:
+				return sendKept(file, w, &kept)
+			case written == kept && resp.StatusCode == http.StatusOK:
+				// The server ignores Range; start the file over, since none
+				// of it has reached w yet.
+				logf("Server cannot resume %s; downloading it again.", savePath)
+				if err := file.Truncate(0); err != nil {
+					return err
+				}
+				if _, err := file.Seek(0, io.SeekStart); err != nil {
+					return err
+				}
+				written, kept = 0, 0
+			case written > 0 && resp.StatusCode == http.StatusOK:
+				return errors.New("server cannot resume the download")
+			default:
+				return &httpStatusError{StatusCode: resp.StatusCode, Status: resp.Status}
+			}
+			if err := sendKept(file, w, &kept); err != nil {
+				return err
+			}
+			timer := time.AfterFunc(downloadIdleTimeout, func() { cancel(errDownloadStalled) })
+			defer timer.Stop()
+			n, err := io.Copy(out, &idleReader{r: resp.Body, timer: timer})
+			written += n
+			if err != nil && ctx.Err() == nil && errors.Is(context.Cause(attemptCtx), errDownloadStalled) {
+				return errDownloadStalled
+			}
+			return err
+		},
+	)
+	if errClose := file.Close(); err == nil {
+		err = errClose
+	}
+	return err
+}
+
+// sendKept copies the first *kept bytes of file to w, once.
+func sendKept(file *os.File, w io.Writer, kept *int64) error {
+	if *kept == 0 {
+		return nil
+	}
+	if _, err := io.Copy(w, io.NewSectionReader(file, 0, *kept)); err != nil {
+		return err
+	}
+	*kept = 0
+	return nil
+}
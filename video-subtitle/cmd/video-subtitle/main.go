@@ -3,6 +3,8 @@ package main
 import (
 	"bytes"
 	"context"
+	"crypto/sha256"
+	"encoding/hex"
 	"encoding/json"
 	"errors"
 	"flag"
@@ -13,27 +15,38 @@ import (
 	"net/http"
 	"os"
 	"os/exec"
+	"os/signal"
 	"path/filepath"
 	"runtime"
 	"strconv"
 	"strings"
 	"sync"
+	"syscall"
 	"time"
 	"unicode"
 )
 
 const (
-	defaultWhisperModel     = "whisper-1"
-	defaultTranslateModel   = "gpt-4o-mini"
-	defaultSourceLang       = "ja"
-	defaultTargetLang       = "zh-TW"
-	defaultChunkSeconds     = 600
-	defaultMaxAudioMB       = 24
-	defaultTranslateWorkers = 4
-	defaultTimeoutSeconds   = 900
-	maxRetries              = 4
-	baseRetryDelay          = 1 * time.Second
-	maxRetryDelay           = 20 * time.Second
+	defaultWhisperModel      = "whisper-1"
+	defaultTranslateModel    = "gpt-4o-mini"
+	defaultSourceLang        = "ja"
+	defaultTargetLang        = "zh-TW"
+	defaultChunkSeconds      = 600
+	defaultAudioFormat       = "opus"
+	defaultDropSilence       = 10
+	silenceNoiseDB           = -35
+	silenceMinSeconds        = 0.5
+	silencePad               = 0.25
+	minChunkSeconds          = 1.0
+	defaultMaxAudioMB        = 24
+	defaultTranslateWorkers  = 4
+	defaultTranscribeWorkers = 3
+	defaultTranslateBatch    = 40
+	maxBatchChars            = 6000
+	defaultTimeoutSeconds    = 900
+	maxRetries               = 4
+	baseRetryDelay           = 1 * time.Second
+	maxRetryDelay            = 20 * time.Second
 )
 
 type Segment struct {
@@ -60,9 +73,18 @@ type openAIClient struct {
 	apiKey     string
 	baseURL    string
 	httpClient *http.Client
+
+	// transcribeJobs and translateJobs cap the requests of each kind in
+	// flight, across every caller; nil admits all.
+	transcribeJobs *jobBudget
+	translateJobs  *jobBudget
 }
 
-func newOpenAIClient(apiKey string, timeout time.Duration) *openAIClient {
+// newOpenAIClient shares one transport across every worker. It keeps up to
+// concurrency idle connections to the API host (the default keeps two, so
+// busier HTTP/1.1 workers would keep redialing) and prefers HTTP/2, which
+// carries them all on one connection.
+func newOpenAIClient(apiKey string, timeout time.Duration, concurrency int) *openAIClient {
 	baseURL := strings.TrimRight(os.Getenv("OPENAI_BASE_URL"), "/")
 	if baseURL == "" {
 		baseURL = "https://api.openai.com/v1"
@@ -70,11 +92,20 @@ func newOpenAIClient(apiKey string, timeout time.Duration) *openAIClient {
 	if timeout <= 0 {
 		timeout = time.Duration(defaultTimeoutSeconds) * time.Second
 	}
+	if concurrency < 2 {
+		concurrency = 2
+	}
+	transport := http.DefaultTransport.(*http.Transport).Clone()
+	transport.ForceAttemptHTTP2 = true
+	transport.MaxIdleConns = concurrency * 2
+	transport.MaxIdleConnsPerHost = concurrency
+	transport.IdleConnTimeout = 90 * time.Second
 	return &openAIClient{
 		apiKey:  apiKey,
 		baseURL: baseURL,
 		httpClient: &http.Client{
-			Timeout: timeout,
+			Timeout:   timeout,
+			Transport: transport,
 		},
 	}
 }
@@ -106,76 +137,127 @@ type openAIErrorResponse struct {
 	} `json:"error"`
 }
 
-func (c *openAIClient) do(req *http.Request) ([]byte, error) {
+// maxErrorBody bounds how much of an error response is read for its message.
+const maxErrorBody = 64 << 10
+
+// do sends req and decodes a successful JSON response into out straight from
+// the body, so no response is held in memory whole.
+func (c *openAIClient) do(req *http.Request, out any) error {
 	req.Header.Set("Authorization", "Bearer "+c.apiKey)
 	req.Header.Set("User-Agent", "video-subtitle/0.1")
 
 	resp, err := c.httpClient.Do(req)
 	if err != nil {
-		return nil, err
+		return err
 	}
 	defer resp.Body.Close()
 
-	body, err := io.ReadAll(resp.Body)
-	if err != nil {
-		return nil, err
-	}
 	if resp.StatusCode < 200 || resp.StatusCode >= 300 {
-		return nil, parseAPIError(resp.StatusCode, body)
+		body, err := io.ReadAll(io.LimitReader(resp.Body, maxErrorBody))
+		if err != nil {
+			return err
+		}
+		return parseAPIError(resp.StatusCode, body)
 	}
-	return body, nil
+	if err := json.NewDecoder(resp.Body).Decode(out); err != nil {
+		return err
+	}
+	// Drain the trailing newline so the connection can be reused.
+	io.Copy(io.Discard, io.LimitReader(resp.Body, 4096))
+	return nil
 }
 
-func (c *openAIClient) Transcribe(ctx context.Context, audioPath, model, language string) ([]Segment, error) {
-	var buf bytes.Buffer
-	writer := multipart.NewWriter(&buf)
+// multipartFile is a multipart/form-data body streamed from disk: the form
+// fields and part header, the file, and the closing boundary, with its
+// length known up front.
+type multipartFile struct {
+	head        []byte
+	tail        []byte
+	path        string
+	size        int64
+	contentType string
+}
 
-	if err := writer.WriteField("model", model); err != nil {
+func newMultipartFile(fields [][2]string, fileField, path string) (*multipartFile, error) {
+	info, err := os.Stat(path)
+	if err != nil {
 		return nil, err
 	}
-	if language != "" {
-		if err := writer.WriteField("language", language); err != nil {
+	var buf bytes.Buffer
+	writer := multipart.NewWriter(&buf)
+	for _, field := range fields {
+		if err := writer.WriteField(field[0], field[1]); err != nil {
 			return nil, err
 		}
 	}
-	if err := writer.WriteField("response_format", "verbose_json"); err != nil {
+	if _, err := writer.CreateFormFile(fileField, filepath.Base(path)); err != nil {
 		return nil, err
 	}
-	if err := writer.WriteField("timestamp_granularities[]", "segment"); err != nil {
+	head := append([]byte(nil), buf.Bytes()...)
+	buf.Reset()
+	if err := writer.Close(); err != nil {
 		return nil, err
 	}
+	return &multipartFile{
+		head:        head,
+		tail:        append([]byte(nil), buf.Bytes()...),
+		path:        path,
+		size:        int64(len(head)) + info.Size() + int64(buf.Len()),
+		contentType: writer.FormDataContentType(),
+	}, nil
+}
 
-	file, err := os.Open(audioPath)
+// open returns a fresh reader over the whole body; the transport calls it
+// again (as GetBody) if a request has to be resent.
+func (m *multipartFile) open() (io.ReadCloser, error) {
+	file, err := os.Open(m.path)
 	if err != nil {
 		return nil, err
 	}
-	defer file.Close()
+	return struct {
+		io.Reader
+		io.Closer
+	}{io.MultiReader(bytes.NewReader(m.head), file, bytes.NewReader(m.tail)), file}, nil
+}
 
-	part, err := writer.CreateFormFile("file", filepath.Base(audioPath))
+// Transcribe uploads audioPath straight from disk, so memory per request
+// stays constant however large the chunk and however many are in flight.
+func (c *openAIClient) Transcribe(ctx context.Context, audioPath, model, language string) ([]Segment, error) {
+	release, err := c.transcribeJobs.acquire(ctx, priorityOf(ctx))
 	if err != nil {
 		return nil, err
 	}
-	if _, err := io.Copy(part, file); err != nil {
-		return nil, err
-	}
+	defer release()
 
-	if err := writer.Close(); err != nil {
+	fields := [][2]string{{"model", model}}
+	if language != "" {
+		fields = append(fields, [2]string{"language", language})
+	}
+	fields = append(
+		fields,
+		[2]string{"response_format", "verbose_json"},
+		[2]string{"timestamp_granularities[]", "segment"},
+	)
+	form, err := newMultipartFile(fields, "file", audioPath)
+	if err != nil {
 		return nil, err
 	}
-
-	req, err := http.NewRequestWithContext(ctx, http.MethodPost, c.baseURL+"/audio/transcriptions", &buf)
+	body, err := form.open()
 	if err != nil {
 		return nil, err
 	}
-	req.Header.Set("Content-Type", writer.FormDataContentType())
 
-	body, err := c.do(req)
+	req, err := http.NewRequestWithContext(ctx, http.MethodPost, c.baseURL+"/audio/transcriptions", body)
 	if err != nil {
+		body.Close()
 		return nil, err
 	}
+	req.ContentLength = form.size
+	req.GetBody = form.open
+	req.Header.Set("Content-Type", form.contentType)
 
 	var resp transcriptionResponse
-	if err := json.Unmarshal(body, &resp); err != nil {
+	if err := c.do(req, &resp); err != nil {
 		return nil, err
 	}
 
@@ -201,7 +283,66 @@ func (c *openAIClient) Translate(ctx context.Context, model, sourceLang, targetL
 		targetLang,
 		text,
 	)
+	return c.chat(ctx, model, systemPrompt, userPrompt, false)
+}
+
+type batchItem struct {
+	ID   int    `json:"id"`
+	Text string `json:"text"`
+}
+
+var errBatchMismatch = errors.New("batch translation did not return every item")
+
+// TranslateBatch translates several texts in one request. Items go out as
+// JSON with stable ids and must all come back under the same ids; anything
+// else is errBatchMismatch.
+func (c *openAIClient) TranslateBatch(ctx context.Context, model, sourceLang, targetLang string, items []batchItem) (map[int]string, error) {
+	systemPrompt := fmt.Sprintf(
+		"You are a precise translator. Translate the text of every item from %s to %s, preserving punctuation and line breaks. "+
+			`Reply with only a JSON object {"translations":[{"id":<id>,"text":"<translation>"}]} that has exactly one entry per input id.`,
+		sourceLang,
+		targetLang,
+	)
+	input, err := json.Marshal(map[string]any{"items": items})
+	if err != nil {
+		return nil, err
+	}
+	content, err := c.chat(ctx, model, systemPrompt, string(input), true)
+	if err != nil {
+		return nil, err
+	}
+
+	content = strings.TrimSpace(content)
+	content = strings.TrimPrefix(content, "```json")
+	content = strings.Trim(content, "` \n")
+	var resp struct {
+		Translations []batchItem `json:"translations"`
+	}
+	if err := json.Unmarshal([]byte(content), &resp); err != nil {
+		return nil, fmt.Errorf("%w: %v", errBatchMismatch, err)
+	}
+	want := make(map[int]bool, len(items))
+	for _, item := range items {
+		want[item.ID] = true
+	}
+	out := make(map[int]string, len(items))
+	for _, t := range resp.Translations {
+		text := strings.TrimSpace(t.Text)
+		if !want[t.ID] || text == "" {
+			return nil, errBatchMismatch
+		}
+		if _, dup := out[t.ID]; dup {
+			return nil, errBatchMismatch
+		}
+		out[t.ID] = text
+	}
+	if len(out) != len(items) {
+		return nil, errBatchMismatch
+	}
+	return out, nil
+}
 
+func (c *openAIClient) chat(ctx context.Context, model, systemPrompt, userPrompt string, jsonMode bool) (string, error) {
 	payload := map[string]any{
 		"model": model,
 		"messages": []map[string]string{
@@ -210,24 +351,28 @@ func (c *openAIClient) Translate(ctx context.Context, model, sourceLang, targetL
 		},
 		"temperature": 0,
 	}
+	if jsonMode {
+		payload["response_format"] = map[string]string{"type": "json_object"}
+	}
 	bodyBytes, err := json.Marshal(payload)
 	if err != nil {
 		return "", err
 	}
 
-	req, err := http.NewRequestWithContext(ctx, http.MethodPost, c.baseURL+"/chat/completions", bytes.NewReader(bodyBytes))
+	release, err := c.translateJobs.acquire(ctx, priorityOf(ctx))
 	if err != nil {
 		return "", err
 	}
-	req.Header.Set("Content-Type", "application/json")
+	defer release()
 
-	body, err := c.do(req)
+	req, err := http.NewRequestWithContext(ctx, http.MethodPost, c.baseURL+"/chat/completions", bytes.NewReader(bodyBytes))
 	if err != nil {
 		return "", err
 	}
+	req.Header.Set("Content-Type", "application/json")
 
 	var resp chatResponse
-	if err := json.Unmarshal(body, &resp); err != nil {
+	if err := c.do(req, &resp); err != nil {
 		return "", err
 	}
 	if len(resp.Choices) == 0 {
@@ -265,6 +410,9 @@ func describeError(err error) string {
 	return err.Error()
 }
 
+// retry runs fn until it succeeds, backing off exponentially with jitter
+// between attempts. A retry that would not start before ctx's deadline is
+// not waited for: the last error is returned at once.
 func retry(
 	ctx context.Context,
 	maxRetries int,
@@ -294,6 +442,9 @@ func retry(
 		}
 		jitter := time.Duration(float64(delay) * (0.25 * randFloat()))
 		delay += jitter
+		if deadline, ok := ctx.Deadline(); ok && time.Until(deadline) <= delay {
+			return err
+		}
 		if onRetry != nil {
 			onRetry(attempt+1, delay, err)
 		}
@@ -393,25 +544,79 @@ func formatSRTTimestamp(seconds float64) string {
 	return fmt.Sprintf("%02d:%02d:%02d,%03d", hours, minutes, secs, millis)
 }
 
+func writeSRTBlock(buf *strings.Builder, number int, seg Segment) {
+	buf.WriteString(strconv.Itoa(number))
+	buf.WriteString("\n")
+	buf.WriteString(formatSRTTimestamp(seg.Start))
+	buf.WriteString(" --> ")
+	buf.WriteString(formatSRTTimestamp(seg.End))
+	buf.WriteString("\n")
+	buf.WriteString(strings.TrimSpace(seg.Text))
+	buf.WriteString("\n\n")
+}
+
 func writeSRT(segments []Segment, outputPath string) error {
 	var buf strings.Builder
 	for idx, seg := range segments {
-		start := formatSRTTimestamp(seg.Start)
-		end := formatSRTTimestamp(seg.End)
-		buf.WriteString(strconv.Itoa(idx + 1))
-		buf.WriteString("\n")
-		buf.WriteString(start)
-		buf.WriteString(" --> ")
-		buf.WriteString(end)
-		buf.WriteString("\n")
-		buf.WriteString(strings.TrimSpace(seg.Text))
-		buf.WriteString("\n\n")
+		writeSRTBlock(&buf, idx+1, seg)
 	}
 	return os.WriteFile(outputPath, []byte(buf.String()), 0644)
 }
 
-func runCommand(name string, args ...string) error {
-	cmd := exec.Command(name, args...)
+// srtWriter appends SRT blocks as chunks finish. Chunks can finish in any
+// order; each is held until every chunk before it has been written, so the
+// file is always a prefix of the final one. The file is synced after each
+// write, so what is on disk survives a crash.
+type srtWriter struct {
+	mu      sync.Mutex
+	file    *os.File
+	next    int
+	written int
+	pending map[int][]Segment
+}
+
+func createSRTWriter(path string) (*srtWriter, error) {
+	file, err := os.Create(path)
+	if err != nil {
+		return nil, err
+	}
+	return &srtWriter{file: file, pending: map[int][]Segment{}}, nil
+}
+
+// Add records the segments of chunk index, which may be empty, and writes
+// out every chunk that is now in order.
+func (w *srtWriter) Add(index int, segments []Segment) error {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+	w.pending[index] = segments
+	var buf strings.Builder
+	for {
+		chunk, ok := w.pending[w.next]
+		if !ok {
+			break
+		}
+		delete(w.pending, w.next)
+		w.next++
+		for _, seg := range chunk {
+			w.written++
+			writeSRTBlock(&buf, w.written, seg)
+		}
+	}
+	if buf.Len() == 0 {
+		return nil
+	}
+	if _, err := w.file.WriteString(buf.String()); err != nil {
+		return err
+	}
+	return w.file.Sync()
+}
+
+func (w *srtWriter) Close() error {
+	return w.file.Close()
+}
+
+func runCommand(ctx context.Context, name string, args ...string) error {
+	cmd := exec.CommandContext(ctx, name, args...)
 	var stderr bytes.Buffer
 	cmd.Stderr = &stderr
 	if err := cmd.Run(); err != nil {
@@ -440,9 +645,40 @@ func runCommandOutput(name string, args ...string) (string, error) {
 	return stdout.String(), nil
 }
 
-func extractAudio(inputPath, outputPath string) error {
-	return runCommand(
-		"ffmpeg",
+// audioFormat is how extracted audio is encoded for upload. Speech at 16 kHz
+// mono needs nowhere near PCM's 256 kbit/s: Opus at 24 kbit/s is about a tenth
+// of the bytes per minute, so a long video fits in far fewer chunks.
+type audioFormat struct {
+	Ext   string
+	Codec []string
+	Muxer string
+	// MaxChunkSeconds caps auto-chunking; compressed chunks can run longer
+	// and still stay well under the upload limit.
+	MaxChunkSeconds int
+}
+
+var audioFormats = map[string]audioFormat{
+	"wav":  {Ext: "wav", Codec: []string{"-c:a", "pcm_s16le"}, Muxer: "wav", MaxChunkSeconds: defaultChunkSeconds},
+	"opus": {Ext: "ogg", Codec: []string{"-c:a", "libopus", "-b:a", "24k", "-application", "voip"}, Muxer: "ogg", MaxChunkSeconds: 1800},
+	"mp3":  {Ext: "mp3", Codec: []string{"-c:a", "libmp3lame", "-b:a", "32k"}, Muxer: "mp3", MaxChunkSeconds: 1800},
+}
+
+// bitexactArgs are the output options for every audio file whose bytes key
+// the transcript cache. Without them the Ogg muxer picks a random stream
+// serial and the muxers and encoders stamp their versions and the input's
+// tags, so the same audio would hash differently on every run.
+var bitexactArgs = []string{"-map_metadata", "-1", "-fflags", "+bitexact", "-flags:a", "+bitexact"}
+
+// ffmpegJobs caps the ffmpeg processes run at once.
+var ffmpegJobs = newJobBudget(runtime.NumCPU())
+
+func extractAudio(ctx context.Context, inputPath, outputPath string, format audioFormat) error {
+	release, err := ffmpegJobs.acquire(ctx, 0)
+	if err != nil {
+		return err
+	}
+	defer release()
+	args := []string{
 		"-y",
 		"-i",
 		inputPath,
@@ -451,35 +687,304 @@ func extractAudio(inputPath, outputPath string) error {
 		"1",
 		"-ar",
 		"16000",
+	}
+	args = append(args, format.Codec...)
+	args = append(args, bitexactArgs...)
+	args = append(args, "-f", format.Muxer, outputPath)
+	return runCommand(ctx, "ffmpeg", args...)
+}
+
+type silence struct {
+	Start float64
+	End   float64
+}
+
+// detectSilences finds the quiet spans in the audio with ffmpeg's
+// silencedetect filter, in one linear decode.
+func detectSilences(ctx context.Context, audioPath string, duration float64) ([]silence, error) {
+	release, err := ffmpegJobs.acquire(ctx, 0)
+	if err != nil {
+		return nil, err
+	}
+	defer release()
+	cmd := exec.CommandContext(
+		ctx,
+		"ffmpeg",
+		"-hide_banner",
+		"-nostats",
+		"-i",
+		audioPath,
+		"-af",
+		fmt.Sprintf("silencedetect=noise=%ddB:d=%g", silenceNoiseDB, silenceMinSeconds),
 		"-f",
-		"wav",
-		outputPath,
+		"null",
+		"-",
 	)
+	var stderr bytes.Buffer
+	cmd.Stderr = &stderr
+	if err := cmd.Run(); err != nil {
+		message := strings.TrimSpace(stderr.String())
+		if message == "" {
+			message = err.Error()
+		}
+		return nil, fmt.Errorf("ffmpeg failed: %s", message)
+	}
+	return parseSilences(stderr.String(), duration), nil
 }
 
-func extractAudioSegment(inputPath, outputPath string, startSeconds, durationSeconds float64, accurate bool) error {
-	args := []string{"-y"}
-	if !accurate {
-		args = append(args, "-ss", fmt.Sprintf("%.3f", startSeconds))
+// parseSilences reads silencedetect's "silence_start: X" and
+// "silence_end: Y | silence_duration: Z" log lines. A silence still open at
+// the end of the log runs to the end of the audio.
+func parseSilences(output string, duration float64) []silence {
+	silences := []silence{}
+	open := -1.0
+	value := func(line, key string) (float64, bool) {
+		i := strings.Index(line, key)
+		if i < 0 {
+			return 0, false
+		}
+		fields := strings.Fields(line[i+len(key):])
+		if len(fields) == 0 {
+			return 0, false
+		}
+		v, err := strconv.ParseFloat(fields[0], 64)
+		return v, err == nil
+	}
+	for _, line := range strings.Split(output, "\n") {
+		if v, ok := value(line, "silence_start:"); ok {
+			open = max(v, 0)
+		} else if v, ok := value(line, "silence_end:"); ok && open >= 0 {
+			silences = append(silences, silence{Start: open, End: v})
+			open = -1
+		}
 	}
-	args = append(args, "-i", inputPath)
-	if accurate {
-		args = append(args, "-ss", fmt.Sprintf("%.3f", startSeconds))
+	if open >= 0 && open < duration {
+		silences = append(silences, silence{Start: open, End: duration})
 	}
+	return silences
+}
+
+type chunkPlan struct {
+	Cuts   []float64    // boundaries after 0, in order
+	Silent map[int]bool // chunks that are one long silence and are not uploaded
+}
+
+// planChunks places chunk boundaries at most chunkSeconds apart. Where the
+// last quarter of a chunk has a silence the cut goes there, so words are not
+// split across chunks. A silence of dropSeconds or more ends the chunk
+// before it early, wherever it starts, and becomes a chunk of its own that
+// is never uploaded; chunks keep their start offsets, so the timestamps
+// after it need no remapping. silencePad is left on either side of speech,
+// and a silence less than minChunkSeconds after the start of a chunk stays
+// in it rather than leave a sliver of audio to upload on its own.
+func planChunks(duration float64, chunkSeconds int, silences []silence, dropSeconds float64) chunkPlan {
+	plan := chunkPlan{Silent: map[int]bool{}}
+	size := float64(chunkSeconds)
+	var long []silence
+	for _, s := range silences {
+		if dropSeconds <= 0 || s.End-s.Start < dropSeconds {
+			continue
+		}
+		// No speech to pad at either end of the audio.
+		start, end := s.Start+silencePad, s.End-silencePad
+		if s.Start <= silencePad {
+			start = 0
+		}
+		if s.End >= duration-silencePad {
+			end = duration
+		}
+		long = append(long, silence{Start: start, End: end})
+	}
+
+	start := 0.0
+	for start < duration-0.01 {
+		dropped := false
+		for _, s := range long {
+			if s.Start <= start+0.01 && start < s.End {
+				plan.Silent[len(plan.Cuts)] = true
+				if s.End < duration-0.01 {
+					plan.Cuts = append(plan.Cuts, s.End)
+				}
+				start = s.End
+				dropped = true
+				break
+			}
+		}
+		if dropped {
+			continue
+		}
+
+		target := start + size
+		next := target
+		found := false
+		for _, s := range long {
+			if s.Start >= start+minChunkSeconds && s.Start < min(target, duration-0.01) {
+				next = s.Start
+				found = true
+				break
+			}
+		}
+		if !found {
+			if target >= duration-0.01 {
+				break
+			}
+			windowStart := target - size/4
+			for _, s := range silences {
+				if s.End <= windowStart || s.Start >= target {
+					continue
+				}
+				if at := min((s.Start+s.End)/2, target); at > windowStart {
+					next = at
+				}
+			}
+		}
+		plan.Cuts = append(plan.Cuts, next)
+		start = next
+	}
+	return plan
+}
+
+// segmentAudio cuts audioPath at the plan's boundaries in one ffmpeg pass
+// with the segment muxer, so the input is read once however long it is. The
+// audio is already encoded for upload and is copied, not re-encoded. Each
+// chunk is sent on ready as soon as ffmpeg has closed it; the files of
+// silent ones are deleted first.
+func segmentAudio(ctx context.Context, audioPath string, plan chunkPlan, ready chan<- audioChunk) error {
+	release, err := ffmpegJobs.acquire(ctx, 0)
+	if err != nil {
+		return err
+	}
+	defer release()
+	baseDir := filepath.Dir(audioPath)
+	listPath := filepath.Join(baseDir, "chunks.csv")
+	args := []string{
+		"-y",
+		"-i",
+		audioPath,
+		"-c",
+		"copy",
+	}
+	args = append(args, bitexactArgs...)
 	args = append(
 		args,
-		"-t",
-		fmt.Sprintf("%.3f", durationSeconds),
-		"-vn",
-		"-ac",
-		"1",
-		"-ar",
-		"16000",
 		"-f",
-		"wav",
-		outputPath,
+		"segment",
+		"-segment_times",
+		formatCuts(plan.Cuts),
+		"-reset_timestamps",
+		"1",
+		"-segment_list",
+		listPath,
+		"-segment_list_type",
+		"csv",
+		filepath.Join(baseDir, "chunk_%04d"+filepath.Ext(audioPath)),
 	)
-	return runCommand("ffmpeg", args...)
+	cmd := exec.CommandContext(ctx, "ffmpeg", args...)
+	list := chunkList{path: listPath, dir: baseDir, silent: plan.Silent}
+	return followSegments(ctx, cmd, &list, ready)
+}
+
+// followSegments runs a segment muxer command and sends each chunk it
+// lists on ready as soon as it is closed, until the command exits.
+func followSegments(ctx context.Context, cmd *exec.Cmd, list *chunkList, ready chan<- audioChunk) error {
+	var stderr bytes.Buffer
+	cmd.Stderr = &stderr
+	if err := cmd.Start(); err != nil {
+		return fmt.Errorf("ffmpeg failed: %s", err)
+	}
+	exited := make(chan error, 1)
+	go func() { exited <- cmd.Wait() }()
+
+	ticker := time.NewTicker(200 * time.Millisecond)
+	defer ticker.Stop()
+	for {
+		select {
+		case err := <-exited:
+			if err != nil {
+				if ctx.Err() != nil {
+					return ctx.Err()
+				}
+				message := strings.TrimSpace(stderr.String())
+				if message == "" {
+					message = err.Error()
+				}
+				return fmt.Errorf("ffmpeg failed: %s", message)
+			}
+			return list.send(ctx, ready)
+		case <-ticker.C:
+			if err := list.send(ctx, ready); err != nil {
+				return err
+			}
+		}
+	}
+}
+
+// chunkList follows the CSV segment list ffmpeg appends a line to
+// ("name,start,end") as it finishes each chunk.
+type chunkList struct {
+	path   string
+	dir    string
+	silent map[int]bool
+	offset int64
+	next   int
+}
+
+func formatCuts(cuts []float64) string {
+	if len(cuts) == 0 {
+		// One chunk; the muxer needs a boundary, so give it one past the end.
+		return "86400000"
+	}
+	parts := make([]string, len(cuts))
+	for i, cut := range cuts {
+		parts[i] = strconv.FormatFloat(cut, 'f', 3, 64)
+	}
+	return strings.Join(parts, ",")
+}
+
+// send hands on the chunks listed since the last call.
+func (l *chunkList) send(ctx context.Context, ready chan<- audioChunk) error {
+	file, err := os.Open(l.path)
+	if errors.Is(err, os.ErrNotExist) {
+		return nil
+	}
+	if err != nil {
+		return err
+	}
+	defer file.Close()
+	data, err := io.ReadAll(io.NewSectionReader(file, l.offset, 1<<62))
+	if err != nil {
+		return err
+	}
+	complete := bytes.LastIndexByte(data, '\n') + 1
+	l.offset += int64(complete)
+	for _, line := range strings.Split(string(data[:complete]), "\n") {
+		fields := strings.Split(strings.TrimSpace(line), ",")
+		if len(fields) < 3 {
+			continue
+		}
+		start, errStart := strconv.ParseFloat(fields[len(fields)-2], 64)
+		end, errEnd := strconv.ParseFloat(fields[len(fields)-1], 64)
+		if errStart != nil || errEnd != nil {
+			return fmt.Errorf("unexpected segment list entry: %q", line)
+		}
+		chunk := audioChunk{
+			Index:    l.next,
+			Path:     filepath.Join(l.dir, strings.Join(fields[:len(fields)-2], ",")),
+			Start:    start,
+			Duration: end - start,
+		}
+		l.next++
+		if l.silent[chunk.Index] {
+			os.Remove(chunk.Path)
+			chunk.Silent = true
+		}
+		select {
+		case <-ctx.Done():
+			return ctx.Err()
+		case ready <- chunk:
+		}
+	}
+	return nil
 }
 
 func audioDuration(path string) (float64, error) {
@@ -524,11 +1029,13 @@ func chooseChunkSeconds(path string, defaultChunk int, maxAudioBytes int64) (int
 	if err != nil {
 		return defaultChunk, err
 	}
+	// Measured on the encoded file; the headroom covers variable-bitrate
+	// chunks that run denser than the average.
 	bytesPerSecond := float64(sizeBytes) / duration
 	if bytesPerSecond <= 0 {
 		return defaultChunk, nil
 	}
-	estimated := int(float64(maxAudioBytes) / bytesPerSecond)
+	estimated := int(0.9 * float64(maxAudioBytes) / bytesPerSecond)
 	if estimated <= 0 {
 		return defaultChunk, nil
 	}
@@ -541,13 +1048,104 @@ func chooseChunkSeconds(path string, defaultChunk int, maxAudioBytes int64) (int
 	return estimated, nil
 }
 
+// resultCache keeps successful API results on disk, content-addressed: a
+// transcript by the hash of the audio it came from plus model and language,
+// a translation by its source text, language pair and model. Re-runs, after a
+// crash or for another target language, only pay for what is missing. A nil
+// cache stores nothing.
+type resultCache struct {
+	dir string
+}
+
+func newResultCache(dir string) (*resultCache, error) {
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		return nil, err
+	}
+	return &resultCache{dir: dir}, nil
+}
+
+func cacheKey(parts ...string) string {
+	h := sha256.New()
+	for _, part := range parts {
+		io.WriteString(h, part)
+		h.Write([]byte{0})
+	}
+	return hex.EncodeToString(h.Sum(nil))
+}
+
+// fileKey hashes the contents of path together with parts.
+func fileKey(path string, parts ...string) (string, error) {
+	file, err := os.Open(path)
+	if err != nil {
+		return "", err
+	}
+	defer file.Close()
+	h := sha256.New()
+	if _, err := io.Copy(h, file); err != nil {
+		return "", err
+	}
+	return cacheKey(append([]string{hex.EncodeToString(h.Sum(nil))}, parts...)...), nil
+}
+
+func (c *resultCache) path(kind, key string) string {
+	return filepath.Join(c.dir, kind, key[:2], key+".json")
+}
+
+func (c *resultCache) get(kind, key string, v any) bool {
+	if c == nil {
+		return false
+	}
+	data, err := os.ReadFile(c.path(kind, key))
+	if err != nil {
+		return false
+	}
+	return json.Unmarshal(data, v) == nil
+}
+
+// put writes through a temporary file and a rename, so an interrupted run
+// never leaves a truncated entry behind.
+func (c *resultCache) put(kind, key string, v any) {
+	if c == nil {
+		return
+	}
+	data, err := json.Marshal(v)
+	if err != nil {
+		return
+	}
+	path := c.path(kind, key)
+	if err := os.MkdirAll(filepath.Dir(path), 0755); err != nil {
+		return
+	}
+	tmp, err := os.CreateTemp(filepath.Dir(path), ".tmp-*")
+	if err != nil {
+		return
+	}
+	_, errWrite := tmp.Write(data)
+	errClose := tmp.Close()
+	if errWrite != nil || errClose != nil || os.Rename(tmp.Name(), path) != nil {
+		os.Remove(tmp.Name())
+	}
+}
+
 func transcribeWithRetry(
 	ctx context.Context,
 	client *openAIClient,
+	cache *resultCache,
 	audioPath, model, language string,
 	logf func(string, ...any),
 ) ([]Segment, error) {
 	var segments []Segment
+	var key string
+	if cache != nil {
+		var err error
+		if key, err = fileKey(audioPath, model, language); err != nil {
+			return nil, err
+		}
+		if cache.get("transcripts", key, &segments) {
+			return segments, nil
+		}
+	}
+
 	var err error
 	retryErr := retry(
 		ctx,
@@ -566,15 +1164,39 @@ func transcribeWithRetry(
 	if retryErr != nil {
 		return nil, retryErr
 	}
+	if cache != nil {
+		cache.put("transcripts", key, segments)
+	}
 	return segments, nil
 }
 
+type audioChunk struct {
+	Index    int
+	Path     string
+	Start    float64
+	Duration float64
+	Silent   bool // a long silence: nothing to upload
+}
+
+// vadSettings controls silence-aware chunking: cuts placed in silences, and
+// silences of DropSeconds or more (if positive) left out of the upload.
+type vadSettings struct {
+	Enabled     bool
+	DropSeconds float64
+}
+
+// transcribeInChunks segments the audio in the background while up to
+// workers chunks upload at once, so each chunk is on its way as soon as
+// ffmpeg has written it. Segments are merged back in timestamp order.
 func transcribeInChunks(
 	ctx context.Context,
 	client *openAIClient,
+	cache *resultCache,
 	audioPath, model, language string,
 	chunkSeconds int,
-	accurate bool,
+	workers int,
+	vad vadSettings,
+	onChunk func(index int, segments []Segment) error,
 	logf func(string, ...any),
 ) ([]Segment, error) {
 	duration, err := audioDuration(audioPath)
@@ -585,89 +1207,271 @@ func transcribeInChunks(
 		return nil, errors.New("audio duration is zero")
 	}
 
-	segments := []Segment{}
-	current := 0.0
-	chunkIndex := 0
-	baseDir := filepath.Dir(audioPath)
-
-	for current < duration-0.01 {
-		remaining := duration - current
-		segmentDuration := float64(chunkSeconds)
-		if remaining < segmentDuration {
-			segmentDuration = remaining
+	var silences []silence
+	if vad.Enabled {
+		silences, err = detectSilences(ctx, audioPath, duration)
+		if err != nil {
+			logf("Silence detection failed; cutting at fixed intervals. %v", err)
+			silences = nil
 		}
-		chunkPath := filepath.Join(baseDir, fmt.Sprintf("chunk_%04d.wav", chunkIndex))
-		logf("Transcribing chunk %d at %.1fs...", chunkIndex+1, current)
-		if err := extractAudioSegment(audioPath, chunkPath, current, segmentDuration, accurate); err != nil {
-			return nil, err
+	}
+	plan := planChunks(duration, chunkSeconds, silences, vad.DropSeconds)
+	if len(plan.Silent) > 0 {
+		logf("Skipping %d long silence(s).", len(plan.Silent))
+	}
+
+	return transcribeChunks(ctx, client, cache, model, language, workers, func(ctx context.Context, ready chan<- audioChunk) error {
+		return segmentAudio(ctx, audioPath, plan, ready)
+	}, onChunk, logf)
+}
+
+// transcribeChunks uploads the chunks cut sends on ready, up to workers at
+// once, while cut is still running, and merges their segments back in
+// timestamp order.
+func transcribeChunks(
+	ctx context.Context,
+	client *openAIClient,
+	cache *resultCache,
+	model, language string,
+	workers int,
+	cut func(ctx context.Context, ready chan<- audioChunk) error,
+	onChunk func(index int, segments []Segment) error,
+	logf func(string, ...any),
+) ([]Segment, error) {
+	if workers <= 0 {
+		workers = 1
+	}
+	ctx, cancel := context.WithCancel(ctx)
+	defer cancel()
+
+	var mu sync.Mutex
+	results := map[int][]Segment{}
+
+	ready := make(chan audioChunk, workers)
+	extractDone := make(chan error, 1)
+	go func() {
+		defer close(ready)
+		err := cut(ctx, ready)
+		if err != nil && !errors.Is(err, context.Canceled) {
+			cancel()
+		} else {
+			err = nil
 		}
-		chunkSegments, err := transcribeWithRetry(ctx, client, chunkPath, model, language, logf)
-		if err != nil {
-			return nil, err
+		extractDone <- err
+	}()
+
+	var wg sync.WaitGroup
+	errCh := make(chan error, 1)
+	fail := func(err error) {
+		select {
+		case errCh <- err:
+		default:
 		}
-		for _, seg := range chunkSegments {
-			seg.Start += current
-			seg.End += current
-			segments = append(segments, seg)
+		cancel()
+	}
+	workerFn := func() {
+		defer wg.Done()
+		for chunk := range ready {
+			if ctx.Err() != nil {
+				continue
+			}
+			var chunkSegments []Segment
+			var err error
+			if !chunk.Silent {
+				logf("Transcribing chunk %d at %.1fs...", chunk.Index+1, chunk.Start)
+				// Earlier chunks go first when uploads are backed up, so
+				// subtitles fill in from the start.
+				chunkSegments, err = transcribeWithRetry(withPriority(ctx, -chunk.Index), client, cache, chunk.Path, model, language, logf)
+				os.Remove(chunk.Path)
+				if err != nil {
+					fail(err)
+					continue
+				}
+				for i := range chunkSegments {
+					chunkSegments[i].Start += chunk.Start
+					chunkSegments[i].End += chunk.Start
+				}
+			}
+			if onChunk != nil {
+				if err := onChunk(chunk.Index, chunkSegments); err != nil {
+					fail(err)
+					continue
+				}
+			}
+			mu.Lock()
+			results[chunk.Index] = chunkSegments
+			mu.Unlock()
 		}
-		current += segmentDuration
-		chunkIndex++
+	}
+	for i := 0; i < workers; i++ {
+		wg.Add(1)
+		go workerFn()
+	}
+	wg.Wait()
+
+	if err := <-extractDone; err != nil {
+		return nil, err
+	}
+	select {
+	case err := <-errCh:
+		return nil, err
+	default:
+	}
+	// Canceled from outside: the chunks still queued were skipped.
+	if err := ctx.Err(); err != nil {
+		return nil, err
+	}
+
+	segments := []Segment{}
+	for i := 0; i < len(results); i++ {
+		segments = append(segments, results[i]...)
 	}
 	return segments, nil
 }
 
+// batchSegments groups the indices of segments worth translating, other
+// than those done already, into batches of at most batchSize segments and
+// maxBatchChars of text.
+func batchSegments(segments []Segment, done []bool, batchSize, minTranslateChars int) [][]int {
+	var batches [][]int
+	var current []int
+	chars := 0
+	for idx, seg := range segments {
+		text := strings.TrimSpace(seg.Text)
+		if done[idx] || text == "" || isLowInfoText(text, minTranslateChars) {
+			continue
+		}
+		if len(current) > 0 && (len(current) >= batchSize || chars+len(text) > maxBatchChars) {
+			batches = append(batches, current)
+			current, chars = nil, 0
+		}
+		current = append(current, idx)
+		chars += len(text)
+	}
+	if len(current) > 0 {
+		batches = append(batches, current)
+	}
+	return batches
+}
+
+// translateSegments sends batches of up to batchSize segments per request
+// on workers goroutines. A batch whose reply does not map back onto its
+// segments, or that the API rejects outright, is translated one segment at a
+// time instead.
 func translateSegments(
 	ctx context.Context,
 	client *openAIClient,
+	cache *resultCache,
 	segments []Segment,
 	sourceLang, targetLang, model string,
 	workers int,
+	batchSize int,
 	minTranslateChars int,
 	logf func(string, ...any),
 ) ([]Segment, error) {
 	if workers <= 0 {
 		workers = 1
 	}
+	if batchSize <= 0 {
+		batchSize = 1
+	}
 	translated := make([]Segment, len(segments))
 	copy(translated, segments)
 
+	translationKey := func(text string) string {
+		return cacheKey(model, sourceLang, targetLang, text)
+	}
+	done := make([]bool, len(segments))
+	if cache != nil {
+		hits := 0
+		for idx, seg := range segments {
+			var output string
+			if cache.get("translations", translationKey(strings.TrimSpace(seg.Text)), &output) {
+				translated[idx].Text = output
+				done[idx] = true
+				hits++
+			}
+		}
+		if hits > 0 {
+			logf("Reusing %d cached translations.", hits)
+		}
+	}
+
 	ctx, cancel := context.WithCancel(ctx)
 	defer cancel()
 
-	jobs := make(chan int)
+	withRetry := func(what string, fn func() error) error {
+		return retry(
+			ctx,
+			maxRetries,
+			baseRetryDelay,
+			maxRetryDelay,
+			isRetryable,
+			func(attempt int, delay time.Duration, err error) {
+				logf("%s failed; retrying in %.1fs (attempt %d). %s", what, delay.Seconds(), attempt, describeError(err))
+			},
+			fn,
+		)
+	}
+	translateOne := func(idx int) error {
+		text := strings.TrimSpace(translated[idx].Text)
+		var output string
+		err := withRetry("Translation", func() error {
+			var err error
+			output, err = client.Translate(ctx, model, sourceLang, targetLang, text)
+			return err
+		})
+		if err != nil {
+			return err
+		}
+		translated[idx].Text = output
+		cache.put("translations", translationKey(text), output)
+		return nil
+	}
+	translateBatch := func(batch []int) error {
+		if len(batch) == 1 {
+			return translateOne(batch[0])
+		}
+		items := make([]batchItem, len(batch))
+		for i, idx := range batch {
+			items[i] = batchItem{ID: i + 1, Text: strings.TrimSpace(translated[idx].Text)}
+		}
+		var outputs map[int]string
+		err := withRetry("Batch translation", func() error {
+			var err error
+			outputs, err = client.TranslateBatch(ctx, model, sourceLang, targetLang, items)
+			return err
+		})
+		if err == nil {
+			for i, idx := range batch {
+				translated[idx].Text = outputs[i+1]
+				cache.put("translations", translationKey(items[i].Text), outputs[i+1])
+			}
+			return nil
+		}
+		if ctx.Err() != nil || isRetryable(err) {
+			return err
+		}
+		logf("Batch of %d segments failed (%s); translating them one at a time.", len(batch), describeError(err))
+		for _, idx := range batch {
+			if err := translateOne(idx); err != nil {
+				return err
+			}
+		}
+		return nil
+	}
+
+	jobs := make(chan []int)
 	var wg sync.WaitGroup
 	errCh := make(chan error, 1)
 
 	workerFn := func() {
 		defer wg.Done()
-		for idx := range jobs {
+		for batch := range jobs {
 			if ctx.Err() != nil {
 				return
 			}
-			text := strings.TrimSpace(translated[idx].Text)
-			if text == "" {
-				continue
-			}
-			if isLowInfoText(text, minTranslateChars) {
-				continue
-			}
-			var output string
-			err := retry(
-				ctx,
-				maxRetries,
-				baseRetryDelay,
-				maxRetryDelay,
-				isRetryable,
-				func(attempt int, delay time.Duration, err error) {
-					logf("Translation failed; retrying in %.1fs (attempt %d). %s", delay.Seconds(), attempt, describeError(err))
-				},
-				func() error {
-					var err error
-					output, err = client.Translate(ctx, model, sourceLang, targetLang, text)
-					return err
-				},
-			)
-			if err != nil {
+			if err := translateBatch(batch); err != nil {
 				select {
 				case errCh <- err:
 				default:
@@ -675,7 +1479,6 @@ func translateSegments(
 				cancel()
 				return
 			}
-			translated[idx].Text = output
 		}
 	}
 
@@ -685,11 +1488,11 @@ func translateSegments(
 	}
 
 sendLoop:
-	for i := range segments {
+	for _, batch := range batchSegments(segments, done, batchSize, minTranslateChars) {
 		select {
 		case <-ctx.Done():
 			break sendLoop
-		case jobs <- i:
+		case jobs <- batch:
 		}
 	}
 	close(jobs)
@@ -735,12 +1538,23 @@ func run() int {
 	translateModel := flag.String("translate-model", defaultTranslateModel, "Translation model")
 	noTranslate := flag.Bool("no-translate", false, "Skip translation and output original transcript")
 	chunkSeconds := flag.Int("chunk-seconds", 0, "Split audio into chunks of N seconds before transcription")
+	audioFormatName := flag.String("audio-format", defaultAudioFormat, "Audio encoding for upload: opus, mp3 or wav")
 	maxAudioMB := flag.Int("max-audio-mb", defaultMaxAudioMB, "Auto-chunk when extracted audio exceeds this size (MB)")
 	keepAudio := flag.Bool("keep-audio", false, "Keep the extracted audio file")
 	translateWorkers := flag.Int("translate-workers", defaultTranslateWorkers, "Number of concurrent translation workers")
+	translateBatch := flag.Int("translate-batch", defaultTranslateBatch, "Segments translated per request (1 to send each on its own)")
+	transcribeWorkers := flag.Int("transcribe-workers", defaultTranscribeWorkers, "Number of chunks uploaded for transcription at once")
 	minTranslateChars := flag.Int("min-translate-chars", 4, "Skip translation for segments with fewer than N letters/numbers (0 to disable)")
+	cacheDir := flag.String("cache-dir", "", "Directory for cached transcripts and translations (defaults to the user cache dir)")
+	noCache := flag.Bool("no-cache", false, "Do not read or write cached results")
 	timeoutSeconds := flag.Int("timeout-seconds", defaultTimeoutSeconds, "HTTP timeout for OpenAI requests (seconds)")
+	noVAD := flag.Bool("no-vad", false, "Cut chunks at fixed intervals instead of inside silences")
+	dropSilence := flag.Float64("drop-silence-seconds", defaultDropSilence, "Leave silences of at least N seconds out of chunked uploads (0 to keep them)")
+	incremental := flag.Bool("incremental", false, "Write subtitles chunk by chunk as they are ready, synced to disk")
 	highAccuracy := flag.Bool("high-accuracy", false, "Use higher-accuracy transcription settings (slower)")
+	budgetDirFlag := flag.String("budget-dir", budgetDir(), "Share transcription, translation and ffmpeg budgets with other tools through slot files in this directory")
+	downloadDir := flag.String("download-dir", ".", "Directory a URL input is saved to")
+	deadline := flag.Duration("deadline", 0, "Give up once the whole run has taken this long, e.g. 30m (0 for no limit)")
 	flag.Parse()
 
 	if flag.NArg() < 1 {
@@ -750,8 +1564,17 @@ func run() int {
 	}
 
 	inputPath := flag.Arg(0)
+	var rawURL string
+	if isURL(inputPath) {
+		rawURL = inputPath
+		inputPath = filepath.Join(*downloadDir, downloadName(rawURL))
+		if err := os.MkdirAll(*downloadDir, 0o755); err != nil {
+			fmt.Fprintf(os.Stderr, "Failed to create download dir: %v\n", err)
+			return 1
+		}
+	}
 	info, err := os.Stat(inputPath)
-	if err != nil || info.IsDir() {
+	if rawURL == "" && (err != nil || info.IsDir()) {
 		fmt.Fprintf(os.Stderr, "Input file not found: %s\n", inputPath)
 		return 1
 	}
@@ -776,8 +1599,34 @@ func run() int {
 		outputPath = strings.TrimSuffix(inputPath, ext) + ".srt"
 	}
 
-	client := newOpenAIClient(apiKey, time.Duration(*timeoutSeconds)*time.Second)
-	ctx := context.Background()
+	concurrency := *translateWorkers
+	if concurrency <= 0 {
+		concurrency = runtime.NumCPU()
+	}
+	client := newOpenAIClient(apiKey, time.Duration(*timeoutSeconds)*time.Second, max(concurrency, *transcribeWorkers))
+	client.transcribeJobs = newJobBudget(*transcribeWorkers)
+	client.translateJobs = newJobBudget(concurrency)
+
+	// Ctrl-C cancels the run, and a second one kills it outright.
+	interrupted, stop := signal.NotifyContext(context.Background(), os.Interrupt, syscall.SIGTERM)
+	defer stop()
+	go func() {
+		<-interrupted.Done()
+		stop()
+	}()
+	ctx := interrupted
+	if *deadline > 0 {
+		var cancel context.CancelFunc
+		ctx, cancel = context.WithTimeout(ctx, *deadline)
+		defer cancel()
+	}
+	// failed is the exit status for an error, 130 when it came from Ctrl-C.
+	failed := func() int {
+		if errors.Is(ctx.Err(), context.Canceled) {
+			return 130
+		}
+		return 1
+	}
 
 	logf := func(format string, args ...any) {
 		if *quiet {
@@ -786,104 +1635,209 @@ func run() int {
 		fmt.Fprintf(os.Stderr, format+"\n", args...)
 	}
 
-	tmpDir, err := os.MkdirTemp("", "video-subtitle-*")
-	if err != nil {
-		fmt.Fprintf(os.Stderr, "Failed to create temp dir: %v\n", err)
-		return 1
+	if *budgetDirFlag != "" {
+		for name, b := range map[string]*jobBudget{
+			"transcribe": client.transcribeJobs,
+			"translate":  client.translateJobs,
+			"ffmpeg":     ffmpegJobs,
+		} {
+			if err := b.share(*budgetDirFlag, name); err != nil {
+				logf("Shared %s budget disabled: %v", name, err)
+			}
+		}
 	}
-	defer os.RemoveAll(tmpDir)
 
-	audioPath := filepath.Join(tmpDir, "audio.wav")
-	logf("Extracting audio...")
-	if err := extractAudio(inputPath, audioPath); err != nil {
-		fmt.Fprintln(os.Stderr, err)
-		return 1
+	var cache *resultCache
+	if !*noCache {
+		dir := *cacheDir
+		if dir == "" {
+			if userDir, err := os.UserCacheDir(); err == nil {
+				dir = filepath.Join(userDir, "video-subtitle")
+			}
+		}
+		if dir != "" {
+			if cache, err = newResultCache(dir); err != nil {
+				logf("Cache disabled: %v", err)
+				cache = nil
+			}
+		}
 	}
 
-	audioSizeBytes, err := audioSize(audioPath)
+	tmpDir, err := os.MkdirTemp("", "video-subtitle-*")
 	if err != nil {
-		fmt.Fprintf(os.Stderr, "Failed to read extracted audio: %v\n", err)
+		fmt.Fprintf(os.Stderr, "Failed to create temp dir: %v\n", err)
 		return 1
 	}
-	if audioSizeBytes < 1024 {
-		fmt.Fprintln(os.Stderr, "Extracted audio is empty or too small.")
+	defer os.RemoveAll(tmpDir)
+
+	format, ok := audioFormats[*audioFormatName]
+	if !ok {
+		fmt.Fprintf(os.Stderr, "Unknown audio format %q (want wav, opus or mp3).\n", *audioFormatName)
 		return 1
 	}
+	audioPath := filepath.Join(tmpDir, "audio."+format.Ext)
 
 	if *highAccuracy {
 		*minTranslateChars = 0
 	}
 
-	maxAudioBytes := int64(*maxAudioMB) * 1024 * 1024
-	useChunking := *chunkSeconds > 0 || audioSizeBytes > maxAudioBytes
-	chunkSecondsValue := *chunkSeconds
+	translate := !*noTranslate && *sourceLang != *targetLang
+	workers := *translateWorkers
+	if workers <= 0 {
+		workers = runtime.NumCPU()
+	}
+	translateChunk := func(index int, chunkSegments []Segment) ([]Segment, error) {
+		if !translate || countTranslatableSegments(chunkSegments, *minTranslateChars) == 0 {
+			return chunkSegments, nil
+		}
+		return translateSegments(withPriority(ctx, -index), client, cache, chunkSegments, *sourceLang, *targetLang, *translateModel, workers, *translateBatch, *minTranslateChars, logf)
+	}
 
-	if useChunking {
-		if _, err := exec.LookPath("ffprobe"); err != nil {
-			fmt.Fprintln(os.Stderr, "ffprobe is required for chunked transcription.")
+	// In incremental mode each chunk is translated and written as soon as it
+	// is transcribed, instead of everything at the end.
+	var writer *srtWriter
+	var onChunk func(int, []Segment) error
+	if *incremental {
+		writer, err = createSRTWriter(outputPath)
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "Failed to write SRT: %v\n", err)
 			return 1
 		}
+		defer writer.Close()
+		onChunk = func(index int, chunkSegments []Segment) error {
+			translated, err := translateChunk(index, chunkSegments)
+			if err != nil {
+				return fmt.Errorf("translation failed: %w", err)
+			}
+			return writer.Add(index, translated)
+		}
 	}
-	if *chunkSeconds <= 0 && audioSizeBytes > maxAudioBytes {
-		chunkSecondsValue, err = chooseChunkSeconds(audioPath, defaultChunkSeconds, maxAudioBytes)
-		if err != nil {
-			logf("Failed to calculate chunk size; using default %ds.", defaultChunkSeconds)
-			chunkSecondsValue = defaultChunkSeconds
+
+	// A URL is downloaded and transcribed in one pass. Should ffmpeg not be
+	// able to read it before it is whole, the finished download is
+	// transcribed as a local file instead.
+	var segments []Segment
+	chunked, streamed := false, false
+	if rawURL != "" {
+		chunkSecondsValue := *chunkSeconds
+		if chunkSecondsValue <= 0 {
+			chunkSecondsValue = defaultIngestChunkSeconds
+		}
+		logf("Downloading to %s and transcribing as it arrives...", inputPath)
+		segments, err = ingestURL(ctx, client, cache, rawURL, inputPath, filepath.Join(tmpDir, "stream"), format, chunkSecondsValue, *whisperModel, *sourceLang, *transcribeWorkers, onChunk, logf)
+		if errors.Is(err, errNotStreamable) {
+			logf("%v; transcribing the downloaded file.", err)
+		} else if err != nil {
+			fmt.Fprintf(os.Stderr, "Transcription failed: %v\n", err)
+			return failed()
+		} else {
+			chunked, streamed = true, true
 		}
-		logf("Audio is large (%.1f MB); auto-chunking with %ds segments.", float64(audioSizeBytes)/(1024*1024), chunkSecondsValue)
-	} else if *chunkSeconds > 0 {
-		logf("Chunking audio into %ds segments.", chunkSecondsValue)
 	}
 
-	logf("Transcribing with Whisper...")
-	segments, err := func() ([]Segment, error) {
-		if useChunking {
-			return transcribeInChunks(ctx, client, audioPath, *whisperModel, *sourceLang, chunkSecondsValue, *highAccuracy, logf)
+	if !streamed {
+		logf("Extracting audio...")
+		if err := extractAudio(ctx, inputPath, audioPath, format); err != nil {
+			fmt.Fprintln(os.Stderr, err)
+			return failed()
 		}
-		return transcribeWithRetry(ctx, client, audioPath, *whisperModel, *sourceLang, logf)
-	}()
-	if err != nil {
-		if !useChunking && shouldFallbackToChunking(err) {
-			if _, errProbe := exec.LookPath("ffprobe"); errProbe != nil {
+
+		audioSizeBytes, err := audioSize(audioPath)
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "Failed to read extracted audio: %v\n", err)
+			return 1
+		}
+		if audioSizeBytes < 1024 {
+			fmt.Fprintln(os.Stderr, "Extracted audio is empty or too small.")
+			return 1
+		}
+
+		maxAudioBytes := int64(*maxAudioMB) * 1024 * 1024
+		useChunking := *chunkSeconds > 0 || audioSizeBytes > maxAudioBytes
+		chunkSecondsValue := *chunkSeconds
+
+		if useChunking {
+			if _, err := exec.LookPath("ffprobe"); err != nil {
 				fmt.Fprintln(os.Stderr, "ffprobe is required for chunked transcription.")
 				return 1
 			}
-			logf("Whisper request failed; retrying in chunks. Chunk size: %ds.", defaultChunkSeconds)
-			segments, err = transcribeInChunks(ctx, client, audioPath, *whisperModel, *sourceLang, defaultChunkSeconds, *highAccuracy, logf)
 		}
-	}
-	if err != nil {
-		fmt.Fprintf(os.Stderr, "Transcription failed: %v\n", err)
-		return 1
+		if *chunkSeconds <= 0 && audioSizeBytes > maxAudioBytes {
+			chunkSecondsValue, err = chooseChunkSeconds(audioPath, format.MaxChunkSeconds, maxAudioBytes)
+			if err != nil {
+				logf("Failed to calculate chunk size; using default %ds.", format.MaxChunkSeconds)
+				chunkSecondsValue = format.MaxChunkSeconds
+			}
+			logf("Audio is large (%.1f MB); auto-chunking with %ds segments.", float64(audioSizeBytes)/(1024*1024), chunkSecondsValue)
+		} else if *chunkSeconds > 0 {
+			logf("Chunking audio into %ds segments.", chunkSecondsValue)
+		}
+
+		vad := vadSettings{Enabled: !*noVAD, DropSeconds: *dropSilence}
+
+		logf("Transcribing with Whisper...")
+		chunked = useChunking
+		segments, err = func() ([]Segment, error) {
+			if useChunking {
+				return transcribeInChunks(ctx, client, cache, audioPath, *whisperModel, *sourceLang, chunkSecondsValue, *transcribeWorkers, vad, onChunk, logf)
+			}
+			return transcribeWithRetry(ctx, client, cache, audioPath, *whisperModel, *sourceLang, logf)
+		}()
+		if err != nil {
+			if !useChunking && shouldFallbackToChunking(err) {
+				if _, errProbe := exec.LookPath("ffprobe"); errProbe != nil {
+					fmt.Fprintln(os.Stderr, "ffprobe is required for chunked transcription.")
+					return 1
+				}
+				logf("Whisper request failed; retrying in chunks. Chunk size: %ds.", defaultChunkSeconds)
+				chunked = true
+				segments, err = transcribeInChunks(ctx, client, cache, audioPath, *whisperModel, *sourceLang, defaultChunkSeconds, *transcribeWorkers, vad, onChunk, logf)
+			}
+		}
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "Transcription failed: %v\n", err)
+			return failed()
+		}
 	}
 
-	if !*noTranslate && *sourceLang != *targetLang {
-		workers := *translateWorkers
-		if workers <= 0 {
-			workers = runtime.NumCPU()
+	if writer != nil {
+		if !chunked {
+			if err := onChunk(0, segments); err != nil {
+				fmt.Fprintf(os.Stderr, "%v\n", err)
+				return failed()
+			}
 		}
-		translatable := countTranslatableSegments(segments, *minTranslateChars)
-		if translatable == 0 {
-			logf("Skipping translation: segments are low-info.")
-		} else {
-			logf("Translating segments (%d of %d segments, %d workers)...", translatable, len(segments), workers)
-			translated, err := translateSegments(ctx, client, segments, *sourceLang, *targetLang, *translateModel, workers, *minTranslateChars, logf)
-			if err != nil {
-				fmt.Fprintf(os.Stderr, "Translation failed: %v\n", err)
-				return 1
+		if err := writer.Close(); err != nil {
+			fmt.Fprintf(os.Stderr, "Failed to write SRT: %v\n", err)
+			return 1
+		}
+	} else {
+		if translate {
+			translatable := countTranslatableSegments(segments, *minTranslateChars)
+			if translatable == 0 {
+				logf("Skipping translation: segments are low-info.")
+			} else {
+				logf("Translating segments (%d of %d segments, %d workers)...", translatable, len(segments), workers)
+				translated, err := translateChunk(0, segments)
+				if err != nil {
+					fmt.Fprintf(os.Stderr, "Translation failed: %v\n", err)
+					return failed()
+				}
+				segments = translated
 			}
-			segments = translated
 		}
-	}
 
-	logf("Writing SRT...")
-	if err := writeSRT(segments, outputPath); err != nil {
-		fmt.Fprintf(os.Stderr, "Failed to write SRT: %v\n", err)
-		return 1
+		logf("Writing SRT...")
+		if err := writeSRT(segments, outputPath); err != nil {
+			fmt.Fprintf(os.Stderr, "Failed to write SRT: %v\n", err)
+			return 1
+		}
 	}
 
-	if *keepAudio {
-		kept := strings.TrimSuffix(inputPath, filepath.Ext(inputPath)) + ".wav"
+	if *keepAudio && streamed {
+		logf("Audio extracted during the download was uploaded in chunks; none kept.")
+	} else if *keepAudio {
+		kept := strings.TrimSuffix(inputPath, filepath.Ext(inputPath)) + "." + format.Ext
 		if err := copyFile(audioPath, kept); err != nil {
 			fmt.Fprintf(os.Stderr, "Failed to keep audio: %v\n", err)
 			return 1
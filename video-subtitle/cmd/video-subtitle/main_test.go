@@ -0,0 +1,270 @@
+package main
+
+import (
+	"context"
+	"encoding/json"
+	"errors"
+	"net/http"
+	"net/http/httptest"
+	"os"
+	"path/filepath"
+	"reflect"
+	"strings"
+	"testing"
+)
+
+func TestParseSilences(t *testing.T) {
+	tests := []struct {
+		name     string
+		output   string
+		duration float64
+		want     []silence
+	}{
+		{
+			name:     "none",
+			output:   "size=N/A time=00:00:30.00 bitrate=N/A speed= 900x\n",
+			duration: 30,
+			want:     []silence{},
+		},
+		{
+			name: "closed",
+			output: "[silencedetect @ 0x1] silence_start: 1.5\n" +
+				"[silencedetect @ 0x1] silence_end: 3.25 | silence_duration: 1.75\n" +
+				"[silencedetect @ 0x1] silence_start: 10\n" +
+				"[silencedetect @ 0x1] silence_end: 12 | silence_duration: 2\n",
+			duration: 30,
+			want:     []silence{{1.5, 3.25}, {10, 12}},
+		},
+		{
+			name:     "negative start",
+			output:   "[silencedetect @ 0x1] silence_start: -0.02\n[silencedetect @ 0x1] silence_end: 4 | silence_duration: 4.02\n",
+			duration: 30,
+			want:     []silence{{0, 4}},
+		},
+		{
+			name:     "open at end",
+			output:   "[silencedetect @ 0x1] silence_start: 25\n",
+			duration: 30,
+			want:     []silence{{25, 30}},
+		},
+		{
+			name:     "end without start",
+			output:   "[silencedetect @ 0x1] silence_end: 2 | silence_duration: 2\n",
+			duration: 30,
+			want:     []silence{},
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			if got := parseSilences(tt.output, tt.duration); !reflect.DeepEqual(got, tt.want) {
+				t.Errorf("parseSilences = %v, want %v", got, tt.want)
+			}
+		})
+	}
+}
+
+func TestPlanChunks(t *testing.T) {
+	tests := []struct {
+		name     string
+		duration float64
+		chunk    int
+		silences []silence
+		drop     float64
+		cuts     []float64
+		silent   []int
+	}{
+		{
+			name:     "fixed intervals",
+			duration: 1500,
+			chunk:    600,
+			cuts:     []float64{600, 1200},
+		},
+		{
+			name:     "cut in the last quarter's silence",
+			duration: 1200,
+			chunk:    600,
+			silences: []silence{{100, 101}, {500, 502}},
+			drop:     10,
+			cuts:     []float64{501, 1101},
+		},
+		{
+			name:     "long silence early in a chunk",
+			duration: 1200,
+			chunk:    600,
+			silences: []silence{{100, 130}},
+			drop:     10,
+			cuts:     []float64{100.25, 129.75, 729.75},
+			silent:   []int{1},
+		},
+		{
+			name:     "leading silence",
+			duration: 300,
+			chunk:    600,
+			silences: []silence{{0, 40}},
+			drop:     10,
+			cuts:     []float64{39.75},
+			silent:   []int{0},
+		},
+		{
+			name:     "trailing silence",
+			duration: 300,
+			chunk:    600,
+			silences: []silence{{250, 300}},
+			drop:     10,
+			cuts:     []float64{250.25},
+			silent:   []int{1},
+		},
+		{
+			name:     "all silent",
+			duration: 30,
+			chunk:    600,
+			silences: []silence{{0, 30}},
+			drop:     10,
+			silent:   []int{0},
+		},
+		{
+			name:     "silence right after a chunk starts stays in it",
+			duration: 300,
+			chunk:    600,
+			silences: []silence{{0.5, 40}},
+			drop:     10,
+		},
+		{
+			name:     "drop disabled",
+			duration: 1200,
+			chunk:    600,
+			silences: []silence{{100, 130}},
+			cuts:     []float64{600},
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			plan := planChunks(tt.duration, tt.chunk, tt.silences, tt.drop)
+			if len(plan.Cuts) != len(tt.cuts) {
+				t.Fatalf("cuts = %v, want %v", plan.Cuts, tt.cuts)
+			}
+			for i, cut := range plan.Cuts {
+				if diff := cut - tt.cuts[i]; diff < -1e-9 || diff > 1e-9 {
+					t.Fatalf("cuts = %v, want %v", plan.Cuts, tt.cuts)
+				}
+			}
+			silent := map[int]bool{}
+			for _, i := range tt.silent {
+				silent[i] = true
+			}
+			if !reflect.DeepEqual(plan.Silent, silent) {
+				t.Errorf("silent = %v, want %v", plan.Silent, silent)
+			}
+		})
+	}
+}
+
+func TestBatchSegments(t *testing.T) {
+	segments := []Segment{
+		{Text: "first line"},
+		{Text: "  "},
+		{Text: "ok"},
+		{Text: "second line"},
+		{Text: "third line"},
+		{Text: strings.Repeat("x", maxBatchChars-5)},
+		{Text: "fourth line"},
+	}
+	done := make([]bool, len(segments))
+	done[3] = true
+	got := batchSegments(segments, done, 2, 3)
+	want := [][]int{{0, 4}, {5}, {6}}
+	if !reflect.DeepEqual(got, want) {
+		t.Errorf("batchSegments = %v, want %v", got, want)
+	}
+}
+
+// chatServer answers every chat completion with content.
+func chatServer(t *testing.T, content string) *openAIClient {
+	t.Helper()
+	srv := httptest.NewServer(http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		json.NewEncoder(w).Encode(map[string]any{
+			"choices": []map[string]any{{"message": map[string]string{"content": content}}},
+		})
+	}))
+	t.Cleanup(srv.Close)
+	client := newOpenAIClient("test", 0, 2)
+	client.baseURL = srv.URL
+	return client
+}
+
+func TestTranslateBatchValidatesReply(t *testing.T) {
+	items := []batchItem{{ID: 3, Text: "a"}, {ID: 7, Text: "b"}}
+	tests := []struct {
+		name    string
+		content string
+		want    map[int]string
+	}{
+		{
+			name:    "every id",
+			content: `{"translations":[{"id":7,"text":" B "},{"id":3,"text":"A"}]}`,
+			want:    map[int]string{3: "A", 7: "B"},
+		},
+		{
+			name:    "fenced",
+			content: "```json\n{\"translations\":[{\"id\":3,\"text\":\"A\"},{\"id\":7,\"text\":\"B\"}]}\n```",
+			want:    map[int]string{3: "A", 7: "B"},
+		},
+		{name: "missing id", content: `{"translations":[{"id":3,"text":"A"}]}`},
+		{name: "unknown id", content: `{"translations":[{"id":3,"text":"A"},{"id":8,"text":"B"}]}`},
+		{name: "duplicate id", content: `{"translations":[{"id":3,"text":"A"},{"id":3,"text":"A"},{"id":7,"text":"B"}]}`},
+		{name: "empty text", content: `{"translations":[{"id":3,"text":"A"},{"id":7,"text":" "}]}`},
+		{name: "not json", content: "A\nB"},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			client := chatServer(t, tt.content)
+			got, err := client.TranslateBatch(context.Background(), "model", "ja", "en", items)
+			if tt.want == nil {
+				if !errors.Is(err, errBatchMismatch) {
+					t.Errorf("TranslateBatch = %v, %v; want errBatchMismatch", got, err)
+				}
+				return
+			}
+			if err != nil || !reflect.DeepEqual(got, tt.want) {
+				t.Errorf("TranslateBatch = %v, %v; want %v", got, err, tt.want)
+			}
+		})
+	}
+}
+
+func TestSRTWriterKeepsChunkOrder(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "out.srt")
+	w, err := createSRTWriter(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	read := func() string {
+		data, err := os.ReadFile(path)
+		if err != nil {
+			t.Fatal(err)
+		}
+		return string(data)
+	}
+
+	if err := w.Add(2, []Segment{{Start: 20, End: 21, Text: "third"}}); err != nil {
+		t.Fatal(err)
+	}
+	if err := w.Add(1, nil); err != nil {
+		t.Fatal(err)
+	}
+	if got := read(); got != "" {
+		t.Fatalf("wrote %q before chunk 0", got)
+	}
+	if err := w.Add(0, []Segment{{Start: 1, End: 2, Text: "first"}, {Start: 3, End: 4, Text: " second "}}); err != nil {
+		t.Fatal(err)
+	}
+	if err := w.Close(); err != nil {
+		t.Fatal(err)
+	}
+	want := "1\n00:00:01,000 --> 00:00:02,000\nfirst\n\n" +
+		"2\n00:00:03,000 --> 00:00:04,000\nsecond\n\n" +
+		"3\n00:00:20,000 --> 00:00:21,000\nthird\n\n"
+	if got := read(); got != want {
+		t.Errorf("SRT =\n%s\nwant\n%s", got, want)
+	}
+}
@@ -0,0 +1,489 @@
+// mockcdn is a local stand-in for a video CDN, for load-testing the
+// downloaders against something that misbehaves on purpose: it can add
+// latency, cap bandwidth, refuse ranges, throttle, and drop responses.
+//
+//	mockcdn serve [flags]                  serve until interrupted
+//	mockcdn run [flags] -cmd "prog args"   time each command downloading a batch
+//
+// Every path is a file whose bytes are derived from its name, so any client
+// can be checked without storing anything. /s/<size>/<name> is a file of
+// that size (with k, m or g suffixes); any other path has -size bytes.
+package main
+
+import (
+	"bytes"
+	"crypto/ecdsa"
+	"crypto/elliptic"
+	"crypto/rand"
+	"crypto/sha256"
+	"crypto/tls"
+	"crypto/x509"
+	"crypto/x509/pkix"
+	"encoding/pem"
+	"errors"
+	"flag"
+	"fmt"
+	"io"
+	"math/big"
+	mrand "math/rand"
+	"net"
+	"net/http"
+	"os"
+	"os/exec"
+	"os/signal"
+	"path"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+type config struct {
+	size     int64
+	latency  time.Duration
+	jitter   time.Duration
+	rate     int64 // bytes per second per response
+	ranges   bool
+	fail     float64 // share of GETs answered 503
+	reset    float64 // share of GETs cut off halfway
+	throttle int     // concurrent GETs before 429, 0 for no limit
+	tls      bool
+	cert     string
+}
+
+func (c *config) register(fs *flag.FlagSet) {
+	fs.Func("size", "size of files not under /s/<size>/ (default 1m)", func(v string) error {
+		n, err := parseSize(v)
+		c.size = n
+		return err
+	})
+	fs.DurationVar(&c.latency, "latency", 0, "delay before each response")
+	fs.DurationVar(&c.jitter, "jitter", 0, "random extra delay, up to this much")
+	fs.Func("rate", "bandwidth cap per response in bytes per second, with k, m or g suffixes", func(v string) error {
+		n, err := parseSize(v)
+		c.rate = n
+		return err
+	})
+	fs.BoolVar(&c.ranges, "ranges", true, "honor Range requests")
+	fs.Float64Var(&c.fail, "fail", 0, "share of GETs answered 503 with Retry-After: 1")
+	fs.Float64Var(&c.reset, "reset", 0, "share of GETs whose body is cut off halfway")
+	fs.IntVar(&c.throttle, "throttle", 0, "concurrent GETs allowed before answering 429, 0 for no limit")
+	fs.BoolVar(&c.tls, "tls", false, "serve HTTPS, with HTTP/2, on a self-signed certificate")
+	fs.StringVar(&c.cert, "cert", "", "write the certificate here, for SSL_CERT_FILE (default a temporary file)")
+}
+
+// parseSize reads a byte count with an optional binary k, m or g suffix.
+func parseSize(v string) (int64, error) {
+	scale := int64(1)
+	switch strings.ToLower(v[len(v)-min(len(v), 1):]) {
+	case "k":
+		scale = 1 << 10
+	case "m":
+		scale = 1 << 20
+	case "g":
+		scale = 1 << 30
+	}
+	if scale != 1 {
+		v = v[:len(v)-1]
+	}
+	n, err := strconv.ParseInt(v, 10, 64)
+	if err != nil || n < 0 {
+		return 0, fmt.Errorf("invalid size %q", v)
+	}
+	return n * scale, nil
+}
+
+type stats struct {
+	requests atomic.Int64
+	conns    atomic.Int64
+	bytes    atomic.Int64
+	failed   atomic.Int64 // 503s, 429s and resets
+}
+
+type server struct {
+	cfg     config
+	stats   stats
+	active  atomic.Int64
+	modTime time.Time
+	rngMu   sync.Mutex
+	rng     *mrand.Rand
+}
+
+func newServer(cfg config) *server {
+	if cfg.size == 0 {
+		cfg.size = 1 << 20
+	}
+	return &server{cfg: cfg, modTime: time.Now().Truncate(time.Second), rng: mrand.New(mrand.NewSource(1))}
+}
+
+func (s *server) chance(p float64) bool {
+	if p <= 0 {
+		return false
+	}
+	s.rngMu.Lock()
+	defer s.rngMu.Unlock()
+	return s.rng.Float64() < p
+}
+
+func (s *server) delay() time.Duration {
+	d := s.cfg.latency
+	if s.cfg.jitter > 0 {
+		s.rngMu.Lock()
+		d += time.Duration(s.rng.Int63n(int64(s.cfg.jitter)))
+		s.rngMu.Unlock()
+	}
+	return d
+}
+
+// fileFor maps a request path to the file it names.
+func (s *server) fileFor(p string) (name string, size int64) {
+	if rest, ok := strings.CutPrefix(p, "/s/"); ok {
+		if sz, name, ok := strings.Cut(rest, "/"); ok {
+			if n, err := parseSize(sz); err == nil {
+				return name, n
+			}
+		}
+	}
+	return path.Base(p), s.cfg.size
+}
+
+func (s *server) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	s.stats.requests.Add(1)
+	if d := s.delay(); d > 0 {
+		time.Sleep(d)
+	}
+	name, size := s.fileFor(r.URL.Path)
+	if r.Method == http.MethodGet {
+		n := s.active.Add(1)
+		defer s.active.Add(-1)
+		if s.cfg.throttle > 0 && n > int64(s.cfg.throttle) {
+			s.stats.failed.Add(1)
+			w.Header().Set("Retry-After", "1")
+			http.Error(w, "slow down", http.StatusTooManyRequests)
+			return
+		}
+		if s.chance(s.cfg.fail) {
+			s.stats.failed.Add(1)
+			w.Header().Set("Retry-After", "1")
+			http.Error(w, "try again", http.StatusServiceUnavailable)
+			return
+		}
+	}
+	if !s.cfg.ranges {
+		r.Header.Del("Range")
+		r.Header.Del("If-Range")
+	} else {
+		w.Header().Set("Accept-Ranges", "bytes")
+	}
+	seed := seedFor(name)
+	w.Header().Set("Content-Type", "video/mp4")
+	w.Header().Set("ETag", fmt.Sprintf(`"%x-%d"`, seed[:8], size))
+
+	out := &shapedWriter{ResponseWriter: w, stats: &s.stats, rate: s.cfg.rate, cut: -1}
+	if r.Method == http.MethodGet && s.chance(s.cfg.reset) {
+		s.stats.failed.Add(1)
+		out.cut = size / 2
+	}
+	if !s.cfg.ranges {
+		// ServeContent would still answer ranges; a plain copy cannot.
+		w.Header().Set("Content-Length", strconv.FormatInt(size, 10))
+		w.Header().Set("Last-Modified", s.modTime.UTC().Format(http.TimeFormat))
+		if r.Method != http.MethodHead {
+			io.Copy(out, io.NewSectionReader(content{seed}, 0, size))
+		}
+		return
+	}
+	http.ServeContent(out, r, name, s.modTime, io.NewSectionReader(content{seed}, 0, size))
+}
+
+// shapedWriter paces a response body to rate and aborts it after cut bytes.
+type shapedWriter struct {
+	http.ResponseWriter
+	stats   *stats
+	rate    int64
+	cut     int64 // -1 for never
+	written int64
+	start   time.Time
+}
+
+func (w *shapedWriter) Write(p []byte) (int, error) {
+	if w.start.IsZero() {
+		w.start = time.Now()
+	}
+	total := 0
+	for len(p) > 0 {
+		chunk := p[:min(len(p), 16<<10)]
+		if w.cut >= 0 && w.written+int64(len(chunk)) > w.cut {
+			chunk = chunk[:w.cut-w.written]
+		}
+		n, err := w.ResponseWriter.Write(chunk)
+		w.written += int64(n)
+		w.stats.bytes.Add(int64(n))
+		total += n
+		if err != nil {
+			return total, err
+		}
+		if w.cut >= 0 && w.written >= w.cut {
+			if f, ok := w.ResponseWriter.(http.Flusher); ok {
+				f.Flush()
+			}
+			// Resets the HTTP/2 stream, or closes the HTTP/1.1 connection.
+			panic(http.ErrAbortHandler)
+		}
+		if w.rate > 0 {
+			due := w.start.Add(time.Duration(float64(w.written) / float64(w.rate) * float64(time.Second)))
+			if wait := time.Until(due); wait > 0 {
+				time.Sleep(wait)
+			}
+		}
+		p = p[n:]
+	}
+	return total, nil
+}
+
+// content is the endless byte stream of one file name: a SHA-256 of the
+// name, repeated with every 32-byte block salted by its index.
+type content struct {
+	seed [32]byte
+}
+
+func seedFor(name string) [32]byte { return sha256.Sum256([]byte(name)) }
+
+func (c content) ReadAt(p []byte, off int64) (int, error) {
+	for i := range p {
+		o := off + int64(i)
+		p[i] = c.seed[o%32] ^ byte(o/32)
+	}
+	return len(p), nil
+}
+
+// listen starts the server on addr and returns its base URL.
+func (s *server) listen(addr string) (string, func(), error) {
+	ln, err := net.Listen("tcp", addr)
+	if err != nil {
+		return "", nil, err
+	}
+	srv := &http.Server{Handler: s, ConnState: func(_ net.Conn, st http.ConnState) {
+		if st == http.StateNew {
+			s.stats.conns.Add(1)
+		}
+	}}
+	scheme := "http"
+	if s.cfg.tls {
+		cert, err := s.certificate()
+		if err != nil {
+			ln.Close()
+			return "", nil, err
+		}
+		srv.TLSConfig = &tls.Config{Certificates: []tls.Certificate{cert}, NextProtos: []string{"h2", "http/1.1"}}
+		ln = tls.NewListener(ln, srv.TLSConfig)
+		scheme = "https"
+	}
+	go srv.Serve(ln)
+	host := ln.Addr().String()
+	if s.cfg.tls {
+		// Certificates name localhost rather than an address.
+		_, port, _ := net.SplitHostPort(host)
+		host = net.JoinHostPort("localhost", port)
+	}
+	return scheme + "://" + host, func() { srv.Close() }, nil
+}
+
+// certificate makes a self-signed certificate for localhost and writes it
+// where clients can be pointed at it.
+func (s *server) certificate() (tls.Certificate, error) {
+	key, err := ecdsa.GenerateKey(elliptic.P256(), rand.Reader)
+	if err != nil {
+		return tls.Certificate{}, err
+	}
+	tmpl := &x509.Certificate{
+		SerialNumber: big.NewInt(1),
+		Subject:      pkix.Name{CommonName: "mockcdn"},
+		DNSNames:     []string{"localhost"},
+		IPAddresses:  []net.IP{net.IPv4(127, 0, 0, 1), net.IPv6loopback},
+		NotBefore:    time.Now().Add(-time.Hour),
+		NotAfter:     time.Now().Add(24 * time.Hour),
+		KeyUsage:     x509.KeyUsageDigitalSignature | x509.KeyUsageCertSign,
+		ExtKeyUsage:  []x509.ExtKeyUsage{x509.ExtKeyUsageServerAuth},
+		IsCA:         true,
+
+		BasicConstraintsValid: true,
+	}
+	der, err := x509.CreateCertificate(rand.Reader, tmpl, tmpl, &key.PublicKey, key)
+	if err != nil {
+		return tls.Certificate{}, err
+	}
+	if s.cfg.cert == "" {
+		f, err := os.CreateTemp("", "mockcdn-*.pem")
+		if err != nil {
+			return tls.Certificate{}, err
+		}
+		f.Close()
+		s.cfg.cert = f.Name()
+	}
+	if err := os.WriteFile(s.cfg.cert, pem.EncodeToMemory(&pem.Block{Type: "CERTIFICATE", Bytes: der}), 0o644); err != nil {
+		return tls.Certificate{}, err
+	}
+	return tls.Certificate{Certificate: [][]byte{der}, PrivateKey: key}, nil
+}
+
+func serve(args []string) error {
+	fs := flag.NewFlagSet("serve", flag.ExitOnError)
+	var cfg config
+	cfg.register(fs)
+	addr := fs.String("addr", "127.0.0.1:8080", "listen address")
+	fs.Parse(args)
+
+	s := newServer(cfg)
+	base, stop, err := s.listen(*addr)
+	if err != nil {
+		return err
+	}
+	defer stop()
+	fmt.Printf("serving %s/<name> and %s/s/<size>/<name>\n", base, base)
+	if s.cfg.tls {
+		fmt.Printf("certificate: %s\n", s.cfg.cert)
+	}
+
+	sig := make(chan os.Signal, 1)
+	signal.Notify(sig, os.Interrupt)
+	<-sig
+	fmt.Printf("\n%d requests, %d connections, %d bytes, %d failed on purpose\n", s.stats.requests.Load(),
+		s.stats.conns.Load(), s.stats.bytes.Load(), s.stats.failed.Load())
+	return nil
+}
+
+type commands []string
+
+func (c *commands) String() string     { return strings.Join(*c, ", ") }
+func (c *commands) Set(v string) error { *c = append(*c, v); return nil }
+
+// run times each command downloading the same batch from a fresh server,
+// feeding the URLs to its prompt and checking every file it leaves behind.
+func run(args []string) error {
+	fs := flag.NewFlagSet("run", flag.ExitOnError)
+	var cfg config
+	cfg.register(fs)
+	var cmds commands
+	fs.Var(&cmds, "cmd", "command to benchmark, run with -dir appended; repeat to compare")
+	files := fs.Int("n", 200, "files per batch")
+	runs := fs.Int("runs", 1, "batches per command")
+	verbose := fs.Bool("v", false, "pass the commands' output through")
+	fs.Parse(args)
+	if len(cmds) == 0 {
+		return errors.New("run: no -cmd given")
+	}
+
+	fmt.Printf("%-40s %9s %9s %9s %9s %9s %7s\n", "command", "ok", "seconds", "files/s", "MB/s", "requests", "conns")
+	for _, cmd := range cmds {
+		for i := 0; i < *runs; i++ {
+			if err := runOnce(cfg, cmd, *files, *verbose); err != nil {
+				return err
+			}
+		}
+	}
+	return nil
+}
+
+func runOnce(cfg config, cmd string, files int, verbose bool) error {
+	s := newServer(cfg)
+	base, stop, err := s.listen("127.0.0.1:0")
+	if err != nil {
+		return err
+	}
+	defer stop()
+	if s.cfg.tls {
+		defer os.Remove(s.cfg.cert)
+	}
+
+	dir, err := os.MkdirTemp("", "mockcdn-run-")
+	if err != nil {
+		return err
+	}
+	defer os.RemoveAll(dir)
+
+	var input bytes.Buffer
+	urls := make([]string, files)
+	for i := range urls {
+		urls[i] = fmt.Sprintf("%s/clip%d.mp4", base, i)
+		input.WriteString(urls[i] + "\n")
+	}
+	input.WriteString(":go\n:q\n")
+
+	argv := append(strings.Fields(cmd), "-dir", dir)
+	c := exec.Command(argv[0], argv[1:]...)
+	c.Stdin = &input
+	if verbose {
+		c.Stdout, c.Stderr = os.Stdout, os.Stderr
+	}
+	if s.cfg.tls {
+		c.Env = append(os.Environ(), "SSL_CERT_FILE="+s.cfg.cert)
+	}
+	start := time.Now()
+	runErr := c.Run()
+	elapsed := time.Since(start).Seconds()
+
+	ok := 0
+	var received int64
+	for i := range urls {
+		name := fmt.Sprintf("clip%d.mp4", i)
+		if n, good := check(filepath.Join(dir, name), name, s.cfg.size); good {
+			ok++
+			received += n
+		}
+	}
+	if runErr != nil && ok < files {
+		fmt.Fprintf(os.Stderr, "%s: %v\n", cmd, runErr)
+	}
+	label := strings.Join(append([]string{filepath.Base(argv[0])}, argv[1:len(argv)-2]...), " ")
+	if len(label) > 40 {
+		label = label[:37] + "..."
+	}
+	fmt.Printf("%-40s %4d/%-4d %9.2f %9.1f %9.1f %9d %7d\n", label, ok, files, elapsed, float64(ok)/elapsed,
+		float64(received)/elapsed/1e6, s.stats.requests.Load(), s.stats.conns.Load())
+	return nil
+}
+
+// check reports whether the file at p holds exactly the bytes served as name.
+func check(p, name string, size int64) (int64, bool) {
+	f, err := os.Open(p)
+	if err != nil {
+		return 0, false
+	}
+	defer f.Close()
+	want := io.NewSectionReader(content{seed: seedFor(name)}, 0, size)
+	got := make([]byte, 64<<10)
+	exp := make([]byte, len(got))
+	var off int64
+	for {
+		n, err := io.ReadFull(f, got)
+		if n > 0 {
+			if m, _ := io.ReadFull(want, exp[:n]); m != n || !bytes.Equal(got[:n], exp[:n]) {
+				return off, false
+			}
+			off += int64(n)
+		}
+		if err != nil {
+			return off, off == size
+		}
+	}
+}
+
+func main() {
+	if len(os.Args) < 2 || (os.Args[1] != "serve" && os.Args[1] != "run") {
+		fmt.Fprintln(os.Stderr, "usage: mockcdn serve|run [flags]")
+		os.Exit(2)
+	}
+	var err error
+	if os.Args[1] == "serve" {
+		err = serve(os.Args[2:])
+	} else {
+		err = run(os.Args[2:])
+	}
+	if err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(1)
+	}
+}
@@ -0,0 +1,103 @@
+package main
+
+import (
+	"context"
+	"fmt"
+	"math/rand"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+const (
+	// maxBudgetSlots bounds a budget read from a .slots file, since each
+	// slot is an open file in every process sharing it.
+	maxBudgetSlots = 1024
+	// budgetPoll is how often a download waiting on a full budget tries the
+	// slot files again, before jitter.
+	budgetPoll = 200 * time.Millisecond
+)
+
+// slotBudget is a concurrency budget shared with other processes through
+// a directory of slot files, <dir>/<name>.<i>, the layout the native build
+// and video-subtitle use: each running job holds one of them locked, and
+// the lock goes away with the process however it exits. The number of
+// slots is read from <dir>/<name>.slots when that holds a positive number.
+//
+// A nil *slotBudget admits everything.
+type slotBudget struct {
+	mu    sync.Mutex
+	slots []*os.File
+	held  []bool
+	next  int // where the next search starts
+}
+
+func openSlotBudget(dir, name string, defaultSlots int) (*slotBudget, error) {
+	if err := os.MkdirAll(dir, 0o755); err != nil {
+		return nil, err
+	}
+	n := max(defaultSlots, 1)
+	if data, err := os.ReadFile(filepath.Join(dir, name+".slots")); err == nil {
+		if v, err := strconv.Atoi(strings.TrimSpace(string(data))); err == nil && v > 0 {
+			n = min(v, maxBudgetSlots)
+		}
+	}
+	b := &slotBudget{held: make([]bool, n), next: os.Getpid() % n}
+	for i := 0; i < n; i++ {
+		f, err := os.OpenFile(filepath.Join(dir, fmt.Sprintf("%s.%d", name, i)), os.O_RDWR|os.O_CREATE, 0o644)
+		if err != nil {
+			for _, f := range b.slots {
+				f.Close()
+			}
+			return nil, err
+		}
+		b.slots = append(b.slots, f)
+	}
+	return b, nil
+}
+
+// acquire waits for a free slot, polling with jitter while every slot is
+// held, or for ctx to end. Call release once the job is done.
+func (b *slotBudget) acquire(ctx context.Context) (release func(), err error) {
+	if b == nil {
+		return func() {}, ctx.Err()
+	}
+	for {
+		if idx, ok := b.tryAcquire(); ok {
+			return func() { b.release(idx) }, nil
+		}
+		timer := time.NewTimer(budgetPoll + time.Duration(rand.Int63n(int64(budgetPoll))))
+		select {
+		case <-ctx.Done():
+			timer.Stop()
+			return nil, ctx.Err()
+		case <-timer.C:
+		}
+	}
+}
+
+func (b *slotBudget) tryAcquire() (int, bool) {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+	n := len(b.slots)
+	for i := 0; i < n; i++ {
+		idx := (b.next + i) % n
+		if b.held[idx] || !tryLockFile(b.slots[idx]) {
+			continue
+		}
+		b.held[idx] = true
+		b.next = (idx + 1) % n
+		return idx, true
+	}
+	return -1, false
+}
+
+func (b *slotBudget) release(idx int) {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+	unlockFile(b.slots[idx])
+	b.held[idx] = false
+}
@@ -2,11 +2,13 @@ package main
 
 import (
 	"bufio"
+	"context"
 	"flag"
 	"fmt"
 	"net/url"
 	"os"
 	"os/exec"
+	"os/signal"
 	"path/filepath"
 	"regexp"
 	"runtime"
@@ -25,7 +27,10 @@ var urlToken = regexp.MustCompile(`(https?://\S+|video\.twimg\.com/\S+)`)
 func main() {
 	destFlag := flag.String("dir", "~/Downloads/mobile/", "download directory")
 	workersFlag := flag.Int("workers", defaultWorkers(), "number of parallel downloads")
+	subtitleFlag := flag.String("subtitle", "", "fetch with this video-subtitle command instead of wget, subtitling each file while it downloads (e.g. \"video-subtitle --target-lang en\")")
+	budgetDirFlag := flag.String("budget-dir", os.Getenv("JOB_BUDGET_DIR"), "share download slots with other tools through this directory (default $JOB_BUDGET_DIR)")
 	flag.Parse()
+	subtitleCmd := strings.Fields(*subtitleFlag)
 
 	destDir, err := expandPath(*destFlag)
 	if err != nil {
@@ -38,6 +43,21 @@ func main() {
 		os.Exit(1)
 	}
 
+	var budget *slotBudget
+	if *budgetDirFlag != "" {
+		budgetDir, err := expandPath(*budgetDirFlag)
+		if err == nil {
+			budget, err = openSlotBudget(budgetDir, "download", *workersFlag)
+		}
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "download budget: %v; continuing without it\n", err)
+		} else {
+			// video-subtitle processes started by -subtitle share their
+			// transcription, translation and ffmpeg budgets there too.
+			os.Setenv("JOB_BUDGET_DIR", budgetDir)
+		}
+	}
+
 	reader := bufio.NewReader(os.Stdin)
 	for {
 		rawURLs, shouldQuit := promptURLs(reader)
@@ -58,10 +78,16 @@ func main() {
 		workerCount := clampWorkers(*workersFlag, len(urls))
 		fmt.Printf("Downloading %d file(s) to %s with %d worker(s)...\n", len(urls), destDir, workerCount)
 
-		results := downloadAll(urls, destDir, workerCount)
+		ctx, stop := interruptible()
+		results := downloadAll(ctx, urls, destDir, workerCount, budget, subtitleCmd)
+		interrupted := ctx.Err() != nil
+		stop()
 		report(results)
 
 		fmt.Println("Batch complete.\n")
+		if interrupted {
+			os.Exit(130)
+		}
 		if shouldQuit {
 			return
 		}
@@ -171,11 +197,45 @@ func cleanURL(raw string) (string, bool) {
 	return normalized, true
 }
 
-func downloadAll(urls []string, destDir string, workers int) []downloadResult {
+// interruptible returns a context that the first Ctrl-C cancels; a second
+// one kills the process as usual. Call stop once the batch is over.
+func interruptible() (ctx context.Context, stop func()) {
+	ctx, cancel := context.WithCancel(context.Background())
+	sig := make(chan os.Signal, 1)
+	signal.Notify(sig, os.Interrupt)
+	done := make(chan struct{})
+	go func() {
+		select {
+		case <-sig:
+			signal.Stop(sig)
+			fmt.Fprintln(os.Stderr, "\nInterrupted: finishing the downloads in flight; press Ctrl-C again to quit now.")
+			cancel()
+		case <-done:
+		}
+	}()
+	return ctx, func() {
+		signal.Stop(sig)
+		close(done)
+		cancel()
+	}
+}
+
+// downloadAll fetches urls on workers goroutines, each download holding a
+// slot of budget while it runs. Once ctx ends, URLs not yet started are
+// reported as cancelled and the ones running finish.
+func downloadAll(ctx context.Context, urls []string, destDir string, workers int, budget *slotBudget, subtitleCmd []string) []downloadResult {
+	fetch := func(u string) downloadResult {
+		release, err := budget.acquire(ctx)
+		if err != nil {
+			return downloadResult{URL: u, OK: false, Msg: "cancelled"}
+		}
+		defer release()
+		return downloadOne(u, destDir, subtitleCmd)
+	}
 	if workers <= 1 {
 		results := make([]downloadResult, 0, len(urls))
 		for _, u := range urls {
-			results = append(results, downloadOne(u, destDir))
+			results = append(results, fetch(u))
 		}
 		return results
 	}
@@ -191,7 +251,7 @@ func downloadAll(urls []string, destDir string, workers int) []downloadResult {
 		go func() {
 			defer wg.Done()
 			for u := range jobs {
-				results <- downloadOne(u, destDir)
+				results <- fetch(u)
 			}
 		}()
 	}
@@ -213,15 +273,23 @@ func downloadAll(urls []string, destDir string, workers int) []downloadResult {
 	return collected
 }
 
-func downloadOne(targetURL, destDir string) downloadResult {
+// downloadOne fetches targetURL with wget or, given subtitleCmd, hands it
+// to video-subtitle, which saves the file while it transcribes the audio
+// as it arrives and writes the SRT beside it.
+func downloadOne(targetURL, destDir string, subtitleCmd []string) downloadResult {
 	cmd := exec.Command("wget", "-c", "-P", destDir, targetURL)
+	if len(subtitleCmd) > 0 {
+		args := append(append([]string{}, subtitleCmd[1:]...), "--download-dir", destDir, targetURL)
+		cmd = exec.Command(subtitleCmd[0], args...)
+	}
 	output, err := cmd.CombinedOutput()
 	if err == nil {
 		return downloadResult{URL: targetURL, OK: true, Msg: "ok"}
 	}
 
 	if isNotFound(err) {
-		return downloadResult{URL: targetURL, OK: false, Msg: "wget not found; install wget and retry"}
+		tool := filepath.Base(cmd.Args[0])
+		return downloadResult{URL: targetURL, OK: false, Msg: fmt.Sprintf("%s not found; install %s and retry", tool, tool)}
 	}
 
 	msg := strings.TrimSpace(string(output))
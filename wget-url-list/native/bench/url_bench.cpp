@@ -0,0 +1,115 @@
+// url-bench measures the paste-handling path: finding URL tokens in pasted
+// text and normalizing them as cleanURL does.
+//
+//   ./url-bench --benchmark_filter=Clean
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "url.h"
+#include "url_batch.h"
+#include "url_scan.h"
+
+namespace {
+
+// A chat line of the kind pasted into the prompt, with the link at the end.
+const std::string kProse =
+    "thanks! here is the clip from yesterday, the second half is the good part, watch it before it's gone ";
+
+// pasted returns n lines of prose and URLs, a quarter of them repeats, in
+// the shapes seen in practice: plain CDN links, tagged ones whose query
+// needs rewriting, and bare video.twimg.com ones.
+std::vector<std::string> pasted(std::size_t n) {
+  std::vector<std::string> lines;
+  lines.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t id = i % 4 == 3 ? i / 2 : i;
+    switch (i % 3) {
+      case 0:
+        lines.push_back(kProse + "https://video.twimg.com/ext_tw_video/" + std::to_string(id) +
+                        "/pu/vid/avc1/1280x720/clip.mp4");
+        break;
+      case 1:
+        lines.push_back("<https://cdn.example.com/v/" + std::to_string(id) + ".mp4?tag=12&b=2&a=1#t=30>");
+        break;
+      default:
+        lines.push_back("video.twimg.com/amplify_video/" + std::to_string(id) + "/vid/clip.mp4?tag=16,");
+        break;
+    }
+  }
+  return lines;
+}
+
+void BM_FindURLToken(benchmark::State& state) {
+  std::string text;
+  while (text.size() < static_cast<std::size_t>(state.range(0))) {
+    text += kProse;
+  }
+  text += "https://video.twimg.com/ext_tw_video/1/pu/vid/clip.mp4";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(urldl::findURLToken(text));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(text.size()));
+}
+BENCHMARK(BM_FindURLToken)->Arg(128)->Arg(4096)->Arg(1 << 20);
+
+void BM_CleanURLSimple(benchmark::State& state) {
+  const std::string line = kProse + "https://video.twimg.com/ext_tw_video/1/pu/vid/avc1/1280x720/clip.mp4?a=1&b=2";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(urldl::cleanURL(line));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CleanURLSimple);
+
+// The query is out of order and escaped, so normalization takes the full
+// net/url port rather than the in-place fast path.
+void BM_CleanURLFull(benchmark::State& state) {
+  const std::string line = "https://cdn.example.com/v/a%20b.mp4?tag=12&z=%7E1&b=2&a=1#t=30";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(urldl::cleanURL(line));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CleanURLFull);
+
+void BM_GatherURLs(benchmark::State& state) {
+  const auto lines = pasted(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(urldl::gatherURLs(lines));
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_GatherURLs)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// The same paste cleaned into a UrlBatch arena, as the prompt does.
+void BM_UrlBatch(benchmark::State& state) {
+  const auto lines = pasted(static_cast<std::size_t>(state.range(0)));
+  urldl::UrlBatch batch;
+  for (auto _ : state) {
+    batch.clear();
+    for (const auto& line : lines) {
+      batch.add(line);
+    }
+    benchmark::DoNotOptimize(batch.size());
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_UrlBatch)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+void BM_ParseURL(benchmark::State& state) {
+  const std::string url = "https://video.twimg.com/ext_tw_video/1/pu/vid/avc1/1280x720/clip.mp4?a=1";
+  for (auto _ : state) {
+    auto parsed = urldl::parseURL(url);
+    benchmark::DoNotOptimize(parsed);
+    benchmark::DoNotOptimize(urldl::localFileName(*parsed));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseURL);
+
+}  // namespace
+
+BENCHMARK_MAIN();
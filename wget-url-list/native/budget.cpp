@@ -0,0 +1,99 @@
+#include "budget.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace urldl {
+
+namespace {
+
+// kMaxSlots bounds a budget read from a .slots file, since each slot is an
+// open descriptor in every process sharing it.
+constexpr int kMaxSlots = 1024;
+
+int configuredSlots(const std::string& path, int fallback) {
+  std::ifstream in(path);
+  int n = 0;
+  if (in >> n && n > 0) {
+    return n < kMaxSlots ? n : kMaxSlots;
+  }
+  return fallback;
+}
+
+}  // namespace
+
+SharedBudget::~SharedBudget() {
+  for (const Slot& slot : slots_) {
+    ::close(slot.fd);  // drops the lock, if held
+  }
+}
+
+bool SharedBudget::open(const std::string& dir, const std::string& name, int defaultSlots, std::string& err) {
+  if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    err = "mkdir " + dir + ": " + std::strerror(errno);
+    return false;
+  }
+  const int n = configuredSlots(dir + "/" + name + ".slots", defaultSlots < 1 ? 1 : defaultSlots);
+  std::vector<Slot> slots;
+  slots.reserve(static_cast<std::size_t>(n));
+  for (int i = 0; i < n; ++i) {
+    const std::string path = dir + "/" + name + "." + std::to_string(i);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      err = "open " + path + ": " + std::strerror(errno);
+      for (const Slot& slot : slots) {
+        ::close(slot.fd);
+      }
+      return false;
+    }
+    slots.push_back(Slot{fd, false});
+  }
+  slots_ = std::move(slots);
+  // Processes start their search at different slots, so they rarely try
+  // the same lock first.
+  next_ = static_cast<std::size_t>(::getpid()) % slots_.size();
+  return true;
+}
+
+bool SharedBudget::tryAcquire() {
+  for (std::size_t i = 0; i < slots_.size(); ++i) {
+    Slot& slot = slots_[(next_ + i) % slots_.size()];
+    if (slot.held) {
+      continue;
+    }
+    // Each slot is its own open file description, so the lock also keeps
+    // this process's other slots from taking it.
+    if (::flock(slot.fd, LOCK_EX | LOCK_NB) == 0) {
+      slot.held = true;
+      ++held_;
+      next_ = (next_ + i + 1) % slots_.size();
+      return true;
+    }
+  }
+  return false;
+}
+
+void SharedBudget::release() {
+  for (Slot& slot : slots_) {
+    if (slot.held) {
+      ::flock(slot.fd, LOCK_UN);
+      slot.held = false;
+      --held_;
+      return;
+    }
+  }
+}
+
+std::string budgetDir() {
+  const char* dir = std::getenv("JOB_BUDGET_DIR");
+  return dir != nullptr ? dir : "";
+}
+
+}  // namespace urldl
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace urldl {
+
+// SharedBudget caps how much of one kind of work runs at once across every
+// process on the machine that uses the same budget directory, whichever
+// tool it is. The budget is a set of slot files, <dir>/<name>.<i>; a unit
+// of work holds one of them locked with flock for as long as it runs, and
+// the kernel drops the lock when the process exits, however it exits.
+//
+// The number of slots is read from <dir>/<name>.slots when that file holds
+// a positive number, so every tool sharing the budget agrees on it; the
+// caller's default applies otherwise. The video-subtitle tool uses the
+// same layout. Not thread-safe: the owner serializes calls.
+class SharedBudget {
+ public:
+  SharedBudget() = default;
+  ~SharedBudget();
+  SharedBudget(const SharedBudget&) = delete;
+  SharedBudget& operator=(const SharedBudget&) = delete;
+
+  bool open(const std::string& dir, const std::string& name, int defaultSlots, std::string& err);
+  bool isOpen() const { return !slots_.empty(); }
+  int size() const { return static_cast<int>(slots_.size()); }
+  int held() const { return held_; }
+
+  // tryAcquire takes a free slot if there is one, without waiting.
+  bool tryAcquire();
+  // release gives back one slot taken by tryAcquire.
+  void release();
+
+ private:
+  struct Slot {
+    int fd = -1;
+    bool held = false;
+  };
+
+  std::vector<Slot> slots_;
+  std::size_t next_ = 0;  // where the next search starts, to spread the locks
+  int held_ = 0;
+};
+
+// budgetDir is the budget directory named by $JOB_BUDGET_DIR, or empty.
+std::string budgetDir();
+
+}  // namespace urldl
@@ -0,0 +1,253 @@
+#include "disk.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace urldl {
+
+namespace {
+
+constexpr std::size_t kStageBytes = 1 << 20;
+constexpr std::size_t kMaxPooledBuffers = 32;
+// kDropWindow is the unit in which drop-behind pushes written data to disk
+// and releases it from the page cache.
+constexpr std::int64_t kDropWindow = 8 << 20;
+
+// BufferRing recycles the aligned staging buffers of one loop thread.
+struct BufferRing {
+  std::vector<char*> free;
+
+  ~BufferRing() {
+    for (char* buf : free) {
+      std::free(buf);
+    }
+  }
+
+  char* take() {
+    if (!free.empty()) {
+      char* buf = free.back();
+      free.pop_back();
+      return buf;
+    }
+    void* buf = nullptr;
+    if (::posix_memalign(&buf, kDirectAlign, kStageBytes) != 0) {
+      return nullptr;
+    }
+    return static_cast<char*>(buf);
+  }
+
+  void give(char* buf) {
+    if (free.size() < kMaxPooledBuffers) {
+      free.push_back(buf);
+    } else {
+      std::free(buf);
+    }
+  }
+};
+
+thread_local BufferRing ring;
+
+bool pwriteFull(int fd, const char* data, std::size_t n, std::int64_t offset, std::string& err) {
+  while (n > 0) {
+    const ssize_t rc = ::pwrite(fd, data, n, static_cast<off_t>(offset));
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      err = std::string("write file: ") + std::strerror(errno);
+      return false;
+    }
+    data += rc;
+    n -= static_cast<std::size_t>(rc);
+    offset += rc;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::int64_t existingSize(const std::string& path) {
+  struct stat st {};
+  if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+  return static_cast<std::int64_t>(st.st_size);
+}
+
+DiskFile::~DiskFile() {
+  std::string err;
+  close(err);
+}
+
+bool DiskFile::open(const std::string& path, int flags, bool direct, std::string& err) {
+  fd_ = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    err = "open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  if (direct) {
+#if defined(O_DIRECT)
+    directFd_ = ::open(path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+#elif defined(F_NOCACHE)
+    directFd_ = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (directFd_ >= 0 && ::fcntl(directFd_, F_NOCACHE, 1) != 0) {
+      ::close(directFd_);
+      directFd_ = -1;
+    }
+#endif
+    dropBehind_ = directFd_ < 0;
+  }
+  return true;
+}
+
+bool DiskFile::close(std::string& err) {
+  bool ok = true;
+  if (directFd_ >= 0) {
+    ::close(directFd_);
+    directFd_ = -1;
+  }
+  if (fd_ >= 0) {
+    if (::close(fd_) != 0) {
+      err = std::string("close file: ") + std::strerror(errno);
+      ok = false;
+    }
+    fd_ = -1;
+  }
+  return ok;
+}
+
+bool DiskFile::preallocate(std::int64_t size, std::string& err) {
+#if defined(__linux__)
+  if (::fallocate(fd_, 0, 0, static_cast<off_t>(size)) == 0) {
+    return true;
+  }
+  if (errno != EOPNOTSUPP && errno != ENOSYS) {
+    err = std::string("allocate file: ") + std::strerror(errno);
+    return false;
+  }
+#endif
+  if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+    err = std::string("allocate file: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+RangeWriter::~RangeWriter() {
+  if (buf_ != nullptr) {
+    ring.give(buf_);
+  }
+}
+
+bool RangeWriter::write(const char* data, std::size_t n, std::string& err) {
+  if (!staging()) {
+    if (!pwriteFull(file_.fd(), data, n, written_, err)) {
+      return false;
+    }
+    written_ += static_cast<std::int64_t>(n);
+    dropWritten();
+    return true;
+  }
+
+  // Bytes up to the first block boundary go through the page cache so that
+  // everything staged starts aligned.
+  if (staged_ == 0 && written_ % static_cast<std::int64_t>(kDirectAlign) != 0) {
+    const std::size_t head =
+        std::min(n, kDirectAlign - static_cast<std::size_t>(written_ % static_cast<std::int64_t>(kDirectAlign)));
+    if (!pwriteFull(file_.fd(), data, head, written_, err)) {
+      return false;
+    }
+    written_ += static_cast<std::int64_t>(head);
+    data += head;
+    n -= head;
+  }
+  while (n > 0) {
+    if (buf_ == nullptr && (buf_ = ring.take()) == nullptr) {
+      err = "allocate write buffer: out of memory";
+      return false;
+    }
+    const std::size_t take = std::min(n, kStageBytes - staged_);
+    std::memcpy(buf_ + staged_, data, take);
+    staged_ += take;
+    data += take;
+    n -= take;
+    if (staged_ == kStageBytes && !writeDirect(kStageBytes, err)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RangeWriter::writeDirect(std::size_t len, std::string& err) {
+  if (!pwriteFull(file_.directFd(), buf_, len, written_, err)) {
+    return false;
+  }
+  written_ += static_cast<std::int64_t>(len);
+  staged_ -= len;
+  if (staged_ > 0) {
+    std::memmove(buf_, buf_ + len, staged_);
+  }
+  return true;
+}
+
+bool RangeWriter::flush(std::string& err) {
+  if (staged_ > 0) {
+    const std::size_t aligned = staged_ / kDirectAlign * kDirectAlign;
+    if (aligned > 0 && !writeDirect(aligned, err)) {
+      return false;
+    }
+    if (!pwriteFull(file_.fd(), buf_, staged_, written_, err)) {
+      return false;
+    }
+    written_ += static_cast<std::int64_t>(staged_);
+    staged_ = 0;
+  }
+  if (buf_ != nullptr) {
+    ring.give(buf_);
+    buf_ = nullptr;
+  }
+#if defined(__linux__)
+  if (file_.dropBehind() && written_ > dropped_) {
+    ::sync_file_range(file_.fd(), dropped_, written_ - dropped_,
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    ::posix_fadvise(file_.fd(), dropped_, written_ - dropped_, POSIX_FADV_DONTNEED);
+    flushed_ = dropped_ = written_;
+  }
+#endif
+  return true;
+}
+
+void RangeWriter::advance(std::size_t n) {
+  written_ += static_cast<std::int64_t>(n);
+  dropWritten();
+}
+
+// dropWritten starts writeback for each completed window and releases the
+// window before it, which has normally reached the disk by then, so a large
+// download never accumulates dirty pages.
+void RangeWriter::dropWritten() {
+#if defined(__linux__)
+  if (!file_.dropBehind()) {
+    return;
+  }
+  while (written_ - flushed_ >= kDropWindow) {
+    ::sync_file_range(file_.fd(), flushed_, kDropWindow, SYNC_FILE_RANGE_WRITE);
+    flushed_ += kDropWindow;
+    if (flushed_ - dropped_ > kDropWindow) {
+      ::sync_file_range(file_.fd(), dropped_, kDropWindow,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+      ::posix_fadvise(file_.fd(), dropped_, kDropWindow, POSIX_FADV_DONTNEED);
+      dropped_ += kDropWindow;
+    }
+  }
+#endif
+}
+
+}  // namespace urldl
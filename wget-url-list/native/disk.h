@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace urldl {
+
+// kDirectAlign is the offset and length granularity of O_DIRECT writes.
+constexpr std::size_t kDirectAlign = 4096;
+
+std::int64_t existingSize(const std::string& path);
+
+// DiskFile is the destination of one download. Opened with direct, it also
+// holds an O_DIRECT descriptor so block-aligned writes skip the page cache.
+// Where the filesystem refuses O_DIRECT, written ranges are flushed and
+// dropped from the cache instead, which keeps the cache clean at the cost of
+// a copy.
+class DiskFile {
+ public:
+  DiskFile() = default;
+  ~DiskFile();
+  DiskFile(const DiskFile&) = delete;
+  DiskFile& operator=(const DiskFile&) = delete;
+
+  bool open(const std::string& path, int flags, bool direct, std::string& err);
+  bool close(std::string& err);
+  // preallocate reserves size bytes so parallel ranges do not fragment the
+  // file. Filesystems without fallocate get a sparse file of that size.
+  bool preallocate(std::int64_t size, std::string& err);
+
+  bool isOpen() const { return fd_ >= 0; }
+  int fd() const { return fd_; }
+  int directFd() const { return directFd_; }
+  bool dropBehind() const { return dropBehind_; }
+
+ private:
+  int fd_ = -1;
+  int directFd_ = -1;
+  bool dropBehind_ = false;
+};
+
+// RangeWriter writes one sequential stream into a DiskFile from an offset.
+// For direct files it stages data in aligned buffers recycled per thread and
+// writes whole blocks; the unaligned edges of the range go through the page
+// cache.
+class RangeWriter {
+ public:
+  RangeWriter(DiskFile& file, std::int64_t offset)
+      : file_(file), written_(offset), flushed_(offset), dropped_(offset) {}
+  ~RangeWriter();
+  RangeWriter(const RangeWriter&) = delete;
+  RangeWriter& operator=(const RangeWriter&) = delete;
+
+  bool write(const char* data, std::size_t n, std::string& err);
+  // flush writes everything staged, including a partial block.
+  bool flush(std::string& err);
+  // advance accounts for n bytes the caller put in the file at offset() by
+  // other means, such as splice. Only valid while nothing is staged.
+  void advance(std::size_t n);
+
+  // staging reports whether writes are buffered; the stream cannot then be
+  // bypassed with advance().
+  bool staging() const { return file_.directFd() >= 0; }
+  // offset is where the next byte goes; durable is how much of the range
+  // is actually in the file.
+  std::int64_t offset() const { return written_ + static_cast<std::int64_t>(staged_); }
+  std::int64_t durable() const { return written_; }
+
+ private:
+  bool writeDirect(std::size_t len, std::string& err);
+  void dropWritten();
+
+  DiskFile& file_;
+  std::int64_t written_;  // end of what has been written
+  char* buf_ = nullptr;
+  std::size_t staged_ = 0;
+  // Drop-behind progress: writeback has been started up to flushed_ and the
+  // cache released up to dropped_.
+  std::int64_t flushed_;
+  std::int64_t dropped_;
+};
+
+}  // namespace urldl
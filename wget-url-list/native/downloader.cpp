@@ -0,0 +1,755 @@
+#include "downloader.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <thread>
+
+#include "event_loop.h"
+#include "file_download.h"
+#include "http.h"
+#include "transfer.h"
+
+namespace urldl {
+
+namespace {
+
+// A host's probes are split among its free slots, each batch pipelined on
+// one connection, with at most kMaxProbeBatch in a batch.
+constexpr std::size_t kMaxProbeBatch = 256;
+constexpr int kMaxProbeRedirects = 20;
+// A file the server keeps turning away with 429 or 503 is given up after
+// kMaxThrottleRetries tries. Without Retry-After the host's pause starts at
+// kThrottleBackoff and doubles per throttled answer; any pause is capped at
+// kMaxThrottlePause.
+constexpr int kMaxThrottleRetries = 5;
+constexpr std::chrono::seconds kThrottleBackoff{1};
+constexpr std::chrono::seconds kMaxThrottlePause{300};
+// A full shared budget is tried again after kBudgetPoll, plus up to as
+// much again at random so processes waiting on it do not retry in step.
+constexpr std::chrono::milliseconds kBudgetPoll{200};
+
+// jittered stretches d by a random fraction of up to spread.
+Clock::duration jittered(Clock::duration d, double spread) {
+  thread_local std::minstd_rand rng{std::random_device{}()};
+  std::uniform_real_distribution<double> frac(0, spread);
+  return d + std::chrono::duration_cast<Clock::duration>(d * frac(rng));
+}
+
+// completeOnDisk reports whether path is a regular file of exactly size
+// bytes with no partial download pending.
+bool completeOnDisk(const std::string& path, std::int64_t size) {
+  struct stat st {};
+  return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size == size &&
+         ::access(sidecarPath(path).c_str(), F_OK) != 0;
+}
+
+}  // namespace
+
+// Slots is the broker a download borrows extra transfer slots through.
+class Downloader::Slots : public SlotBroker {
+ public:
+  Slots(Downloader& owner, Loop& loop, std::size_t index, std::string origin)
+      : owner_(owner), loop_(loop), index_(index), origin_(std::move(origin)) {}
+
+  void advertise(std::int64_t stealable) override { owner_.advertise(index_, stealable); }
+  void release() override { owner_.releaseSlot(loop_, origin_); }
+
+ private:
+  Downloader& owner_;
+  Loop& loop_;
+  std::size_t index_;
+  std::string origin_;
+};
+
+struct Downloader::Loop {
+  struct Active {
+    std::unique_ptr<Slots> slots;  // outlives download, which refers to it
+    std::unique_ptr<FileDownload> download;
+  };
+
+  Loop(TlsContext& tls, DnsCache& dns, Shaper& shaper, Metrics& metrics, std::size_t maxIdle, bool http2)
+      : pool(maxIdle), h2(loop, shaper, http2), ctx{loop, pool, h2, tls, dns, shaper, metrics} {}
+
+  EventLoop loop;
+  ConnectionPool pool;
+  H2Pool h2;
+  LoopContext ctx;
+  // By URL index; loop thread only.
+  std::unordered_map<std::size_t, Active> jobs;
+  std::unordered_map<std::size_t, std::shared_ptr<ProbeBatch>> probes;  // by first job
+  std::atomic<int> active{0};  // slots in use, for balancing
+  std::thread thread;
+};
+
+Downloader::Downloader(DownloadOptions opts)
+    : opts_(std::move(opts)), tls_(opts_.http2), shaper_(opts_.rateLimit), dns_(std::make_shared<DnsCache>()) {
+  if (opts_.threads < 1) {
+    opts_.threads = 1;
+  }
+  if (opts_.maxActive < 1) {
+    opts_.maxActive = 1;
+  }
+  if (opts_.perHost < 1) {
+    opts_.perHost = 1;
+  }
+  if (opts_.segments < 1) {
+    opts_.segments = 1;
+  }
+  for (int i = 0; i < opts_.threads; ++i) {
+    auto loop = std::make_unique<Loop>(tls_, *dns_, shaper_, metrics_, static_cast<std::size_t>(opts_.perHost),
+                                       opts_.http2);
+    Loop* raw = loop.get();
+    raw->thread = std::thread([raw] { raw->loop.run(); });
+    loops_.push_back(std::move(loop));
+  }
+}
+
+Downloader::~Downloader() {
+  dns_->shutdown();
+  for (auto& loop : loops_) {
+    loop->loop.stop();
+    loop->thread.join();
+  }
+}
+
+std::vector<DownloadResult> Downloader::downloadAll(const std::vector<std::string_view>& urls) {
+  std::vector<DownloadResult> results(urls.size());
+  std::unique_lock<std::mutex> lock(mu_);
+  // Each job writes only its own entry, and the wait below orders those
+  // writes before the return.
+  resetLocked([&results](std::size_t index, DownloadResult result) { results[index] = std::move(result); },
+              std::numeric_limits<std::size_t>::max());
+  for (std::size_t i = 0; i < urls.size(); ++i) {
+    results[i].url = urls[i];
+    if (!enqueueLocked(nextIndex_++, urls[i], results[i])) {
+      countResult(results[i]);
+    }
+  }
+
+  bool revalidate = false;
+  for (const auto& [origin, host] : hosts_) {
+    for (const auto& job : host.waiting) {
+      revalidate = revalidate || job.known;
+    }
+  }
+  if (revalidate || needsProbeLocked()) {
+    for (auto& [origin, host] : hosts_) {
+      for (auto& job : host.waiting) {
+        job.probe = true;
+      }
+    }
+    pumpLocked();
+    idle_.wait(lock, [this] { return remaining_ == 0; });
+    // Jobs the probes settled have already reported.
+    remaining_ = queued_ = orderBySizeLocked();
+  }
+
+  pumpLocked();
+  idle_.wait(lock, [this] { return remaining_ == 0; });
+  return results;
+}
+
+void Downloader::beginStream(ResultFn onResult) {
+  std::lock_guard<std::mutex> lock(mu_);
+  resetLocked([onResult = std::move(onResult)](std::size_t, DownloadResult result) { onResult(std::move(result)); },
+              static_cast<std::size_t>(opts_.maxActive));
+  streaming_ = true;
+}
+
+void Downloader::submit(std::string_view url) {
+  DownloadResult result;
+  result.url = url;
+  Job rejected;
+  rejected.target = url;
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    room_.wait(lock, [this] { return queued_ < maxQueued_; });
+    rejected.index = nextIndex_++;
+    if (enqueueLocked(rejected.index, url, result)) {
+      pumpLocked();
+      return;
+    }
+  }
+  deliver(rejected, std::move(result));
+}
+
+void Downloader::endStream() {
+  std::unique_lock<std::mutex> lock(mu_);
+  idle_.wait(lock, [this] { return remaining_ == 0; });
+}
+
+void Downloader::resetLocked(SinkFn sink, std::size_t maxQueued) {
+  sink_ = std::move(sink);
+  maxQueued_ = maxQueued;
+  hosts_.clear();
+  hostOrder_.clear();
+  inFlight_.clear();
+  nextHost_ = 0;
+  remaining_ = 0;
+  queued_ = 0;
+  nextIndex_ = 0;
+  cancelled_ = false;
+  streaming_ = false;
+}
+
+// enqueueLocked adds a job for target. When there is nothing to run it
+// fills in result instead: already complete, or why it cannot be fetched.
+bool Downloader::enqueueLocked(std::size_t index, std::string_view target, DownloadResult& result) {
+  auto url = parseURL(target);
+  if (!url) {
+    result.outcome = Outcome::InvalidUrl;
+    return false;
+  }
+  IndexEntry entry;
+  const bool indexed = indexedComplete(target, *url, entry);
+  if (indexed && !opts_.revalidate) {
+    result.outcome = Outcome::AlreadyDownloaded;
+    return false;
+  }
+  if (!tls_.ok() || !loops_.front()->loop.ok()) {
+    result.outcome = Outcome::Startup;
+    result.detail = tls_.ok() ? "event loop: failed to initialize" : "tls: failed to initialize OpenSSL";
+    return false;
+  }
+  const std::string origin = url->origin();
+  auto [it, inserted] = hosts_.try_emplace(origin);
+  if (inserted) {
+    hostOrder_.push_back(origin);
+  }
+  Job& job = it->second.waiting.emplace_back();
+  job.index = index;
+  job.target = target;
+  job.url = std::move(*url);
+  if (indexed) {
+    job.known = std::move(entry);
+    // A stream has no probe phase; a file to revalidate gets its
+    // conditional HEAD on the way to its download all the same.
+    job.probe = streaming_;
+  }
+  ++remaining_;
+  ++queued_;
+  return true;
+}
+
+// indexedComplete reports whether the index lists target and its file is
+// still on disk at the recorded size, with no partial download pending.
+bool Downloader::indexedComplete(std::string_view target, const Url& url, IndexEntry& entry) const {
+  if (opts_.index == nullptr || !opts_.index->lookup(target, entry) || entry.size < 0) {
+    return false;
+  }
+  return completeOnDisk(opts_.destDir + "/" + localFileName(url), entry.size);
+}
+
+// needsProbeLocked reports whether some job would have to queue. Only then
+// does the order matter enough to pay for a HEAD per file.
+bool Downloader::needsProbeLocked() const {
+  std::size_t total = 0;
+  for (const auto& [origin, host] : hosts_) {
+    if (host.waiting.size() > static_cast<std::size_t>(opts_.perHost)) {
+      return true;
+    }
+    total += host.waiting.size();
+  }
+  return total > static_cast<std::size_t>(opts_.maxActive);
+}
+
+// orderBySizeLocked queues the probed jobs largest first and returns how
+// many there are. Files of unknown size keep their submission order after
+// the known ones.
+std::size_t Downloader::orderBySizeLocked() {
+  std::size_t jobs = 0;
+  for (auto& [origin, host] : hosts_) {
+    std::sort(host.probed.begin(), host.probed.end(), [](const Job& a, const Job& b) {
+      return a.size != b.size ? a.size > b.size : a.index < b.index;
+    });
+    host.waiting.assign(std::make_move_iterator(host.probed.begin()), std::make_move_iterator(host.probed.end()));
+    host.probed.clear();
+    jobs += host.waiting.size();
+  }
+  return jobs;
+}
+
+// pumpLocked hands out free slots: first to queued jobs, then to in-flight
+// downloads that can split off more work.
+void Downloader::pumpLocked() {
+  if (cancelled_) {
+    abortQueuedLocked();
+    return;
+  }
+  while (active_ < opts_.maxActive && startNextLocked()) {
+  }
+  while (active_ < opts_.maxActive && offerSlotLocked()) {
+  }
+  wakeLocked();
+}
+
+// wakeLocked makes sure pumpLocked runs again when the first host that is
+// only held back by a pause or by pacing may start its next job. Nothing
+// else would: no transfer of the host has to end for that to happen.
+void Downloader::wakeLocked() {
+  if (active_ >= opts_.maxActive) {
+    return;  // a finishing transfer pumps
+  }
+  const auto now = Clock::now();
+  auto when = Clock::time_point::max();
+  for (const auto& [origin, host] : hosts_) {
+    if (!host.waiting.empty() && host.active < opts_.perHost - host.withheld) {
+      const auto ready = std::max(host.resumeAt, host.nextStart);
+      if (ready > now) {
+        when = std::min(when, ready);
+      }
+    }
+  }
+  if (budgetRetryAt_ > now) {
+    when = std::min(when, budgetRetryAt_);
+  }
+  if (when == Clock::time_point::max() || (wakeAt_ > now && wakeAt_ <= when)) {
+    return;
+  }
+  wakeAt_ = when;
+  EventLoop& loop = loops_.front()->loop;
+  loop.post([this, &loop, when] {
+    loop.addTimer(when, [this, when] {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (wakeAt_ == when) {
+        wakeAt_ = Clock::time_point::max();
+      }
+      pumpLocked();
+    });
+  });
+}
+
+bool Downloader::hostReadyLocked(const HostQueue& host, Clock::time_point now) const {
+  return host.active < opts_.perHost - host.withheld && now >= host.resumeAt && now >= host.nextStart;
+}
+
+// paceLocked spaces the host's next start to keep it under hostRate.
+void Downloader::paceLocked(HostQueue& host, Clock::time_point now, std::size_t requests) {
+  if (opts_.hostRate > 0) {
+    const std::chrono::duration<double> spacing(static_cast<double>(requests) / opts_.hostRate);
+    host.nextStart = std::max(host.nextStart, now) + std::chrono::duration_cast<Clock::duration>(spacing);
+  }
+}
+
+// throttleLocked backs off a host that answered 429 or 503: half the
+// parallel transfers, and a pause before the next one. Each success
+// afterwards gives one slot back.
+void Downloader::throttleLocked(HostQueue& host, std::int64_t retryAfter) {
+  const int limit = std::max(1, (opts_.perHost - host.withheld) / 2);
+  host.withheld = opts_.perHost - limit;
+  Clock::duration pause = jittered(kThrottleBackoff * (1 << std::min(host.throttles, 8)), 0.25);
+  if (retryAfter >= 0) {
+    pause = std::chrono::seconds(retryAfter);
+  }
+  host.resumeAt = std::max(host.resumeAt, Clock::now() + std::min<Clock::duration>(pause, kMaxThrottlePause));
+  ++host.throttles;
+  metrics_.throttled.fetch_add(1, std::memory_order_relaxed);
+}
+
+// startNextLocked starts the largest queued job on a host with a free slot.
+// Ties, including every job while sizes are unknown, go round-robin across
+// hosts so one busy host cannot starve the others.
+bool Downloader::startNextLocked() {
+  const std::size_t hosts = hostOrder_.size();
+  const auto now = Clock::now();
+  HostQueue* best = nullptr;
+  std::size_t bestAt = 0;
+  for (std::size_t i = 0; i < hosts; ++i) {
+    const std::size_t at = (nextHost_ + i) % hosts;
+    HostQueue& host = hosts_[hostOrder_[at]];
+    if (host.waiting.empty() || !hostReadyLocked(host, now)) {
+      continue;
+    }
+    if (best == nullptr || host.waiting.front().size > best->waiting.front().size) {
+      best = &host;
+      bestAt = at;
+    }
+  }
+  if (best == nullptr || !acquireBudgetLocked()) {
+    return false;
+  }
+  nextHost_ = (bestAt + 1) % hosts;
+  Loop* target = &leastLoaded();
+  takeSlotLocked(*target, *best);
+
+  if (best->waiting.front().probe) {
+    // Probes pipeline, so the host's queue is shared out over its free
+    // slots instead of taking one slot per probe.
+    const std::size_t free = static_cast<std::size_t>(opts_.perHost - best->withheld - best->active + 1);
+    std::size_t take = std::min((best->waiting.size() + free - 1) / free, kMaxProbeBatch);
+    if (opts_.hostRate > 0) {
+      // A batch goes out at once, so under a rate cap it is a second's worth.
+      take = std::min(take, static_cast<std::size_t>(std::max(opts_.hostRate, 1.0)));
+    }
+    std::vector<Job> batch;
+    while (batch.size() < take && !best->waiting.empty() && best->waiting.front().probe) {
+      batch.push_back(std::move(best->waiting.front()));
+      best->waiting.pop_front();
+    }
+    paceLocked(*best, now, batch.size());
+    target->loop.post([this, target, batch = std::move(batch)] { startProbes(*target, batch); });
+    return true;
+  }
+
+  paceLocked(*best, now, 1);
+  Job job = std::move(best->waiting.front());
+  best->waiting.pop_front();
+  if (--queued_ < maxQueued_) {
+    room_.notify_one();
+  }
+  inFlight_[job.index] = InFlight{target, job.url.origin(), 0};
+  target->loop.post([this, target, job = std::move(job)] { startJob(*target, job); });
+  return true;
+}
+
+// offerSlotLocked lends a free slot to the in-flight download with the most
+// bytes to give away, on a host that has nothing else queued.
+bool Downloader::offerSlotLocked() {
+  const auto now = Clock::now();
+  InFlight* best = nullptr;
+  std::size_t bestIndex = 0;
+  for (auto& [index, job] : inFlight_) {
+    if (job.stealable <= 0 || (best != nullptr && job.stealable <= best->stealable)) {
+      continue;
+    }
+    const HostQueue& host = hosts_[job.origin];
+    if (host.waiting.empty() && hostReadyLocked(host, now)) {
+      best = &job;
+      bestIndex = index;
+    }
+  }
+  if (best == nullptr || !acquireBudgetLocked()) {
+    return false;
+  }
+  // The download is not offered another slot until it advertises again.
+  best->stealable = 0;
+  HostQueue& host = hosts_[best->origin];
+  paceLocked(host, now, 1);
+  takeSlotLocked(*best->loop, host);
+  Loop* target = best->loop;
+  target->loop.post([this, target, bestIndex, origin = best->origin] { offerSlot(*target, bestIndex, origin); });
+  return true;
+}
+
+Downloader::Loop& Downloader::leastLoaded() {
+  Loop* target = loops_.front().get();
+  for (auto& loop : loops_) {
+    if (loop->active.load(std::memory_order_relaxed) < target->active.load(std::memory_order_relaxed)) {
+      target = loop.get();
+    }
+  }
+  return *target;
+}
+
+void Downloader::takeSlotLocked(Loop& loop, HostQueue& host) {
+  ++host.active;
+  ++active_;
+  loop.active.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Downloader::freeSlotLocked(HostQueue& host) {
+  --host.active;
+  --active_;
+  if (opts_.budget != nullptr) {
+    opts_.budget->release();
+  }
+}
+
+// acquireBudgetLocked takes a slot of the shared budget for a transfer
+// about to start. When other processes hold them all, it returns false and
+// has wakeLocked try again shortly.
+bool Downloader::acquireBudgetLocked() {
+  if (opts_.budget == nullptr || opts_.budget->tryAcquire()) {
+    budgetRetryAt_ = Clock::time_point::max();
+    return true;
+  }
+  const auto now = Clock::now();
+  if (budgetRetryAt_ == Clock::time_point::max() || budgetRetryAt_ <= now) {
+    budgetRetryAt_ = now + jittered(kBudgetPoll, 1.0);
+  }
+  return false;
+}
+
+void Downloader::releaseSlot(Loop& loop, const std::string& origin) {
+  loop.active.fetch_sub(1, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(mu_);
+  freeSlotLocked(hosts_[origin]);
+  pumpLocked();
+}
+
+bool Downloader::cancel() {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (remaining_ == 0) {
+    return false;
+  }
+  cancelled_ = true;
+  pumpLocked();
+  return true;
+}
+
+// abortQueuedLocked takes every queued job off its host and has the first
+// loop report them Aborted, outside mu_.
+void Downloader::abortQueuedLocked() {
+  std::vector<Job> jobs;
+  for (auto& [origin, host] : hosts_) {
+    for (Job& job : host.waiting) {
+      jobs.push_back(std::move(job));
+    }
+    host.waiting.clear();
+  }
+  if (jobs.empty()) {
+    return;
+  }
+  queued_ -= std::min(queued_, jobs.size());
+  room_.notify_all();
+  loops_.front()->loop.post([this, jobs = std::move(jobs)] { abortJobs(jobs); });
+}
+
+void Downloader::abortJobs(const std::vector<Job>& jobs) {
+  for (const Job& job : jobs) {
+    DownloadResult result;
+    result.url = job.target;
+    result.outcome = Outcome::Aborted;
+    result.detail = "cancelled";
+    deliver(job, std::move(result));
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  remaining_ -= jobs.size();
+  if (remaining_ == 0) {
+    idle_.notify_all();
+  }
+}
+
+void Downloader::startProbes(Loop& loop, std::vector<Job> jobs) {
+  std::vector<ProbeRequest> requests;
+  requests.reserve(jobs.size());
+  for (const Job& job : jobs) {
+    ProbeRequest& req = requests.emplace_back(ProbeRequest{job.redirect ? *job.redirect : job.url, {}});
+    // The index keeps a strong ETag when the server sent one, else the date.
+    if (job.known && !job.known->validator.empty()) {
+      const std::string& validator = job.known->validator;
+      req.headers.push_back({validator.front() == '"' ? "If-None-Match" : "If-Modified-Since", validator});
+    }
+  }
+  const std::size_t key = jobs.front().index;
+  auto batch = std::make_shared<ProbeBatch>(
+      loop.ctx, std::move(requests), [this, &loop, key, jobs = std::move(jobs)](std::vector<ProbeResult> results) {
+        // The batch is still on the stack; free it once the loop unwinds.
+        loop.loop.post([&loop, key] { loop.probes.erase(key); });
+        finishProbes(loop, jobs, std::move(results));
+      });
+  loop.probes[key] = batch;
+  batch->start();
+}
+
+void Downloader::finishProbes(Loop& loop, std::vector<Job> jobs, std::vector<ProbeResult> results) {
+  loop.active.fetch_sub(1, std::memory_order_relaxed);
+  const std::string origin = jobs.front().redirect ? jobs.front().redirect->origin() : jobs.front().url.origin();
+
+  std::vector<Job> redirected;
+  std::vector<Job> probed;
+  std::size_t settled = 0;
+  bool throttled = false;
+  std::int64_t retryAfter = -1;
+  for (std::size_t i = 0; i < jobs.size(); ++i) {
+    Job& job = jobs[i];
+    const Response& resp = results[i].resp;
+    if (isThrottled(resp.status)) {
+      throttled = true;
+      retryAfter = std::max(retryAfter, retryAfterSeconds(resp));
+    }
+    const std::string* location = resp.header("Location");
+    if (results[i].err.empty() && isRedirect(resp.status) && location != nullptr &&
+        job.redirects < kMaxProbeRedirects) {
+      if (auto next = resolveReference(job.redirect ? *job.redirect : job.url, *location)) {
+        job.redirect = std::move(next);
+        ++job.redirects;
+        redirected.push_back(std::move(job));
+        continue;
+      }
+    }
+    DownloadResult result;
+    result.url = job.target;
+    if (settleProbe(job, results[i], result)) {
+      deliver(job, std::move(result));
+      ++settled;
+      continue;
+    }
+    job.probe = false;
+    job.redirect.reset();
+    probed.push_back(std::move(job));
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  freeSlotLocked(hosts_[origin]);
+  if (throttled) {
+    throttleLocked(hosts_[origin], retryAfter);
+  }
+  // A redirected probe queues again behind the probes of its new origin.
+  for (Job& job : redirected) {
+    const std::string next = job.redirect->origin();
+    auto [it, inserted] = hosts_.try_emplace(next);
+    if (inserted) {
+      hostOrder_.push_back(next);
+    }
+    it->second.waiting.push_back(std::move(job));
+  }
+  queued_ -= std::min(queued_, settled);
+  if (streaming_) {
+    // Back to the front of the queue they were submitted to, ahead of the
+    // URLs that came after them.
+    remaining_ -= settled;
+    for (auto it = probed.rbegin(); it != probed.rend(); ++it) {
+      hosts_[it->url.origin()].waiting.push_front(std::move(*it));
+    }
+  } else {
+    remaining_ -= settled + probed.size();
+    for (Job& job : probed) {
+      hosts_[job.url.origin()].probed.push_back(std::move(job));
+    }
+  }
+  room_.notify_all();
+  pumpLocked();
+  if (remaining_ == 0) {
+    idle_.notify_all();
+  }
+}
+
+// settleProbe reads a probe's answer. It returns true with result filled in
+// when the file needs no download at all: the server confirmed the indexed
+// copy, or the file on disk is already as large as the server's. Otherwise
+// it sets the job's size, and whether the download must start over.
+bool Downloader::settleProbe(Job& job, const ProbeResult& probe, DownloadResult& result) const {
+  const Response& resp = probe.resp;
+  if (!probe.err.empty() || (resp.status != 200 && resp.status != 304)) {
+    return false;  // the download itself reports what is wrong
+  }
+  const std::string path = opts_.destDir + "/" + localFileName(job.url);
+  if (job.known) {
+    if (resp.status == 304 || (resp.contentLength == job.known->size && validatorFor(resp) == job.known->validator)) {
+      result.outcome = Outcome::NotModified;
+      result.size = job.known->size;
+      result.validator = job.known->validator;
+      return true;
+    }
+    job.restart = true;
+    job.size = resp.status == 200 ? resp.contentLength : -1;
+    return false;
+  }
+  if (resp.status != 200 || resp.contentLength < 0) {
+    return false;
+  }
+  if (resp.contentLength > 0 && completeOnDisk(path, resp.contentLength)) {
+    result.outcome = Outcome::AlreadyComplete;
+    result.size = resp.contentLength;
+    result.validator = validatorFor(resp);
+    return true;
+  }
+  job.size = bytesLeft(path, resp.contentLength);
+  return false;
+}
+
+void Downloader::startJob(Loop& loop, const Job& job) {
+  const std::string path = opts_.destDir + "/" + localFileName(job.url);
+  Loop::Active& active = loop.jobs[job.index];
+  active.slots = std::make_unique<Slots>(*this, loop, job.index, job.url.origin());
+  FileOptions fileOpts;
+  fileOpts.maxSegments = opts_.segments;
+  fileOpts.direct = opts_.direct;
+  fileOpts.restart = job.restart;
+  active.download = std::make_unique<FileDownload>(
+      loop.ctx, *active.slots, job.target, job.url, path, fileOpts,
+      [this, &loop, job](DownloadResult result) { finishJob(loop, job, std::move(result)); });
+  active.download->start();
+}
+
+void Downloader::offerSlot(Loop& loop, std::size_t index, const std::string& origin) {
+  auto it = loop.jobs.find(index);
+  if (it == loop.jobs.end()) {
+    releaseSlot(loop, origin);
+    return;
+  }
+  it->second.download->offerSlot();
+}
+
+void Downloader::advertise(std::size_t index, std::int64_t stealable) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = inFlight_.find(index);
+  if (it == inFlight_.end()) {
+    return;
+  }
+  it->second.stealable = stealable;
+  if (stealable > 0) {
+    pumpLocked();
+  }
+}
+
+void Downloader::finishJob(Loop& loop, const Job& job, DownloadResult result) {
+  // The download is still on the stack; free it once the loop unwinds.
+  loop.loop.post([&loop, index = job.index] { loop.jobs.erase(index); });
+  loop.active.fetch_sub(1, std::memory_order_relaxed);
+  if (result.throttled && job.throttled < kMaxThrottleRetries) {
+    // Back to the front of its host's queue, to start once the host's pause
+    // is over; what it got so far is kept like any interrupted download.
+    std::lock_guard<std::mutex> lock(mu_);
+    inFlight_.erase(job.index);
+    HostQueue& host = hosts_[job.url.origin()];
+    freeSlotLocked(host);
+    throttleLocked(host, result.retryAfter);
+    Job& retry = host.waiting.emplace_front(job);
+    ++retry.throttled;
+    ++queued_;
+    pumpLocked();
+    return;
+  }
+  if (result.throttled) {
+    result.detail = result.message() + " (gave up after " + std::to_string(job.throttled + 1) + " tries)";
+  }
+  const bool ok = result.ok();
+  // Before remaining_ drops, so the batch cannot end with a result pending.
+  deliver(job, std::move(result));
+
+  std::lock_guard<std::mutex> lock(mu_);
+  inFlight_.erase(job.index);
+  HostQueue& host = hosts_[job.url.origin()];
+  freeSlotLocked(host);
+  if (ok) {
+    host.throttles = 0;
+    host.withheld = std::max(host.withheld - 1, 0);
+  }
+  pumpLocked();
+  if (--remaining_ == 0) {
+    idle_.notify_all();
+  }
+}
+
+// deliver records a successful result in the index and passes it on. It
+// runs outside mu_.
+void Downloader::deliver(const Job& job, DownloadResult result) {
+  countResult(result);
+  if (opts_.index != nullptr && result.ok() && result.size >= 0) {
+    // A file found complete by a resumed GET comes back without a
+    // validator; an empty one never replaces what the index holds.
+    IndexEntry known;
+    if (result.validator.empty() && opts_.index->lookup(job.target, known)) {
+      result.validator = std::move(known.validator);
+    }
+    std::string err;
+    opts_.index->record(job.target, IndexEntry{result.size, result.validator}, err);
+  }
+  sink_(job.index, std::move(result));
+}
+
+// countResult adds a finished URL to the file counts, whether it was
+// downloaded or settled before it could be queued.
+void Downloader::countResult(const DownloadResult& result) {
+  (result.ok() ? metrics_.filesOk : metrics_.filesFailed).fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace urldl
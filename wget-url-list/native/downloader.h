@@ -0,0 +1,200 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "budget.h"
+#include "file_download.h"
+#include "metrics.h"
+#include "net.h"
+#include "probe.h"
+#include "shaper.h"
+#include "url.h"
+#include "url_index.h"
+
+namespace urldl {
+
+struct DownloadOptions {
+  std::string destDir;
+  int threads = 1;      // event loop threads
+  int maxActive = 256;  // transfers in flight across all hosts
+  int perHost = 8;      // transfers in flight per origin
+  int segments = 4;     // parallel ranges per large file; 1 disables splitting
+  bool direct = false;  // write with O_DIRECT, bypassing the page cache
+  // index remembers completed downloads across runs; a URL it lists whose
+  // file is still there at that size is skipped. Optional; must outlive
+  // the Downloader.
+  UrlIndex* index = nullptr;
+  // revalidate asks the server about those files instead of trusting the
+  // index: a conditional HEAD, and the file is only fetched again if it
+  // changed.
+  bool revalidate = false;
+  // http2 offers HTTP/2 to HTTPS servers; those that take it carry all of
+  // an origin's transfers as streams of one connection per loop.
+  bool http2 = true;
+  // rateLimit caps the combined download rate in bytes per second; 0 is
+  // unlimited.
+  std::int64_t rateLimit = 0;
+  // hostRate caps the requests started per second on each origin; 0 is
+  // unlimited. Servers that answer 429 or 503 get fewer parallel transfers
+  // and a pause, as long as Retry-After asks, whatever the settings.
+  double hostRate = 0;
+  // budget, when set, is a slot budget shared with other processes; every
+  // transfer slot also holds one of its slots, so several tools running at
+  // once stay within one combined limit. Optional; must outlive the
+  // Downloader.
+  SharedBudget* budget = nullptr;
+};
+
+// Downloader fetches URLs into destDir with wget -c semantics: an existing
+// partial file is continued with a Range request, a server that ignores the
+// range restarts it from scratch, and 416 on a non-empty file means the file
+// is already complete. When the batch is larger than the slots available,
+// HEAD probes, pipelined per host, order it largest file first and skip
+// files that are already complete; large files are fetched as
+// parallel ranges that idle slots can steal from (see FileDownload).
+// Transfers are multiplexed over a few event loop threads; each loop keeps
+// its own keep-alive pool and HTTP/2 sessions, while TLS sessions and DNS
+// answers are shared by all of them.
+class Downloader {
+ public:
+  explicit Downloader(DownloadOptions opts);
+  ~Downloader();
+  Downloader(const Downloader&) = delete;
+  Downloader& operator=(const Downloader&) = delete;
+
+  // downloadAll blocks until every URL has finished. Results are in the
+  // order of urls.
+  // The strings urls point to must outlive the results.
+  std::vector<DownloadResult> downloadAll(const std::vector<std::string_view>& urls);
+
+  // ResultFn receives one finished download. It runs on loop threads, or
+  // inside submit() for a URL that cannot be queued, possibly concurrently.
+  using ResultFn = std::function<void(DownloadResult)>;
+
+  // beginStream starts a batch whose URLs arrive one at a time. There is no
+  // size probe: jobs start in submission order as slots free up. With
+  // revalidate, an indexed file still gets its conditional HEAD first.
+  void beginStream(ResultFn onResult);
+  // submit queues one URL of the stream. It blocks while maxActive URLs are
+  // already waiting, so a producer faster than the network is held back
+  // instead of buffered. url must stay valid until its result is delivered.
+  void submit(std::string_view url);
+  // endStream waits until every submitted URL has finished.
+  void endStream();
+
+  // cancel stops the batch in progress from starting anything more: URLs
+  // still queued, and any submitted later in a stream, finish as Aborted,
+  // while transfers already running go on to the end and keep what they fetched
+  // resumable. It returns false when no batch is running. Safe to call from
+  // any thread; the next batch starts uncancelled.
+  bool cancel();
+
+  // metrics counts everything the Downloader has done so far; it may be read
+  // from any thread at any time.
+  const Metrics& metrics() const { return metrics_; }
+
+ private:
+  struct Loop;
+  class Slots;
+  using SinkFn = std::function<void(std::size_t index, DownloadResult result)>;
+  struct Job {
+    std::size_t index = 0;
+    std::string_view target;  // as submitted, owned by the caller
+    Url url;
+    bool probe = false;
+    std::int64_t size = -1;  // bytes still to fetch, from the probe; -1 if unknown
+    std::optional<IndexEntry> known;  // index entry of a file to revalidate
+    bool restart = false;             // the server's copy changed; fetch it all again
+    std::optional<Url> redirect;      // where the probe was sent on to
+    int redirects = 0;
+    int throttled = 0;  // times the server turned it away with 429 or 503
+  };
+  struct HostQueue {
+    std::deque<Job> waiting;
+    std::vector<Job> probed;
+    int active = 0;    // transfer slots in use
+    int withheld = 0;  // of perHost, while the server throttles us
+    int throttles = 0;  // 429 or 503 answers since the last success
+    Clock::time_point resumeAt{};   // nothing starts before then
+    Clock::time_point nextStart{};  // pacing for hostRate
+  };
+  // InFlight is a running download that can put extra slots to use.
+  struct InFlight {
+    Loop* loop = nullptr;
+    std::string origin;
+    std::int64_t stealable = 0;
+  };
+
+  void resetLocked(SinkFn sink, std::size_t maxQueued);
+  bool enqueueLocked(std::size_t index, std::string_view target, DownloadResult& result);
+  bool indexedComplete(std::string_view target, const Url& url, IndexEntry& entry) const;
+  bool needsProbeLocked() const;
+  std::size_t orderBySizeLocked();
+  void pumpLocked();
+  bool startNextLocked();
+  bool offerSlotLocked();
+  Loop& leastLoaded();
+  void takeSlotLocked(Loop& loop, HostQueue& host);
+  void freeSlotLocked(HostQueue& host);
+  bool acquireBudgetLocked();
+  void abortQueuedLocked();
+  void abortJobs(const std::vector<Job>& jobs);
+  bool hostReadyLocked(const HostQueue& host, Clock::time_point now) const;
+  void paceLocked(HostQueue& host, Clock::time_point now, std::size_t requests);
+  void throttleLocked(HostQueue& host, std::int64_t retryAfter);
+  void wakeLocked();
+  void startProbes(Loop& loop, std::vector<Job> jobs);
+  void finishProbes(Loop& loop, std::vector<Job> jobs, std::vector<ProbeResult> results);
+  bool settleProbe(Job& job, const ProbeResult& probe, DownloadResult& result) const;
+  void deliver(const Job& job, DownloadResult result);
+  void countResult(const DownloadResult& result);
+  void startJob(Loop& loop, const Job& job);
+  void finishJob(Loop& loop, const Job& job, DownloadResult result);
+  void offerSlot(Loop& loop, std::size_t index, const std::string& origin);
+  void advertise(std::size_t index, std::int64_t stealable);
+  void releaseSlot(Loop& loop, const std::string& origin);
+
+  DownloadOptions opts_;
+  TlsContext tls_;
+  Shaper shaper_;
+  Metrics metrics_;
+  std::shared_ptr<DnsCache> dns_;
+  std::vector<std::unique_ptr<Loop>> loops_;
+
+  // Scheduling state, guarded by mu_. Every transfer holds one slot, counted
+  // per origin and globally. Queued jobs go largest first; once no job is
+  // waiting, free slots are lent to the in-flight files with the most bytes
+  // left to split off.
+  std::mutex mu_;
+  std::condition_variable idle_;
+  std::condition_variable room_;  // queued_ dropped below maxQueued_
+  SinkFn sink_;  // set per batch; called outside mu_
+  std::unordered_map<std::string, HostQueue> hosts_;
+  std::vector<std::string> hostOrder_;
+  std::unordered_map<std::size_t, InFlight> inFlight_;
+  std::size_t nextHost_ = 0;
+  int active_ = 0;
+  std::size_t remaining_ = 0;
+  std::size_t queued_ = 0;  // jobs waiting across all hosts
+  std::size_t maxQueued_ = std::numeric_limits<std::size_t>::max();
+  std::size_t nextIndex_ = 0;
+  Clock::time_point wakeAt_ = Clock::time_point::max();  // pending pumpLocked for a paused host
+  // When the shared budget was last found full, the time to try it again.
+  Clock::time_point budgetRetryAt_ = Clock::time_point::max();
+  bool cancelled_ = false;
+  bool streaming_ = false;  // the batch is a stream: probed jobs requeue one by one
+};
+
+}  // namespace urldl
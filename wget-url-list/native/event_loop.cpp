@@ -0,0 +1,274 @@
+#include "event_loop.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+namespace urldl {
+
+namespace {
+
+constexpr int kMaxEvents = 256;
+// kMaxWaitMillis bounds a wait so a loop with nothing but a far-off timer
+// still notices stop() promptly even if a wakeup write was lost.
+constexpr int kMaxWaitMillis = 1000;
+
+}  // namespace
+
+EventLoop::EventLoop() {
+#if defined(__linux__)
+  poller_ = ::epoll_create1(EPOLL_CLOEXEC);
+  wakeRead_ = wakeWrite_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (poller_ >= 0 && wakeRead_ >= 0) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeRead_;
+    ::epoll_ctl(poller_, EPOLL_CTL_ADD, wakeRead_, &ev);
+  }
+#else
+  poller_ = ::kqueue();
+  int fds[2];
+  if (::pipe(fds) == 0) {
+    wakeRead_ = fds[0];
+    wakeWrite_ = fds[1];
+    for (int fd : fds) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+  if (poller_ >= 0 && wakeRead_ >= 0) {
+    struct kevent ev;
+    EV_SET(&ev, wakeRead_, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+    ::kevent(poller_, &ev, 1, nullptr, 0, nullptr);
+  }
+#endif
+  if (wakeRead_ < 0 && poller_ >= 0) {
+    ::close(poller_);
+    poller_ = -1;
+  }
+}
+
+EventLoop::~EventLoop() {
+  if (wakeWrite_ >= 0 && wakeWrite_ != wakeRead_) {
+    ::close(wakeWrite_);
+  }
+  if (wakeRead_ >= 0) {
+    ::close(wakeRead_);
+  }
+  if (poller_ >= 0) {
+    ::close(poller_);
+  }
+}
+
+void EventLoop::watch(int fd, Handler* handler, bool read, bool write) {
+  auto [it, inserted] = watches_.try_emplace(fd);
+  Watch& w = it->second;
+  const bool wasRead = !inserted && w.read;
+  const bool wasWrite = !inserted && w.write;
+  w.handler = handler;
+  w.read = read;
+  w.write = write;
+  if (!inserted && wasRead == read && wasWrite == write) {
+    return;
+  }
+#if defined(__linux__)
+  epoll_event ev{};
+  ev.events = (read ? EPOLLIN : 0u) | (write ? EPOLLOUT : 0u) | EPOLLRDHUP;
+  ev.data.fd = fd;
+  ::epoll_ctl(poller_, inserted ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+#else
+  struct kevent changes[2];
+  int n = 0;
+  if (inserted || wasRead != read) {
+    EV_SET(&changes[n++], fd, EVFILT_READ, read ? EV_ADD | EV_ENABLE : EV_ADD | EV_DISABLE, 0, 0, nullptr);
+  }
+  if (inserted || wasWrite != write) {
+    EV_SET(&changes[n++], fd, EVFILT_WRITE, write ? EV_ADD | EV_ENABLE : EV_ADD | EV_DISABLE, 0, 0, nullptr);
+  }
+  ::kevent(poller_, changes, n, nullptr, 0, nullptr);
+#endif
+}
+
+void EventLoop::unwatch(int fd) {
+  if (watches_.erase(fd) == 0) {
+    return;
+  }
+#if defined(__linux__)
+  ::epoll_ctl(poller_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+  struct kevent changes[2];
+  EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+  EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+  ::kevent(poller_, changes, 2, nullptr, 0, nullptr);
+#endif
+}
+
+EventLoop::TimerId EventLoop::addTimer(Clock::time_point when, std::function<void()> fn) {
+  const TimerId id = nextTimer_++;
+  timers_.emplace(id, std::make_pair(when, std::move(fn)));
+  timerQueue_.emplace(when, id);
+  return id;
+}
+
+void EventLoop::cancelTimer(TimerId id) {
+  auto it = timers_.find(id);
+  if (it == timers_.end()) {
+    return;
+  }
+  auto range = timerQueue_.equal_range(it->second.first);
+  for (auto q = range.first; q != range.second; ++q) {
+    if (q->second == id) {
+      timerQueue_.erase(q);
+      break;
+    }
+  }
+  timers_.erase(it);
+}
+
+void EventLoop::post(std::function<void()> fn) {
+  bool first = false;
+  {
+    std::lock_guard<std::mutex> lock(postMu_);
+    first = posted_.empty();
+    posted_.push_back(std::move(fn));
+  }
+  if (first) {
+    wake();
+  }
+}
+
+void EventLoop::stop() {
+  {
+    std::lock_guard<std::mutex> lock(postMu_);
+    stopRequested_ = true;
+  }
+  wake();
+}
+
+void EventLoop::wake() {
+#if defined(__linux__)
+  const std::uint64_t one = 1;
+  [[maybe_unused]] auto rc = ::write(wakeWrite_, &one, sizeof(one));
+#else
+  const char one = 1;
+  [[maybe_unused]] auto rc = ::write(wakeWrite_, &one, 1);
+#endif
+}
+
+void EventLoop::drainWakeups() {
+  char buf[64];
+  while (::read(wakeRead_, buf, sizeof(buf)) > 0) {
+  }
+}
+
+int EventLoop::nextTimeoutMillis() {
+  {
+    std::lock_guard<std::mutex> lock(postMu_);
+    if (!posted_.empty() || stopRequested_) {
+      return 0;
+    }
+  }
+  if (timerQueue_.empty()) {
+    return kMaxWaitMillis;
+  }
+  const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(timerQueue_.begin()->first - Clock::now());
+  if (left.count() <= 0) {
+    return 0;
+  }
+  return left.count() > kMaxWaitMillis ? kMaxWaitMillis : static_cast<int>(left.count()) + 1;
+}
+
+void EventLoop::runTimers() {
+  const auto now = Clock::now();
+  while (!timerQueue_.empty() && timerQueue_.begin()->first <= now) {
+    const TimerId id = timerQueue_.begin()->second;
+    timerQueue_.erase(timerQueue_.begin());
+    auto it = timers_.find(id);
+    if (it == timers_.end()) {
+      continue;
+    }
+    auto fn = std::move(it->second.second);
+    timers_.erase(it);
+    fn();
+  }
+}
+
+void EventLoop::runPosted() {
+  std::vector<std::function<void()>> batch;
+  {
+    std::lock_guard<std::mutex> lock(postMu_);
+    batch.swap(posted_);
+  }
+  for (auto& fn : batch) {
+    fn();
+  }
+}
+
+void EventLoop::run() {
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(postMu_);
+      if (stopRequested_) {
+        stopRequested_ = false;
+        break;
+      }
+    }
+    const int timeout = nextTimeoutMillis();
+
+#if defined(__linux__)
+    epoll_event events[kMaxEvents];
+    const int n = ::epoll_wait(poller_, events, kMaxEvents, timeout);
+    for (int i = 0; i < n; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == wakeRead_) {
+        drainWakeups();
+        continue;
+      }
+      auto it = watches_.find(fd);
+      if (it == watches_.end()) {
+        continue;  // unwatched by an earlier handler in this batch
+      }
+      const std::uint32_t e = events[i].events;
+      const bool failed = (e & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0;
+      // Errors are reported as readiness so the handler's next I/O call
+      // surfaces the actual failure.
+      it->second.handler->onEvent((e & EPOLLIN) != 0 || failed, (e & EPOLLOUT) != 0 || failed);
+    }
+#else
+    struct kevent events[kMaxEvents];
+    timespec ts{timeout / 1000, static_cast<long>(timeout % 1000) * 1000000L};
+    const int n = ::kevent(poller_, nullptr, 0, events, kMaxEvents, &ts);
+    for (int i = 0; i < n; ++i) {
+      const int fd = static_cast<int>(events[i].ident);
+      if (fd == wakeRead_) {
+        drainWakeups();
+        continue;
+      }
+      auto it = watches_.find(fd);
+      if (it == watches_.end()) {
+        continue;
+      }
+      const bool failed = (events[i].flags & (EV_EOF | EV_ERROR)) != 0;
+      const bool readable = events[i].filter == EVFILT_READ || failed;
+      const bool writable = events[i].filter == EVFILT_WRITE || failed;
+      it->second.handler->onEvent(readable, writable);
+    }
+#endif
+    if (n < 0 && errno != EINTR) {
+      break;
+    }
+    runTimers();
+    runPosted();
+  }
+}
+
+}  // namespace urldl
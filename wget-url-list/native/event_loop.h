@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace urldl {
+
+using Clock = std::chrono::steady_clock;
+
+// EventLoop is a single-threaded readiness loop over epoll (Linux) or kqueue
+// (macOS/BSD). Everything registered with a loop must only be touched from
+// the loop's thread; other threads hand work over with post().
+class EventLoop {
+ public:
+  class Handler {
+   public:
+    virtual ~Handler() = default;
+    virtual void onEvent(bool readable, bool writable) = 0;
+  };
+
+  using TimerId = std::uint64_t;
+
+  EventLoop();
+  ~EventLoop();
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  bool ok() const { return poller_ >= 0; }
+
+  // watch registers fd or changes its interest set. Readiness is
+  // level-triggered, so handlers may stop reading at any point.
+  void watch(int fd, Handler* handler, bool read, bool write);
+  void unwatch(int fd);
+
+  TimerId addTimer(Clock::time_point when, std::function<void()> fn);
+  void cancelTimer(TimerId id);
+
+  // post queues fn to run on the loop thread after the current batch of
+  // events; it is safe to call from any thread.
+  void post(std::function<void()> fn);
+
+  void run();
+  void stop();
+
+ private:
+  struct Watch {
+    Handler* handler = nullptr;
+    bool read = false;
+    bool write = false;
+  };
+
+  void wake();
+  void drainWakeups();
+  int nextTimeoutMillis();
+  void runTimers();
+  void runPosted();
+
+  int poller_ = -1;
+  int wakeRead_ = -1;
+  int wakeWrite_ = -1;
+
+  std::unordered_map<int, Watch> watches_;
+  std::multimap<Clock::time_point, TimerId> timerQueue_;
+  std::unordered_map<TimerId, std::pair<Clock::time_point, std::function<void()>>> timers_;
+  TimerId nextTimer_ = 1;
+
+  std::mutex postMu_;
+  std::vector<std::function<void()>> posted_;
+  bool stopRequested_ = false;
+};
+
+}  // namespace urldl
@@ -0,0 +1,543 @@
+#include "file_download.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace urldl {
+
+namespace {
+
+// A file is only split when every range gets at least kMinSegmentBytes;
+// below that the extra connection setup costs more than it saves.
+constexpr std::int64_t kMinSegmentBytes = 4 << 20;
+// kCheckpointBytes is how much new data may be written before the sidecar
+// is refreshed, bounding what an interrupted run has to fetch again.
+constexpr std::int64_t kCheckpointBytes = 8 << 20;
+// kSegmentRetries is how often a stream that broke off is resent from where
+// it stopped, whether one range or the whole file.
+constexpr int kSegmentRetries = 2;
+// Stolen ranges start on kStealAlign boundaries, so both halves keep whole
+// blocks for direct writes.
+constexpr std::int64_t kStealAlign = 1 << 20;
+
+bool acceptsRanges(const Response& resp) {
+  const std::string* ranges = resp.header("Accept-Ranges");
+  return resp.status == 206 || (ranges != nullptr && equalsIgnoreCase(*ranges, "bytes"));
+}
+
+std::string statusError(const Response& resp) {
+  return "HTTP " + std::to_string(resp.status) + (resp.reason.empty() ? "" : " " + resp.reason);
+}
+
+}  // namespace
+
+std::int64_t bytesLeft(const std::string& path, std::int64_t size) {
+  SegmentState saved;
+  if (loadSidecar(path, saved) && saved.total == size) {
+    std::int64_t left = 0;
+    for (const auto& seg : saved.segments) {
+      left += seg.end - seg.pos;
+    }
+    return left;
+  }
+  return std::max<std::int64_t>(size - existingSize(path), 0);
+}
+
+// Fetch is one transfer of the download: the initial request, or one range.
+class FileDownload::Fetch : public TransferDelegate {
+ public:
+  Fetch(FileDownload& owner, std::size_t segment) : segment(segment), owner_(owner) {}
+
+  bool onResponse(const Response& resp) override { return owner_.onResponse(*this, resp); }
+  bool onBody(const char* data, std::size_t n) override { return owner_.onBody(*this, data, n); }
+  bool spliceTarget(int& fd, std::int64_t& offset, std::int64_t& limit) override {
+    return owner_.spliceTarget(*this, fd, offset, limit);
+  }
+  void onSpliced(std::size_t n) override { owner_.onSpliced(*this, n); }
+  void onDone(Outcome outcome, const std::string& err) override { owner_.onDone(*this, outcome, err); }
+
+  std::size_t segment;
+  int attempts = 0;
+  Outcome rejected = Outcome::Ok;  // set when this fetch itself rejected the response
+  std::string err;
+  std::shared_ptr<Transfer> transfer;
+  std::unique_ptr<RangeWriter> writer;
+
+ private:
+  FileDownload& owner_;
+};
+
+FileDownload::FileDownload(LoopContext& ctx, SlotBroker& slots, std::string_view target, Url url, std::string path,
+                           FileOptions opts, DoneFn done)
+    : ctx_(ctx),
+      slots_(slots),
+      target_(target),
+      url_(std::move(url)),
+      path_(std::move(path)),
+      opts_(opts),
+      done_(std::move(done)) {}
+
+FileDownload::~FileDownload() = default;
+
+void FileDownload::start() {
+  startedAt_ = Clock::now();
+  // A sidecar means the file was preallocated by an interrupted segmented
+  // run, so its size says nothing about how much of it is there.
+  SegmentState saved;
+  if (!opts_.restart && loadSidecar(path_, saved) && existingSize(path_) == saved.total) {
+    std::string err;
+    if (!file_.open(path_, O_WRONLY, opts_.direct, err)) {
+      fail(Outcome::Disk, err);
+      complete();
+      return;
+    }
+    segmented_ = true;
+    okOutcome_ = Outcome::Ok;
+    segmentUrl_ = url_;
+    state_ = std::move(saved);
+    fetches_.resize(state_.segments.size());
+    if (!useSlot()) {
+      complete();
+      return;
+    }
+    advertise();
+    return;
+  }
+  removeSidecar(path_);
+
+  offset_ = opts_.restart ? 0 : existingSize(path_);
+  primary_ = std::make_unique<Fetch>(*this, kPrimary);
+  requestPrimary(url_);
+}
+
+// requestPrimary asks for the file from offset_ on. A resumed request names
+// the validator it started with, so a replaced file comes back whole.
+void FileDownload::requestPrimary(const Url& url) {
+  std::vector<Header> extra;
+  if (offset_ > 0) {
+    extra.push_back({"Range", "bytes=" + std::to_string(offset_) + "-"});
+    if (!validator_.empty()) {
+      extra.push_back({"If-Range", validator_});
+    }
+  }
+  primary_->transfer = std::make_shared<Transfer>(ctx_, *primary_, "GET", url, std::move(extra));
+  ++running_;
+  primary_->transfer->start();
+}
+
+bool FileDownload::onResponse(Fetch& fetch, const Response& resp) {
+  return &fetch == primary_.get() ? primaryResponse(resp) : segmentResponse(fetch, resp);
+}
+
+bool FileDownload::primaryResponse(const Response& resp) {
+  if (resp.status == 416 && offset_ > 0) {
+    okOutcome_ = Outcome::AlreadyComplete;
+    if (std::string v = validatorFor(resp); !v.empty()) {
+      validator_ = std::move(v);
+    }
+    return false;
+  }
+  if (resp.status != 200 && resp.status != 206) {
+    throttle(resp);
+    fail(Outcome::Http, statusError(resp));
+    return false;
+  }
+
+  std::int64_t start = 0;
+  std::int64_t total = resp.contentLength;
+  int flags = O_WRONLY | O_CREAT;
+  if (resp.status == 206) {
+    std::int64_t last = 0;
+    const std::string* range = resp.header("Content-Range");
+    if (range == nullptr || !parseContentRange(*range, start, last, total) || start != offset_) {
+      fail(Outcome::Protocol, "server returned an unexpected range");
+      return false;
+    }
+  } else {
+    flags |= O_TRUNC;
+  }
+
+  std::string err;
+  if (!file_.open(path_, flags, opts_.direct, err)) {
+    fail(Outcome::Disk, err);
+    return false;
+  }
+  okOutcome_ = Outcome::Ok;
+  validator_ = validatorFor(resp);
+  segmentUrl_ = primary_->transfer->url();
+  primary_->writer = std::make_unique<RangeWriter>(file_, start);
+
+  const std::int64_t parts = total > start ? (total - start) / kMinSegmentBytes : 0;
+  if (opts_.maxSegments > 1 && parts >= 2 && acceptsRanges(resp)) {
+    return beginSegments(start, total, validator_);
+  }
+  return true;
+}
+
+// beginSegments splits [start, total) into ranges. The primary stream keeps
+// the first one; the rest wait for slots from the broker.
+bool FileDownload::beginSegments(std::int64_t start, std::int64_t total, std::string validator) {
+  const std::int64_t parts =
+      std::min<std::int64_t>(opts_.maxSegments, (total - start) / kMinSegmentBytes);
+  state_.total = total;
+  state_.validator = std::move(validator);
+  state_.segments.clear();
+  if (start > 0) {
+    state_.segments.push_back(Segment{0, start, start});
+  }
+  const std::int64_t step = (total - start) / parts;
+  for (std::int64_t i = 0; i < parts; ++i) {
+    const std::int64_t from = start + i * step;
+    const std::int64_t to = i + 1 == parts ? total : from + step;
+    state_.segments.push_back(Segment{from, from, to});
+  }
+
+  // The sidecar goes first: once the file is preallocated it looks complete.
+  std::string err;
+  if (!saveSidecar(path_, state_, err) || !file_.preallocate(total, err)) {
+    fail(Outcome::Disk, err);
+    return false;
+  }
+  segmented_ = true;
+  fetches_.resize(state_.segments.size());
+  primary_->segment = start > 0 ? 1 : 0;
+  fetches_[primary_->segment] = std::move(primary_);
+  advertise();
+  return true;
+}
+
+void FileDownload::offerSlot() {
+  if (!useSlot()) {
+    slots_.release();
+  }
+  advertise();
+}
+
+bool FileDownload::fetching(std::size_t segment) const {
+  return fetches_[segment] && fetches_[segment]->transfer;
+}
+
+// stealable is how many bytes one more slot would take: a whole range nobody
+// is fetching yet, or else half of the largest range in flight.
+std::int64_t FileDownload::stealable() const {
+  if (!segmented_ || finished_ || changed_ || failure_ != Outcome::Ok || running_ >= opts_.maxSegments) {
+    return 0;
+  }
+  std::int64_t best = 0;
+  for (std::size_t i = 0; i < state_.segments.size(); ++i) {
+    const Segment& seg = state_.segments[i];
+    const std::int64_t left = seg.end - seg.pos;
+    if (seg.done()) {
+      continue;
+    }
+    if (!fetching(i)) {
+      best = std::max(best, left);
+    } else if (left >= 2 * kMinSegmentBytes) {
+      best = std::max(best, left / 2);
+    }
+  }
+  return best;
+}
+
+// useSlot starts one more fetch on a slot the download already holds.
+bool FileDownload::useSlot() {
+  if (stealable() == 0) {
+    return false;
+  }
+  std::size_t pending = state_.segments.size();
+  std::size_t busiest = state_.segments.size();
+  for (std::size_t i = 0; i < state_.segments.size(); ++i) {
+    const Segment& seg = state_.segments[i];
+    if (seg.done()) {
+      continue;
+    }
+    auto& best = fetching(i) ? busiest : pending;
+    if (best == state_.segments.size() ||
+        seg.end - seg.pos > state_.segments[best].end - state_.segments[best].pos) {
+      best = i;
+    }
+  }
+  if (pending < state_.segments.size()) {
+    launch(pending);
+    return true;
+  }
+
+  // Split the largest range in flight. Its fetch stops as soon as it runs
+  // into the stolen half.
+  Segment& victim = state_.segments[busiest];
+  std::int64_t mid = victim.pos + (victim.end - victim.pos) / 2;
+  mid -= mid % kStealAlign;
+  const Segment stolen{mid, mid, victim.end};
+  victim.end = mid;
+  state_.segments.push_back(stolen);
+  fetches_.emplace_back();
+  launch(state_.segments.size() - 1);
+  return true;
+}
+
+void FileDownload::advertise() {
+  if (!finished_) {
+    slots_.advertise(stealable());
+  }
+}
+
+void FileDownload::launch(std::size_t segment) {
+  const Segment& seg = state_.segments[segment];
+  auto& fetch = fetches_[segment];
+  if (!fetch) {
+    fetch = std::make_unique<Fetch>(*this, segment);
+  }
+  fetch->err.clear();
+  fetch->writer = std::make_unique<RangeWriter>(file_, seg.pos);
+  std::vector<Header> extra{{"Range", "bytes=" + std::to_string(seg.pos) + "-" + std::to_string(seg.end - 1)}};
+  if (!state_.validator.empty()) {
+    extra.push_back({"If-Range", state_.validator});
+  }
+  fetch->transfer = std::make_shared<Transfer>(ctx_, *fetch, "GET", segmentUrl_, std::move(extra));
+  ++running_;
+  fetch->transfer->start();
+}
+
+bool FileDownload::segmentResponse(Fetch& fetch, const Response& resp) {
+  const Segment& seg = state_.segments[fetch.segment];
+  if (resp.status == 200 && !state_.validator.empty()) {
+    changed_ = true;
+    fetch.rejected = Outcome::Changed;
+    fetch.err = "remote file changed";
+    return false;
+  }
+  if (resp.status != 206) {
+    // A throttled range fails the whole file: its progress is in the
+    // sidecar, and the downloader retries it once the host has cooled off.
+    throttle(resp);
+    fetch.rejected = resp.status == 200 ? Outcome::Protocol : Outcome::Http;
+    fetch.err = resp.status == 200 ? "server returned an unexpected range" : statusError(resp);
+    return false;
+  }
+  std::int64_t first = 0;
+  std::int64_t last = 0;
+  std::int64_t total = 0;
+  const std::string* range = resp.header("Content-Range");
+  if (range == nullptr || !parseContentRange(*range, first, last, total) || first != seg.pos ||
+      (total >= 0 && total != state_.total)) {
+    fetch.rejected = Outcome::Protocol;
+    fetch.err = "server returned an unexpected range";
+    return false;
+  }
+  return true;
+}
+
+bool FileDownload::onBody(Fetch& fetch, const char* data, std::size_t n) {
+  if (!segmented_) {
+    std::string err;
+    if (!fetch.writer->write(data, n, err)) {
+      fail(Outcome::Disk, err);
+      return false;
+    }
+    return true;
+  }
+  return writeSegment(fetch, data, n);
+}
+
+// spliceTarget offers the file to the transfer while nothing is staged for
+// direct writes; a range may take at most what is left of it.
+bool FileDownload::spliceTarget(Fetch& fetch, int& fd, std::int64_t& offset, std::int64_t& limit) {
+  if (!fetch.writer || fetch.writer->staging() || failure_ != Outcome::Ok) {
+    return false;
+  }
+  fd = file_.fd();
+  offset = fetch.writer->offset();
+  limit = std::numeric_limits<std::int64_t>::max();
+  if (segmented_) {
+    const Segment& seg = state_.segments[fetch.segment];
+    limit = seg.end - seg.pos;
+  }
+  return limit > 0;
+}
+
+void FileDownload::onSpliced(Fetch& fetch, std::size_t n) {
+  fetch.writer->advance(n);
+  if (segmented_) {
+    state_.segments[fetch.segment].pos += static_cast<std::int64_t>(n);
+    unsaved_ += static_cast<std::int64_t>(n);
+    checkpoint(false);
+  }
+}
+
+// writeSegment stores data at the segment's position. Bytes past the end of
+// the range (the primary stream runs on into the next one) abort the fetch.
+bool FileDownload::writeSegment(Fetch& fetch, const char* data, std::size_t n) {
+  Segment& seg = state_.segments[fetch.segment];
+  const std::size_t room = static_cast<std::size_t>(seg.end - seg.pos);
+  const std::size_t len = std::min(n, room);
+  std::string err;
+  if (!fetch.writer->write(data, len, err)) {
+    fail(Outcome::Disk, err);
+    return false;
+  }
+  seg.pos += static_cast<std::int64_t>(len);
+  unsaved_ += static_cast<std::int64_t>(len);
+  checkpoint(false);
+  return len == n;
+}
+
+// flush writes out what the fetch still has staged. A range whose tail cannot
+// be written falls back to what actually reached the file.
+void FileDownload::flush(Fetch& fetch) {
+  if (!fetch.writer) {
+    return;
+  }
+  std::string err;
+  if (!fetch.writer->flush(err)) {
+    fail(Outcome::Disk, err);
+    if (segmented_) {
+      state_.segments[fetch.segment].pos = fetch.writer->durable();
+    }
+  }
+  fetch.writer.reset();
+}
+
+void FileDownload::onDone(Fetch& fetch, Outcome outcome, const std::string& err) {
+  --running_;
+  const TransferStats& ts = fetch.transfer->stats();
+  if (stats_.transfers++ == 0) {
+    stats_.first = ts;
+  }
+  stats_.bytes += ts.bytes;
+  stats_.retries += ts.retries;
+  stats_.reused += ts.reused ? 1 : 0;
+  // The transfer is still on the stack; release it once the loop unwinds.
+  ctx_.loop.post([transfer = std::move(fetch.transfer)] {});
+  const std::int64_t reached = fetch.writer ? fetch.writer->offset() : offset_;
+  flush(fetch);
+
+  if (!segmented_) {
+    // A connection lost mid-body, or a stream the server reset after the
+    // headers, continues from what reached the file, as wget -c would.
+    const bool broken = outcome == Outcome::Network || outcome == Outcome::Protocol;
+    if (broken && failure_ == Outcome::Ok && okOutcome_ != Outcome::AlreadyComplete &&
+        ++fetch.attempts <= kSegmentRetries) {
+      std::string closeErr;
+      if (file_.isOpen() && !file_.close(closeErr)) {
+        fail(Outcome::Disk, closeErr);
+        complete();
+        return;
+      }
+      offset_ = reached;
+      requestPrimary(okOutcome_ ? segmentUrl_ : url_);
+      return;
+    }
+    if (!succeeded(outcome)) {
+      fail(outcome, err);
+    }
+    complete();
+    return;
+  }
+  if (!state_.segments[fetch.segment].done()) {
+    const bool rejected = fetch.rejected != Outcome::Ok;
+    if (!rejected && failure_ == Outcome::Ok && ++fetch.attempts <= kSegmentRetries) {
+      launch(fetch.segment);
+      return;
+    }
+    if (rejected) {
+      fail(fetch.rejected, fetch.err);
+    } else if (succeeded(outcome)) {
+      fail(Outcome::Network, "connection closed before the range was complete");
+    } else {
+      fail(outcome, err);
+    }
+  }
+
+  // The slot this fetch ran on moves to the next range, or goes back to the
+  // broker. The last one is the download's own and ends it.
+  if (useSlot()) {
+    advertise();
+    return;
+  }
+  if (running_ > 0) {
+    slots_.release();
+    advertise();
+    return;
+  }
+  complete();
+}
+
+void FileDownload::checkpoint(bool force) {
+  if (!segmented_ || (!force && unsaved_ < kCheckpointBytes)) {
+    return;
+  }
+  unsaved_ = 0;
+  // Data still staged for direct writes is not in the file yet.
+  SegmentState saved = state_;
+  for (std::size_t i = 0; i < fetches_.size(); ++i) {
+    if (fetches_[i] && fetches_[i]->writer) {
+      saved.segments[i].pos = fetches_[i]->writer->durable();
+    }
+  }
+  std::string err;
+  if (!saveSidecar(path_, saved, err) && force) {
+    fail(Outcome::Disk, err);
+  }
+}
+
+void FileDownload::fail(Outcome failure, const std::string& detail) {
+  if (failure_ == Outcome::Ok) {
+    failure_ = failure;
+    err_ = detail;
+  }
+}
+
+void FileDownload::throttle(const Response& resp) {
+  if (isThrottled(resp.status) && !throttled_) {
+    throttled_ = true;
+    retryAfter_ = retryAfterSeconds(resp);
+  }
+}
+
+void FileDownload::complete() {
+  finished_ = true;
+  if (segmented_) {
+    const bool all = std::all_of(state_.segments.begin(), state_.segments.end(),
+                                 [](const Segment& seg) { return seg.done(); });
+    if (changed_) {
+      // The ranges on disk belong to an older version; start over next run.
+      ::unlink(path_.c_str());
+      removeSidecar(path_);
+      failure_ = Outcome::Changed;
+      err_.clear();
+    } else if (all && failure_ == Outcome::Ok) {
+      removeSidecar(path_);
+    } else {
+      checkpoint(true);
+      fail(Outcome::Network, "");
+    }
+  }
+  std::string err;
+  if (file_.isOpen() && !file_.close(err)) {
+    fail(Outcome::Disk, err);
+  }
+
+  DownloadResult result;
+  result.url = target_;
+  stats_.elapsed = Clock::now() - startedAt_;
+  result.stats = stats_;
+  if (failure_ != Outcome::Ok) {
+    result.outcome = failure_;
+    result.detail = std::move(err_);
+    result.throttled = throttled_;
+    result.retryAfter = retryAfter_;
+  } else if (!okOutcome_) {
+    result.outcome = Outcome::Protocol;
+    result.detail = "empty response";
+  } else {
+    result.outcome = *okOutcome_;
+    result.size = existingSize(path_);
+    result.validator = segmented_ ? state_.validator : validator_;
+  }
+  done_(std::move(result));
+}
+
+}  // namespace urldl
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "disk.h"
+#include "http.h"
+#include "metrics.h"
+#include "outcome.h"
+#include "sidecar.h"
+#include "transfer.h"
+#include "url.h"
+
+namespace urldl {
+
+// DownloadResult is how one URL of a batch ended. url points into the
+// caller's copy of the URL, which must outlive the result.
+struct DownloadResult {
+  std::string_view url;
+  Outcome outcome = Outcome::Aborted;
+  std::string detail;  // the error as reported, or empty for describe(outcome)
+  // On success: the size of the file on disk and the validator the server
+  // sent for it, if any.
+  std::int64_t size = -1;
+  std::string validator;
+  // throttled is set when the server turned the download away with 429 or
+  // 503; retryAfter is the delay it asked for in seconds, or -1.
+  bool throttled = false;
+  std::int64_t retryAfter = -1;
+  DownloadStats stats;
+
+  bool ok() const { return succeeded(outcome); }
+  std::string message() const { return detail.empty() ? std::string(describe(outcome)) : detail; }
+};
+
+// bytesLeft estimates how much of a remote file of the given size is still
+// missing at path, counting a partial file or the open ranges of a sidecar.
+std::int64_t bytesLeft(const std::string& path, std::int64_t size);
+
+// SlotBroker lends a download transfer slots beyond the one it starts with,
+// so capacity that goes idle late in a batch moves to the files still running.
+class SlotBroker {
+ public:
+  virtual ~SlotBroker() = default;
+  // advertise reports how many bytes one more slot could take over; the
+  // broker answers with FileDownload::offerSlot when it has one to spare.
+  virtual void advertise(std::int64_t stealable) = 0;
+  // release hands back a slot that came from offerSlot.
+  virtual void release() = 0;
+};
+
+struct FileOptions {
+  int maxSegments = 1;
+  bool direct = false;  // write with O_DIRECT, bypassing the page cache
+  // restart ignores what is on disk and fetches the whole file again, for a
+  // copy the server has since replaced.
+  bool restart = false;
+};
+
+// FileDownload saves one URL to disk on a single event loop and reports
+// through done exactly once. Small files, and servers without range support,
+// take a single stream. Larger files are split into byte ranges written in
+// place; progress is kept in a sidecar so an interrupted run picks up the
+// open ranges again. Every range past the first runs on a slot
+// borrowed from the broker, and a borrowed slot with no unclaimed range left
+// steals the back half of the largest one still in flight. A stream that
+// breaks off is resent from where it stopped a couple of times before the
+// file fails. Plain-HTTP bodies
+// are spliced from the socket into the file; with direct, writes bypass the
+// page cache.
+class FileDownload {
+ public:
+  using DoneFn = std::function<void(DownloadResult)>;
+
+  FileDownload(LoopContext& ctx, SlotBroker& slots, std::string_view target, Url url, std::string path,
+               FileOptions opts, DoneFn done);
+  ~FileDownload();
+  FileDownload(const FileDownload&) = delete;
+  FileDownload& operator=(const FileDownload&) = delete;
+
+  void start();
+  // offerSlot gives the download one more slot, which it uses or releases.
+  void offerSlot();
+
+ private:
+  class Fetch;
+
+  static constexpr std::size_t kPrimary = static_cast<std::size_t>(-1);
+
+  bool onResponse(Fetch& fetch, const Response& resp);
+  bool onBody(Fetch& fetch, const char* data, std::size_t n);
+  bool spliceTarget(Fetch& fetch, int& fd, std::int64_t& offset, std::int64_t& limit);
+  void onSpliced(Fetch& fetch, std::size_t n);
+  void onDone(Fetch& fetch, Outcome outcome, const std::string& err);
+
+  void requestPrimary(const Url& url);
+  bool primaryResponse(const Response& resp);
+  bool segmentResponse(Fetch& fetch, const Response& resp);
+  bool beginSegments(std::int64_t start, std::int64_t total, std::string validator);
+  std::int64_t stealable() const;
+  bool useSlot();
+  void advertise();
+  bool fetching(std::size_t segment) const;
+  void launch(std::size_t segment);
+  bool writeSegment(Fetch& fetch, const char* data, std::size_t n);
+  void flush(Fetch& fetch);
+  void checkpoint(bool force);
+  void complete();
+  void fail(Outcome failure, const std::string& detail);
+  void throttle(const Response& resp);
+
+  LoopContext& ctx_;
+  SlotBroker& slots_;
+  std::string_view target_;
+  Url url_;
+  std::string path_;
+  FileOptions opts_;
+  DoneFn done_;
+
+  DiskFile file_;
+  std::int64_t offset_ = 0;
+  std::unique_ptr<Fetch> primary_;
+  std::vector<std::unique_ptr<Fetch>> fetches_;  // one per segment, created on launch
+  int running_ = 0;
+  bool finished_ = false;
+
+  bool segmented_ = false;
+  bool changed_ = false;
+  Url segmentUrl_;  // where the primary ended up after redirects
+  SegmentState state_;
+  std::int64_t unsaved_ = 0;
+
+  std::string validator_;  // of the primary response
+  std::optional<Outcome> okOutcome_;  // set once a response is accepted
+  Outcome failure_ = Outcome::Ok;      // the first failure, with err_ as its detail
+  std::string err_;
+  bool throttled_ = false;
+  std::int64_t retryAfter_ = -1;
+  Clock::time_point startedAt_{};
+  DownloadStats stats_;
+};
+
+}  // namespace urldl
@@ -0,0 +1,598 @@
+#include "h2.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace urldl {
+
+namespace {
+
+constexpr std::string_view kPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr std::size_t kFrameHeader = 9;
+// kMaxFrame is the default SETTINGS_MAX_FRAME_SIZE, which is kept.
+constexpr std::size_t kMaxFrame = 16384;
+// Receive windows: large enough that a single stream is never held back by
+// the round trip on a fast link, and returned once half is used.
+constexpr std::int64_t kStreamWindow = 16 << 20;
+constexpr std::int64_t kConnWindow = 64 << 20;
+constexpr std::int64_t kDefaultWindow = 65535;
+constexpr std::size_t kReadChunk = 256 * 1024;
+constexpr int kMaxReadsPerEvent = 16;
+
+enum FrameType : std::uint8_t {
+  kData = 0x0,
+  kHeaders = 0x1,
+  kPriority = 0x2,
+  kRstStream = 0x3,
+  kSettings = 0x4,
+  kPushPromise = 0x5,
+  kPing = 0x6,
+  kGoAway = 0x7,
+  kWindowUpdate = 0x8,
+  kContinuation = 0x9,
+};
+
+enum FrameFlag : std::uint8_t {
+  kEndStream = 0x1,
+  kAck = 0x1,
+  kEndHeaders = 0x4,
+  kPadded = 0x8,
+  kPriorityFlag = 0x20,
+};
+
+enum Setting : std::uint16_t {
+  kEnablePush = 0x2,
+  kMaxConcurrentStreams = 0x3,
+  kInitialWindowSize = 0x4,
+  kMaxFrameSize = 0x5,
+};
+
+constexpr std::uint32_t kCancel = 0x8;
+constexpr std::uint32_t kRefusedStream = 0x7;
+constexpr std::uint32_t kMaxStreamId = 0x7fffffff;
+
+std::uint32_t readU32(const std::uint8_t* p) {
+  return static_cast<std::uint32_t>(p[0]) << 24 | static_cast<std::uint32_t>(p[1]) << 16 |
+         static_cast<std::uint32_t>(p[2]) << 8 | p[3];
+}
+
+void putU32(std::string& out, std::uint32_t v) {
+  out.push_back(static_cast<char>(v >> 24));
+  out.push_back(static_cast<char>(v >> 16));
+  out.push_back(static_cast<char>(v >> 8));
+  out.push_back(static_cast<char>(v));
+}
+
+void putSetting(std::string& out, std::uint16_t id, std::uint32_t value) {
+  out.push_back(static_cast<char>(id >> 8));
+  out.push_back(static_cast<char>(id));
+  putU32(out, value);
+}
+
+std::string lower(std::string_view s) {
+  std::string out(s);
+  for (char& c : out) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return out;
+}
+
+// stripPadding removes the Pad Length octet and the padding of a padded
+// frame. It returns false when the padding is longer than the frame.
+bool stripPadding(std::uint8_t flags, const std::uint8_t*& p, std::size_t& n) {
+  if ((flags & kPadded) == 0) {
+    return true;
+  }
+  if (n < 1 || p[0] >= n) {
+    return false;
+  }
+  n -= 1 + p[0];
+  ++p;
+  return true;
+}
+
+}  // namespace
+
+H2Session::H2Session(EventLoop& loop, H2Pool& pool, std::unique_ptr<Connection> conn)
+    : loop_(loop), pool_(pool), conn_(std::move(conn)), origin_(conn_->origin()) {}
+
+H2Session::~H2Session() {
+  if (resumeTimer_ != 0) {
+    loop_.cancelTimer(resumeTimer_);
+  }
+  if (conn_) {
+    loop_.unwatch(conn_->fd());
+  }
+}
+
+void H2Session::start() {
+  out_.append(kPreface);
+  std::string settings;
+  putSetting(settings, kEnablePush, 0);
+  putSetting(settings, kInitialWindowSize, static_cast<std::uint32_t>(kStreamWindow));
+  writeFrame(kSettings, 0, 0, settings.data(), settings.size());
+  windowUpdate(0, static_cast<std::uint32_t>(kConnWindow - kDefaultWindow));
+}
+
+bool H2Session::canOpen() const {
+  return !closed_ && !draining_ && streams_.size() < maxStreams_ && nextId_ < kMaxStreamId;
+}
+
+std::uint32_t H2Session::open(std::string_view method, const Url& url, const std::vector<Header>& headers,
+                              H2StreamHandler& handler) {
+  if (!canOpen()) {
+    return 0;
+  }
+  const std::uint32_t id = nextId_;
+  nextId_ += 2;
+
+  std::vector<Header> fields;
+  fields.reserve(headers.size() + 7);
+  fields.push_back({":method", std::string(method)});
+  fields.push_back({":scheme", url.scheme});
+  fields.push_back({":authority", url.hostHeader()});
+  fields.push_back({":path", url.target});
+  fields.push_back({"user-agent", std::string(kUserAgent)});
+  fields.push_back({"accept", "*/*"});
+  fields.push_back({"accept-encoding", "identity"});
+  for (const Header& h : headers) {
+    fields.push_back({lower(h.name), h.value});
+  }
+  std::string block;
+  hpackEncode(fields, block);
+
+  // Blocks over the peer's frame size continue in CONTINUATION frames.
+  std::size_t at = std::min<std::size_t>(block.size(), peerMaxFrame_);
+  writeFrame(kHeaders, kEndStream | (at == block.size() ? kEndHeaders : 0), id, block.data(), at);
+  while (at < block.size()) {
+    const std::size_t len = std::min<std::size_t>(block.size() - at, peerMaxFrame_);
+    writeFrame(kContinuation, at + len == block.size() ? kEndHeaders : 0, id, block.data() + at, len);
+    at += len;
+  }
+  streams_[id].handler = &handler;
+  return id;
+}
+
+void H2Session::cancel(std::uint32_t id) {
+  auto it = streams_.find(id);
+  if (it == streams_.end()) {
+    return;
+  }
+  const bool remoteClosed = it->second.remoteClosed;
+  streams_.erase(it);
+  if (closed_ || remoteClosed) {
+    closeIfDone();
+    return;
+  }
+  std::string code;
+  putU32(code, kCancel);
+  writeFrame(kRstStream, 0, id, code.data(), code.size());
+  closeIfDone();
+}
+
+void H2Session::abandon(const std::string& err) {
+  auto self = shared_from_this();
+  fail(err);
+}
+
+void H2Session::onEvent(bool, bool) {
+  auto self = shared_from_this();  // handlers may drop their references
+  if (closed_) {
+    return;
+  }
+  inEvent_ = true;
+  bool wantWrite = false;
+  while (outPos_ < out_.size()) {
+    std::size_t n = 0;
+    std::string err;
+    const IoStatus status = conn_->write(out_.data() + outPos_, out_.size() - outPos_, n, err);
+    if (status == IoStatus::Ok) {
+      outPos_ += n;
+      continue;
+    }
+    if (status == IoStatus::Eof || status == IoStatus::Error) {
+      fail(err.empty() ? "write: connection closed" : err);
+      return;
+    }
+    break;
+  }
+  if (outPos_ == out_.size()) {
+    out_.clear();
+    outPos_ = 0;
+  }
+
+  Shaper& shaper = pool_.shaper();
+  bool paused = false;
+  for (int i = 0; i < kMaxReadsPerEvent && !closed_; ++i) {
+    std::size_t room = kReadChunk;
+    if (shaper.limited()) {
+      Clock::duration wait{};
+      room = shaper.take(room, wait);
+      if (room == 0) {
+        // Every stream of the session waits for the shaper together.
+        paused = true;
+        if (resumeTimer_ == 0) {
+          resumeTimer_ = loop_.addTimer(Clock::now() + wait, [this] {
+            resumeTimer_ = 0;
+            onEvent(true, false);
+          });
+        }
+        break;
+      }
+    }
+    const std::size_t had = in_.size();
+    in_.resize(had + room);
+    std::size_t n = 0;
+    std::string err;
+    const IoStatus status = conn_->read(&in_[had], room, n, err);
+    in_.resize(had + n);
+    shaper.refund(room - n);
+    if (status == IoStatus::Ok) {
+      if (!processFrames()) {
+        return;
+      }
+      continue;
+    }
+    if (status == IoStatus::Eof) {
+      fail("connection closed by server");
+      return;
+    }
+    if (status == IoStatus::Error) {
+      fail(err);
+      return;
+    }
+    wantWrite = status == IoStatus::WantWrite;
+    break;
+  }
+  inEvent_ = false;
+  if (!closed_) {
+    loop_.watch(conn_->fd(), this, !paused, wantWrite || outPos_ < out_.size());
+    if (!paused && conn_->buffered()) {
+      // Decrypted data does not make the socket readable.
+      std::weak_ptr<H2Session> weak = self;
+      loop_.post([weak] {
+        if (auto session = weak.lock()) {
+          session->onEvent(true, false);
+        }
+      });
+    }
+  }
+}
+
+// processFrames handles every complete frame received so far. It returns
+// false once the session has failed.
+bool H2Session::processFrames() {
+  while (!closed_ && in_.size() - inPos_ >= kFrameHeader) {
+    const auto* h = reinterpret_cast<const std::uint8_t*>(in_.data() + inPos_);
+    const std::size_t len = static_cast<std::size_t>(h[0]) << 16 | static_cast<std::size_t>(h[1]) << 8 | h[2];
+    if (len > kMaxFrame) {
+      fail("http2: frame too large");
+      return false;
+    }
+    if (in_.size() - inPos_ < kFrameHeader + len) {
+      break;
+    }
+    inPos_ += kFrameHeader + len;
+    const std::uint32_t id = readU32(h + 5) & kMaxStreamId;
+    if (blockStream_ != 0 && h[3] != kContinuation) {
+      fail("http2: header block interrupted");
+      return false;
+    }
+    if (!onFrame(h[3], h[4], id, h + kFrameHeader, len)) {
+      if (!closed_) {
+        fail("http2: protocol error");
+      }
+      return false;
+    }
+  }
+  in_.erase(0, inPos_);
+  inPos_ = 0;
+  return !closed_;
+}
+
+bool H2Session::onFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t id, const std::uint8_t* p,
+                        std::size_t n) {
+  switch (type) {
+    case kData:
+      return id != 0 && onData(flags, id, p, n);
+    case kHeaders:
+      if (id == 0 || !stripPadding(flags, p, n)) {
+        return false;
+      }
+      if (flags & kPriorityFlag) {
+        if (n < 5) {
+          return false;
+        }
+        p += 5;
+        n -= 5;
+      }
+      block_.assign(reinterpret_cast<const char*>(p), n);
+      blockStream_ = id;
+      blockEndStream_ = (flags & kEndStream) != 0;
+      return (flags & kEndHeaders) == 0 || onHeaderBlock(id, blockEndStream_);
+    case kContinuation:
+      if (id != blockStream_) {
+        return false;
+      }
+      block_.append(reinterpret_cast<const char*>(p), n);
+      return (flags & kEndHeaders) == 0 || onHeaderBlock(id, blockEndStream_);
+    case kRstStream: {
+      if (n != 4) {
+        return false;
+      }
+      const std::uint32_t code = readU32(p);
+      closeStream(id, "http2: stream reset by server (code " + std::to_string(code) + ")", code == kRefusedStream);
+      return true;
+    }
+    case kSettings:
+      return id == 0 && onSettings(flags, p, n);
+    case kPushPromise:
+      return false;  // disabled in our SETTINGS
+    case kPing:
+      if (n != 8) {
+        return false;
+      }
+      if ((flags & kAck) == 0) {
+        writeFrame(kPing, kAck, 0, p, n);
+      }
+      return true;
+    case kGoAway:
+      if (n < 8) {
+        return false;
+      }
+      onGoAway(readU32(p) & kMaxStreamId);
+      return true;
+    default:
+      return true;  // PRIORITY, WINDOW_UPDATE (nothing is sent with a body) and unknown types
+  }
+}
+
+bool H2Session::onData(std::uint8_t flags, std::uint32_t id, const std::uint8_t* p, std::size_t n) {
+  // Flow control counts the whole payload, padding included, and applies
+  // to streams that were cancelled too.
+  const auto full = static_cast<std::int64_t>(n);
+  if (!stripPadding(flags, p, n)) {
+    return false;
+  }
+  connUnacked_ += full;
+  if (connUnacked_ >= kConnWindow / 2) {
+    windowUpdate(0, static_cast<std::uint32_t>(connUnacked_));
+    connUnacked_ = 0;
+  }
+  auto it = streams_.find(id);
+  if (it == streams_.end()) {
+    return true;
+  }
+  Stream& stream = it->second;
+  stream.unacked += full;
+  if (stream.unacked >= kStreamWindow / 2 && (flags & kEndStream) == 0) {
+    windowUpdate(id, static_cast<std::uint32_t>(stream.unacked));
+    stream.unacked = 0;
+  }
+  if (!stream.gotHeaders) {
+    return false;
+  }
+  stream.remoteClosed = (flags & kEndStream) != 0;
+  if (n > 0) {
+    stream.handler->onStreamData(reinterpret_cast<const char*>(p), n);
+  }
+  if (flags & kEndStream) {
+    closeStream(id, "", false);
+  }
+  return true;
+}
+
+bool H2Session::onHeaderBlock(std::uint32_t id, bool endStream) {
+  blockStream_ = 0;
+  std::vector<Header> fields;
+  std::string err;
+  // Decoded even for a cancelled stream, to keep the table in step.
+  if (!decoder_.decode(reinterpret_cast<const std::uint8_t*>(block_.data()), block_.size(), fields, err)) {
+    fail(err);
+    return false;
+  }
+  auto it = streams_.find(id);
+  if (it == streams_.end()) {
+    return true;
+  }
+  Response resp;
+  for (Header& f : fields) {
+    if (f.name == ":status") {
+      std::from_chars(f.value.data(), f.value.data() + f.value.size(), resp.status);
+    } else if (!f.name.empty() && f.name[0] != ':') {
+      if (f.name == "content-length") {
+        std::int64_t len = -1;
+        const auto [ptr, ec] = std::from_chars(f.value.data(), f.value.data() + f.value.size(), len);
+        if (ec == std::errc() && ptr == f.value.data() + f.value.size() && len >= 0) {
+          resp.contentLength = len;
+        }
+      }
+      resp.headers.push_back(std::move(f));
+    }
+  }
+
+  Stream& stream = it->second;
+  stream.remoteClosed = endStream;
+  if (stream.gotHeaders) {
+    // Trailers: nothing in them is used.
+  } else if (resp.status >= 100 && resp.status < 200 && !endStream) {
+    return true;  // interim response
+  } else {
+    stream.gotHeaders = true;
+    stream.handler->onStreamHeaders(resp);
+  }
+  if (endStream) {
+    closeStream(id, "", false);
+  }
+  return true;
+}
+
+bool H2Session::onSettings(std::uint8_t flags, const std::uint8_t* p, std::size_t n) {
+  if (flags & kAck) {
+    return n == 0;
+  }
+  if (n % 6 != 0) {
+    return false;
+  }
+  for (std::size_t at = 0; at < n; at += 6) {
+    const auto id = static_cast<std::uint16_t>(p[at] << 8 | p[at + 1]);
+    const std::uint32_t value = readU32(p + at + 2);
+    if (id == kMaxConcurrentStreams) {
+      maxStreams_ = value;
+    } else if (id == kMaxFrameSize) {
+      if (value < kMaxFrame || value > 0xffffff) {
+        return false;
+      }
+      peerMaxFrame_ = value;
+    }
+  }
+  writeFrame(kSettings, kAck, 0, nullptr, 0);
+  return true;
+}
+
+// onGoAway stops new streams. Those the server will not process may be
+// retried elsewhere; the others run to completion.
+void H2Session::onGoAway(std::uint32_t lastId) {
+  draining_ = true;
+  std::vector<std::uint32_t> refused;
+  for (const auto& [id, stream] : streams_) {
+    if (id > lastId) {
+      refused.push_back(id);
+    }
+  }
+  for (const std::uint32_t id : refused) {
+    closeStream(id, "http2: server is going away", true);
+  }
+  closeIfDone();
+}
+
+void H2Session::closeStream(std::uint32_t id, const std::string& err, bool retry) {
+  auto it = streams_.find(id);
+  if (it == streams_.end()) {
+    return;
+  }
+  H2StreamHandler* handler = it->second.handler;
+  streams_.erase(it);
+  handler->onStreamClose(err, retry);
+  closeIfDone();
+}
+
+void H2Session::writeFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t id, const void* payload,
+                           std::size_t n) {
+  out_.push_back(static_cast<char>(n >> 16));
+  out_.push_back(static_cast<char>(n >> 8));
+  out_.push_back(static_cast<char>(n));
+  out_.push_back(static_cast<char>(type));
+  out_.push_back(static_cast<char>(flags));
+  putU32(out_, id);
+  out_.append(static_cast<const char*>(payload), n);
+  // Written from onEvent, which is never far away once write interest is
+  // set; writing here could fail the session under a caller's feet.
+  if (!inEvent_ && !closed_) {
+    loop_.watch(conn_->fd(), this, true, true);
+  }
+}
+
+void H2Session::windowUpdate(std::uint32_t id, std::uint32_t increment) {
+  std::string payload;
+  putU32(payload, increment);
+  writeFrame(kWindowUpdate, 0, id, payload.data(), payload.size());
+}
+
+// fail closes the connection and every stream on it. Streams the server
+// had sent nothing for may be retried.
+void H2Session::fail(const std::string& err) {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  inEvent_ = false;
+  loop_.unwatch(conn_->fd());
+  pool_.remove(*this);
+  // One at a time: a handler may cancel the streams of others.
+  while (!streams_.empty()) {
+    auto it = streams_.begin();
+    H2StreamHandler* handler = it->second.handler;
+    const bool retry = !it->second.gotHeaders;
+    streams_.erase(it);
+    handler->onStreamClose(err, retry);
+  }
+}
+
+void H2Session::closeIfDone() {
+  if (draining_ && streams_.empty() && !closed_) {
+    closed_ = true;
+    loop_.unwatch(conn_->fd());
+    pool_.remove(*this);
+  }
+}
+
+std::shared_ptr<H2Session> H2Pool::find(const std::string& origin) {
+  auto it = sessions_.find(origin);
+  if (it == sessions_.end()) {
+    return nullptr;
+  }
+  std::shared_ptr<H2Session> best;
+  for (const auto& session : it->second) {
+    if (session->canOpen() && (!best || session->streams() < best->streams())) {
+      best = session;
+    }
+  }
+  return best;
+}
+
+bool H2Pool::claim(const std::string& origin, ReadyFn ready) {
+  if (!enabled_ || http1_.count(origin) != 0) {
+    return true;
+  }
+  auto [it, inserted] = dialing_.try_emplace(origin);
+  if (inserted) {
+    return true;
+  }
+  it->second.push_back(std::move(ready));
+  return false;
+}
+
+std::shared_ptr<H2Session> H2Pool::adopt(std::unique_ptr<Connection> conn) {
+  loop_.unwatch(conn->fd());
+  auto session = std::make_shared<H2Session>(loop_, *this, std::move(conn));
+  sessions_[session->origin()].push_back(session);
+  session->start();
+  wake(session->origin(), session);
+  return session;
+}
+
+void H2Pool::settle(const std::string& origin, bool http1) {
+  if (http1) {
+    http1_.insert(origin);
+  }
+  wake(origin, nullptr);
+}
+
+void H2Pool::remove(const H2Session& session) {
+  auto it = sessions_.find(session.origin());
+  if (it == sessions_.end()) {
+    return;
+  }
+  auto& list = it->second;
+  list.erase(std::remove_if(list.begin(), list.end(), [&](const auto& s) { return s.get() == &session; }),
+             list.end());
+  if (list.empty()) {
+    sessions_.erase(it);
+  }
+}
+
+void H2Pool::wake(const std::string& origin, const std::shared_ptr<H2Session>& session) {
+  auto it = dialing_.find(origin);
+  if (it == dialing_.end()) {
+    return;
+  }
+  std::vector<ReadyFn> waiters = std::move(it->second);
+  dialing_.erase(it);
+  for (ReadyFn& ready : waiters) {
+    loop_.post([ready = std::move(ready), session] { ready(session); });
+  }
+}
+
+}  // namespace urldl
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "event_loop.h"
+#include "hpack.h"
+#include "http.h"
+#include "net.h"
+#include "shaper.h"
+#include "url.h"
+
+namespace urldl {
+
+// H2StreamHandler receives the response on one stream of an H2Session.
+// Handlers may cancel their stream, or open others, from any callback.
+class H2StreamHandler {
+ public:
+  virtual ~H2StreamHandler() = default;
+  // onStreamHeaders sees the final response header block.
+  virtual void onStreamHeaders(const Response& resp) = 0;
+  virtual void onStreamData(const char* data, std::size_t n) = 0;
+  // onStreamClose ends the stream, exactly once unless it was cancelled.
+  // err is empty when the response completed. retry means the server
+  // never saw the request or sent nothing for it, so it is safe to resend.
+  virtual void onStreamClose(const std::string& err, bool retry) = 0;
+};
+
+class H2Pool;
+
+// H2Session runs HTTP/2 (RFC 9113) over one TLS connection that negotiated
+// "h2", multiplexing the body-less requests of this client as concurrent
+// streams. Receive windows are large and refilled as data is consumed, so
+// flow control never throttles a transfer the disk keeps up with.
+class H2Session : public EventLoop::Handler, public std::enable_shared_from_this<H2Session> {
+ public:
+  H2Session(EventLoop& loop, H2Pool& pool, std::unique_ptr<Connection> conn);
+  ~H2Session() override;
+  H2Session(const H2Session&) = delete;
+  H2Session& operator=(const H2Session&) = delete;
+
+  void start();
+  // canOpen reports whether the session takes another stream.
+  bool canOpen() const;
+  std::size_t streams() const { return streams_.size(); }
+  const std::string& origin() const { return origin_; }
+
+  // open sends a request and returns its stream id, or 0 if the session
+  // takes no new streams.
+  std::uint32_t open(std::string_view method, const Url& url, const std::vector<Header>& headers,
+                     H2StreamHandler& handler);
+  // cancel resets a stream; its handler is not called again.
+  void cancel(std::uint32_t id);
+  // abandon closes a connection that stopped responding, failing its
+  // streams.
+  void abandon(const std::string& err);
+
+  void onEvent(bool readable, bool writable) override;
+
+ private:
+  struct Stream {
+    H2StreamHandler* handler = nullptr;
+    bool gotHeaders = false;
+    bool remoteClosed = false;  // END_STREAM seen; no RST_STREAM on cancel
+    std::int64_t unacked = 0;  // received bytes not yet returned by WINDOW_UPDATE
+  };
+
+  bool processFrames();
+  bool onFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t id, const std::uint8_t* p, std::size_t n);
+  bool onData(std::uint8_t flags, std::uint32_t id, const std::uint8_t* p, std::size_t n);
+  bool onHeaderBlock(std::uint32_t id, bool endStream);
+  bool onSettings(std::uint8_t flags, const std::uint8_t* p, std::size_t n);
+  void onGoAway(std::uint32_t lastId);
+  void closeStream(std::uint32_t id, const std::string& err, bool retry);
+  void writeFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t id, const void* payload, std::size_t n);
+  void windowUpdate(std::uint32_t id, std::uint32_t increment);
+  void fail(const std::string& err);
+  void closeIfDone();
+
+  EventLoop& loop_;
+  H2Pool& pool_;
+  std::unique_ptr<Connection> conn_;
+  std::string origin_;
+  HpackDecoder decoder_;
+
+  std::unordered_map<std::uint32_t, Stream> streams_;
+  std::uint32_t nextId_ = 1;
+  std::uint32_t maxStreams_ = 100;  // until the server's SETTINGS say otherwise
+  std::uint32_t peerMaxFrame_ = 16384;
+  std::int64_t connUnacked_ = 0;
+  bool draining_ = false;  // GOAWAY received: no new streams
+  bool closed_ = false;
+  bool inEvent_ = false;
+  EventLoop::TimerId resumeTimer_ = 0;  // reading paused by the shaper
+
+  std::string in_;
+  std::size_t inPos_ = 0;
+  std::string out_;
+  std::size_t outPos_ = 0;
+  // A header block in progress: HEADERS then CONTINUATION frames.
+  std::uint32_t blockStream_ = 0;
+  bool blockEndStream_ = false;
+  std::string block_;
+};
+
+// H2Pool keeps the HTTP/2 sessions of one event loop by origin. Concurrent
+// first requests to an HTTPS origin wait for the first connection's ALPN
+// answer rather than all dialing at once: if the server speaks h2 they
+// share that one connection.
+class H2Pool {
+ public:
+  using ReadyFn = std::function<void(std::shared_ptr<H2Session> session)>;
+
+  H2Pool(EventLoop& loop, Shaper& shaper, bool enabled) : loop_(loop), shaper_(shaper), enabled_(enabled) {}
+
+  Shaper& shaper() { return shaper_; }
+
+  // find returns a session to origin with room for a stream, or nullptr.
+  std::shared_ptr<H2Session> find(const std::string& origin);
+  // claim is called before dialing an HTTPS origin. It returns true when
+  // the caller should dial, and then owes a settle or adopt for origin.
+  // Otherwise ready runs on the loop once the dial in progress settles,
+  // with its session, or with nullptr to dial after all.
+  bool claim(const std::string& origin, ReadyFn ready);
+  // adopt turns a connection that negotiated h2 into a session.
+  std::shared_ptr<H2Session> adopt(std::unique_ptr<Connection> conn);
+  // settle ends a claim without a session; http1 records that the server
+  // chose HTTP/1.1, so later dials to it need not wait.
+  void settle(const std::string& origin, bool http1);
+  void remove(const H2Session& session);
+
+ private:
+  void wake(const std::string& origin, const std::shared_ptr<H2Session>& session);
+
+  EventLoop& loop_;
+  Shaper& shaper_;
+  bool enabled_;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<H2Session>>> sessions_;
+  std::unordered_map<std::string, std::vector<ReadyFn>> dialing_;
+  std::unordered_set<std::string> http1_;
+};
+
+}  // namespace urldl
@@ -0,0 +1,356 @@
+#include "hpack.h"
+
+#include <string_view>
+
+namespace urldl {
+
+namespace {
+
+struct StaticEntry {
+  std::string_view name;
+  std::string_view value;
+};
+
+// The static table of RFC 7541 Appendix A; index 1 is element 0.
+constexpr StaticEntry kStaticTable[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+constexpr std::size_t kStaticEntries = sizeof(kStaticTable) / sizeof(kStaticTable[0]);
+// Every table entry is charged this much beyond its name and value.
+constexpr std::size_t kEntryOverhead = 32;
+
+// The Huffman code of RFC 7541 Appendix B, by symbol.
+constexpr std::uint32_t kHuffmanCodes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+constexpr std::uint8_t kHuffmanBits[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+// HuffmanTree is the decoding trie of the code. Leaves hold a symbol;
+// inner nodes hold the indices of their two children.
+struct HuffmanTree {
+  struct Node {
+    std::int16_t child[2] = {-1, -1};
+    std::int16_t symbol = -1;
+  };
+  std::vector<Node> nodes;
+
+  HuffmanTree() : nodes(1) {
+    for (int sym = 0; sym < 256; ++sym) {
+      std::size_t at = 0;
+      for (int bit = kHuffmanBits[sym] - 1; bit >= 0; --bit) {
+        const int b = (kHuffmanCodes[sym] >> bit) & 1;
+        if (nodes[at].child[b] < 0) {
+          nodes[at].child[b] = static_cast<std::int16_t>(nodes.size());
+          nodes.emplace_back();
+        }
+        at = static_cast<std::size_t>(nodes[at].child[b]);
+      }
+      nodes[at].symbol = static_cast<std::int16_t>(sym);
+    }
+  }
+};
+
+bool huffmanDecode(const std::uint8_t* p, std::size_t n, std::string& out) {
+  static const HuffmanTree tree;
+  std::size_t at = 0;
+  int depth = 0;  // bits since the last symbol
+  bool ones = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    for (int bit = 7; bit >= 0; --bit) {
+      const int b = (p[i] >> bit) & 1;
+      const std::int16_t next = tree.nodes[at].child[b];
+      if (next < 0) {
+        return false;  // only EOS gets here, and it must not be encoded
+      }
+      at = static_cast<std::size_t>(next);
+      ++depth;
+      ones = ones && b == 1;
+      if (tree.nodes[at].symbol >= 0) {
+        out.push_back(static_cast<char>(tree.nodes[at].symbol));
+        at = 0;
+        depth = 0;
+        ones = true;
+      }
+    }
+  }
+  // What is left must be padding: fewer than 8 bits of the EOS prefix.
+  return depth < 8 && ones;
+}
+
+// readInt decodes an integer with an n-bit prefix (RFC 7541 5.1).
+bool readInt(const std::uint8_t*& p, const std::uint8_t* end, int prefix, std::uint64_t& out) {
+  if (p == end) {
+    return false;
+  }
+  const std::uint64_t mask = (1u << prefix) - 1;
+  out = *p++ & mask;
+  if (out < mask) {
+    return true;
+  }
+  for (int shift = 0; shift < 56; shift += 7) {
+    if (p == end) {
+      return false;
+    }
+    const std::uint8_t b = *p++;
+    out += static_cast<std::uint64_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool readString(const std::uint8_t*& p, const std::uint8_t* end, std::string& out) {
+  if (p == end) {
+    return false;
+  }
+  const bool huffman = (*p & 0x80) != 0;
+  std::uint64_t len = 0;
+  if (!readInt(p, end, 7, len) || len > static_cast<std::uint64_t>(end - p)) {
+    return false;
+  }
+  out.clear();
+  if (huffman) {
+    if (!huffmanDecode(p, static_cast<std::size_t>(len), out)) {
+      return false;
+    }
+  } else {
+    out.assign(reinterpret_cast<const char*>(p), static_cast<std::size_t>(len));
+  }
+  p += len;
+  return true;
+}
+
+void writeInt(std::string& out, std::uint8_t first, int prefix, std::uint64_t value) {
+  const std::uint64_t mask = (1u << prefix) - 1;
+  if (value < mask) {
+    out.push_back(static_cast<char>(first | value));
+    return;
+  }
+  out.push_back(static_cast<char>(first | mask));
+  value -= mask;
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(0x80 | (value & 0x7f)));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void writeString(std::string& out, std::string_view s) {
+  writeInt(out, 0, 7, s.size());
+  out.append(s);
+}
+
+}  // namespace
+
+bool HpackDecoder::lookup(std::uint64_t index, Header& out) const {
+  if (index == 0) {
+    return false;
+  }
+  if (index <= kStaticEntries) {
+    out.name = std::string(kStaticTable[index - 1].name);
+    out.value = std::string(kStaticTable[index - 1].value);
+    return true;
+  }
+  index -= kStaticEntries + 1;
+  if (index >= dynamic_.size()) {
+    return false;
+  }
+  out = dynamic_[static_cast<std::size_t>(index)];
+  return true;
+}
+
+void HpackDecoder::insert(Header h) {
+  const std::size_t size = h.name.size() + h.value.size() + kEntryOverhead;
+  if (size > tableSize_) {
+    // An entry larger than the table empties it (RFC 7541 4.4).
+    evict(0);
+    return;
+  }
+  evict(tableSize_ - size);
+  size_ += size;
+  dynamic_.push_front(std::move(h));
+}
+
+void HpackDecoder::evict(std::size_t limit) {
+  while (size_ > limit) {
+    const Header& last = dynamic_.back();
+    size_ -= last.name.size() + last.value.size() + kEntryOverhead;
+    dynamic_.pop_back();
+  }
+}
+
+bool HpackDecoder::decode(const std::uint8_t* data, std::size_t n, std::vector<Header>& out, std::string& err) {
+  const std::uint8_t* p = data;
+  const std::uint8_t* end = data + n;
+  err = "hpack: malformed header block";
+  while (p < end) {
+    const std::uint8_t b = *p;
+    Header h;
+    std::uint64_t index = 0;
+    if (b & 0x80) {  // indexed field
+      if (!readInt(p, end, 7, index) || !lookup(index, h)) {
+        return false;
+      }
+      out.push_back(std::move(h));
+      continue;
+    }
+    if ((b & 0xe0) == 0x20) {  // dynamic table size update
+      if (!readInt(p, end, 5, index) || index > maxSize_) {
+        return false;
+      }
+      tableSize_ = static_cast<std::size_t>(index);
+      evict(tableSize_);
+      continue;
+    }
+    // Literal: with incremental indexing (01), or without / never (000x).
+    const bool indexing = (b & 0xc0) == 0x40;
+    if (!readInt(p, end, indexing ? 6 : 4, index)) {
+      return false;
+    }
+    if (index != 0) {
+      if (!lookup(index, h)) {
+        return false;
+      }
+    } else if (!readString(p, end, h.name)) {
+      return false;
+    }
+    if (!readString(p, end, h.value)) {
+      return false;
+    }
+    if (indexing) {
+      insert(h);
+    }
+    out.push_back(std::move(h));
+  }
+  err.clear();
+  return true;
+}
+
+void hpackEncode(const std::vector<Header>& headers, std::string& out) {
+  for (const Header& h : headers) {
+    std::size_t index = 0;
+    for (std::size_t i = 0; i < kStaticEntries; ++i) {
+      if (kStaticTable[i].name == h.name) {
+        index = i + 1;
+        break;
+      }
+    }
+    writeInt(out, 0x00, 4, index);  // literal without indexing
+    if (index == 0) {
+      writeString(out, h.name);
+    }
+    writeString(out, h.value);
+  }
+}
+
+}  // namespace urldl
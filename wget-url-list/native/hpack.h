@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "http.h"
+
+namespace urldl {
+
+// HpackDecoder decodes the header blocks of one HTTP/2 connection
+// (RFC 7541). It owns that connection's dynamic table, so every block the
+// peer sends must pass through it in order, even for streams nobody is
+// listening to any more.
+class HpackDecoder {
+ public:
+  bool decode(const std::uint8_t* data, std::size_t n, std::vector<Header>& out, std::string& err);
+
+ private:
+  bool lookup(std::uint64_t index, Header& out) const;
+  void insert(Header h);
+  void evict(std::size_t limit);
+
+  std::deque<Header> dynamic_;  // newest first
+  std::size_t size_ = 0;
+  std::size_t maxSize_ = 4096;  // SETTINGS_HEADER_TABLE_SIZE, which is never changed
+  std::size_t tableSize_ = 4096;
+};
+
+// hpackEncode appends the header block for headers. Every field is a
+// literal that is never added to the dynamic table, so encoding needs no
+// per-connection state; names in the static table go by index.
+void hpackEncode(const std::vector<Header>& headers, std::string& out);
+
+}  // namespace urldl
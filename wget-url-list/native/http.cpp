@@ -0,0 +1,362 @@
+#include "http.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+
+namespace urldl {
+
+namespace {
+
+constexpr std::size_t kMaxHeaderBytes = 64 * 1024;
+
+std::string_view trimOWS(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+  return s;
+}
+
+bool containsToken(std::string_view list, std::string_view token) {
+  while (!list.empty()) {
+    const auto comma = list.find(',');
+    if (equalsIgnoreCase(trimOWS(list.substr(0, comma)), token)) {
+      return true;
+    }
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma + 1);
+  }
+  return false;
+}
+
+bool parseInt64(std::string_view s, std::int64_t& out, int base = 10) {
+  if (s.empty()) {
+    return false;
+  }
+  const auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out, base);
+  return ec == std::errc() && ptr == s.data() + s.size() && out >= 0;
+}
+
+// takeLine moves bytes up to and including '\n' into line. It returns false
+// when the line is still incomplete.
+bool takeLine(std::string& line, const char* data, std::size_t n, std::size_t& used) {
+  const char* start = data + used;
+  const char* nl = static_cast<const char*>(std::memchr(start, '\n', n - used));
+  if (nl == nullptr) {
+    line.append(start, n - used);
+    used = n;
+    return false;
+  }
+  line.append(start, static_cast<std::size_t>(nl - start));
+  used += static_cast<std::size_t>(nl - start) + 1;
+  if (!line.empty() && line.back() == '\r') {
+    line.pop_back();
+  }
+  return true;
+}
+
+}  // namespace
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+const std::string* Response::header(std::string_view name) const {
+  for (const auto& h : headers) {
+    if (equalsIgnoreCase(h.name, name)) {
+      return &h.value;
+    }
+  }
+  return nullptr;
+}
+
+std::string buildRequest(std::string_view method, const Url& url, const std::vector<Header>& extra) {
+  std::string req;
+  req.reserve(256);
+  req.append(method).append(" ").append(url.target).append(" HTTP/1.1\r\n");
+  req.append("Host: ").append(url.hostHeader()).append("\r\n");
+  req.append("User-Agent: ").append(kUserAgent).append("\r\n");
+  req.append("Accept: */*\r\n");
+  req.append("Accept-Encoding: identity\r\n");
+  for (const auto& h : extra) {
+    req.append(h.name).append(": ").append(h.value).append("\r\n");
+  }
+  req.append("\r\n");
+  return req;
+}
+
+bool parseContentRange(std::string_view value, std::int64_t& first, std::int64_t& last,
+                       std::int64_t& total) {
+  value = trimOWS(value);
+  if (value.substr(0, 6) != "bytes ") {
+    return false;
+  }
+  value.remove_prefix(6);
+  const auto dash = value.find('-');
+  const auto slash = value.find('/');
+  if (dash == std::string_view::npos || slash == std::string_view::npos || dash > slash) {
+    return false;
+  }
+  if (!parseInt64(value.substr(0, dash), first) || !parseInt64(value.substr(dash + 1, slash - dash - 1), last) ||
+      last < first) {
+    return false;
+  }
+  const std::string_view totalText = value.substr(slash + 1);
+  if (totalText == "*") {
+    total = -1;
+    return true;
+  }
+  return parseInt64(totalText, total);
+}
+
+bool isRedirect(int status) {
+  return status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+}
+
+bool isThrottled(int status) { return status == 429 || status == 503; }
+
+std::int64_t retryAfterSeconds(const Response& resp) {
+  const std::string* value = resp.header("Retry-After");
+  if (value == nullptr) {
+    return -1;
+  }
+  const std::string_view v = trimOWS(*value);
+  std::int64_t seconds = -1;
+  const auto [ptr, ec] = std::from_chars(v.data(), v.data() + v.size(), seconds);
+  if (ec == std::errc() && ptr == v.data() + v.size()) {
+    return seconds >= 0 ? seconds : -1;
+  }
+  // IMF-fixdate, the only date form servers are still allowed to send.
+  std::tm tm{};
+  const std::string date(v);
+  const char* end = ::strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (end == nullptr || *end != '\0') {
+    return -1;
+  }
+  const std::time_t when = ::timegm(&tm);
+  const std::time_t now = std::time(nullptr);
+  return when > now ? static_cast<std::int64_t>(when - now) : 0;
+}
+
+std::string validatorFor(const Response& resp) {
+  const std::string* etag = resp.header("ETag");
+  if (etag != nullptr && !etag->empty() && etag->rfind("W/", 0) != 0) {
+    return *etag;
+  }
+  const std::string* modified = resp.header("Last-Modified");
+  return modified != nullptr ? *modified : "";
+}
+
+std::int64_t ResponseParser::bodyRemaining() const {
+  switch (state_) {
+    case State::Body:
+      return remaining_;
+    case State::Done:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+void ResponseParser::skipBody(std::size_t n) {
+  if (state_ != State::Body) {
+    return;
+  }
+  remaining_ -= std::min<std::int64_t>(remaining_, static_cast<std::int64_t>(n));
+  if (remaining_ == 0) {
+    state_ = State::Done;
+  }
+}
+
+bool ResponseParser::fail(std::string message) {
+  state_ = State::Error;
+  error_ = std::move(message);
+  return false;
+}
+
+bool ResponseParser::parseHead(std::string_view head) {
+  response_ = Response{};
+  const auto eol = head.find('\n');
+  std::string_view status = trimOWS(head.substr(0, eol));
+  head = eol == std::string_view::npos ? std::string_view{} : head.substr(eol + 1);
+
+  if (status.substr(0, 5) != "HTTP/" || status.size() < 12 || status[8] != ' ') {
+    return fail("malformed status line");
+  }
+  const bool http10 = status.substr(5, 3) == "1.0";
+  std::int64_t statusCode = 0;
+  if (!parseInt64(status.substr(9, 3), statusCode) || statusCode < 100 || statusCode > 999) {
+    return fail("malformed status code");
+  }
+  response_.status = static_cast<int>(statusCode);
+  response_.reason = std::string(trimOWS(status.substr(12)));
+  response_.keepAlive = !http10;
+
+  bool chunked = false;
+  while (!head.empty()) {
+    const auto nl = head.find('\n');
+    std::string_view line = head.substr(0, nl);
+    head = nl == std::string_view::npos ? std::string_view{} : head.substr(nl + 1);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.empty()) {
+      break;
+    }
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) {
+      return fail("malformed header line");
+    }
+    Header h{std::string(line.substr(0, colon)), std::string(trimOWS(line.substr(colon + 1)))};
+    if (equalsIgnoreCase(h.name, "Connection")) {
+      if (containsToken(h.value, "close")) {
+        response_.keepAlive = false;
+      } else if (containsToken(h.value, "keep-alive")) {
+        response_.keepAlive = true;
+      }
+    } else if (equalsIgnoreCase(h.name, "Transfer-Encoding")) {
+      chunked = containsToken(h.value, "chunked");
+    } else if (equalsIgnoreCase(h.name, "Content-Length")) {
+      if (!parseInt64(h.value, response_.contentLength)) {
+        return fail("malformed Content-Length");
+      }
+    }
+    response_.headers.push_back(std::move(h));
+  }
+
+  const int code = response_.status;
+  if (headRequest_ || code == 204 || code == 304 || code < 200) {
+    state_ = State::Done;
+  } else if (chunked) {
+    response_.contentLength = -1;
+    state_ = State::ChunkSize;
+  } else if (response_.contentLength >= 0) {
+    remaining_ = response_.contentLength;
+    state_ = remaining_ == 0 ? State::Done : State::Body;
+  } else {
+    response_.keepAlive = false;
+    state_ = State::UntilClose;
+  }
+  return true;
+}
+
+std::size_t ResponseParser::feed(const char* data, std::size_t n, const BodyFn& onBody) {
+  std::size_t used = 0;
+  while (used < n) {
+    switch (state_) {
+      case State::Headers: {
+        const std::size_t before = line_.size();
+        line_.append(data + used, n - used);
+        const std::size_t from = before < 3 ? 0 : before - 3;
+        auto end = line_.find("\r\n\r\n", from);
+        std::size_t endLen = 4;
+        if (end == std::string::npos) {
+          end = line_.find("\n\n", from < 1 ? 0 : from);
+          endLen = 2;
+        }
+        if (end == std::string::npos) {
+          used = n;
+          if (line_.size() > kMaxHeaderBytes) {
+            fail("response header too large");
+          }
+          return used;
+        }
+        const std::size_t headLen = end + endLen;
+        used += headLen - before;
+        line_.resize(headLen);
+        const std::string head = std::move(line_);
+        line_.clear();
+        if (!parseHead(head)) {
+          return used;
+        }
+        if (response_.status >= 100 && response_.status < 200 && response_.status != 101 && !headRequest_) {
+          state_ = State::Headers;  // interim response; the real one follows
+          continue;
+        }
+        return used;
+      }
+      case State::Body:
+      case State::ChunkData: {
+        const auto take = static_cast<std::size_t>(std::min<std::int64_t>(remaining_, static_cast<std::int64_t>(n - used)));
+        if (!onBody(data + used, take)) {
+          fail("aborted");
+          return used;
+        }
+        used += take;
+        remaining_ -= static_cast<std::int64_t>(take);
+        if (remaining_ == 0) {
+          state_ = state_ == State::Body ? State::Done : State::ChunkDataEnd;
+        }
+        break;
+      }
+      case State::ChunkSize: {
+        if (!takeLine(line_, data, n, used)) {
+          if (line_.size() > 1024) fail("malformed chunk size");
+          break;
+        }
+        std::string_view sizeText = trimOWS(std::string_view(line_).substr(0, line_.find(';')));
+        std::int64_t size = 0;
+        if (!parseInt64(sizeText, size, 16)) {
+          fail("malformed chunk size");
+          return used;
+        }
+        line_.clear();
+        remaining_ = size;
+        state_ = size == 0 ? State::Trailers : State::ChunkData;
+        break;
+      }
+      case State::ChunkDataEnd:
+        if (!takeLine(line_, data, n, used)) {
+          break;
+        }
+        if (!line_.empty()) {
+          fail("malformed chunk terminator");
+          return used;
+        }
+        state_ = State::ChunkSize;
+        break;
+      case State::Trailers:
+        if (!takeLine(line_, data, n, used)) {
+          if (line_.size() > kMaxHeaderBytes) fail("response trailer too large");
+          break;
+        }
+        if (line_.empty()) {
+          state_ = State::Done;
+        }
+        line_.clear();
+        break;
+      case State::UntilClose:
+        if (!onBody(data + used, n - used)) {
+          fail("aborted");
+          return used;
+        }
+        used = n;
+        break;
+      case State::Done:
+      case State::Error:
+        return used;
+    }
+  }
+  return used;
+}
+
+bool ResponseParser::finish() {
+  if (state_ == State::UntilClose) {
+    state_ = State::Done;
+    return true;
+  }
+  if (state_ == State::Done) {
+    return true;
+  }
+  if (state_ != State::Error) {
+    fail(state_ == State::Headers ? "connection closed before response" : "connection closed mid-body");
+  }
+  return false;
+}
+
+}  // namespace urldl
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "url.h"
+
+namespace urldl {
+
+constexpr std::string_view kUserAgent = "url-downloader/0.1";
+
+struct Header {
+  std::string name;
+  std::string value;
+};
+
+struct Response {
+  int status = 0;
+  std::string reason;
+  bool keepAlive = true;
+  std::int64_t contentLength = -1;  // -1 when the body is chunked or runs to EOF
+  std::vector<Header> headers;
+
+  // header returns the first value of the named header, or nullptr.
+  const std::string* header(std::string_view name) const;
+};
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b);
+
+std::string buildRequest(std::string_view method, const Url& url, const std::vector<Header>& extra);
+
+// parseContentRange reads "bytes first-last/total" ("*" total yields -1).
+bool parseContentRange(std::string_view value, std::int64_t& first, std::int64_t& last,
+                       std::int64_t& total);
+
+bool isRedirect(int status);
+
+// isThrottled reports a server asking the client to back off: 429 Too Many
+// Requests, or 503 Service Unavailable.
+bool isThrottled(int status);
+
+// retryAfterSeconds reads Retry-After, as delay-seconds or an HTTP date. It
+// returns -1 when the header is missing or unreadable.
+std::int64_t retryAfterSeconds(const Response& resp);
+
+// validatorFor picks the value that proves a stored copy is still the same
+// file: a strong ETag, else Last-Modified, else "". Weak ETags cannot be
+// used for ranges.
+std::string validatorFor(const Response& resp);
+
+// ResponseParser incrementally decodes one HTTP/1.x response. feed() stops
+// right after the header block so the caller can inspect the status before
+// any body bytes are delivered.
+class ResponseParser {
+ public:
+  using BodyFn = std::function<bool(const char* data, std::size_t n)>;
+
+  explicit ResponseParser(bool headRequest = false) : headRequest_(headRequest) {}
+
+  // feed consumes input and returns how many bytes it used. Body bytes go to
+  // onBody; returning false from onBody aborts parsing.
+  std::size_t feed(const char* data, std::size_t n, const BodyFn& onBody);
+  // finish signals EOF; it completes bodies that are delimited by close.
+  bool finish();
+
+  bool headersDone() const { return state_ > State::Headers; }
+  bool done() const { return state_ == State::Done; }
+  bool failed() const { return state_ == State::Error; }
+  // bodyRemaining is the number of body bytes still expected, or -1.
+  std::int64_t bodyRemaining() const;
+  // rawBody reports whether the rest of the body is plain bytes on the wire
+  // (Content-Length or read-until-close), so it may bypass feed().
+  bool rawBody() const { return state_ == State::Body || state_ == State::UntilClose; }
+  // skipBody accounts for n raw body bytes the caller consumed itself.
+  void skipBody(std::size_t n);
+  const std::string& error() const { return error_; }
+  const Response& response() const { return response_; }
+
+ private:
+  enum class State { Headers, Body, ChunkSize, ChunkData, ChunkDataEnd, Trailers, UntilClose, Done, Error };
+
+  bool parseHead(std::string_view head);
+  bool fail(std::string message);
+
+  bool headRequest_;
+  State state_ = State::Headers;
+  std::string line_;
+  std::int64_t remaining_ = 0;
+  std::string error_;
+  Response response_;
+};
+
+}  // namespace urldl
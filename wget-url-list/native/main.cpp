@@ -0,0 +1,762 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "budget.h"
+#include "downloader.h"
+#include "url.h"
+#include "url_batch.h"
+
+namespace {
+
+constexpr int kDefaultWorkers = 256;
+constexpr int kDefaultPerHost = 8;
+constexpr int kDefaultSegments = 4;
+constexpr const char* kIndexName = ".urldl-index";
+
+struct Flags {
+  std::string dir = "~/Downloads/mobile/";
+  std::string index;  // empty means kIndexName in the download directory
+  std::string metrics;
+  std::string metricsFormat = "json";
+  std::string budgetDir;  // empty without a shared budget
+  int workers = kDefaultWorkers;
+  int perHost = kDefaultPerHost;
+  int segments = kDefaultSegments;
+  int threads = 0;
+  std::int64_t limitRate = 0;  // bytes per second
+  double hostRate = 0;         // requests per second
+  bool direct = false;
+  bool http2 = true;
+  bool revalidate = false;
+  bool stream = false;
+  bool fromStdin = false;
+  bool progress = isatty(STDERR_FILENO) != 0;
+};
+
+// defaultThreads sizes the event loop pool. Transfers are I/O bound, so a
+// couple of loops saturate a link long before they saturate a core.
+int defaultThreads() {
+  const unsigned cpus = std::thread::hardware_concurrency();
+  if (cpus < 4) {
+    return 1;
+  }
+  return cpus < 8 ? 2 : 4;
+}
+
+int clampWorkers(int requested, int urls) {
+  if (requested < 1) {
+    return 1;
+  }
+  if (requested > urls) {
+    return urls;
+  }
+  return requested;
+}
+
+bool parseInt(const std::string& name, const std::string& value, int& out) {
+  try {
+    out = std::stoi(value);
+    return true;
+  } catch (const std::exception&) {
+    std::cerr << "invalid value \"" << value << "\" for flag -" << name << "\n";
+    return false;
+  }
+}
+
+// parseRate reads a byte rate the way wget's --limit-rate does: a number
+// with an optional k, m or g suffix for binary multiples.
+bool parseRate(const std::string& name, const std::string& value, std::int64_t& out) {
+  double amount = 0;
+  std::size_t used = 0;
+  try {
+    amount = std::stod(value, &used);
+  } catch (const std::exception&) {
+    used = 0;
+  }
+  std::string suffix = value.substr(used);
+  double scale = 1;
+  if (suffix == "k" || suffix == "K") {
+    scale = 1024;
+  } else if (suffix == "m" || suffix == "M") {
+    scale = 1024 * 1024;
+  } else if (suffix == "g" || suffix == "G") {
+    scale = 1024.0 * 1024 * 1024;
+  } else if (!suffix.empty()) {
+    used = 0;
+  }
+  if (used == 0 || !(amount >= 0)) {
+    std::cerr << "invalid value \"" << value << "\" for flag -" << name << "\n";
+    return false;
+  }
+  out = static_cast<std::int64_t>(amount * scale);
+  return true;
+}
+
+bool parseFloat(const std::string& name, const std::string& value, double& out) {
+  try {
+    std::size_t used = 0;
+    out = std::stod(value, &used);
+    if (used == value.size() && out >= 0) {
+      return true;
+    }
+  } catch (const std::exception&) {
+  }
+  std::cerr << "invalid value \"" << value << "\" for flag -" << name << "\n";
+  return false;
+}
+
+// parseBool accepts the values Go's strconv.ParseBool does.
+bool parseBool(const std::string& name, const std::string& value, bool& out) {
+  if (value == "1" || value == "t" || value == "T" || value == "true" || value == "TRUE" || value == "True") {
+    out = true;
+    return true;
+  }
+  if (value == "0" || value == "f" || value == "F" || value == "false" || value == "FALSE" || value == "False") {
+    out = false;
+    return true;
+  }
+  std::cerr << "invalid boolean value \"" << value << "\" for -" << name << "\n";
+  return false;
+}
+
+// boolFlag returns the field behind a boolean flag, or nullptr.
+bool* boolFlag(Flags& flags, const std::string& name) {
+  if (name == "direct") return &flags.direct;
+  if (name == "http2") return &flags.http2;
+  if (name == "revalidate") return &flags.revalidate;
+  if (name == "stream") return &flags.stream;
+  if (name == "stdin") return &flags.fromStdin;
+  if (name == "progress") return &flags.progress;
+  return nullptr;
+}
+
+void usage(const char* argv0) {
+  std::cerr << "Usage of " << argv0 << ":\n"
+            << "  -budget-dir string\n"
+            << "    \tshare download slots with other tools through this directory (default $JOB_BUDGET_DIR)\n"
+            << "  -direct\n"
+            << "    \twrite with O_DIRECT to bypass the page cache\n"
+            << "  -dir string\n"
+            << "    \tdownload directory (default \"~/Downloads/mobile/\")\n"
+            << "  -host-rate float\n"
+            << "    \trequests started per second per host, 0 for no limit\n"
+            << "  -http2\n"
+            << "    \toffer HTTP/2 to HTTPS servers (default true)\n"
+            << "  -index string\n"
+            << "    \tindex of completed downloads, \"off\" to disable (default \"<dir>/" << kIndexName << "\")\n"
+            << "  -limit-rate string\n"
+            << "    \tcap on the total download rate in bytes per second, with k, m or g suffixes (e.g. 10m)\n"
+            << "  -metrics string\n"
+            << "    \twrite per-file and batch metrics to this file\n"
+            << "  -metrics-format string\n"
+            << "    \t\"json\" for JSON lines or \"prom\" for Prometheus text (default \"json\")\n"
+            << "  -per-host int\n"
+            << "    \tparallel downloads per host (default " << kDefaultPerHost << ")\n"
+            << "  -progress\n"
+            << "    \tshow a live progress line on stderr (default true when it is a terminal)\n"
+            << "  -revalidate\n"
+            << "    \tcheck indexed files with the server instead of skipping them\n"
+            << "  -segments int\n"
+            << "    \tparallel ranges per large file, 1 to disable (default " << kDefaultSegments << ")\n"
+            << "  -stdin\n"
+            << "    \tread URLs from standard input without prompting, downloading each as it arrives\n"
+            << "  -stream\n"
+            << "    \tstart each pasted URL right away instead of waiting for :go\n"
+            << "  -threads int\n"
+            << "    \tnetwork event loop threads (default " << defaultThreads() << ")\n"
+            << "  -workers int\n"
+            << "    \tnumber of parallel downloads (default " << kDefaultWorkers << ")\n";
+}
+
+// parseFlags accepts the same spellings as Go's flag package: -name value,
+// -name=value, and the double-dash forms; boolean flags take no value
+// unless it is attached with =.
+bool parseFlags(int argc, char** argv, Flags& flags) {
+  flags.threads = defaultThreads();
+  flags.budgetDir = urldl::budgetDir();
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "-help" || arg == "--help") {
+      usage(argv[0]);
+      std::exit(0);
+    }
+    if (arg.size() < 2 || arg[0] != '-') {
+      break;
+    }
+    arg.erase(0, arg[1] == '-' ? 2 : 1);
+    std::string value;
+    const auto eq = arg.find('=');
+    if (eq != std::string::npos) {
+      value = arg.substr(eq + 1);
+      arg.resize(eq);
+    } else if (boolFlag(flags, arg) != nullptr) {
+      value = "true";
+    } else if (i + 1 < argc) {
+      value = argv[++i];
+    } else {
+      std::cerr << "flag needs an argument: -" << arg << "\n";
+      usage(argv[0]);
+      return false;
+    }
+
+    if (arg == "dir") {
+      flags.dir = value;
+    } else if (arg == "budget-dir") {
+      flags.budgetDir = value;
+    } else if (arg == "index") {
+      flags.index = value;
+    } else if (arg == "metrics") {
+      flags.metrics = value;
+    } else if (arg == "metrics-format") {
+      if (value != "json" && value != "prom") {
+        std::cerr << "invalid value \"" << value << "\" for flag -" << arg << "\n";
+        usage(argv[0]);
+        return false;
+      }
+      flags.metricsFormat = value;
+    } else if (bool* out = boolFlag(flags, arg)) {
+      if (!parseBool(arg, value, *out)) {
+        usage(argv[0]);
+        return false;
+      }
+    } else if (arg == "limit-rate") {
+      if (!parseRate(arg, value, flags.limitRate)) {
+        usage(argv[0]);
+        return false;
+      }
+    } else if (arg == "host-rate") {
+      if (!parseFloat(arg, value, flags.hostRate)) {
+        usage(argv[0]);
+        return false;
+      }
+    } else if (arg == "workers" || arg == "per-host" || arg == "segments" || arg == "threads") {
+      int& out = arg == "workers"    ? flags.workers
+                 : arg == "per-host" ? flags.perHost
+                 : arg == "segments" ? flags.segments
+                                     : flags.threads;
+      if (!parseInt(arg, value, out)) {
+        usage(argv[0]);
+        return false;
+      }
+    } else {
+      std::cerr << "flag provided but not defined: -" << arg << "\n";
+      usage(argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool expandPath(std::string path, std::string& out) {
+  if (!path.empty() && path[0] == '~') {
+    const char* home = std::getenv("HOME");
+    if (home == nullptr || *home == '\0') {
+      return false;
+    }
+    path = std::string(home) + "/" + path.substr(1);
+  }
+  std::string clean = std::filesystem::path(path).lexically_normal().string();
+  while (clean.size() > 1 && clean.back() == '/') {
+    clean.pop_back();
+  }
+  out = clean.empty() ? "." : clean;
+  return true;
+}
+
+std::string trimSpace(const std::string& s) {
+  const auto begin = s.find_first_not_of(" \t\r\n\v\f");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  const auto end = s.find_last_not_of(" \t\r\n\v\f");
+  return s.substr(begin, end - begin + 1);
+}
+
+// promptURLs reads pasted lines up to :go or :q, cleaning each into batch
+// as it arrives, like gatherURLs over the whole paste.
+void promptURLs(urldl::UrlBatch& batch, bool& shouldQuit) {
+  std::cout << "Paste MP4 URLs (one per line). Blank lines are ignored. Type ':go' to start, ':q' to quit.\n";
+
+  std::string line;
+  for (;;) {
+    std::cout << "> " << std::flush;
+    if (!std::getline(std::cin, line)) {
+      batch.add(line);
+      shouldQuit = true;
+      return;
+    }
+
+    const std::string stripped = trimSpace(line);
+    if (stripped == ":q" || stripped == ":quit" || stripped == ":exit") {
+      shouldQuit = true;
+      return;
+    }
+    if (stripped == ":go" || stripped == ":start" || stripped == ":run") {
+      shouldQuit = false;
+      return;
+    }
+    batch.add(line);
+  }
+}
+
+// Progress redraws one status line on stderr every second while a batch
+// runs: files finished, bytes received and the current rate, all read from
+// the downloader's counters.
+class Progress {
+ public:
+  // total is the number of files in the batch, or 0 when it is not known.
+  Progress(const urldl::Metrics& metrics, bool enabled, std::size_t total)
+      : metrics_(metrics), total_(total), doneAtStart_(finished()),
+        bytesAtStart_(metrics.bytes.load(std::memory_order_relaxed)) {
+    if (enabled) {
+      thread_ = std::thread([this] { run(); });
+    }
+  }
+
+  ~Progress() {
+    if (!thread_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    std::cerr << "\r\033[K" << std::flush;
+  }
+
+  Progress(const Progress&) = delete;
+  Progress& operator=(const Progress&) = delete;
+
+ private:
+  std::int64_t finished() const {
+    return metrics_.filesOk.load(std::memory_order_relaxed) + metrics_.filesFailed.load(std::memory_order_relaxed);
+  }
+
+  void run() {
+    std::int64_t lastBytes = bytesAtStart_;
+    auto last = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!cv_.wait_for(lock, std::chrono::seconds(1), [this] { return stop_; })) {
+      const auto now = std::chrono::steady_clock::now();
+      const std::int64_t bytes = metrics_.bytes.load(std::memory_order_relaxed);
+      const double secs = std::chrono::duration<double>(now - last).count();
+      const double rate = secs > 0 ? static_cast<double>(bytes - lastBytes) / secs : 0;
+      lastBytes = bytes;
+      last = now;
+
+      char line[160];
+      const long long done = finished() - doneAtStart_;
+      const double mib = static_cast<double>(bytes - bytesAtStart_) / (1024 * 1024);
+      if (total_ > 0) {
+        std::snprintf(line, sizeof(line), "%lld/%zu files  %.1f MiB  %.2f MiB/s  %d active", done, total_, mib,
+                      rate / (1024 * 1024), metrics_.active.load(std::memory_order_relaxed));
+      } else {
+        std::snprintf(line, sizeof(line), "%lld files  %.1f MiB  %.2f MiB/s  %d active", done, mib,
+                      rate / (1024 * 1024), metrics_.active.load(std::memory_order_relaxed));
+      }
+      std::cerr << "\r\033[K" << line << std::flush;
+    }
+  }
+
+  const urldl::Metrics& metrics_;
+  const std::size_t total_;
+  const std::int64_t doneAtStart_;
+  const std::int64_t bytesAtStart_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+// Interrupts turns Ctrl-C into a cancel. The first SIGINT fails the queued
+// URLs and lets the transfers in flight finish; a second one, or one with
+// no batch running, quits at once. Either way partial files stay
+// resumable. SIGINT is blocked from construction on, so construct it
+// before any thread that must not take the signal.
+class Interrupts {
+ public:
+  Interrupts() {
+    sigemptyset(&set_);
+    sigaddset(&set_, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set_, nullptr);
+    if (::pipe(wake_) == 0) {
+      ::fcntl(wake_[0], F_SETFD, FD_CLOEXEC);
+      ::fcntl(wake_[1], F_SETFD, FD_CLOEXEC);
+    }
+  }
+  Interrupts(const Interrupts&) = delete;
+  Interrupts& operator=(const Interrupts&) = delete;
+
+  // watch starts the thread that waits for the signal. It is left running
+  // until the process exits.
+  void watch(urldl::Downloader& downloader) {
+    std::thread([this, &downloader] {
+      int sig = 0;
+      sigwait(&set_, &sig);
+      interrupted_.store(true);
+      if (wake_[1] >= 0) {
+        const char byte = 0;
+        [[maybe_unused]] auto rc = ::write(wake_[1], &byte, 1);
+      }
+      if (!downloader.cancel()) {
+        std::_Exit(130);
+      }
+      std::cerr << "\nInterrupted: finishing the transfers in flight; press Ctrl-C again to quit now.\n";
+      sigwait(&set_, &sig);
+      std::_Exit(130);
+    }).detach();
+  }
+
+  bool interrupted() const { return interrupted_.load(); }
+  // wakeFd turns readable on the first SIGINT, for a poll that must not
+  // outlast it; -1 if the pipe could not be made.
+  int wakeFd() const { return wake_[0]; }
+
+ private:
+  sigset_t set_;
+  int wake_[2] = {-1, -1};
+  std::atomic<bool> interrupted_{false};
+};
+
+// StdinLines reads standard input a line at a time, like std::getline on
+// std::cin, but polls it together with a wake descriptor, so a Ctrl-C stops
+// the read even while the other end of a pipe sends nothing and stays open.
+class StdinLines {
+ public:
+  explicit StdinLines(int wakeFd) : wakeFd_(wakeFd) {}
+
+  // next reads one line without its newline. It returns false at the end of
+  // input, on a read error, or once wakeFd is readable.
+  bool next(std::string& line) {
+    for (;;) {
+      if (const auto nl = buf_.find('\n', pos_); nl != std::string::npos) {
+        line.assign(buf_, pos_, nl - pos_);
+        pos_ = nl + 1;
+        return true;
+      }
+      if (eof_) {
+        if (pos_ == buf_.size()) {
+          return false;
+        }
+        line.assign(buf_, pos_);
+        pos_ = buf_.size();
+        return true;
+      }
+      buf_.erase(0, pos_);
+      pos_ = 0;
+      pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+      if (::poll(fds, wakeFd_ >= 0 ? 2 : 1, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      if (fds[1].revents != 0) {
+        return false;
+      }
+      char chunk[4096];
+      const ssize_t n = ::read(STDIN_FILENO, chunk, sizeof(chunk));
+      if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+          continue;
+        }
+        return false;
+      }
+      if (n == 0) {
+        eof_ = true;
+      } else {
+        buf_.append(chunk, static_cast<std::size_t>(n));
+      }
+    }
+  }
+
+ private:
+  int wakeFd_;
+  std::string buf_;
+  std::size_t pos_ = 0;
+  bool eof_ = false;
+};
+
+// MetricsDump writes the -metrics file: in JSON one line per file and a
+// summary line per batch, in Prometheus text the totals rewritten at the
+// end of every batch.
+class MetricsDump {
+ public:
+  MetricsDump(std::string path, bool prom) : path_(std::move(path)), prom_(prom) {}
+
+  bool open() {
+    if (path_.empty()) {
+      return true;
+    }
+    out_.open(path_, std::ios::out | std::ios::trunc);
+    if (!out_) {
+      std::cerr << "open metrics file " << path_ << " failed\n";
+      return false;
+    }
+    return true;
+  }
+
+  void file(const urldl::DownloadResult& result) {
+    if (!out_.is_open() || prom_) {
+      return;
+    }
+    urldl::writeDownloadJson(out_, result.url, result.outcome, result.message(), result.stats);
+    out_ << '\n' << std::flush;
+  }
+
+  void batch(const urldl::Metrics& metrics) {
+    if (!out_.is_open()) {
+      return;
+    }
+    if (prom_) {
+      out_.close();
+      out_.open(path_, std::ios::out | std::ios::trunc);
+      metrics.writePrometheus(out_);
+    } else {
+      out_ << "{\"summary\":";
+      metrics.writeJson(out_);
+      out_ << "}\n";
+    }
+    out_ << std::flush;
+  }
+
+ private:
+  std::string path_;
+  bool prom_;
+  std::ofstream out_;
+};
+
+void report(const std::vector<urldl::DownloadResult>& results) {
+  std::size_t success = 0;
+  std::vector<const urldl::DownloadResult*> failed;
+  for (const auto& res : results) {
+    if (res.ok()) {
+      ++success;
+      continue;
+    }
+    failed.push_back(&res);
+  }
+
+  if (success > 0) {
+    std::cout << "Downloaded " << success << " file(s).\n";
+  }
+  if (!failed.empty()) {
+    std::cout << "Failed " << failed.size() << " file(s):\n";
+    for (const auto* res : failed) {
+      std::cout << "- " << res->url << " :: " << res->message() << "\n";
+    }
+  }
+}
+
+// streamURLs sends each line read from stdin to the downloader as soon as
+// it is cleaned, so the first files start while later ones are still being
+// pasted or piped in. Only the dedup set grows with the input; submit()
+// holds reading back while the queue is full. At a prompt, :go waits for
+// the batch and :q also quits; without one the batch runs to EOF. It
+// returns the number of failed downloads.
+std::size_t streamURLs(urldl::Downloader& downloader, const Interrupts& interrupts, StdinLines& input, bool prompt,
+                       MetricsDump& dump, bool progress, bool& shouldQuit) {
+  std::mutex outMu;
+  std::size_t success = 0;
+  std::size_t failed = 0;
+  // A prompt shares the terminal, so only an unattended stream draws progress.
+  Progress bar(downloader.metrics(), progress && !prompt, 0);
+  downloader.beginStream([&](urldl::DownloadResult result) {
+    std::lock_guard<std::mutex> lock(outMu);
+    dump.file(result);
+    if (result.ok()) {
+      ++success;
+      return;
+    }
+    ++failed;
+    std::cout << "- " << result.url << " :: " << result.message() << "\n" << std::flush;
+  });
+
+  // Every URL of the stream stays in the batch: it dedups the input and owns
+  // the strings the downloader works from.
+  urldl::UrlBatch batch;
+  shouldQuit = true;
+  std::string line;
+  for (;;) {
+    if (prompt) {
+      std::lock_guard<std::mutex> lock(outMu);
+      std::cout << "> " << std::flush;
+    }
+    if (!input.next(line) || interrupts.interrupted()) {
+      break;
+    }
+    if (prompt) {
+      const std::string stripped = trimSpace(line);
+      if (stripped == ":q" || stripped == ":quit" || stripped == ":exit") {
+        break;
+      }
+      if (stripped == ":go" || stripped == ":start" || stripped == ":run") {
+        shouldQuit = false;
+        break;
+      }
+    }
+    if (const std::string_view url = batch.add(line); !url.empty()) {
+      downloader.submit(url);
+    }
+  }
+  downloader.endStream();
+  dump.batch(downloader.metrics());
+
+  if (batch.empty()) {
+    std::cout << "No URLs provided.\n";
+    return 0;
+  }
+  if (success > 0) {
+    std::cout << "Downloaded " << success << " file(s).\n";
+  }
+  if (failed > 0) {
+    std::cout << "Failed " << failed << " file(s).\n";
+  }
+  return failed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::signal(SIGPIPE, SIG_IGN);
+
+  Flags flags;
+  if (!parseFlags(argc, argv, flags)) {
+    return 2;
+  }
+
+  std::string destDir;
+  if (!expandPath(flags.dir, destDir)) {
+    std::cerr << "resolve download directory: $HOME is not defined\n";
+    return 1;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(destDir, ec);
+  if (ec) {
+    std::cerr << "create download directory: " << ec.message() << "\n";
+    return 1;
+  }
+
+  urldl::UrlIndex index;
+  if (flags.index != "off") {
+    std::string indexPath = destDir + "/" + kIndexName;
+    std::string err;
+    if (!flags.index.empty() && !expandPath(flags.index, indexPath)) {
+      err = "$HOME is not defined";
+    }
+    if (!err.empty() || !index.open(indexPath, err)) {
+      std::cerr << "download index: " << err << "; continuing without it\n";
+    }
+  }
+
+  urldl::SharedBudget budget;
+  if (!flags.budgetDir.empty()) {
+    std::string budgetDir;
+    std::string err = "$HOME is not defined";
+    if (!expandPath(flags.budgetDir, budgetDir) || !budget.open(budgetDir, "download", flags.workers, err)) {
+      std::cerr << "download budget: " << err << "; continuing without it\n";
+    }
+  }
+
+  urldl::DownloadOptions opts;
+  opts.destDir = destDir;
+  opts.threads = flags.threads;
+  opts.maxActive = flags.workers;
+  opts.perHost = flags.perHost;
+  opts.segments = flags.segments;
+  opts.direct = flags.direct;
+  opts.revalidate = flags.revalidate;
+  opts.http2 = flags.http2;
+  opts.rateLimit = flags.limitRate;
+  opts.hostRate = flags.hostRate;
+  opts.index = index.isOpen() ? &index : nullptr;
+  opts.budget = budget.isOpen() ? &budget : nullptr;
+  Interrupts interrupts;
+  urldl::Downloader downloader(opts);
+  interrupts.watch(downloader);
+  MetricsDump dump(flags.metrics, flags.metricsFormat == "prom");
+  if (!dump.open()) {
+    return 1;
+  }
+  StdinLines input(interrupts.wakeFd());
+  if (flags.fromStdin) {
+    bool shouldQuit = true;
+    const std::size_t failed = streamURLs(downloader, interrupts, input, false, dump, flags.progress, shouldQuit);
+    return interrupts.interrupted() ? 130 : failed > 0 ? 1 : 0;
+  }
+  while (flags.stream) {
+    std::cout << "Paste MP4 URLs (one per line); each starts downloading to " << destDir
+              << " right away. Type ':go' to wait for the batch, ':q' to quit.\n";
+    bool shouldQuit = false;
+    streamURLs(downloader, interrupts, input, true, dump, flags.progress, shouldQuit);
+    std::cout << "Batch complete.\n\n";
+    if (interrupts.interrupted()) {
+      return 130;
+    }
+    if (shouldQuit) {
+      return 0;
+    }
+  }
+  urldl::UrlBatch batch;
+  for (;;) {
+    bool shouldQuit = false;
+    batch.clear();
+    promptURLs(batch, shouldQuit);
+    const auto& urls = batch.urls();
+
+    if (shouldQuit && urls.empty()) {
+      std::cout << "Goodbye.\n";
+      return 0;
+    }
+    if (urls.empty()) {
+      std::cout << "No URLs provided. Paste URLs or type :q to quit.\n";
+      if (shouldQuit) {
+        return 0;
+      }
+      continue;
+    }
+
+    const int workerCount = clampWorkers(flags.workers, static_cast<int>(urls.size()));
+    std::cout << "Downloading " << urls.size() << " file(s) to " << destDir << " with " << workerCount
+              << " worker(s)...\n";
+
+    std::vector<urldl::DownloadResult> results;
+    {
+      Progress bar(downloader.metrics(), flags.progress, urls.size());
+      results = downloader.downloadAll(urls);
+    }
+    for (const auto& result : results) {
+      dump.file(result);
+    }
+    dump.batch(downloader.metrics());
+    report(results);
+
+    std::cout << "Batch complete.\n\n";
+    if (interrupts.interrupted()) {
+      return 130;
+    }
+    if (shouldQuit) {
+      return 0;
+    }
+  }
+}
@@ -0,0 +1,128 @@
+#include "metrics.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace urldl {
+
+namespace {
+
+double seconds(Clock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+double millis(Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); }
+
+void counter(std::ostream& out, std::string_view name, std::string_view help, std::int64_t value) {
+  out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " counter\n" << name << ' ' << value << '\n';
+}
+
+}  // namespace
+
+void Histogram::observe(Clock::duration d) {
+  const double s = seconds(d);
+  std::size_t i = 0;
+  while (i < kBounds.size() && s > kBounds[i]) {
+    ++i;
+  }
+  counts_[i].fetch_add(1, std::memory_order_relaxed);
+  sumMicros_.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count()),
+                       std::memory_order_relaxed);
+}
+
+void Histogram::writePrometheus(std::ostream& out, std::string_view name, std::string_view help) const {
+  out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " histogram\n";
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < counts_.size(); ++i) {
+    total += counts_[i].load(std::memory_order_relaxed);
+    out << name << "_bucket{le=\"";
+    if (i < kBounds.size()) {
+      out << kBounds[i];
+    } else {
+      out << "+Inf";
+    }
+    out << "\"} " << total << '\n';
+  }
+  out << name << "_sum " << static_cast<double>(sumMicros_.load(std::memory_order_relaxed)) / 1e6 << '\n'
+      << name << "_count " << total << '\n';
+}
+
+void Metrics::writePrometheus(std::ostream& out) const {
+  counter(out, "urldl_received_bytes_total", "Response body bytes received.", bytes.load(std::memory_order_relaxed));
+  counter(out, "urldl_requests_total", "Requests sent, probes included.", requests.load(std::memory_order_relaxed));
+  counter(out, "urldl_connections_total", "Connections established.", connections.load(std::memory_order_relaxed));
+  counter(out, "urldl_reused_total", "Requests sent without a new connection.",
+          reused.load(std::memory_order_relaxed));
+  counter(out, "urldl_retries_total", "Requests resent after a connection broke.",
+          retries.load(std::memory_order_relaxed));
+  counter(out, "urldl_throttled_total", "429 and 503 answers backed off from.",
+          throttled.load(std::memory_order_relaxed));
+  out << "# HELP urldl_files_total Files finished, by outcome.\n# TYPE urldl_files_total counter\n"
+      << "urldl_files_total{result=\"ok\"} " << filesOk.load(std::memory_order_relaxed) << '\n'
+      << "urldl_files_total{result=\"failed\"} " << filesFailed.load(std::memory_order_relaxed) << '\n';
+  out << "# HELP urldl_active_transfers Transfers in progress.\n# TYPE urldl_active_transfers gauge\n"
+      << "urldl_active_transfers " << active.load(std::memory_order_relaxed) << '\n';
+  dns.writePrometheus(out, "urldl_dns_seconds", "Time to resolve a host.");
+  connect.writePrometheus(out, "urldl_connect_seconds", "Time to establish a TCP connection.");
+  tls.writePrometheus(out, "urldl_tls_seconds", "Time for the TLS handshake.");
+  ttfb.writePrometheus(out, "urldl_ttfb_seconds", "Time from request to the first response byte.");
+}
+
+void Metrics::writeJson(std::ostream& out) const {
+  out << "{\"bytes\":" << bytes.load(std::memory_order_relaxed)
+      << ",\"requests\":" << requests.load(std::memory_order_relaxed)
+      << ",\"connections\":" << connections.load(std::memory_order_relaxed)
+      << ",\"reused\":" << reused.load(std::memory_order_relaxed)
+      << ",\"retries\":" << retries.load(std::memory_order_relaxed)
+      << ",\"throttled\":" << throttled.load(std::memory_order_relaxed)
+      << ",\"files_ok\":" << filesOk.load(std::memory_order_relaxed)
+      << ",\"files_failed\":" << filesFailed.load(std::memory_order_relaxed) << '}';
+}
+
+void writeJsonString(std::ostream& out, std::string_view s) {
+  out << '"';
+  for (const char c : s) {
+    switch (c) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      case '\n':
+        out << "\\n";
+        break;
+      case '\r':
+        out << "\\r";
+        break;
+      case '\t':
+        out << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out << buf;
+        } else {
+          out << c;
+        }
+    }
+  }
+  out << '"';
+}
+
+void writeDownloadJson(std::ostream& out, std::string_view url, Outcome outcome, std::string_view msg,
+                       const DownloadStats& stats) {
+  const double elapsed = seconds(stats.elapsed);
+  out << "{\"url\":";
+  writeJsonString(out, url);
+  out << ",\"ok\":" << (succeeded(outcome) ? "true" : "false") << ",\"outcome\":\"" << outcomeName(outcome)
+      << "\",\"msg\":";
+  writeJsonString(out, msg);
+  out << ",\"bytes\":" << stats.bytes << ",\"seconds\":" << elapsed << ",\"bytes_per_second\":"
+      << (elapsed > 0 ? static_cast<std::int64_t>(static_cast<double>(stats.bytes) / elapsed) : 0)
+      << ",\"transfers\":" << stats.transfers << ",\"retries\":" << stats.retries << ",\"reused\":" << stats.reused
+      << ",\"protocol\":\"" << (stats.transfers == 0 ? "" : stats.first.h2 ? "h2" : "http/1.1") << '"'
+      << ",\"dns_ms\":" << millis(stats.first.dns) << ",\"connect_ms\":" << millis(stats.first.connect)
+      << ",\"tls_ms\":" << millis(stats.first.tls) << ",\"ttfb_ms\":" << millis(stats.first.ttfb) << '}';
+}
+
+}  // namespace urldl
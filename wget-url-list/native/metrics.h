@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#include "event_loop.h"
+#include "outcome.h"
+
+namespace urldl {
+
+// TransferStats describes one transfer. A phase it skipped, such as the
+// handshake of a reused connection, stays zero.
+struct TransferStats {
+  Clock::duration dns{};
+  Clock::duration connect{};  // TCP
+  Clock::duration tls{};
+  Clock::duration ttfb{};  // request sent to first response byte
+  std::int64_t bytes = 0;  // body bytes received
+  int retries = 0;         // resends after the connection broke
+  bool reused = false;     // ran on a kept-alive connection or a shared HTTP/2 session
+  bool h2 = false;
+};
+
+// DownloadStats sums up the transfers of one file.
+struct DownloadStats {
+  Clock::duration elapsed{};
+  std::int64_t bytes = 0;
+  int transfers = 0;
+  int retries = 0;
+  int reused = 0;
+  TransferStats first;  // the file's first transfer, which paid for the connection
+};
+
+// Histogram counts durations into the default Prometheus buckets. Lock-free.
+class Histogram {
+ public:
+  static constexpr std::array<double, 11> kBounds{0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+  void observe(Clock::duration d);
+  void writePrometheus(std::ostream& out, std::string_view name, std::string_view help) const;
+
+ private:
+  std::array<std::atomic<std::uint64_t>, kBounds.size() + 1> counts_{};  // the last is +Inf
+  std::atomic<std::uint64_t> sumMicros_{0};
+};
+
+// Metrics aggregates every transfer of a Downloader, for the progress line
+// and the dump at the end of a batch. The counters are relaxed atomics
+// bumped on the hot path from every loop and read from any thread; bytes,
+// which changes on every read, has a cache line of its own.
+struct Metrics {
+  alignas(64) std::atomic<std::int64_t> bytes{0};
+  alignas(64) std::atomic<std::int64_t> requests{0};
+  std::atomic<std::int64_t> connections{0};  // dialed
+  std::atomic<std::int64_t> reused{0};       // requests that needed no new connection
+  std::atomic<std::int64_t> retries{0};
+  std::atomic<std::int64_t> throttled{0};  // 429 and 503 answers backed off from
+  std::atomic<std::int64_t> filesOk{0};
+  std::atomic<std::int64_t> filesFailed{0};
+  std::atomic<int> active{0};  // transfers in progress
+  Histogram dns;
+  Histogram connect;
+  Histogram tls;
+  Histogram ttfb;
+
+  // writePrometheus writes the text exposition format.
+  void writePrometheus(std::ostream& out) const;
+  // writeJson writes the counters as one JSON object, without a newline.
+  void writeJson(std::ostream& out) const;
+};
+
+// writeJsonString writes s as a JSON string literal.
+void writeJsonString(std::ostream& out, std::string_view s);
+
+// writeDownloadJson writes one file's result as a JSON object, without a
+// newline.
+void writeDownloadJson(std::ostream& out, std::string_view url, Outcome outcome, std::string_view msg,
+                       const DownloadStats& stats);
+
+}  // namespace urldl
@@ -0,0 +1,728 @@
+#include "net.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <poll.h>
+#include <unistd.h>
+
+#if defined(URLDL_CARES)
+#include <ares.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+namespace urldl {
+
+namespace {
+
+std::string sslError(const char* what) {
+  char buf[256];
+  const unsigned long code = ERR_get_error();
+  if (code == 0) {
+    return std::string(what) + ": " + std::strerror(errno);
+  }
+  ERR_error_string_n(code, buf, sizeof(buf));
+  ERR_clear_error();
+  return std::string(what) + ": " + buf;
+}
+
+bool isIPLiteral(const std::string& host) {
+  in6_addr addr6{};
+  in_addr addr4{};
+  return inet_pton(AF_INET, host.c_str(), &addr4) == 1 || inet_pton(AF_INET6, host.c_str(), &addr6) == 1;
+}
+
+// getaddrinfo reports no TTL; its answers are kept this long.
+constexpr auto kUnknownTtl = std::chrono::minutes(5);
+constexpr auto kMinTtl = std::chrono::seconds(1);
+constexpr auto kMaxTtl = std::chrono::hours(1);
+
+// interleave orders addresses as RFC 8305 section 4 asks: the resolver's
+// first choice, then alternating between the two families.
+std::vector<Address> interleave(const std::vector<Address>& addrs) {
+  if (addrs.empty()) {
+    return addrs;
+  }
+  const auto first = addrs.front().addr.ss_family;
+  std::vector<Address> preferred;
+  std::vector<Address> other;
+  for (const Address& a : addrs) {
+    (a.addr.ss_family == first ? preferred : other).push_back(a);
+  }
+  std::vector<Address> out;
+  out.reserve(addrs.size());
+  for (std::size_t i = 0; i < preferred.size() || i < other.size(); ++i) {
+    if (i < preferred.size()) {
+      out.push_back(preferred[i]);
+    }
+    if (i < other.size()) {
+      out.push_back(other[i]);
+    }
+  }
+  return out;
+}
+
+int onNewSession(SSL* ssl, SSL_SESSION* session) {
+  auto* tls = static_cast<TlsContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  auto* origin = static_cast<const std::string*>(SSL_get_app_data(ssl));
+  if (tls == nullptr || origin == nullptr) {
+    return 0;
+  }
+  tls->storeSession(*origin, session);
+  return 1;  // we took the reference
+}
+
+}  // namespace
+
+TlsContext::TlsContext(bool http2) {
+  ctx_ = SSL_CTX_new(TLS_client_method());
+  if (ctx_ == nullptr) {
+    return;
+  }
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  SSL_CTX_set_default_verify_paths(ctx_);
+  SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
+  // Many CDNs close without close_notify; body framing catches truncation.
+  SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#ifdef SSL_OP_ENABLE_KTLS
+  // Where the kernel has kTLS, record decryption moves there and reads skip
+  // OpenSSL's own buffering.
+  SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+#endif
+  SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx_, onNewSession);
+  SSL_CTX_set_app_data(ctx_, this);
+  static const unsigned char kAlpn[] = "\x02h2\x08http/1.1";
+  // The h2 entry is the first three bytes of kAlpn.
+  if (http2) {
+    SSL_CTX_set_alpn_protos(ctx_, kAlpn, sizeof(kAlpn) - 1);
+  } else {
+    SSL_CTX_set_alpn_protos(ctx_, kAlpn + 3, sizeof(kAlpn) - 4);
+  }
+}
+
+TlsContext::~TlsContext() {
+  for (auto& [key, session] : sessions_) {
+    SSL_SESSION_free(session);
+  }
+  if (ctx_ != nullptr) {
+    SSL_CTX_free(ctx_);
+  }
+}
+
+SSL_SESSION* TlsContext::session(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = sessions_.find(key);
+  if (it == sessions_.end()) {
+    return nullptr;
+  }
+  SSL_SESSION_up_ref(it->second);
+  return it->second;
+}
+
+void TlsContext::storeSession(const std::string& key, SSL_SESSION* session) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto [it, inserted] = sessions_.emplace(key, session);
+  if (!inserted) {
+    SSL_SESSION_free(it->second);
+    it->second = session;
+  }
+}
+
+#if defined(URLDL_CARES)
+
+// Resolver runs every c-ares lookup of a DnsCache on one thread: queries are
+// handed over through a queue and a wake pipe, and answers go to settle().
+class DnsCache::Resolver {
+ public:
+  explicit Resolver(DnsCache& cache) : cache_(cache) {
+    static std::once_flag once;
+    std::call_once(once, [] { ares_library_init(ARES_LIB_INIT_ALL); });
+    if (ares_init(&channel_) != ARES_SUCCESS) {
+      channel_ = nullptr;
+      return;
+    }
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      ares_destroy(channel_);
+      channel_ = nullptr;
+      return;
+    }
+    wakeRead_ = fds[0];
+    wakeWrite_ = fds[1];
+    for (const int fd : fds) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~Resolver() {
+    stop();
+    if (wakeRead_ >= 0) {
+      ::close(wakeRead_);
+      ::close(wakeWrite_);
+    }
+  }
+
+  bool ok() const { return channel_ != nullptr; }
+
+  void query(const std::string& key, const std::string& host, std::uint16_t port) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (stopping_) {
+        return;
+      }
+      queued_.push_back(new Query{cache_, key, host, std::to_string(port)});
+    }
+    wake();
+  }
+
+  // stop cancels outstanding lookups and joins the thread; their callbacks
+  // do not run.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (stopping_ || !thread_.joinable()) {
+        return;
+      }
+      stopping_ = true;
+    }
+    wake();
+    thread_.join();
+  }
+
+ private:
+  struct Query {
+    DnsCache& cache;
+    std::string key;
+    std::string host;
+    std::string service;
+  };
+
+  void wake() {
+    const char b = 1;
+    [[maybe_unused]] const ssize_t n = ::write(wakeWrite_, &b, 1);
+  }
+
+  void run() {
+    for (;;) {
+      std::vector<Query*> queued;
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (stopping_) {
+          break;
+        }
+        queued.swap(queued_);
+      }
+      for (Query* q : queued) {
+        ares_addrinfo_hints hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = ARES_AI_ADDRCONFIG | ARES_AI_NUMERICSERV;
+        ares_getaddrinfo(channel_, q->host.c_str(), q->service.c_str(), &hints, &Resolver::onAnswer, q);
+      }
+
+      ares_socket_t socks[ARES_GETSOCK_MAXNUM];
+      const int mask = ares_getsock(channel_, socks, ARES_GETSOCK_MAXNUM);
+      std::vector<pollfd> fds{{wakeRead_, POLLIN, 0}};
+      for (int i = 0; i < ARES_GETSOCK_MAXNUM; ++i) {
+        short events = 0;
+        if (ARES_GETSOCK_READABLE(mask, i)) {
+          events |= POLLIN;
+        }
+        if (ARES_GETSOCK_WRITABLE(mask, i)) {
+          events |= POLLOUT;
+        }
+        if (events != 0) {
+          fds.push_back({socks[i], events, 0});
+        }
+      }
+      timeval tv{};
+      const timeval* wait = ares_timeout(channel_, nullptr, &tv);
+      const int timeout = wait == nullptr ? -1 : static_cast<int>(wait->tv_sec * 1000 + (wait->tv_usec + 999) / 1000);
+      if (::poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+        break;
+      }
+      if ((fds[0].revents & POLLIN) != 0) {
+        char buf[64];
+        while (::read(wakeRead_, buf, sizeof(buf)) > 0) {
+        }
+      }
+      for (std::size_t i = 1; i < fds.size(); ++i) {
+        const short ev = fds[i].revents;
+        const bool failed = (ev & (POLLERR | POLLHUP)) != 0;
+        ares_process_fd(channel_, (ev & POLLIN) != 0 || failed ? fds[i].fd : ARES_SOCKET_BAD,
+                        (ev & POLLOUT) != 0 || failed ? fds[i].fd : ARES_SOCKET_BAD);
+      }
+      ares_process_fd(channel_, ARES_SOCKET_BAD, ARES_SOCKET_BAD);  // retransmits and timeouts
+    }
+
+    // Outstanding lookups end with ARES_EDESTRUCTION.
+    ares_destroy(channel_);
+    std::lock_guard<std::mutex> lock(mu_);
+    for (Query* q : queued_) {
+      delete q;
+    }
+    queued_.clear();
+  }
+
+  static void onAnswer(void* arg, int status, int /*timeouts*/, ares_addrinfo* res) {
+    std::unique_ptr<Query> q(static_cast<Query*>(arg));
+    if (status == ARES_EDESTRUCTION) {
+      return;
+    }
+    std::vector<Address> addrs;
+    std::string err;
+    int ttl = -1;
+    if (status != ARES_SUCCESS) {
+      err = "resolve " + q->host + ": " + ares_strerror(status);
+    } else {
+      for (const ares_addrinfo_node* ai = res->nodes; ai != nullptr; ai = ai->ai_next) {
+        Address a;
+        std::memcpy(&a.addr, ai->ai_addr, ai->ai_addrlen);
+        a.len = static_cast<socklen_t>(ai->ai_addrlen);
+        addrs.push_back(a);
+        ttl = ttl < 0 ? ai->ai_ttl : std::min(ttl, ai->ai_ttl);
+      }
+      if (addrs.empty()) {
+        err = "resolve " + q->host + ": no addresses";
+      }
+    }
+    if (res != nullptr) {
+      ares_freeaddrinfo(res);
+    }
+    q->cache.settle(q->key, std::move(addrs), err, std::chrono::seconds(std::max(ttl, 0)));
+  }
+
+  DnsCache& cache_;
+  ares_channel channel_ = nullptr;
+  int wakeRead_ = -1;
+  int wakeWrite_ = -1;
+  std::thread thread_;
+
+  std::mutex mu_;
+  bool stopping_ = false;
+  std::vector<Query*> queued_;
+};
+
+#else
+
+class DnsCache::Resolver {};
+
+#endif
+
+DnsCache::DnsCache() {
+#if defined(URLDL_CARES)
+  resolver_ = std::make_unique<Resolver>(*this);
+  if (!resolver_->ok()) {
+    resolver_.reset();  // fall back to getaddrinfo threads
+  }
+#endif
+}
+
+DnsCache::~DnsCache() { shutdown(); }
+
+void DnsCache::resolve(const std::string& host, std::uint16_t port, Callback cb) {
+  const std::string key = host + ":" + std::to_string(port);
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    if (shutdown_) {
+      return;
+    }
+    Entry& entry = entries_[key];
+    if (entry.done && Clock::now() < entry.expires) {
+      const std::vector<Address> addrs = entry.addrs;
+      lock.unlock();
+      cb(addrs, std::string());
+      return;
+    }
+    entry.done = false;  // new, or expired and looked up again
+    entry.waiters.push_back(std::move(cb));
+    if (entry.waiters.size() > 1) {
+      return;
+    }
+  }
+  lookup(key, host, port);
+}
+
+void DnsCache::lookup(const std::string& key, const std::string& host, std::uint16_t port) {
+#if defined(URLDL_CARES)
+  if (resolver_ != nullptr) {
+    resolver_->query(key, host, port);
+    return;
+  }
+#endif
+  std::thread([self = shared_from_this(), key, host, port] {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    addrinfo* res = nullptr;
+    std::vector<Address> addrs;
+    std::string err;
+    const int rc = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (rc != 0) {
+      err = "resolve " + host + ": " + gai_strerror(rc);
+    } else {
+      for (const addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+        Address a;
+        std::memcpy(&a.addr, ai->ai_addr, ai->ai_addrlen);
+        a.len = static_cast<socklen_t>(ai->ai_addrlen);
+        addrs.push_back(a);
+      }
+      ::freeaddrinfo(res);
+    }
+    self->settle(key, std::move(addrs), err, kUnknownTtl);
+  }).detach();
+}
+
+void DnsCache::settle(const std::string& key, std::vector<Address> addrs, const std::string& err,
+                      Clock::duration ttl) {
+  const std::vector<Address> ordered = interleave(addrs);
+  // Callbacks run under the lock so shutdown() can guarantee none is
+  // still in flight; they only hand the result to an event loop.
+  std::lock_guard<std::mutex> lock(mu_);
+  if (shutdown_) {
+    return;
+  }
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return;
+  }
+  std::vector<Callback> waiters;
+  waiters.swap(it->second.waiters);
+  if (err.empty()) {
+    it->second.done = true;
+    it->second.addrs = ordered;
+    it->second.expires = Clock::now() + std::clamp<Clock::duration>(ttl, kMinTtl, kMaxTtl);
+  } else {
+    // Failed lookups are not cached so a later batch tries again.
+    entries_.erase(it);
+  }
+  for (auto& cb : waiters) {
+    cb(ordered, err);
+  }
+}
+
+void DnsCache::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    shutdown_ = true;
+    entries_.clear();
+  }
+#if defined(URLDL_CARES)
+  // Outside the lock: an answer being delivered may be waiting for it.
+  if (resolver_ != nullptr) {
+    resolver_->stop();
+  }
+#endif
+}
+
+Connection::~Connection() {
+  if (ssl_ != nullptr) {
+    SSL_free(ssl_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+std::unique_ptr<Connection> Connection::connect(const Url& url, const Address& addr, std::string& err) {
+  const int fd = ::socket(addr.addr.ss_family, SOCK_STREAM, 0);
+  if (fd < 0) {
+    err = std::string("socket: ") + std::strerror(errno);
+    return nullptr;
+  }
+  std::unique_ptr<Connection> conn(new Connection(fd, url));
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  const int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr.addr), addr.len) != 0 && errno != EINPROGRESS) {
+    err = std::string("connect: ") + std::strerror(errno);
+    return nullptr;
+  }
+  return conn;
+}
+
+IoStatus Connection::finishConnect(std::string& err) {
+  if (tcpConnected_) {
+    return IoStatus::Ok;
+  }
+  int soErr = 0;
+  socklen_t len = sizeof(soErr);
+  ::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &soErr, &len);
+  if (soErr != 0) {
+    err = std::string("connect: ") + std::strerror(soErr);
+    return IoStatus::Error;
+  }
+  sockaddr_storage peer{};
+  socklen_t peerLen = sizeof(peer);
+  if (::getpeername(fd_, reinterpret_cast<sockaddr*>(&peer), &peerLen) != 0) {
+    return IoStatus::WantWrite;  // still in progress
+  }
+  tcpConnected_ = true;
+  connectedAt_ = Clock::now();
+  return IoStatus::Ok;
+}
+
+IoStatus Connection::setup(TlsContext& tls, std::string& err) {
+  if (ready_) {
+    return IoStatus::Ok;
+  }
+  if (ssl_ == nullptr) {
+    const IoStatus st = finishConnect(err);
+    if (st != IoStatus::Ok) {
+      return st;
+    }
+    if (!tls_) {
+      ready_ = true;
+      return IoStatus::Ok;
+    }
+
+    ssl_ = SSL_new(tls.get());
+    if (ssl_ == nullptr) {
+      err = sslError("tls");
+      return IoStatus::Error;
+    }
+    SSL_set_fd(ssl_, fd_);
+    SSL_set_app_data(ssl_, &origin_);
+    if (isIPLiteral(host_)) {
+      X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl_), host_.c_str());
+    } else {
+      SSL_set_tlsext_host_name(ssl_, host_.c_str());
+      SSL_set1_host(ssl_, host_.c_str());
+    }
+    if (SSL_SESSION* session = tls.session(origin_)) {
+      SSL_set_session(ssl_, session);
+      SSL_SESSION_free(session);
+    }
+  }
+
+  const int rc = SSL_connect(ssl_);
+  if (rc == 1) {
+    const unsigned char* proto = nullptr;
+    unsigned len = 0;
+    SSL_get0_alpn_selected(ssl_, &proto, &len);
+    h2_ = len == 2 && proto[0] == 'h' && proto[1] == '2';
+    ready_ = true;
+    return IoStatus::Ok;
+  }
+  const int code = SSL_get_error(ssl_, rc);
+  if (code == SSL_ERROR_WANT_READ) {
+    return IoStatus::WantRead;
+  }
+  if (code == SSL_ERROR_WANT_WRITE) {
+    return IoStatus::WantWrite;
+  }
+  const long verify = SSL_get_verify_result(ssl_);
+  if (verify != X509_V_OK) {
+    err = std::string("tls handshake: ") + X509_verify_cert_error_string(verify);
+    ERR_clear_error();
+  } else {
+    err = sslError("tls handshake");
+  }
+  return IoStatus::Error;
+}
+
+IoStatus Connection::read(char* buf, std::size_t cap, std::size_t& n, std::string& err) {
+  n = 0;
+  if (ssl_ == nullptr) {
+    for (;;) {
+      const ssize_t rc = ::recv(fd_, buf, cap, 0);
+      if (rc > 0) {
+        n = static_cast<std::size_t>(rc);
+        return IoStatus::Ok;
+      }
+      if (rc == 0) {
+        return IoStatus::Eof;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return IoStatus::WantRead;
+      }
+      err = std::string("read: ") + std::strerror(errno);
+      return IoStatus::Error;
+    }
+  }
+
+  const int rc = SSL_read(ssl_, buf, static_cast<int>(cap));
+  if (rc > 0) {
+    n = static_cast<std::size_t>(rc);
+    return IoStatus::Ok;
+  }
+  switch (SSL_get_error(ssl_, rc)) {
+    case SSL_ERROR_ZERO_RETURN:
+      return IoStatus::Eof;
+    case SSL_ERROR_WANT_READ:
+      return IoStatus::WantRead;
+    case SSL_ERROR_WANT_WRITE:
+      return IoStatus::WantWrite;
+    default:
+      err = sslError("read");
+      return IoStatus::Error;
+  }
+}
+
+bool Connection::buffered() const { return ssl_ != nullptr && SSL_pending(ssl_) > 0; }
+
+IoStatus Connection::write(const char* data, std::size_t len, std::size_t& n, std::string& err) {
+  n = 0;
+  if (ssl_ == nullptr) {
+    for (;;) {
+#ifdef MSG_NOSIGNAL
+      const ssize_t rc = ::send(fd_, data, len, MSG_NOSIGNAL);
+#else
+      const ssize_t rc = ::send(fd_, data, len, 0);
+#endif
+      if (rc >= 0) {
+        n = static_cast<std::size_t>(rc);
+        return IoStatus::Ok;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return IoStatus::WantWrite;
+      }
+      err = std::string("write: ") + std::strerror(errno);
+      return IoStatus::Error;
+    }
+  }
+
+  const int rc = SSL_write(ssl_, data, static_cast<int>(len));
+  if (rc > 0) {
+    n = static_cast<std::size_t>(rc);
+    return IoStatus::Ok;
+  }
+  switch (SSL_get_error(ssl_, rc)) {
+    case SSL_ERROR_WANT_READ:
+      return IoStatus::WantRead;
+    case SSL_ERROR_WANT_WRITE:
+      return IoStatus::WantWrite;
+    default:
+      err = sslError("write");
+      return IoStatus::Error;
+  }
+}
+
+bool Connection::idleAlive() {
+  if (ssl_ != nullptr && SSL_pending(ssl_) > 0) {
+    return false;
+  }
+  pollfd pfd{fd_, POLLIN, 0};
+  return ::poll(&pfd, 1, 0) == 0;
+}
+
+Dialer::Dialer(EventLoop& loop, const Url& url, std::vector<Address> addrs, DoneFn done)
+    : loop_(loop), url_(url), addrs_(std::move(addrs)), done_(std::move(done)) {}
+
+Dialer::~Dialer() {
+  if (timer_ != 0) {
+    loop_.cancelTimer(timer_);
+  }
+  for (const auto& attempt : attempts_) {
+    loop_.unwatch(attempt->conn->fd());
+  }
+}
+
+void Dialer::start() { next(); }
+
+// next starts an attempt on the next address that takes a socket, and
+// arms the delay after which the one behind it joins.
+void Dialer::next() {
+  if (timer_ != 0) {
+    loop_.cancelTimer(timer_);
+    timer_ = 0;
+  }
+  while (next_ < addrs_.size()) {
+    std::string err;
+    auto conn = Connection::connect(url_, addrs_[next_++], err);
+    if (conn == nullptr) {
+      lastErr_ = err;
+      continue;
+    }
+    auto attempt = std::make_unique<Attempt>(*this, std::move(conn));
+    loop_.watch(attempt->conn->fd(), attempt.get(), false, true);
+    attempts_.push_back(std::move(attempt));
+    if (next_ < addrs_.size()) {
+      timer_ = loop_.addTimer(Clock::now() + kAttemptDelay, [this] {
+        timer_ = 0;
+        next();
+      });
+    }
+    return;
+  }
+  if (attempts_.empty()) {
+    done(nullptr, lastErr_.empty() ? "dial " + url_.host + ": no addresses" : lastErr_);
+  }
+}
+
+void Dialer::onReady(Attempt& attempt) {
+  std::string err;
+  const IoStatus st = attempt.conn->finishConnect(err);
+  if (st == IoStatus::WantRead || st == IoStatus::WantWrite) {
+    return;
+  }
+  auto it = std::find_if(attempts_.begin(), attempts_.end(), [&](const auto& a) { return a.get() == &attempt; });
+  std::unique_ptr<Attempt> self = std::move(*it);
+  attempts_.erase(it);
+  loop_.unwatch(self->conn->fd());
+  if (st == IoStatus::Error) {
+    lastErr_ = err;
+    next();
+    return;
+  }
+  for (const auto& loser : attempts_) {
+    loop_.unwatch(loser->conn->fd());
+  }
+  attempts_.clear();
+  if (timer_ != 0) {
+    loop_.cancelTimer(timer_);
+    timer_ = 0;
+  }
+  done(std::move(self->conn), std::string());
+}
+
+void Dialer::done(std::unique_ptr<Connection> conn, const std::string& err) {
+  DoneFn fn = std::move(done_);
+  fn(std::move(conn), err);
+}
+
+std::unique_ptr<Connection> ConnectionPool::take(const std::string& origin) {
+  auto it = idle_.find(origin);
+  while (it != idle_.end() && !it->second.empty()) {
+    std::unique_ptr<Connection> conn = std::move(it->second.back());
+    it->second.pop_back();
+    if (conn->idleAlive()) {
+      conn->markReused();
+      return conn;
+    }
+  }
+  return nullptr;
+}
+
+void ConnectionPool::put(std::unique_ptr<Connection> conn) {
+  auto& list = idle_[conn->origin()];
+  if (list.size() < maxIdle_) {
+    list.push_back(std::move(conn));
+  }
+}
+
+}  // namespace urldl
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "event_loop.h"
+#include "url.h"
+
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_session_st SSL_SESSION;
+
+namespace urldl {
+
+constexpr auto kConnectTimeout = std::chrono::seconds(30);
+// kAttemptDelay is how long a connection attempt runs alone before the
+// next address joins the race (RFC 8305's Connection Attempt Delay).
+constexpr auto kAttemptDelay = std::chrono::milliseconds(250);
+// kReadTimeout matches wget's default --read-timeout.
+constexpr auto kReadTimeout = std::chrono::seconds(900);
+
+// TlsContext owns the shared client SSL_CTX and a per-origin session cache so
+// reconnects to a host resume the previous TLS session instead of paying a
+// full handshake. With http2, ALPN offers "h2" ahead of "http/1.1".
+class TlsContext {
+ public:
+  explicit TlsContext(bool http2);
+  ~TlsContext();
+  TlsContext(const TlsContext&) = delete;
+  TlsContext& operator=(const TlsContext&) = delete;
+
+  bool ok() const { return ctx_ != nullptr; }
+  SSL_CTX* get() const { return ctx_; }
+
+  // session returns a new reference to the cached session for key, or nullptr.
+  SSL_SESSION* session(const std::string& key);
+  void storeSession(const std::string& key, SSL_SESSION* session);
+
+ private:
+  SSL_CTX* ctx_ = nullptr;
+  std::mutex mu_;
+  std::unordered_map<std::string, SSL_SESSION*> sessions_;
+};
+
+struct Address {
+  sockaddr_storage addr{};
+  socklen_t len = 0;
+};
+
+// DnsCache resolves hosts for every loop and keeps each answer for as long
+// as its TTL allows, so a batch looks a host up about once. With c-ares the
+// lookups run asynchronously on one resolver thread; without it each one
+// gets a helper thread for getaddrinfo, whose answers carry no TTL and are
+// kept for kUnknownTtl. Either way an event loop never blocks on DNS, and
+// concurrent requests for the same host share one lookup. Addresses come
+// back with the two families interleaved, the order a Dialer races them in.
+class DnsCache : public std::enable_shared_from_this<DnsCache> {
+ public:
+  using Callback = std::function<void(const std::vector<Address>& addrs, const std::string& err)>;
+
+  DnsCache();
+  ~DnsCache();
+  DnsCache(const DnsCache&) = delete;
+  DnsCache& operator=(const DnsCache&) = delete;
+
+  // resolve invokes cb exactly once, inline on a cache hit or from the
+  // resolver thread otherwise.
+  void resolve(const std::string& host, std::uint16_t port, Callback cb);
+  // shutdown drops pending callbacks; none run once it returns.
+  void shutdown();
+
+ private:
+  class Resolver;
+  struct Entry {
+    bool done = false;
+    Clock::time_point expires{};
+    std::vector<Address> addrs;
+    std::vector<Callback> waiters;
+  };
+
+  void lookup(const std::string& key, const std::string& host, std::uint16_t port);
+  void settle(const std::string& key, std::vector<Address> addrs, const std::string& err, Clock::duration ttl);
+
+  std::mutex mu_;
+  bool shutdown_ = false;
+  std::unordered_map<std::string, Entry> entries_;
+  std::unique_ptr<Resolver> resolver_;  // null without c-ares
+};
+
+enum class IoStatus { Ok, WantRead, WantWrite, Eof, Error };
+
+// Connection is one non-blocking TCP (optionally TLS) stream to an origin.
+// The owner drives it from event loop readiness: setup() until Ok, then
+// read() and write() until they ask to wait.
+class Connection {
+ public:
+  ~Connection();
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  // connect starts a non-blocking connect to addr.
+  static std::unique_ptr<Connection> connect(const Url& url, const Address& addr, std::string& err);
+
+  // finishConnect completes the TCP connect only, WantWrite while it is in
+  // progress.
+  IoStatus finishConnect(std::string& err);
+  // setup finishes the TCP connect and the TLS handshake.
+  IoStatus setup(TlsContext& tls, std::string& err);
+  IoStatus read(char* buf, std::size_t cap, std::size_t& n, std::string& err);
+  IoStatus write(const char* data, std::size_t len, std::size_t& n, std::string& err);
+
+  // idleAlive reports whether a pooled connection is still usable: the peer
+  // has not closed it and sent nothing unsolicited.
+  bool idleAlive();
+
+  int fd() const { return fd_; }
+  const std::string& origin() const { return origin_; }
+  // plain reports a connection without TLS, whose bytes can be spliced.
+  bool plain() const { return !tls_; }
+  // h2 reports that the TLS handshake negotiated HTTP/2.
+  bool h2() const { return h2_; }
+  bool reused() const { return reused_; }
+  // connectedAt is when the TCP handshake completed, once setup got there.
+  Clock::time_point connectedAt() const { return connectedAt_; }
+  // buffered reports TLS data already decrypted but not yet read, which
+  // readiness of the socket says nothing about.
+  bool buffered() const;
+  void markReused() { reused_ = true; }
+
+ private:
+  Connection(int fd, const Url& url) : fd_(fd), origin_(url.origin()), host_(url.host), tls_(url.tls()) {}
+
+  int fd_ = -1;
+  SSL* ssl_ = nullptr;
+  std::string origin_;
+  std::string host_;
+  bool tls_ = false;
+  bool tcpConnected_ = false;
+  bool ready_ = false;
+  bool reused_ = false;
+  bool h2_ = false;
+  Clock::time_point connectedAt_{};
+};
+
+// Dialer opens a TCP connection to the first address of a host that
+// answers, racing them as RFC 8305 (Happy Eyeballs) describes: each attempt
+// has kAttemptDelay to itself before the next address starts alongside it,
+// and one that fails starts the next at once. With the families
+// interleaved, a black-holed IPv6 route costs a quarter second instead of
+// a connect timeout. TLS is left to the winner's setup().
+class Dialer {
+ public:
+  // DoneFn receives the connected stream, or nullptr with the last error
+  // once every address has failed. It runs once, on the loop; the Dialer
+  // must not be destroyed from inside it.
+  using DoneFn = std::function<void(std::unique_ptr<Connection> conn, const std::string& err)>;
+
+  Dialer(EventLoop& loop, const Url& url, std::vector<Address> addrs, DoneFn done);
+  ~Dialer();
+  Dialer(const Dialer&) = delete;
+  Dialer& operator=(const Dialer&) = delete;
+
+  void start();
+
+ private:
+  struct Attempt final : EventLoop::Handler {
+    Attempt(Dialer& dialer, std::unique_ptr<Connection> conn) : dialer(dialer), conn(std::move(conn)) {}
+    void onEvent(bool, bool) override { dialer.onReady(*this); }
+
+    Dialer& dialer;
+    std::unique_ptr<Connection> conn;
+  };
+
+  void next();
+  void onReady(Attempt& attempt);
+  void done(std::unique_ptr<Connection> conn, const std::string& err);
+
+  EventLoop& loop_;
+  Url url_;
+  std::vector<Address> addrs_;
+  std::size_t next_ = 0;
+  std::vector<std::unique_ptr<Attempt>> attempts_;
+  std::string lastErr_;
+  EventLoop::TimerId timer_ = 0;
+  DoneFn done_;
+};
+
+// ConnectionPool keeps idle keep-alive connections per origin. Each event
+// loop owns one, so it is not synchronized.
+class ConnectionPool {
+ public:
+  explicit ConnectionPool(std::size_t maxIdlePerOrigin) : maxIdle_(maxIdlePerOrigin) {}
+
+  // take returns a live idle connection for origin, or nullptr.
+  std::unique_ptr<Connection> take(const std::string& origin);
+  void put(std::unique_ptr<Connection> conn);
+
+ private:
+  std::size_t maxIdle_;
+  std::unordered_map<std::string, std::vector<std::unique_ptr<Connection>>> idle_;
+};
+
+}  // namespace urldl
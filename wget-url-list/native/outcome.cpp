@@ -0,0 +1,51 @@
+#include "outcome.h"
+
+namespace urldl {
+
+std::string_view outcomeName(Outcome o) {
+  switch (o) {
+    case Outcome::Ok: return "ok";
+    case Outcome::AlreadyComplete: return "already_complete";
+    case Outcome::AlreadyDownloaded: return "already_downloaded";
+    case Outcome::NotModified: return "not_modified";
+    case Outcome::InvalidUrl: return "invalid_url";
+    case Outcome::Startup: return "startup";
+    case Outcome::Dns: return "dns";
+    case Outcome::Connect: return "connect";
+    case Outcome::Tls: return "tls";
+    case Outcome::Timeout: return "timeout";
+    case Outcome::Network: return "network";
+    case Outcome::Protocol: return "protocol";
+    case Outcome::Redirect: return "redirect";
+    case Outcome::Http: return "http";
+    case Outcome::Changed: return "changed";
+    case Outcome::Disk: return "disk";
+    case Outcome::Aborted: return "aborted";
+  }
+  return "unknown";
+}
+
+std::string_view describe(Outcome o) {
+  switch (o) {
+    case Outcome::Ok: return "ok";
+    case Outcome::AlreadyComplete: return "already complete";
+    case Outcome::AlreadyDownloaded: return "already downloaded";
+    case Outcome::NotModified: return "not modified";
+    case Outcome::InvalidUrl: return "invalid URL";
+    case Outcome::Startup: return "failed to initialize";
+    case Outcome::Dns: return "lookup failed";
+    case Outcome::Connect: return "connect failed";
+    case Outcome::Tls: return "tls handshake failed";
+    case Outcome::Timeout: return "i/o timeout";
+    case Outcome::Network: return "connection closed before the download was complete";
+    case Outcome::Protocol: return "protocol error";
+    case Outcome::Redirect: return "redirect failed";
+    case Outcome::Http: return "HTTP error";
+    case Outcome::Changed: return "remote file changed; partial download discarded";
+    case Outcome::Disk: return "write failed";
+    case Outcome::Aborted: return "aborted";
+  }
+  return "unknown";
+}
+
+}  // namespace urldl
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace urldl {
+
+// Outcome says how a download or one of its transfers ended, in a byte. A
+// result carries it with a detail string that is usually empty on success
+// and short otherwise, so a 100k-file batch holds no message text for the
+// files that simply worked.
+enum class Outcome : std::uint8_t {
+  Ok,
+  AlreadyComplete,    // the file on disk was already whole
+  AlreadyDownloaded,  // the index lists it and the file is still there
+  NotModified,        // revalidated and unchanged
+  // Everything from here on is a failure.
+  InvalidUrl,
+  Startup,   // the engine itself could not start
+  Dns,
+  Connect,
+  Tls,
+  Timeout,
+  Network,   // the connection broke mid-exchange
+  Protocol,  // a response that makes no sense
+  Redirect,
+  Http,      // a status other than 2xx
+  Changed,   // the server's copy changed under a partial download
+  Disk,
+  Aborted,
+};
+
+constexpr bool succeeded(Outcome o) { return o < Outcome::InvalidUrl; }
+
+// outcomeName is the snake_case name used in metrics output.
+std::string_view outcomeName(Outcome o);
+// describe is the message shown for an outcome without a detail.
+std::string_view describe(Outcome o);
+
+}  // namespace urldl
@@ -0,0 +1,444 @@
+#include "probe.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace urldl {
+
+namespace {
+
+// kPipelineDepth is how many requests may be outstanding on one connection.
+// Servers answer a pipeline in order and one at a time, so a deeper one
+// saves nothing once the round trip is covered.
+constexpr std::size_t kPipelineDepth = 32;
+constexpr std::size_t kReadBufferSize = 64 * 1024;
+constexpr int kMaxReadsPerEvent = 16;
+
+thread_local std::vector<char> probeBuf(kReadBufferSize);
+
+}  // namespace
+
+ProbeBatch::ProbeBatch(LoopContext& ctx, std::vector<ProbeRequest> requests, DoneFn done)
+    : ctx_(ctx),
+      requests_(std::move(requests)),
+      results_(requests_.size()),
+      done_(std::move(done)),
+      depth_(kPipelineDepth) {}
+
+ProbeBatch::~ProbeBatch() {
+  if (timer_ != 0) {
+    ctx_.loop.cancelTimer(timer_);
+  }
+  dropConnection();
+  settleClaim(false);
+}
+
+void ProbeBatch::start() {
+  if (requests_.empty()) {
+    finish();
+    return;
+  }
+  open(true);
+}
+
+// open starts a connection for the requests not answered yet.
+void ProbeBatch::open(bool allowPooled) {
+  out_.clear();
+  sent_ = 0;
+  queued_ = answered_;
+  answeredHere_ = 0;
+  parser_ = ResponseParser(true);
+  closing_ = false;
+
+  const Url& url = requests_.front().url;
+  if (url.tls()) {
+    if (auto session = ctx_.h2.find(url.origin())) {
+      startSession(std::move(session));
+      return;
+    }
+  }
+  if (allowPooled) {
+    conn_ = ctx_.pool.take(url.origin());
+  }
+  if (conn_) {
+    phase_ = Phase::Exchanging;
+    armTimer(kReadTimeout);
+    exchange();
+    return;
+  }
+
+  std::weak_ptr<ProbeBatch> weak = shared_from_this();
+  if (url.tls() && !claimed_) {
+    if (!ctx_.h2.claim(url.origin(), [weak](std::shared_ptr<H2Session> session) {
+          if (auto self = weak.lock()) {
+            self->onSessionReady(std::move(session));
+          }
+        })) {
+      phase_ = Phase::Waiting;
+      armTimer(kConnectTimeout);
+      return;
+    }
+    claimed_ = true;
+  }
+  phase_ = Phase::Resolving;
+  armTimer(kConnectTimeout);
+  EventLoop* loop = &ctx_.loop;
+  ctx_.dns.resolve(url.host, url.port, [weak, loop](const std::vector<Address>& addrs, const std::string& err) {
+    loop->post([weak, addrs, err] {
+      if (auto self = weak.lock()) {
+        self->onResolved(addrs, err);
+      }
+    });
+  });
+}
+
+void ProbeBatch::onSessionReady(std::shared_ptr<H2Session> session) {
+  if (phase_ != Phase::Waiting) {
+    return;
+  }
+  if (session && session->canOpen()) {
+    startSession(std::move(session));
+  } else {
+    open(true);
+  }
+}
+
+void ProbeBatch::settleClaim(bool http1) {
+  if (claimed_) {
+    claimed_ = false;
+    ctx_.h2.settle(requests_.front().url.origin(), http1);
+  }
+}
+
+void ProbeBatch::onResolved(const std::vector<Address>& addrs, const std::string& err) {
+  if (phase_ != Phase::Resolving) {
+    return;
+  }
+  if (!err.empty()) {
+    failRemaining(err);
+    finish();
+    return;
+  }
+  phase_ = Phase::Connecting;
+  armTimer(kConnectTimeout);
+  dialer_ = std::make_unique<Dialer>(ctx_.loop, requests_.front().url, addrs,
+                                     [this](std::unique_ptr<Connection> conn, const std::string& dialErr) {
+                                       onDialed(std::move(conn), dialErr);
+                                     });
+  dialer_->start();
+}
+
+void ProbeBatch::onDialed(std::unique_ptr<Connection> conn, const std::string& err) {
+  // The dialer is still on the stack; free it once it has returned.
+  ctx_.loop.post([dialer = std::shared_ptr<Dialer>(std::move(dialer_))] {});
+  if (conn == nullptr) {
+    failRemaining(err);
+    finish();
+    return;
+  }
+  conn_ = std::move(conn);
+  handshake();
+}
+
+void ProbeBatch::onEvent(bool, bool) {
+  if (phase_ == Phase::Exchanging) {
+    exchange();
+  } else if (phase_ == Phase::Connecting) {
+    handshake();
+  }
+}
+
+void ProbeBatch::handshake() {
+  std::string err;
+  switch (conn_->setup(ctx_.tls, err)) {
+    case IoStatus::Ok:
+      ctx_.metrics.connections.fetch_add(1, std::memory_order_relaxed);
+      if (conn_->h2()) {
+        claimed_ = false;
+        startSession(ctx_.h2.adopt(std::move(conn_)));
+        break;
+      }
+      settleClaim(requests_.front().url.tls());
+      phase_ = Phase::Exchanging;
+      armTimer(kReadTimeout);
+      exchange();
+      break;
+    case IoStatus::WantRead:
+      ctx_.loop.watch(conn_->fd(), this, true, false);
+      break;
+    case IoStatus::WantWrite:
+      ctx_.loop.watch(conn_->fd(), this, false, true);
+      break;
+    case IoStatus::Eof:
+    case IoStatus::Error:
+      failRemaining(err);
+      finish();
+      break;
+  }
+}
+
+// exchange keeps the pipeline topped up and reads whatever has arrived.
+// Writing and reading interleave, so neither side can stall the other.
+void ProbeBatch::exchange() {
+  std::vector<char>& buf = probeBuf;
+  bool wantWrite = false;
+  for (int i = 0; i < kMaxReadsPerEvent; ++i) {
+    if (!sendMore()) {
+      return;
+    }
+    std::size_t n = 0;
+    std::string err;
+    switch (conn_->read(buf.data(), buf.size(), n, err)) {
+      case IoStatus::Ok:
+        lastProgress_ = Clock::now();
+        if (!consume(buf.data(), n)) {
+          return;
+        }
+        continue;
+      case IoStatus::WantRead:
+        break;
+      case IoStatus::WantWrite:
+        wantWrite = true;
+        break;
+      case IoStatus::Eof:
+        broken("read: unexpected EOF");
+        return;
+      case IoStatus::Error:
+        broken(err);
+        return;
+    }
+    break;
+  }
+  ctx_.loop.watch(conn_->fd(), this, true, wantWrite || sent_ < out_.size());
+}
+
+// sendMore writes requests up to the pipeline depth. It returns false when
+// the connection broke and the batch has moved on.
+bool ProbeBatch::sendMore() {
+  if (sent_ == out_.size()) {
+    out_.clear();
+    sent_ = 0;
+  }
+  while (!closing_ && queued_ < requests_.size() && queued_ < answered_ + depth_) {
+    const ProbeRequest& req = requests_[queued_++];
+    out_ += buildRequest("HEAD", req.url, req.headers);
+    ctx_.metrics.requests.fetch_add(1, std::memory_order_relaxed);
+  }
+  while (sent_ < out_.size()) {
+    std::size_t n = 0;
+    std::string err;
+    switch (conn_->write(out_.data() + sent_, out_.size() - sent_, n, err)) {
+      case IoStatus::Ok:
+        sent_ += n;
+        lastProgress_ = Clock::now();
+        break;
+      case IoStatus::WantRead:
+      case IoStatus::WantWrite:
+        return true;
+      case IoStatus::Eof:
+      case IoStatus::Error:
+        broken(err);
+        return false;
+    }
+  }
+  return true;
+}
+
+// consume parses the responses in n received bytes. It returns false once
+// the batch has moved to another connection or finished.
+bool ProbeBatch::consume(const char* data, std::size_t n) {
+  std::size_t off = 0;
+  while (off < n) {
+    off += parser_.feed(data + off, n - off, nullptr);
+    if (parser_.failed()) {
+      broken(parser_.error());
+      return false;
+    }
+    if (!parser_.done()) {
+      return true;
+    }
+    results_[answered_++].resp = parser_.response();
+    ++answeredHere_;
+    closing_ = !parser_.response().keepAlive;
+    parser_ = ResponseParser(true);
+
+    if (answered_ == requests_.size()) {
+      if (closing_ || off < n) {
+        dropConnection();
+      } else {
+        ctx_.loop.unwatch(conn_->fd());
+        ctx_.pool.put(std::move(conn_));
+      }
+      finish();
+      return false;
+    }
+    if (closing_) {
+      // Nothing past this response will be answered here.
+      dropConnection();
+      open(false);
+      return false;
+    }
+  }
+  return true;
+}
+
+void ProbeBatch::startSession(std::shared_ptr<H2Session> session) {
+  phase_ = Phase::Multiplexing;
+  session_ = std::move(session);
+  lostErr_.clear();
+  armTimer(kReadTimeout);
+  openStreams();
+  if (streams_.empty()) {
+    broken("http2: session takes no new streams");
+  }
+}
+
+// openStreams opens the requests still unanswered, as many as the session
+// takes at once.
+void ProbeBatch::openStreams() {
+  for (; queued_ < requests_.size() && session_->canOpen(); ++queued_) {
+    if (filled(queued_)) {
+      continue;
+    }
+    const ProbeRequest& req = requests_[queued_];
+    auto stream = std::make_unique<ProbeStream>(*this, queued_);
+    stream->id = session_->open("HEAD", req.url, req.headers, *stream);
+    ctx_.metrics.requests.fetch_add(1, std::memory_order_relaxed);
+    streams_.push_back(std::move(stream));
+  }
+}
+
+void ProbeBatch::onStreamClose(ProbeStream& stream, const std::string& err, bool retry) {
+  lastProgress_ = Clock::now();
+  ProbeResult& result = results_[stream.index];
+  if (!err.empty() && retry) {
+    lostErr_ = err;  // sent again below, once the session has settled
+  } else if (!err.empty()) {
+    result.err = err;
+  } else if (stream.resp.status == 0) {
+    result.err = "http2: response without :status";
+  } else {
+    result.resp = std::move(stream.resp);
+    ++answeredHere_;
+  }
+  streams_.erase(std::find_if(streams_.begin(), streams_.end(), [&](const auto& s) { return s.get() == &stream; }));
+
+  while (answered_ < requests_.size() && filled(answered_)) {
+    ++answered_;
+  }
+  if (answered_ == requests_.size()) {
+    finish();
+    return;
+  }
+  openStreams();
+  if (streams_.empty()) {
+    // Every request was sent and some came back unanswered: start over
+    // from the first of them, on this session if it is still usable.
+    broken(lostErr_.empty() ? "http2: session closed" : lostErr_);
+  }
+}
+
+// broken handles a connection that failed before answering everything it
+// was sent. Whatever made progress is resumed on a new connection; a
+// connection that answered nothing is retried without pipelining, and
+// without pipelining the request it stalled on fails alone.
+void ProbeBatch::broken(const std::string& err) {
+  const bool stale = conn_ && conn_->reused() && answeredHere_ == 0;
+  dropConnection();
+  if (answeredHere_ == 0 && !stale) {
+    if (depth_ > 1) {
+      depth_ = 1;
+    } else {
+      results_[answered_++].err = err;
+    }
+  }
+  while (answered_ < requests_.size() && filled(answered_)) {
+    ++answered_;
+  }
+  if (answered_ == requests_.size()) {
+    finish();
+    return;
+  }
+  open(false);
+}
+
+void ProbeBatch::failRemaining(const std::string& err) {
+  for (; answered_ < requests_.size(); ++answered_) {
+    if (!filled(answered_)) {
+      results_[answered_].err = err;
+    }
+  }
+}
+
+void ProbeBatch::dropConnection() {
+  if (conn_) {
+    ctx_.loop.unwatch(conn_->fd());
+    conn_.reset();
+  }
+  for (const auto& stream : streams_) {
+    session_->cancel(stream->id);
+  }
+  streams_.clear();
+  session_.reset();
+}
+
+void ProbeBatch::armTimer(Clock::duration timeout) {
+  lastProgress_ = Clock::now();
+  timeout_ = timeout;
+  if (timer_ == 0) {
+    timer_ = ctx_.loop.addTimer(lastProgress_ + timeout_, [this] { onTimer(); });
+  }
+}
+
+void ProbeBatch::onTimer() {
+  timer_ = 0;
+  const auto deadline = lastProgress_ + timeout_;
+  if (Clock::now() < deadline) {
+    timer_ = ctx_.loop.addTimer(deadline, [this] { onTimer(); });
+    return;
+  }
+  switch (phase_) {
+    case Phase::Waiting:
+      failRemaining("dial " + requests_.front().url.hostHeader() + ": i/o timeout");
+      finish();
+      break;
+    case Phase::Resolving:
+      failRemaining("lookup " + requests_.front().url.host + ": timed out");
+      finish();
+      break;
+    case Phase::Connecting:
+      failRemaining("dial " + requests_.front().url.hostHeader() + ": i/o timeout");
+      finish();
+      break;
+    case Phase::Exchanging:
+      dropConnection();
+      failRemaining("read: i/o timeout");
+      finish();
+      break;
+    case Phase::Multiplexing:
+      if (auto session = session_) {
+        dropConnection();
+        session->abandon("read: i/o timeout");
+      }
+      failRemaining("read: i/o timeout");
+      finish();
+      break;
+    default:
+      break;
+  }
+}
+
+// finish reports the results. The batch may be destroyed from inside done_.
+void ProbeBatch::finish() {
+  phase_ = Phase::Done;
+  if (timer_ != 0) {
+    ctx_.loop.cancelTimer(timer_);
+    timer_ = 0;
+  }
+  dialer_.reset();
+  dropConnection();
+  settleClaim(false);
+  done_(std::move(results_));
+}
+
+}  // namespace urldl
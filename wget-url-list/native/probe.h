@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "event_loop.h"
+#include "h2.h"
+#include "http.h"
+#include "net.h"
+#include "transfer.h"
+#include "url.h"
+
+namespace urldl {
+
+// ProbeRequest is one HEAD of a ProbeBatch, typically with conditional
+// headers.
+struct ProbeRequest {
+  Url url;
+  std::vector<Header> headers;
+};
+
+// ProbeResult is the answer to one ProbeRequest. err is set, and resp left
+// empty, when no response arrived.
+struct ProbeResult {
+  std::string err;
+  Response resp;
+};
+
+// ProbeBatch sends HEAD requests for URLs of one origin pipelined on a
+// single keep-alive connection: requests go out back to back and the
+// responses are read in order, so n probes cost about one round trip
+// instead of n. HEAD is idempotent, so when the server closes early the
+// unanswered requests are simply sent again on a new connection, and a
+// server that closes without answering any is asked one at a time. Over
+// HTTP/2 the requests are concurrent streams of the origin's session
+// instead, answered in any order. Redirects are reported, not followed.
+class ProbeBatch : public EventLoop::Handler, public std::enable_shared_from_this<ProbeBatch> {
+ public:
+  using DoneFn = std::function<void(std::vector<ProbeResult> results)>;
+
+  ProbeBatch(LoopContext& ctx, std::vector<ProbeRequest> requests, DoneFn done);
+  ~ProbeBatch() override;
+
+  void start();
+  void onEvent(bool readable, bool writable) override;
+
+ private:
+  enum class Phase { Idle, Waiting, Resolving, Connecting, Exchanging, Multiplexing, Done };
+
+  // ProbeStream is one request in flight on an H2Session.
+  struct ProbeStream final : H2StreamHandler {
+    ProbeStream(ProbeBatch& batch, std::size_t index) : batch(batch), index(index) {}
+    void onStreamHeaders(const Response& r) override { resp = r; }
+    void onStreamData(const char*, std::size_t) override {}
+    void onStreamClose(const std::string& err, bool retry) override { batch.onStreamClose(*this, err, retry); }
+
+    ProbeBatch& batch;
+    std::size_t index;
+    std::uint32_t id = 0;
+    Response resp;
+  };
+
+  void open(bool allowPooled);
+  void onSessionReady(std::shared_ptr<H2Session> session);
+  void settleClaim(bool http1);
+  void startSession(std::shared_ptr<H2Session> session);
+  void openStreams();
+  void onStreamClose(ProbeStream& stream, const std::string& err, bool retry);
+  bool filled(std::size_t i) const { return results_[i].resp.status != 0 || !results_[i].err.empty(); }
+  void onResolved(const std::vector<Address>& addrs, const std::string& err);
+  void onDialed(std::unique_ptr<Connection> conn, const std::string& err);
+  void handshake();
+  void exchange();
+  bool sendMore();
+  bool consume(const char* data, std::size_t n);
+  void broken(const std::string& err);
+  void failRemaining(const std::string& err);
+  void dropConnection();
+  void armTimer(Clock::duration timeout);
+  void onTimer();
+  void finish();
+
+  LoopContext& ctx_;
+  std::vector<ProbeRequest> requests_;
+  std::vector<ProbeResult> results_;
+  DoneFn done_;
+
+  Phase phase_ = Phase::Idle;
+  std::unique_ptr<Connection> conn_;
+  std::unique_ptr<Dialer> dialer_;
+
+  std::size_t depth_;         // requests in flight at once
+  std::size_t answered_ = 0;  // results_ filled so far
+  std::size_t queued_ = 0;    // requests written into out_ on this connection
+  std::size_t answeredHere_ = 0;
+  std::string out_;
+  std::size_t sent_ = 0;
+  ResponseParser parser_{true};
+  bool closing_ = false;  // the server said this is the last response
+
+  bool claimed_ = false;  // this batch dials for the origin's HTTP/2 waiters
+  std::shared_ptr<H2Session> session_;
+  std::vector<std::unique_ptr<ProbeStream>> streams_;
+  std::string lostErr_;  // why a stream ended that may be sent again
+
+  Clock::time_point lastProgress_{};
+  Clock::duration timeout_{};
+  EventLoop::TimerId timer_ = 0;
+};
+
+}  // namespace urldl
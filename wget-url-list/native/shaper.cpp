@@ -0,0 +1,58 @@
+#include "shaper.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace urldl {
+
+namespace {
+
+// The bucket holds a tenth of a second at the rate, but never less than
+// kMinBurstBytes so a slow cap still reads in useful chunks.
+constexpr std::int64_t kMinBurstBytes = 16 * 1024;
+constexpr std::int64_t kNanos = 1000000000;
+
+std::int64_t nowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+Shaper::Shaper(std::int64_t bytesPerSecond) : rate_(std::max<std::int64_t>(bytesPerSecond, 0)), burstNanos_(0) {
+  if (rate_ > 0) {
+    burstNanos_ = nanosFor(static_cast<std::size_t>(std::max(kMinBurstBytes, rate_ / 10)));
+  }
+}
+
+std::int64_t Shaper::nanosFor(std::size_t bytes) const {
+  return static_cast<std::int64_t>(static_cast<long double>(bytes) * kNanos / rate_);
+}
+
+std::size_t Shaper::take(std::size_t want, Clock::duration& wait) {
+  if (rate_ == 0) {
+    return want;
+  }
+  const std::int64_t now = nowNanos();
+  std::int64_t paid = paidUntil_.load(std::memory_order_relaxed);
+  for (;;) {
+    // A bucket left alone refills only up to the burst.
+    const std::int64_t from = std::max(paid, now - burstNanos_);
+    if (from >= now) {
+      wait = std::chrono::nanoseconds(std::max<std::int64_t>(from - now, 1000000));
+      return 0;
+    }
+    const auto available = static_cast<std::size_t>(static_cast<long double>(now - from) * rate_ / kNanos);
+    const std::size_t grant = std::min(want, std::max<std::size_t>(available, 1));
+    if (paidUntil_.compare_exchange_weak(paid, from + nanosFor(grant), std::memory_order_relaxed)) {
+      return grant;
+    }
+  }
+}
+
+void Shaper::refund(std::size_t n) {
+  if (rate_ != 0 && n != 0) {
+    paidUntil_.fetch_sub(nanosFor(n), std::memory_order_relaxed);
+  }
+}
+
+}  // namespace urldl
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "event_loop.h"
+
+namespace urldl {
+
+// Shaper caps the combined read rate of every transfer on every loop. It is
+// a token bucket kept as a single timestamp (the time the bucket will have
+// paid off what was taken, as in GCRA), so taking bytes is one CAS and
+// loops never wait on each other. Readers that find the bucket empty stop
+// reading until it refills, and TCP flow control holds the sender back.
+class Shaper {
+ public:
+  // bytesPerSecond 0 means unlimited.
+  explicit Shaper(std::int64_t bytesPerSecond);
+  Shaper(const Shaper&) = delete;
+  Shaper& operator=(const Shaper&) = delete;
+
+  bool limited() const { return rate_ > 0; }
+  // take grants up to want bytes of reading. It returns 0 when the bucket
+  // is empty, with wait set to how long until it is not.
+  std::size_t take(std::size_t want, Clock::duration& wait);
+  // refund returns bytes granted but not read.
+  void refund(std::size_t n);
+
+ private:
+  std::int64_t nanosFor(std::size_t bytes) const;
+
+  std::int64_t rate_;
+  std::int64_t burstNanos_;  // how long the bucket takes to fill
+  std::atomic<std::int64_t> paidUntil_{0};  // steady clock, in nanoseconds
+};
+
+}  // namespace urldl
@@ -0,0 +1,86 @@
+#include "sidecar.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace urldl {
+
+namespace {
+
+constexpr const char* kMagic = "urldl-segments 1";
+
+}  // namespace
+
+std::string sidecarPath(const std::string& path) { return path + ".urldl"; }
+
+bool loadSidecar(const std::string& path, SegmentState& state) {
+  std::ifstream in(sidecarPath(path));
+  std::string line;
+  if (!in || !std::getline(in, line) || line != kMagic) {
+    return false;
+  }
+  if (!std::getline(in, line)) {
+    return false;
+  }
+  std::istringstream total(line);
+  if (!(total >> state.total) || state.total <= 0) {
+    return false;
+  }
+  if (!std::getline(in, state.validator)) {
+    return false;
+  }
+
+  state.segments.clear();
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    Segment seg;
+    if (!(fields >> seg.start >> seg.pos >> seg.end) || seg.pos < seg.start || seg.pos > seg.end) {
+      return false;
+    }
+    state.segments.push_back(seg);
+  }
+
+  // Segments must tile [0, total); anything else is a damaged file.
+  std::sort(state.segments.begin(), state.segments.end(),
+            [](const Segment& a, const Segment& b) { return a.start < b.start; });
+  std::int64_t next = 0;
+  for (const auto& seg : state.segments) {
+    if (seg.start != next) {
+      return false;
+    }
+    next = seg.end;
+  }
+  return next == state.total && !state.segments.empty();
+}
+
+bool saveSidecar(const std::string& path, const SegmentState& state, std::string& err) {
+  const std::string target = sidecarPath(path);
+  const std::string tmp = target + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    out << kMagic << "\n" << state.total << "\n" << state.validator << "\n";
+    std::vector<Segment> segments = state.segments;
+    std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) { return a.start < b.start; });
+    for (const auto& seg : segments) {
+      out << seg.start << " " << seg.pos << " " << seg.end << "\n";
+    }
+    out.flush();
+    if (!out) {
+      err = "write " + tmp + ": " + std::strerror(errno);
+      return false;
+    }
+  }
+  if (std::rename(tmp.c_str(), target.c_str()) != 0) {
+    err = "rename " + tmp + ": " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+void removeSidecar(const std::string& path) { std::remove(sidecarPath(path).c_str()); }
+
+}  // namespace urldl
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace urldl {
+
+// Segment is one byte range [start, end) of a segmented download; pos is
+// how far it has been written.
+struct Segment {
+  std::int64_t start = 0;
+  std::int64_t pos = 0;
+  std::int64_t end = 0;
+
+  bool done() const { return pos >= end; }
+};
+
+// SegmentState is what a segmented download records next to its file so an
+// interrupted run can continue the ranges that were still open, much like
+// wget -c continues a single stream.
+struct SegmentState {
+  std::int64_t total = 0;
+  std::string validator;          // strong ETag or Last-Modified, sent as If-Range
+  std::vector<Segment> segments;  // in split order; sorted they tile [0, total)
+};
+
+// sidecarPath is the state file kept beside path while it is incomplete.
+std::string sidecarPath(const std::string& path);
+
+// loadSidecar reads the state for path. It returns false when there is no
+// usable state, which callers treat as an unsegmented file.
+bool loadSidecar(const std::string& path, SegmentState& state);
+// saveSidecar replaces the state atomically.
+bool saveSidecar(const std::string& path, const SegmentState& state, std::string& err);
+void removeSidecar(const std::string& path);
+
+}  // namespace urldl
@@ -0,0 +1,713 @@
+#include "transfer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace urldl {
+
+namespace {
+
+constexpr std::size_t kReadBufferSize = 256 * 1024;
+// Bodies of redirects and skipped responses up to this size are read and
+// dropped so the connection can go back to the pool; larger ones close it.
+constexpr std::int64_t kMaxDrainBytes = 64 * 1024;
+// kMaxReadsPerEvent caps how long one fast transfer can hold its loop.
+constexpr int kMaxReadsPerEvent = 16;
+
+// Transfers on a loop run one at a time, so they share the loop thread's
+// read buffer.
+thread_local std::vector<char> readBuf(kReadBufferSize);
+
+#if defined(__linux__)
+// kSpliceBytes is the pipe size asked for, and so the most one splice moves.
+constexpr std::size_t kSpliceBytes = 1 << 20;
+
+// SplicePipe is the loop thread's pipe between socket and file for splice.
+struct SplicePipe {
+  int r = -1;
+  int w = -1;
+
+  ~SplicePipe() { reset(); }
+
+  bool open() {
+    if (r >= 0) {
+      return true;
+    }
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0) {
+      return false;
+    }
+    r = fds[0];
+    w = fds[1];
+    ::fcntl(w, F_SETPIPE_SZ, static_cast<int>(kSpliceBytes));
+    return true;
+  }
+
+  // reset discards the pipe along with anything stuck in it.
+  void reset() {
+    if (r >= 0) {
+      ::close(r);
+      ::close(w);
+      r = w = -1;
+    }
+  }
+};
+
+thread_local SplicePipe splicePipe;
+#endif
+
+}  // namespace
+
+Transfer::Transfer(LoopContext& ctx, TransferDelegate& delegate, std::string method, Url url,
+                   std::vector<Header> headers)
+    : ctx_(ctx),
+      delegate_(delegate),
+      method_(std::move(method)),
+      url_(std::move(url)),
+      headers_(std::move(headers)) {
+  ctx_.metrics.active.fetch_add(1, std::memory_order_relaxed);
+}
+
+Transfer::~Transfer() {
+  ctx_.metrics.active.fetch_sub(1, std::memory_order_relaxed);
+  if (timer_ != 0) {
+    ctx_.loop.cancelTimer(timer_);
+  }
+  if (resumeTimer_ != 0) {
+    ctx_.loop.cancelTimer(resumeTimer_);
+  }
+  dropConnection();
+  settleClaim(false);
+}
+
+void Transfer::start() { begin(true); }
+
+void Transfer::begin(bool allowPooled) {
+  request_ = buildRequest(method_, url_, headers_);
+  sent_ = 0;
+  parser_ = ResponseParser(method_ == "HEAD");
+  gotBytes_ = false;
+  leftover_ = false;
+  deliverBody_ = false;
+  redirectTo_.reset();
+  dialed_ = false;
+  stats_.h2 = false;
+
+  if (url_.tls()) {
+    if (auto session = ctx_.h2.find(url_.origin())) {
+      startStream(std::move(session));
+      return;
+    }
+  }
+  if (allowPooled) {
+    conn_ = ctx_.pool.take(url_.origin());
+  }
+  if (conn_) {
+    armTimer(kReadTimeout);
+    onRequest(true);
+    sendRequest();
+    return;
+  }
+
+  if (url_.tls() && !claimed_) {
+    std::weak_ptr<Transfer> weak = shared_from_this();
+    if (!ctx_.h2.claim(url_.origin(), [weak](std::shared_ptr<H2Session> session) {
+          if (auto self = weak.lock()) {
+            self->onSessionReady(std::move(session));
+          }
+        })) {
+      phase_ = Phase::Waiting;
+      armTimer(kConnectTimeout);
+      return;
+    }
+    claimed_ = true;
+  }
+  dial();
+}
+
+void Transfer::dial() {
+  phase_ = Phase::Resolving;
+  phaseStart_ = Clock::now();
+  armTimer(kConnectTimeout);
+  std::weak_ptr<Transfer> weak = shared_from_this();
+  EventLoop* loop = &ctx_.loop;
+  ctx_.dns.resolve(url_.host, url_.port, [weak, loop](const std::vector<Address>& addrs, const std::string& err) {
+    loop->post([weak, addrs, err] {
+      if (auto self = weak.lock()) {
+        self->onResolved(addrs, err);
+      }
+    });
+  });
+}
+
+// onSessionReady resumes a transfer that waited for another dial to the
+// origin: onto its session, or onto a connection of its own.
+void Transfer::onSessionReady(std::shared_ptr<H2Session> session) {
+  if (phase_ != Phase::Waiting) {
+    return;
+  }
+  if (session && session->canOpen()) {
+    startStream(std::move(session));
+  } else {
+    begin(true);
+  }
+}
+
+void Transfer::startStream(std::shared_ptr<H2Session> session) {
+  phase_ = Phase::Receiving;
+  session_ = std::move(session);
+  streamBytes_ = 0;
+  streamExpected_ = -1;
+  stats_.h2 = true;
+  armTimer(kReadTimeout);
+  onRequest(!dialed_);
+  stream_ = session_->open(method_, url_, headers_, *this);
+  if (stream_ == 0) {
+    session_.reset();
+    finish(Outcome::Protocol, "http2: session refused a new stream");
+  }
+}
+
+void Transfer::settleClaim(bool http1) {
+  if (claimed_) {
+    claimed_ = false;
+    ctx_.h2.settle(url_.origin(), http1);
+  }
+}
+
+void Transfer::onResolved(const std::vector<Address>& addrs, const std::string& err) {
+  if (phase_ != Phase::Resolving) {
+    return;
+  }
+  stats_.dns = Clock::now() - phaseStart_;
+  ctx_.metrics.dns.observe(stats_.dns);
+  if (!err.empty()) {
+    finish(Outcome::Dns, err);
+    return;
+  }
+  phase_ = Phase::Connecting;
+  phaseStart_ = Clock::now();
+  armTimer(kConnectTimeout);
+  dialer_ = std::make_unique<Dialer>(ctx_.loop, url_, addrs,
+                                     [this](std::unique_ptr<Connection> conn, const std::string& dialErr) {
+                                       onDialed(std::move(conn), dialErr);
+                                     });
+  dialer_->start();
+}
+
+void Transfer::onDialed(std::unique_ptr<Connection> conn, const std::string& err) {
+  // The dialer is still on the stack; free it once it has returned.
+  ctx_.loop.post([dialer = std::shared_ptr<Dialer>(std::move(dialer_))] {});
+  if (conn == nullptr) {
+    finish(Outcome::Connect, err);
+    return;
+  }
+  conn_ = std::move(conn);
+  handshake();
+}
+
+// handshake runs TLS on a connected stream, then sends the request or
+// hands the connection to an HTTP/2 session.
+void Transfer::handshake() {
+  std::string err;
+  switch (conn_->setup(ctx_.tls, err)) {
+    case IoStatus::Ok: {
+      const Clock::time_point connected = conn_->connectedAt();
+      stats_.connect = connected - phaseStart_;
+      ctx_.metrics.connect.observe(stats_.connect);
+      if (url_.tls()) {
+        stats_.tls = Clock::now() - connected;
+        ctx_.metrics.tls.observe(stats_.tls);
+      }
+      ctx_.metrics.connections.fetch_add(1, std::memory_order_relaxed);
+      dialed_ = true;
+      if (conn_->h2()) {
+        claimed_ = false;
+        startStream(ctx_.h2.adopt(std::move(conn_)));
+        return;
+      }
+      settleClaim(url_.tls());
+      armTimer(kReadTimeout);
+      onRequest(false);
+      sendRequest();
+      return;
+    }
+    case IoStatus::WantRead:
+      interest(true, false);
+      return;
+    case IoStatus::WantWrite:
+      interest(false, true);
+      return;
+    case IoStatus::Eof:
+    case IoStatus::Error:
+      // The dialer finished the TCP connect; only the handshake can fail.
+      finish(Outcome::Tls, err);
+      return;
+  }
+}
+
+void Transfer::onEvent(bool, bool) {
+  switch (phase_) {
+    case Phase::Connecting:
+      handshake();
+      break;
+    case Phase::Sending:
+      sendRequest();
+      break;
+    case Phase::Receiving:
+      receive();
+      break;
+    default:
+      break;
+  }
+}
+
+void Transfer::sendRequest() {
+  phase_ = Phase::Sending;
+  while (sent_ < request_.size()) {
+    std::size_t n = 0;
+    std::string err;
+    switch (conn_->write(request_.data() + sent_, request_.size() - sent_, n, err)) {
+      case IoStatus::Ok:
+        sent_ += n;
+        lastProgress_ = Clock::now();
+        break;
+      case IoStatus::WantRead:
+        interest(true, false);
+        return;
+      case IoStatus::WantWrite:
+        interest(false, true);
+        return;
+      case IoStatus::Eof:
+      case IoStatus::Error:
+        retryOrFail(err);
+        return;
+    }
+  }
+  phase_ = Phase::Receiving;
+  interest(true, false);
+  receive();
+}
+
+void Transfer::receive() {
+  std::vector<char>& buf = readBuf;
+  for (int i = 0; i < kMaxReadsPerEvent; ++i) {
+    std::size_t room = buf.size();
+    if (ctx_.shaper.limited()) {
+      Clock::duration wait{};
+      room = ctx_.shaper.take(room, wait);
+      if (room == 0) {
+        pauseReading(wait);
+        return;
+      }
+    }
+    std::size_t n = 0;
+    std::string err;
+    IoStatus status = IoStatus::Ok;
+    const bool spliced = spliceBody(room, n, err, status);
+    if (!spliced) {
+      status = conn_->read(buf.data(), room, n, err);
+    }
+    ctx_.shaper.refund(room - n);
+    switch (status) {
+      case IoStatus::Ok:
+        onFirstByte();
+        lastProgress_ = Clock::now();
+        if (spliced) {
+          countBody(n);
+          parser_.skipBody(n);
+          delegate_.onSpliced(n);
+          if (parser_.done()) {
+            onMessageEnd();
+            return;
+          }
+        } else if (!consume(buf.data(), n)) {
+          return;
+        }
+        break;
+      case IoStatus::WantRead:
+        interest(true, false);
+        return;
+      case IoStatus::WantWrite:
+        interest(false, true);
+        return;
+      case IoStatus::Eof:
+        parser_.finish();
+        if (parser_.done()) {
+          onMessageEnd();
+        } else {
+          retryOrFail(parser_.error());
+        }
+        return;
+      case IoStatus::Error:
+        retryOrFail(err);
+        return;
+    }
+  }
+  if (conn_->buffered()) {
+    // The socket may never get readable again for these; come back for them.
+    std::weak_ptr<Transfer> weak = shared_from_this();
+    ctx_.loop.post([weak] {
+      if (auto self = weak.lock(); self && self->phase_ == Phase::Receiving && self->conn_) {
+        self->receive();
+      }
+    });
+  }
+}
+
+// pauseReading stops reading until the shaper has bytes to give again.
+// Time spent paused is not the server's fault, so it does not count
+// towards the read timeout.
+void Transfer::pauseReading(Clock::duration wait) {
+  interest(false, false);
+  resumeTimer_ = ctx_.loop.addTimer(Clock::now() + wait, [this] {
+    resumeTimer_ = 0;
+    if (phase_ == Phase::Receiving && conn_) {
+      lastProgress_ = Clock::now();
+      interest(true, false);
+      receive();
+    }
+  });
+}
+
+// spliceBody moves the next raw body bytes from the socket into the
+// delegate's file through a pipe, so they never pass through user space. It
+// returns false when they have to be read normally instead: TLS, chunked
+// framing, or a delegate that wants to see the data.
+bool Transfer::spliceBody(std::size_t room, std::size_t& n, std::string& err, IoStatus& status) {
+#if defined(__linux__)
+  int fd = -1;
+  std::int64_t offset = 0;
+  std::int64_t limit = 0;
+  if (!conn_->plain() || !deliverBody_ || redirectTo_ || !parser_.headersDone() || parser_.done() ||
+      !parser_.rawBody() || !delegate_.spliceTarget(fd, offset, limit) || limit <= 0 || !splicePipe.open()) {
+    return false;
+  }
+  std::int64_t want = std::min<std::int64_t>(limit, std::min(kSpliceBytes, room));
+  if (parser_.bodyRemaining() >= 0) {
+    want = std::min(want, parser_.bodyRemaining());
+  }
+
+  ssize_t in = -1;
+  do {
+    in = ::splice(conn_->fd(), nullptr, splicePipe.w, nullptr, static_cast<std::size_t>(want),
+                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  } while (in < 0 && errno == EINTR);
+  if (in <= 0) {
+    if (in == 0) {
+      status = IoStatus::Eof;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      status = IoStatus::WantRead;
+    } else {
+      status = IoStatus::Error;
+      err = std::string("read: ") + std::strerror(errno);
+    }
+    return true;
+  }
+
+  loff_t at = offset;
+  std::size_t moved = 0;
+  while (moved < static_cast<std::size_t>(in)) {
+    const ssize_t out =
+        ::splice(splicePipe.r, nullptr, fd, &at, static_cast<std::size_t>(in) - moved, SPLICE_F_MOVE);
+    if (out < 0 && errno == EINTR) {
+      continue;
+    }
+    if (out <= 0) {
+      err = std::string("write file: ") + (out < 0 ? std::strerror(errno) : "short write");
+      splicePipe.reset();
+      status = IoStatus::Error;
+      return true;
+    }
+    moved += static_cast<std::size_t>(out);
+  }
+  n = moved;
+  status = IoStatus::Ok;
+  return true;
+#else
+  (void)room;
+  (void)n;
+  (void)err;
+  (void)status;
+  return false;
+#endif
+}
+
+// consume feeds n received bytes to the parser. It returns false once the
+// transfer has moved on (finished, or restarted for a redirect) and the rest
+// of the buffer must not be looked at.
+bool Transfer::consume(const char* data, std::size_t n) {
+  std::size_t off = 0;
+  if (!parser_.headersDone()) {
+    off = parser_.feed(data, n, nullptr);
+    if (parser_.failed()) {
+      dropConnection();
+      finish(Outcome::Protocol, parser_.error());
+      return false;
+    }
+    if (!parser_.headersDone()) {
+      return true;
+    }
+    if (!onHeaders()) {
+      return false;
+    }
+  }
+  if (!parser_.done() && off < n) {
+    off += parser_.feed(data + off, n - off, [this](const char* p, std::size_t len) {
+      countBody(len);
+      return !deliverBody_ || delegate_.onBody(p, len);
+    });
+    if (parser_.failed()) {
+      dropConnection();
+      finish(Outcome::Protocol, parser_.error());
+      return false;
+    }
+  }
+  if (parser_.done()) {
+    leftover_ = off < n;
+    onMessageEnd();
+    return false;
+  }
+  return true;
+}
+
+// onHeaders decides what to do with the response body. It returns false when
+// the transfer has already moved on.
+bool Transfer::onHeaders() {
+  const Response& resp = parser_.response();
+  const std::string* location = resp.header("Location");
+  if (isRedirect(resp.status) && location != nullptr) {
+    auto next = resolveReference(url_, *location);
+    if (!next) {
+      dropConnection();
+      finish(Outcome::Redirect, "invalid redirect location: " + *location);
+      return false;
+    }
+    if (++redirects_ > kMaxRedirects) {
+      dropConnection();
+      finish(Outcome::Redirect, "too many redirects");
+      return false;
+    }
+    redirectTo_ = std::move(next);
+    deliverBody_ = false;
+    const std::int64_t left = parser_.bodyRemaining();
+    if (!parser_.done() && (left < 0 || left > kMaxDrainBytes)) {
+      dropConnection();
+      url_ = std::move(*redirectTo_);
+      begin(true);
+      return false;
+    }
+    return true;
+  }
+
+  deliverBody_ = delegate_.onResponse(resp);
+  if (!deliverBody_ && !parser_.done()) {
+    const std::int64_t left = parser_.bodyRemaining();
+    if (left < 0 || left > kMaxDrainBytes) {
+      dropConnection();
+      finish(Outcome::Ok, "");
+      return false;
+    }
+  }
+  return true;
+}
+
+void Transfer::onMessageEnd() {
+  releaseConnection();
+  if (redirectTo_) {
+    url_ = std::move(*redirectTo_);
+    retried_ = false;
+    begin(true);
+    return;
+  }
+  finish(Outcome::Ok, "");
+}
+
+void Transfer::onStreamHeaders(const Response& resp) {
+  onFirstByte();
+  lastProgress_ = Clock::now();
+  const std::string* location = resp.header("Location");
+  if (isRedirect(resp.status) && location != nullptr) {
+    auto next = resolveReference(url_, *location);
+    dropConnection();
+    if (!next) {
+      finish(Outcome::Redirect, "invalid redirect location: " + *location);
+    } else if (++redirects_ > kMaxRedirects) {
+      finish(Outcome::Redirect, "too many redirects");
+    } else {
+      url_ = std::move(*next);
+      retried_ = false;
+      begin(true);
+    }
+    return;
+  }
+  if (method_ != "HEAD" && resp.status != 204 && resp.status != 304) {
+    streamExpected_ = resp.contentLength;
+  }
+  deliverBody_ = delegate_.onResponse(resp);
+  if (!deliverBody_) {
+    // Cancelling a stream costs nothing, unlike closing a connection.
+    dropConnection();
+    finish(Outcome::Ok, "");
+  }
+}
+
+void Transfer::onStreamData(const char* data, std::size_t n) {
+  lastProgress_ = Clock::now();
+  countBody(n);
+  streamBytes_ += static_cast<std::int64_t>(n);
+  if (deliverBody_ && !delegate_.onBody(data, n)) {
+    dropConnection();
+    finish(Outcome::Aborted, "aborted");
+  }
+}
+
+void Transfer::onStreamClose(const std::string& err, bool retry) {
+  stream_ = 0;
+  session_.reset();
+  if (!err.empty()) {
+    if (retry && !retried_) {
+      retried_ = true;
+      ++stats_.retries;
+      ctx_.metrics.retries.fetch_add(1, std::memory_order_relaxed);
+      begin(true);
+      return;
+    }
+    finish(Outcome::Network, err);
+    return;
+  }
+  if (streamExpected_ >= 0 && streamBytes_ != streamExpected_) {
+    finish(Outcome::Protocol, "http2: body length does not match Content-Length");
+    return;
+  }
+  finish(Outcome::Ok, "");
+}
+
+// retryOrFail handles a broken stream. A pooled connection the server had
+// already dropped is retried once on a fresh one, since nothing was lost.
+void Transfer::retryOrFail(const std::string& err) {
+  const bool stale = conn_ && conn_->reused() && !gotBytes_ && !retried_;
+  dropConnection();
+  if (stale) {
+    retried_ = true;
+    ++stats_.retries;
+    ctx_.metrics.retries.fetch_add(1, std::memory_order_relaxed);
+    begin(false);
+    return;
+  }
+  finish(Outcome::Network, err);
+}
+
+void Transfer::onRequest(bool reused) {
+  requestAt_ = Clock::now();
+  stats_.reused = reused;
+  ctx_.metrics.requests.fetch_add(1, std::memory_order_relaxed);
+  if (reused) {
+    ctx_.metrics.reused.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Transfer::onFirstByte() {
+  if (!gotBytes_) {
+    gotBytes_ = true;
+    stats_.ttfb = Clock::now() - requestAt_;
+    ctx_.metrics.ttfb.observe(stats_.ttfb);
+  }
+}
+
+void Transfer::countBody(std::size_t n) {
+  stats_.bytes += static_cast<std::int64_t>(n);
+  ctx_.metrics.bytes.fetch_add(static_cast<std::int64_t>(n), std::memory_order_relaxed);
+}
+
+// dropConnection abandons the current connection, or the current stream
+// of a shared session.
+void Transfer::dropConnection() {
+  if (conn_) {
+    ctx_.loop.unwatch(conn_->fd());
+    conn_.reset();
+  }
+  if (stream_ != 0) {
+    session_->cancel(stream_);
+    stream_ = 0;
+  }
+  session_.reset();
+}
+
+void Transfer::releaseConnection() {
+  if (!conn_) {
+    return;
+  }
+  if (!leftover_ && parser_.done() && parser_.response().keepAlive) {
+    ctx_.loop.unwatch(conn_->fd());
+    ctx_.pool.put(std::move(conn_));
+    return;
+  }
+  dropConnection();
+}
+
+void Transfer::interest(bool read, bool write) { ctx_.loop.watch(conn_->fd(), this, read, write); }
+
+// armTimer starts a new inactivity window. Progress only bumps lastProgress_;
+// the timer re-arms itself until the window passes without any.
+void Transfer::armTimer(Clock::duration timeout) {
+  lastProgress_ = Clock::now();
+  timeout_ = timeout;
+  if (timer_ == 0) {
+    timer_ = ctx_.loop.addTimer(lastProgress_ + timeout_, [this] { onTimer(); });
+  }
+}
+
+void Transfer::onTimer() {
+  timer_ = 0;
+  const auto deadline = lastProgress_ + timeout_;
+  if (Clock::now() < deadline) {
+    timer_ = ctx_.loop.addTimer(deadline, [this] { onTimer(); });
+    return;
+  }
+  switch (phase_) {
+    case Phase::Waiting:
+      finish(Outcome::Timeout, "dial " + url_.hostHeader() + ": i/o timeout");
+      break;
+    case Phase::Resolving:
+      finish(Outcome::Timeout, "lookup " + url_.host + ": timed out");
+      break;
+    case Phase::Connecting:
+      finish(Outcome::Timeout, "dial " + url_.hostHeader() + ": i/o timeout");
+      break;
+    case Phase::Sending:
+    case Phase::Receiving:
+      if (auto session = session_) {
+        // A silent stream means a silent connection: fail it for everyone.
+        dropConnection();
+        session->abandon("read: i/o timeout");
+      }
+      dropConnection();
+      finish(Outcome::Timeout, "read: i/o timeout");
+      break;
+    default:
+      break;
+  }
+}
+
+void Transfer::finish(Outcome outcome, const std::string& err) {
+  phase_ = Phase::Done;
+  if (timer_ != 0) {
+    ctx_.loop.cancelTimer(timer_);
+    timer_ = 0;
+  }
+  if (resumeTimer_ != 0) {
+    ctx_.loop.cancelTimer(resumeTimer_);
+    resumeTimer_ = 0;
+  }
+  dialer_.reset();
+  dropConnection();
+  settleClaim(false);
+  delegate_.onDone(outcome, err);
+}
+
+}  // namespace urldl
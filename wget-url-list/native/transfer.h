@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "event_loop.h"
+#include "h2.h"
+#include "http.h"
+#include "metrics.h"
+#include "net.h"
+#include "outcome.h"
+#include "shaper.h"
+#include "url.h"
+
+namespace urldl {
+
+// LoopContext is the per-loop state a transfer runs against.
+struct LoopContext {
+  EventLoop& loop;
+  ConnectionPool& pool;
+  H2Pool& h2;
+  TlsContext& tls;
+  DnsCache& dns;
+  Shaper& shaper;
+  Metrics& metrics;
+};
+
+// TransferDelegate receives the final (post-redirect) response of a transfer.
+class TransferDelegate {
+ public:
+  virtual ~TransferDelegate() = default;
+  // onResponse sees the header block; returning false skips the body, which
+  // is drained when small so the connection can be reused.
+  virtual bool onResponse(const Response& resp) = 0;
+  // onBody returns false to abort with the delegate's own error.
+  virtual bool onBody(const char* data, std::size_t n) = 0;
+  // spliceTarget lets a plain-HTTP body skip onBody: while it returns true,
+  // up to limit raw body bytes may be moved by the kernel straight into fd
+  // at offset, each batch reported through onSpliced.
+  virtual bool spliceTarget(int& /*fd*/, std::int64_t& /*offset*/, std::int64_t& /*limit*/) { return false; }
+  virtual void onSpliced(std::size_t /*n*/) {}
+  // onDone is called exactly once, with Outcome::Ok and an empty err on
+  // success. The transfer may be destroyed from inside onDone.
+  virtual void onDone(Outcome outcome, const std::string& err) = 0;
+};
+
+// Transfer runs one request on an event loop: connection reuse or setup,
+// redirects, response framing and timeouts. HTTPS origins that negotiate
+// h2 get a stream on the loop's shared session instead of a connection of
+// their own.
+class Transfer : public EventLoop::Handler,
+                 public H2StreamHandler,
+                 public std::enable_shared_from_this<Transfer> {
+ public:
+  Transfer(LoopContext& ctx, TransferDelegate& delegate, std::string method, Url url, std::vector<Header> headers);
+  ~Transfer() override;
+
+  void start();
+  void onEvent(bool readable, bool writable) override;
+  void onStreamHeaders(const Response& resp) override;
+  void onStreamData(const char* data, std::size_t n) override;
+  void onStreamClose(const std::string& err, bool retry) override;
+
+  // url is the current target, which changes as redirects are followed.
+  const Url& url() const { return url_; }
+  const TransferStats& stats() const { return stats_; }
+
+ private:
+  enum class Phase { Idle, Waiting, Resolving, Connecting, Sending, Receiving, Done };
+
+  static constexpr int kMaxRedirects = 20;
+
+  void begin(bool allowPooled);
+  void dial();
+  void onSessionReady(std::shared_ptr<H2Session> session);
+  void startStream(std::shared_ptr<H2Session> session);
+  void settleClaim(bool http1);
+  void onResolved(const std::vector<Address>& addrs, const std::string& err);
+  void onDialed(std::unique_ptr<Connection> conn, const std::string& err);
+  void handshake();
+  void sendRequest();
+  void receive();
+  bool spliceBody(std::size_t room, std::size_t& n, std::string& err, IoStatus& status);
+  void pauseReading(Clock::duration wait);
+  void onRequest(bool reused);
+  void onFirstByte();
+  void countBody(std::size_t n);
+  bool consume(const char* data, std::size_t n);
+  bool onHeaders();
+  void onMessageEnd();
+  void retryOrFail(const std::string& err);
+  void dropConnection();
+  void releaseConnection();
+  void interest(bool read, bool write);
+  void armTimer(Clock::duration timeout);
+  void onTimer();
+  void finish(Outcome outcome, const std::string& err);
+
+  LoopContext& ctx_;
+  TransferDelegate& delegate_;
+  std::string method_;
+  Url url_;
+  std::vector<Header> headers_;
+
+  Phase phase_ = Phase::Idle;
+  std::unique_ptr<Connection> conn_;
+  std::shared_ptr<H2Session> session_;
+  std::uint32_t stream_ = 0;
+  bool claimed_ = false;  // this transfer's dial decides the origin's protocol
+  std::int64_t streamBytes_ = 0;
+  std::int64_t streamExpected_ = -1;
+  std::unique_ptr<Dialer> dialer_;
+
+  std::string request_;
+  std::size_t sent_ = 0;
+  ResponseParser parser_;
+  bool gotBytes_ = false;
+  bool leftover_ = false;
+  bool retried_ = false;
+  int redirects_ = 0;
+
+  // What happens once the current response body ends.
+  bool deliverBody_ = false;
+  std::optional<Url> redirectTo_;
+
+  Clock::time_point lastProgress_{};
+  Clock::duration timeout_{};
+  EventLoop::TimerId timer_ = 0;
+  EventLoop::TimerId resumeTimer_ = 0;  // reading paused by the shaper
+
+  TransferStats stats_;
+  Clock::time_point phaseStart_{};  // of the lookup or the connection attempt
+  Clock::time_point requestAt_{};
+  bool dialed_ = false;  // the current request got a new connection
+};
+
+}  // namespace urldl
@@ -0,0 +1,625 @@
+#include "url.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+
+#include "url_scan.h"
+
+namespace urldl {
+
+namespace {
+
+// The helpers below are a byte-for-byte port of the parts of Go's net/url
+// that cleanURL relies on, so both binaries agree on every normalized URL.
+enum class Encoding {
+  Path,
+  Host,
+  Zone,
+  UserPassword,
+  QueryComponent,
+  Fragment,
+};
+
+bool isHex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+unsigned char unhex(char c) {
+  if (c >= '0' && c <= '9') return static_cast<unsigned char>(c - '0');
+  if (c >= 'a' && c <= 'f') return static_cast<unsigned char>(c - 'a' + 10);
+  return static_cast<unsigned char>(c - 'A' + 10);
+}
+
+bool shouldEscape(unsigned char c, Encoding mode) {
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+    return false;
+  }
+  if (mode == Encoding::Host || mode == Encoding::Zone) {
+    switch (c) {
+      case '!': case '$': case '&': case '\'': case '(': case ')': case '*':
+      case '+': case ',': case ';': case '=': case ':': case '[': case ']':
+      case '<': case '>': case '"':
+        return false;
+      default:
+        break;
+    }
+  }
+  switch (c) {
+    case '-': case '_': case '.': case '~':
+      return false;
+    case '$': case '&': case '+': case ',': case '/': case ':': case ';':
+    case '=': case '?': case '@':
+      switch (mode) {
+        case Encoding::Path:
+          return c == '?';
+        case Encoding::UserPassword:
+          return c == '@' || c == '/' || c == '?' || c == ':';
+        case Encoding::QueryComponent:
+          return true;
+        case Encoding::Fragment:
+          return false;
+        default:
+          break;
+      }
+      break;
+    default:
+      break;
+  }
+  if (mode == Encoding::Fragment) {
+    switch (c) {
+      case '!': case '(': case ')': case '*':
+        return false;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+std::optional<std::string> unescape(std::string_view s, Encoding mode) {
+  std::size_t n = 0;
+  bool hasPlus = false;
+  for (std::size_t i = 0; i < s.size();) {
+    const char c = s[i];
+    if (c == '%') {
+      ++n;
+      if (i + 2 >= s.size() || !isHex(s[i + 1]) || !isHex(s[i + 2])) {
+        return std::nullopt;
+      }
+      if (mode == Encoding::Host && unhex(s[i + 1]) < 8 && s.substr(i, 3) != "%25") {
+        return std::nullopt;
+      }
+      if (mode == Encoding::Zone) {
+        const unsigned char v = static_cast<unsigned char>(unhex(s[i + 1]) << 4 | unhex(s[i + 2]));
+        if (s.substr(i, 3) != "%25" && v != ' ' && shouldEscape(v, Encoding::Host)) {
+          return std::nullopt;
+        }
+      }
+      i += 3;
+    } else if (c == '+') {
+      hasPlus = mode == Encoding::QueryComponent;
+      ++i;
+    } else {
+      const auto uc = static_cast<unsigned char>(c);
+      if ((mode == Encoding::Host || mode == Encoding::Zone) && uc < 0x80 && shouldEscape(uc, mode)) {
+        return std::nullopt;
+      }
+      ++i;
+    }
+  }
+  if (n == 0 && !hasPlus) {
+    return std::string(s);
+  }
+
+  std::string out;
+  out.reserve(s.size() - 2 * n);
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '%') {
+      out.push_back(static_cast<char>(unhex(s[i + 1]) << 4 | unhex(s[i + 2])));
+      i += 2;
+    } else if (s[i] == '+' && mode == Encoding::QueryComponent) {
+      out.push_back(' ');
+    } else {
+      out.push_back(s[i]);
+    }
+  }
+  return out;
+}
+
+std::string escape(std::string_view s, Encoding mode) {
+  static constexpr char kUpperHex[] = "0123456789ABCDEF";
+  std::string out;
+  out.reserve(s.size());
+  for (const char c : s) {
+    const auto uc = static_cast<unsigned char>(c);
+    if (!shouldEscape(uc, mode)) {
+      out.push_back(c);
+    } else if (c == ' ' && mode == Encoding::QueryComponent) {
+      out.push_back('+');
+    } else {
+      out.push_back('%');
+      out.push_back(kUpperHex[uc >> 4]);
+      out.push_back(kUpperHex[uc & 15]);
+    }
+  }
+  return out;
+}
+
+bool validEncoded(std::string_view s, Encoding mode) {
+  for (const char c : s) {
+    switch (c) {
+      case '!': case '$': case '&': case '\'': case '(': case ')': case '*':
+      case '+': case ',': case ';': case '=': case ':': case '@': case '[':
+      case ']': case '%':
+        break;
+      default:
+        if (shouldEscape(static_cast<unsigned char>(c), mode)) {
+          return false;
+        }
+    }
+  }
+  return true;
+}
+
+bool validOptionalPort(std::string_view port) {
+  if (port.empty()) {
+    return true;
+  }
+  if (port[0] != ':') {
+    return false;
+  }
+  return std::all_of(port.begin() + 1, port.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+bool validUserinfo(std::string_view s) {
+  static constexpr std::string_view kAllowed = "-._:~!$&'()*+,;=%@";
+  return std::all_of(s.begin(), s.end(), [](char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           kAllowed.find(c) != std::string_view::npos;
+  });
+}
+
+std::optional<std::string> parseHost(std::string_view host) {
+  if (!host.empty() && host[0] == '[') {
+    const auto close = host.rfind(']');
+    if (close == std::string_view::npos || !validOptionalPort(host.substr(close + 1))) {
+      return std::nullopt;
+    }
+    const auto zone = host.substr(0, close).find("%25");
+    if (zone != std::string_view::npos) {
+      auto h1 = unescape(host.substr(0, zone), Encoding::Host);
+      auto h2 = unescape(host.substr(zone, close - zone), Encoding::Zone);
+      auto h3 = unescape(host.substr(close), Encoding::Host);
+      if (!h1 || !h2 || !h3) {
+        return std::nullopt;
+      }
+      return *h1 + *h2 + *h3;
+    }
+  } else if (const auto colon = host.rfind(':'); colon != std::string_view::npos) {
+    if (!validOptionalPort(host.substr(colon))) {
+      return std::nullopt;
+    }
+  }
+  return unescape(host, Encoding::Host);
+}
+
+struct GoURL {
+  std::string scheme;
+  bool hasUser = false;
+  bool passwordSet = false;
+  std::string username;
+  std::string password;
+  std::string host;
+  std::string path;
+  std::string rawPath;
+  bool forceQuery = false;
+  std::string rawQuery;
+
+  std::string escapedPath() const {
+    if (!rawPath.empty() && validEncoded(rawPath, Encoding::Path)) {
+      if (auto p = unescape(rawPath, Encoding::Path); p && *p == path) {
+        return rawPath;
+      }
+    }
+    if (path == "*") {
+      return "*";
+    }
+    return escape(path, Encoding::Path);
+  }
+
+  std::string str() const {
+    std::string out = scheme + ":";
+    if (!host.empty() || !path.empty() || hasUser) {
+      out += "//";
+    }
+    if (hasUser) {
+      out += escape(username, Encoding::UserPassword);
+      if (passwordSet) {
+        out += ':';
+        out += escape(password, Encoding::UserPassword);
+      }
+      out += '@';
+    }
+    out += escape(host, Encoding::Host);
+    const std::string p = escapedPath();
+    if (!p.empty() && p[0] != '/' && !host.empty()) {
+      out += '/';
+    }
+    out += p;
+    if (forceQuery || !rawQuery.empty()) {
+      out += '?';
+      out += rawQuery;
+    }
+    return out;
+  }
+};
+
+// parseGoURL mirrors url.Parse for inputs that already start with
+// "http://" or "https://".
+std::optional<GoURL> parseGoURL(std::string_view raw) {
+  const auto hash = raw.find('#');
+  if (hash != std::string_view::npos) {
+    if (!unescape(raw.substr(hash + 1), Encoding::Fragment)) {
+      return std::nullopt;
+    }
+    raw = raw.substr(0, hash);
+  }
+  for (const char c : raw) {
+    const auto uc = static_cast<unsigned char>(c);
+    if (uc < 0x20 || uc == 0x7f) {
+      return std::nullopt;
+    }
+  }
+
+  GoURL u;
+  const auto colon = raw.find(':');
+  u.scheme = std::string(raw.substr(0, colon));
+  std::string_view rest = raw.substr(colon + 1);
+
+  if (!rest.empty() && rest.back() == '?' && std::count(rest.begin(), rest.end(), '?') == 1) {
+    u.forceQuery = true;
+    rest.remove_suffix(1);
+  } else if (const auto q = rest.find('?'); q != std::string_view::npos) {
+    u.rawQuery = std::string(rest.substr(q + 1));
+    rest = rest.substr(0, q);
+  }
+
+  if (rest.substr(0, 2) == "//") {
+    std::string_view authority = rest.substr(2);
+    rest = {};
+    if (const auto slash = authority.find('/'); slash != std::string_view::npos) {
+      rest = authority.substr(slash);
+      authority = authority.substr(0, slash);
+    }
+    const auto at = authority.rfind('@');
+    auto host = parseHost(at == std::string_view::npos ? authority : authority.substr(at + 1));
+    if (!host) {
+      return std::nullopt;
+    }
+    u.host = std::move(*host);
+    if (at != std::string_view::npos) {
+      const std::string_view userinfo = authority.substr(0, at);
+      if (!validUserinfo(userinfo)) {
+        return std::nullopt;
+      }
+      u.hasUser = true;
+      const auto sep = userinfo.find(':');
+      auto name = unescape(userinfo.substr(0, sep), Encoding::UserPassword);
+      if (!name) {
+        return std::nullopt;
+      }
+      u.username = std::move(*name);
+      if (sep != std::string_view::npos) {
+        auto pass = unescape(userinfo.substr(sep + 1), Encoding::UserPassword);
+        if (!pass) {
+          return std::nullopt;
+        }
+        u.passwordSet = true;
+        u.password = std::move(*pass);
+      }
+    }
+  }
+
+  auto path = unescape(rest, Encoding::Path);
+  if (!path) {
+    return std::nullopt;
+  }
+  u.path = std::move(*path);
+  if (escape(u.path, Encoding::Path) != rest) {
+    u.rawPath = std::string(rest);
+  }
+  return u;
+}
+
+// parseQuery mirrors url.ParseQuery, silently skipping malformed pairs the
+// way Query() does.
+std::map<std::string, std::vector<std::string>> parseQuery(std::string_view query) {
+  std::map<std::string, std::vector<std::string>> values;
+  while (!query.empty()) {
+    const auto amp = query.find('&');
+    std::string_view pair = query.substr(0, amp);
+    query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+    if (pair.find(';') != std::string_view::npos || pair.empty()) {
+      continue;
+    }
+    const auto eq = pair.find('=');
+    auto key = unescape(pair.substr(0, eq), Encoding::QueryComponent);
+    if (!key) {
+      continue;
+    }
+    auto value = unescape(eq == std::string_view::npos ? std::string_view{} : pair.substr(eq + 1),
+                          Encoding::QueryComponent);
+    if (!value) {
+      continue;
+    }
+    values[*key].push_back(std::move(*value));
+  }
+  return values;
+}
+
+std::string encodeQuery(const std::map<std::string, std::vector<std::string>>& values) {
+  std::string out;
+  for (const auto& [key, vs] : values) {
+    const std::string keyEscaped = escape(key, Encoding::QueryComponent);
+    for (const auto& v : vs) {
+      if (!out.empty()) {
+        out += '&';
+      }
+      out += keyEscaped;
+      out += '=';
+      out += escape(v, Encoding::QueryComponent);
+    }
+  }
+  return out;
+}
+
+// unicodeSpaceLen reports the byte length of a unicode.IsSpace rune that
+// starts at s[0], or 0.
+std::size_t unicodeSpaceLen(std::string_view s) {
+  if (s.empty()) {
+    return 0;
+  }
+  const auto c0 = static_cast<unsigned char>(s[0]);
+  if (c0 == ' ' || (c0 >= '\t' && c0 <= '\r')) {
+    return 1;
+  }
+  if (s.size() >= 2 && c0 == 0xC2) {
+    const auto c1 = static_cast<unsigned char>(s[1]);
+    return c1 == 0x85 || c1 == 0xA0 ? 2 : 0;
+  }
+  if (s.size() >= 3) {
+    const auto c1 = static_cast<unsigned char>(s[1]);
+    const auto c2 = static_cast<unsigned char>(s[2]);
+    if (c0 == 0xE1 && c1 == 0x9A && c2 == 0x80) return 3;  // U+1680
+    if (c0 == 0xE2 && c1 == 0x80 && (c2 <= 0x8A || c2 == 0xA8 || c2 == 0xA9 || c2 == 0xAF) &&
+        c2 >= 0x80) {
+      return 3;  // U+2000..U+200A, U+2028, U+2029, U+202F
+    }
+    if (c0 == 0xE2 && c1 == 0x81 && c2 == 0x9F) return 3;  // U+205F
+    if (c0 == 0xE3 && c1 == 0x80 && c2 == 0x80) return 3;  // U+3000
+  }
+  return 0;
+}
+
+std::string_view trimSpace(std::string_view s) {
+  while (const std::size_t n = unicodeSpaceLen(s)) {
+    s.remove_prefix(n);
+  }
+  for (;;) {
+    std::size_t n = 0;
+    for (std::size_t width = 1; width <= 3 && width <= s.size(); ++width) {
+      if (unicodeSpaceLen(s.substr(s.size() - width)) == width) {
+        n = width;
+        break;
+      }
+    }
+    if (n == 0) {
+      return s;
+    }
+    s.remove_suffix(n);
+  }
+}
+
+std::string_view trimCutset(std::string_view s, std::string_view cutset) {
+  while (!s.empty() && cutset.find(s.front()) != std::string_view::npos) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && cutset.find(s.back()) != std::string_view::npos) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
+}
+
+}  // namespace
+
+std::optional<std::string> cleanURL(std::string_view raw) {
+  std::string url;
+  if (!cleanURLInto(raw, url)) {
+    return std::nullopt;
+  }
+  return url;
+}
+
+bool cleanURLInto(std::string_view raw, std::string& out) {
+  const std::string_view text = trimSpace(raw);
+  if (text.empty()) {
+    return false;
+  }
+
+  const std::string_view match = findURLToken(text);
+  if (match.empty()) {
+    return false;
+  }
+  std::string_view trimmed = trimCutset(match, "><()[]{}.,;:\"'`");
+
+  out.clear();
+  if (!startsWith(trimmed, "http://") && !startsWith(trimmed, "https://")) {
+    while (!trimmed.empty() && trimmed.front() == '/') {
+      trimmed.remove_prefix(1);
+    }
+    out = "https://";
+  }
+  out.append(trimmed);
+  if (normalizeSimpleURL(out)) {
+    return true;
+  }
+
+  auto parsed = parseGoURL(out);
+  if (!parsed || parsed->host.empty()) {
+    return false;
+  }
+
+  auto query = parseQuery(parsed->rawQuery);
+  if (!query.empty()) {
+    query.erase("tag");
+    parsed->rawQuery = encodeQuery(query);
+  }
+
+  out = parsed->str();
+  if (!out.empty() && out.back() == '?') {
+    out.pop_back();
+  }
+  return true;
+}
+
+std::vector<std::string> gatherURLs(const std::vector<std::string>& raw) {
+  std::unordered_set<std::string> seen;
+  std::vector<std::string> cleaned;
+  for (const auto& candidate : raw) {
+    if (auto url = cleanURL(candidate); url && seen.insert(*url).second) {
+      cleaned.push_back(std::move(*url));
+    }
+  }
+  return cleaned;
+}
+
+std::string Url::hostHeader() const {
+  std::string out = host.find(':') != std::string::npos ? "[" + host + "]" : host;
+  if (port != (tls() ? 443 : 80)) {
+    out += ':';
+    out += std::to_string(port);
+  }
+  return out;
+}
+
+std::string Url::origin() const {
+  return scheme + "://" + hostHeader();
+}
+
+std::string Url::str() const {
+  return origin() + target;
+}
+
+std::optional<Url> parseURL(std::string_view raw) {
+  Url u;
+  if (startsWith(raw, "https://")) {
+    u.scheme = "https";
+    u.port = 443;
+    raw.remove_prefix(8);
+  } else if (startsWith(raw, "http://")) {
+    u.scheme = "http";
+    u.port = 80;
+    raw.remove_prefix(7);
+  } else {
+    return std::nullopt;
+  }
+
+  raw = raw.substr(0, raw.find('#'));
+  const auto end = raw.find_first_of("/?");
+  std::string_view authority = raw.substr(0, end);
+  std::string_view target = end == std::string_view::npos ? std::string_view{} : raw.substr(end);
+  if (const auto at = authority.rfind('@'); at != std::string_view::npos) {
+    authority.remove_prefix(at + 1);
+  }
+
+  std::string_view portText;
+  if (!authority.empty() && authority[0] == '[') {
+    const auto close = authority.find(']');
+    if (close == std::string_view::npos) {
+      return std::nullopt;
+    }
+    u.host = std::string(authority.substr(1, close - 1));
+    if (authority.size() > close + 1) {
+      if (authority[close + 1] != ':') {
+        return std::nullopt;
+      }
+      portText = authority.substr(close + 2);
+    }
+  } else {
+    const auto colon = authority.rfind(':');
+    u.host = std::string(authority.substr(0, colon));
+    if (colon != std::string_view::npos) {
+      portText = authority.substr(colon + 1);
+    }
+  }
+  if (u.host.empty()) {
+    return std::nullopt;
+  }
+  if (!portText.empty()) {
+    unsigned long port = 0;
+    for (const char c : portText) {
+      if (c < '0' || c > '9' || (port = port * 10 + static_cast<unsigned long>(c - '0')) > 65535) {
+        return std::nullopt;
+      }
+    }
+    if (port == 0) {
+      return std::nullopt;
+    }
+    u.port = static_cast<std::uint16_t>(port);
+  }
+
+  u.target = std::string(target);
+  if (u.target.empty() || u.target[0] == '?') {
+    u.target.insert(0, "/");
+  }
+  return u;
+}
+
+std::optional<Url> resolveReference(const Url& base, std::string_view ref) {
+  ref = ref.substr(0, ref.find('#'));
+  if (startsWith(ref, "http://") || startsWith(ref, "https://")) {
+    return parseURL(ref);
+  }
+  if (startsWith(ref, "//")) {
+    return parseURL(base.scheme + ":" + std::string(ref));
+  }
+  Url u = base;
+  if (ref.empty()) {
+    return u;
+  }
+  if (ref[0] == '/') {
+    u.target = std::string(ref);
+  } else if (ref[0] == '?') {
+    u.target = base.target.substr(0, base.target.find('?')) + std::string(ref);
+  } else {
+    const std::string path = base.target.substr(0, base.target.find('?'));
+    u.target = path.substr(0, path.rfind('/') + 1) + std::string(ref);
+  }
+  return u;
+}
+
+std::string localFileName(const Url& url) {
+  const auto q = url.target.find('?');
+  const std::string path = url.target.substr(0, q);
+  const std::string segment = path.substr(path.rfind('/') + 1);
+
+  std::string name = segment;
+  if (auto decoded = unescape(segment, Encoding::Path);
+      decoded && decoded->find_first_of(std::string_view("/\0", 2)) == std::string::npos) {
+    name = std::move(*decoded);
+  }
+  if (name.empty() || name == "." || name == "..") {
+    name = "index.html";
+  }
+  if (q != std::string::npos && q + 1 < url.target.size()) {
+    name += url.target.substr(q);
+  }
+  return name;
+}
+
+}  // namespace urldl
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace urldl {
+
+// cleanURL extracts the first URL token from a pasted line and normalizes it
+// exactly like cleanURL in main.go: surrounding punctuation is trimmed, bare
+// video.twimg.com links get https://, the tag query parameter and the
+// fragment are dropped, and the remaining query is re-encoded in key order.
+std::optional<std::string> cleanURL(std::string_view raw);
+
+// cleanURLInto is cleanURL writing into out, whose capacity is reused: the
+// common URLs that need no re-encoding are cleaned without allocating.
+// out is unspecified when it returns false.
+bool cleanURLInto(std::string_view raw, std::string& out);
+
+// gatherURLs cleans every line and drops duplicates, keeping first-seen order.
+std::vector<std::string> gatherURLs(const std::vector<std::string>& raw);
+
+struct Url {
+  std::string scheme;  // "http" or "https"
+  std::string host;    // brackets stripped for IPv6 literals
+  std::uint16_t port = 0;
+  std::string target;  // path and query as sent on the request line
+
+  bool tls() const { return scheme == "https"; }
+  // hostHeader is the authority as sent in the Host header.
+  std::string hostHeader() const;
+  // origin is scheme://host:port and keys connection reuse.
+  std::string origin() const;
+  std::string str() const;
+};
+
+// parseURL splits an absolute http(s) URL. Userinfo is ignored.
+std::optional<Url> parseURL(std::string_view url);
+
+// resolveReference resolves a Location header value against base.
+std::optional<Url> resolveReference(const Url& base, std::string_view ref);
+
+// localFileName returns the name wget -P would save the URL under: the
+// unescaped last path segment plus "?query" when present, or index.html.
+std::string localFileName(const Url& url);
+
+}  // namespace urldl
@@ -0,0 +1,78 @@
+#include "url_batch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "url.h"
+
+namespace urldl {
+
+std::string_view UrlBatch::add(std::string_view line) {
+  if (!cleanURLInto(line, scratch_)) {
+    return {};
+  }
+  // Keep probes short: past 70% full the table doubles.
+  if ((urls_.size() + 1) * 10 > slots_.size() * 7) {
+    grow();
+  }
+  const std::size_t hash = std::hash<std::string_view>{}(scratch_);
+  std::uint32_t* slot = find(scratch_, hash);
+  if (*slot != 0) {
+    return {};
+  }
+  const std::string_view url = store(scratch_);
+  urls_.push_back(url);
+  *slot = static_cast<std::uint32_t>(urls_.size());
+  return url;
+}
+
+void UrlBatch::clear() {
+  if (blocks_.size() > 1) {
+    blocks_.resize(1);
+  }
+  used_ = 0;
+  room_ = blocks_.empty() ? 0 : kBlockBytes;
+  urls_.clear();
+  std::fill(slots_.begin(), slots_.end(), 0);
+}
+
+// find returns the slot holding url, or the empty slot where it would go.
+std::uint32_t* UrlBatch::find(std::string_view url, std::size_t hash) {
+  const std::size_t mask = slots_.size() - 1;
+  for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+    std::uint32_t& slot = slots_[i];
+    if (slot == 0 || urls_[slot - 1] == url) {
+      return &slot;
+    }
+  }
+}
+
+void UrlBatch::grow() {
+  std::vector<std::uint32_t> old = std::move(slots_);
+  slots_.assign(old.empty() ? 1024 : old.size() * 2, 0);
+  for (const std::uint32_t index : old) {
+    if (index != 0) {
+      *find(urls_[index - 1], std::hash<std::string_view>{}(urls_[index - 1])) = index;
+    }
+  }
+}
+
+// store copies url into the arena. A URL longer than a block gets one of its
+// own; the rest of the current block is then wasted, which for URLs that
+// long hardly matters.
+std::string_view UrlBatch::store(std::string_view url) {
+  if (url.size() > room_) {
+    const std::size_t bytes = std::max(kBlockBytes, url.size());
+    blocks_.emplace_back(new char[bytes]);
+    used_ = 0;
+    room_ = bytes;
+  }
+  char* at = blocks_.back().get() + used_;
+  std::memcpy(at, url.data(), url.size());
+  used_ += url.size();
+  room_ -= url.size();
+  return {at, url.size()};
+}
+
+}  // namespace urldl
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace urldl {
+
+// UrlBatch holds the cleaned, deduplicated URLs of one batch back to back in
+// an arena of large blocks, so a paste of 100k lines costs a few dozen
+// allocations rather than several per line, and the views it hands out stay
+// put as it grows. Lines are cleaned through one reused buffer and never
+// kept themselves; duplicates are found with an open-addressing table of
+// indices into urls().
+class UrlBatch {
+ public:
+  UrlBatch() = default;
+  UrlBatch(const UrlBatch&) = delete;
+  UrlBatch& operator=(const UrlBatch&) = delete;
+
+  // add cleans a pasted line like cleanURL. It returns the URL as stored,
+  // or an empty view when the line has no URL or one already in the batch.
+  std::string_view add(std::string_view line);
+
+  // urls are in first-seen order, like gatherURLs.
+  const std::vector<std::string_view>& urls() const { return urls_; }
+  std::size_t size() const { return urls_.size(); }
+  bool empty() const { return urls_.empty(); }
+  // clear forgets every URL; views handed out before become invalid. The
+  // first block is kept for the next batch.
+  void clear();
+
+ private:
+  static constexpr std::size_t kBlockBytes = 256 << 10;
+
+  std::string_view store(std::string_view url);
+  std::uint32_t* find(std::string_view url, std::size_t hash);
+  void grow();
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  std::size_t used_ = 0;  // of the last block
+  std::size_t room_ = 0;  // left in the last block
+  std::vector<std::string_view> urls_;
+  std::vector<std::uint32_t> slots_;  // index into urls_ plus one; 0 is empty
+  std::string scratch_;
+};
+
+}  // namespace urldl
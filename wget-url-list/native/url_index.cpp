@@ -0,0 +1,304 @@
+#include "url_index.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace urldl {
+
+namespace {
+
+constexpr char kMagic[8] = {'u', 'r', 'l', 'd', 'l', 'i', 'x', '1'};
+constexpr std::uint64_t kInitialSlots = 4096;
+constexpr std::uint64_t kInitialArena = 1 << 20;
+// The on-disk sizes of Header and Slot.
+constexpr std::size_t kHeaderBytes = 64;
+constexpr std::size_t kSlotBytes = 32;
+
+std::size_t layoutBytes(std::uint64_t slots, std::uint64_t arenaCap) {
+  return kHeaderBytes + static_cast<std::size_t>(slots) * kSlotBytes + static_cast<std::size_t>(arenaCap);
+}
+
+// hashURL is FNV-1a with a final mix so that linear probing sees well
+// spread low bits. Zero marks an empty slot and is never returned.
+std::uint64_t hashURL(std::string_view url) {
+  std::uint64_t h = 0xcbf29ce484222325ull;
+  for (const char c : url) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ull;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h == 0 ? 1 : h;
+}
+
+}  // namespace
+
+struct UrlIndex::Header {
+  char magic[8];
+  std::uint64_t slotCount;  // power of two
+  std::uint64_t used;
+  std::uint64_t arenaUsed;
+  std::uint64_t arenaCap;
+  std::uint64_t reserved[3];
+};
+
+struct UrlIndex::Slot {
+  std::uint64_t hash;    // 0 when empty; written last so a torn insert stays empty
+  std::uint64_t offset;  // key then validator bytes, in the arena
+  std::int64_t size;
+  std::uint32_t keyLen;
+  std::uint32_t validatorLen;
+};
+
+UrlIndex::~UrlIndex() {
+  unmap();
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+bool UrlIndex::open(const std::string& path, std::string& err) {
+  path_ = path;
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    err = "open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  if (::flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+    err = "index " + path + " is in use by another process";
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  struct stat st {};
+  if (::fstat(fd_, &st) != 0) {
+    err = "stat " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  Header head{};
+  const bool valid = static_cast<std::size_t>(st.st_size) >= sizeof(Header) &&
+                     ::pread(fd_, &head, sizeof(head), 0) == static_cast<ssize_t>(sizeof(head)) &&
+                     std::memcmp(head.magic, kMagic, sizeof(kMagic)) == 0 && head.slotCount != 0 &&
+                     (head.slotCount & (head.slotCount - 1)) == 0 && head.arenaUsed <= head.arenaCap &&
+                     static_cast<std::size_t>(st.st_size) == layoutBytes(head.slotCount, head.arenaCap);
+  if (!valid) {
+    return create(err);
+  }
+  return map(static_cast<std::size_t>(st.st_size), err);
+}
+
+// create starts an empty index in the open file.
+bool UrlIndex::create(std::string& err) {
+  const std::size_t bytes = layoutBytes(kInitialSlots, kInitialArena);
+  if (::ftruncate(fd_, 0) != 0 || ::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+    err = "resize " + path_ + ": " + std::strerror(errno);
+    return false;
+  }
+  if (!map(bytes, err)) {
+    return false;
+  }
+  Header& head = header();
+  std::memcpy(head.magic, kMagic, sizeof(kMagic));
+  head.slotCount = kInitialSlots;
+  head.used = 0;
+  head.arenaUsed = 0;
+  head.arenaCap = kInitialArena;
+  return true;
+}
+
+bool UrlIndex::map(std::size_t bytes, std::string& err) {
+  unmap();
+  void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (base == MAP_FAILED) {
+    err = "map " + path_ + ": " + std::strerror(errno);
+    return false;
+  }
+  base_ = static_cast<char*>(base);
+  mapped_ = bytes;
+  return true;
+}
+
+void UrlIndex::unmap() {
+  if (base_ != nullptr) {
+    ::munmap(base_, mapped_);
+    base_ = nullptr;
+    mapped_ = 0;
+  }
+}
+
+UrlIndex::Header& UrlIndex::header() const {
+  static_assert(sizeof(Header) == kHeaderBytes, "index header layout");
+  return *reinterpret_cast<Header*>(base_);
+}
+
+UrlIndex::Slot* UrlIndex::slots() const {
+  static_assert(sizeof(Slot) == kSlotBytes, "index slot layout");
+  return reinterpret_cast<Slot*>(base_ + sizeof(Header));
+}
+
+char* UrlIndex::arena() const { return base_ + sizeof(Header) + header().slotCount * sizeof(Slot); }
+
+// find returns the slot holding url, or the empty slot where it would go.
+UrlIndex::Slot* UrlIndex::find(std::string_view url, std::uint64_t hash) const {
+  const Header& head = header();
+  const std::uint64_t mask = head.slotCount - 1;
+  for (std::uint64_t i = hash & mask;; i = (i + 1) & mask) {
+    Slot& slot = slots()[i];
+    if (slot.hash == 0) {
+      return &slot;
+    }
+    if (slot.hash == hash && slot.keyLen == url.size() &&
+        slot.offset + slot.keyLen + slot.validatorLen <= head.arenaUsed &&
+        std::memcmp(arena() + slot.offset, url.data(), url.size()) == 0) {
+      return &slot;
+    }
+  }
+}
+
+bool UrlIndex::lookup(std::string_view url, IndexEntry& entry) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (base_ == nullptr) {
+    return false;
+  }
+  const Slot* slot = find(url, hashURL(url));
+  if (slot->hash == 0) {
+    return false;
+  }
+  entry.size = slot->size;
+  entry.validator.assign(arena() + slot->offset + slot->keyLen, slot->validatorLen);
+  return true;
+}
+
+std::size_t UrlIndex::size() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return base_ == nullptr ? 0 : static_cast<std::size_t>(header().used);
+}
+
+bool UrlIndex::record(std::string_view url, const IndexEntry& entry, std::string& err) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (base_ == nullptr) {
+    return false;
+  }
+  const std::uint64_t hash = hashURL(url);
+  Slot* slot = find(url, hash);
+  if (slot->hash != 0) {
+    const std::string_view old(arena() + slot->offset + slot->keyLen, slot->validatorLen);
+    if (old == entry.validator) {
+      slot->size = entry.size;
+      return true;
+    }
+  } else if ((header().used + 1) * 10 > header().slotCount * 7) {
+    // Keep probes short: past 70% full the table doubles.
+    if (!growSlots(err)) {
+      return false;
+    }
+  }
+
+  const std::uint64_t need = url.size() + entry.validator.size();
+  if (header().arenaUsed + need > header().arenaCap && !growArena(need, err)) {
+    return false;
+  }
+  slot = find(url, hash);  // remapping moved everything
+  Header& head = header();
+  const std::uint64_t offset = head.arenaUsed;
+  std::memcpy(arena() + offset, url.data(), url.size());
+  std::memcpy(arena() + offset + url.size(), entry.validator.data(), entry.validator.size());
+  head.arenaUsed += need;
+
+  const bool fresh = slot->hash == 0;
+  slot->offset = offset;
+  slot->size = entry.size;
+  slot->keyLen = static_cast<std::uint32_t>(url.size());
+  slot->validatorLen = static_cast<std::uint32_t>(entry.validator.size());
+  slot->hash = hash;
+  if (fresh) {
+    ++head.used;
+  }
+  return true;
+}
+
+// growArena makes room for need more arena bytes. The arena is the end of
+// the file, so growing it leaves every offset in place.
+bool UrlIndex::growArena(std::uint64_t need, std::string& err) {
+  const Header& head = header();
+  std::uint64_t cap = head.arenaCap * 2;
+  while (head.arenaUsed + need > cap) {
+    cap *= 2;
+  }
+  const std::uint64_t slotCount = head.slotCount;
+  const std::size_t bytes = layoutBytes(slotCount, cap);
+  if (::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+    err = "resize " + path_ + ": " + std::strerror(errno);
+    return false;
+  }
+  if (!map(bytes, err)) {
+    return false;
+  }
+  header().arenaCap = cap;
+  return true;
+}
+
+// growSlots rehashes into a table twice the size. It is built in a new file
+// that replaces the old one, so a crash leaves one of the two intact.
+bool UrlIndex::growSlots(std::string& err) {
+  const Header old = header();
+  const std::uint64_t slotCount = old.slotCount * 2;
+  const std::size_t bytes = layoutBytes(slotCount, old.arenaCap);
+  const std::string tmp = path_ + ".tmp";
+  const int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    err = "open " + tmp + ": " + std::strerror(errno);
+    return false;
+  }
+  void* mem = MAP_FAILED;
+  if (::flock(fd, LOCK_EX | LOCK_NB) != 0 || ::ftruncate(fd, static_cast<off_t>(bytes)) != 0 ||
+      (mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    err = "grow " + tmp + ": " + std::strerror(errno);
+    ::close(fd);
+    ::unlink(tmp.c_str());
+    return false;
+  }
+
+  char* base = static_cast<char*>(mem);
+  Header& head = *reinterpret_cast<Header*>(base);
+  head = old;
+  head.slotCount = slotCount;
+  Slot* table = reinterpret_cast<Slot*>(base + sizeof(Header));
+  std::memcpy(base + sizeof(Header) + slotCount * sizeof(Slot), arena(), old.arenaUsed);
+  for (std::uint64_t i = 0; i < old.slotCount; ++i) {
+    const Slot& slot = slots()[i];
+    if (slot.hash == 0) {
+      continue;
+    }
+    std::uint64_t at = slot.hash & (slotCount - 1);
+    while (table[at].hash != 0) {
+      at = (at + 1) & (slotCount - 1);
+    }
+    table[at] = slot;
+  }
+
+  if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+    err = "rename " + tmp + ": " + std::strerror(errno);
+    ::munmap(mem, bytes);
+    ::close(fd);
+    ::unlink(tmp.c_str());
+    return false;
+  }
+  unmap();
+  ::close(fd_);
+  fd_ = fd;
+  base_ = base;
+  mapped_ = bytes;
+  return true;
+}
+
+}  // namespace urldl
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace urldl {
+
+// IndexEntry is what is known about a URL that was downloaded completely.
+struct IndexEntry {
+  std::int64_t size = -1;
+  std::string validator;  // strong ETag or Last-Modified; may be empty
+};
+
+// UrlIndex is a persistent hash table from normalized URL to IndexEntry,
+// kept in one memory-mapped file so lookups cost a probe or two no matter
+// how many runs have added to it. The file is only a cache: if it is
+// missing or damaged it starts over empty. One process holds it at a time.
+//
+// Layout: a header, a power-of-two table of fixed-size slots probed
+// linearly, and an append-only arena with the key and validator bytes.
+// Slots record the full key, so a lookup never mistakes one URL for another.
+class UrlIndex {
+ public:
+  UrlIndex() = default;
+  ~UrlIndex();
+  UrlIndex(const UrlIndex&) = delete;
+  UrlIndex& operator=(const UrlIndex&) = delete;
+
+  bool open(const std::string& path, std::string& err);
+  bool isOpen() const { return base_ != nullptr; }
+
+  bool lookup(std::string_view url, IndexEntry& entry) const;
+  bool record(std::string_view url, const IndexEntry& entry, std::string& err);
+  std::size_t size() const;
+
+ private:
+  struct Header;
+  struct Slot;
+
+  bool create(std::string& err);
+  bool map(std::size_t bytes, std::string& err);
+  void unmap();
+  Header& header() const;
+  Slot* slots() const;
+  char* arena() const;
+  Slot* find(std::string_view url, std::uint64_t hash) const;
+  bool growArena(std::uint64_t need, std::string& err);
+  bool growSlots(std::string& err);
+
+  std::string path_;
+  int fd_ = -1;
+  char* base_ = nullptr;
+  std::size_t mapped_ = 0;
+  mutable std::mutex mu_;  // loops record from their own threads
+};
+
+}  // namespace urldl
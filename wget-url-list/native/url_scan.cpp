@@ -0,0 +1,292 @@
+#include "url_scan.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define URLDL_VECTOR 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define URLDL_VECTOR 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define URLDL_VECTOR 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace urldl {
+
+namespace {
+
+bool isRegexSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+#if defined(URLDL_VECTOR)
+// Vec is one register of input bytes. mask() packs a comparison result into
+// an integer with kBitsPerLane set bits for every matching byte, lowest
+// address first.
+#if defined(__AVX2__)
+constexpr std::size_t kLanes = 32;
+constexpr unsigned kBitsPerLane = 1;
+using Vec = __m256i;
+Vec load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+Vec eq(Vec v, char c) { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)); }
+Vec both(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+Vec either(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+std::uint64_t mask(Vec v) { return static_cast<std::uint32_t>(_mm256_movemask_epi8(v)); }
+#elif defined(__SSE2__) || defined(_M_X64)
+constexpr std::size_t kLanes = 16;
+constexpr unsigned kBitsPerLane = 1;
+using Vec = __m128i;
+Vec load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+Vec eq(Vec v, char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+Vec both(Vec a, Vec b) { return _mm_and_si128(a, b); }
+Vec either(Vec a, Vec b) { return _mm_or_si128(a, b); }
+std::uint64_t mask(Vec v) { return static_cast<std::uint32_t>(_mm_movemask_epi8(v)); }
+#else
+constexpr std::size_t kLanes = 16;
+constexpr unsigned kBitsPerLane = 4;
+using Vec = uint8x16_t;
+Vec load(const char* p) { return vld1q_u8(reinterpret_cast<const std::uint8_t*>(p)); }
+Vec eq(Vec v, char c) { return vceqq_u8(v, vdupq_n_u8(static_cast<std::uint8_t>(c))); }
+Vec both(Vec a, Vec b) { return vandq_u8(a, b); }
+Vec either(Vec a, Vec b) { return vorrq_u8(a, b); }
+// NEON has no movemask; narrowing each 16-bit pair keeps a nibble per byte.
+std::uint64_t mask(Vec v) {
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+}
+#endif
+
+unsigned lowestBit(std::uint64_t m) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward64(&index, m);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(m));
+#endif
+}
+
+// nextLane pops the lowest matching lane off m and returns its index.
+std::size_t nextLane(std::uint64_t& m) {
+  const unsigned lane = lowestBit(m) / kBitsPerLane;
+  m &= ~(((std::uint64_t{1} << kBitsPerLane) - 1) << (lane * kBitsPerLane));
+  return lane;
+}
+#endif
+
+// bodyStart returns where the \S+ part of a urlToken match starting at i
+// begins, or 0 when no alternative matches there.
+std::size_t bodyStart(std::string_view text, std::size_t i) {
+  std::size_t body = 0;
+  if (text.compare(i, 8, "https://") == 0) {
+    body = i + 8;
+  } else if (text.compare(i, 7, "http://") == 0) {
+    body = i + 7;
+  } else if (text.compare(i, 16, "video.twimg.com/") == 0) {
+    body = i + 16;
+  } else {
+    return 0;
+  }
+  return body < text.size() && !isRegexSpace(text[body]) ? body : 0;
+}
+
+// spaceAt returns the first regexp \s at or after i, or text.size().
+std::size_t spaceAt(std::string_view text, std::size_t i) {
+  const char* p = text.data();
+#if defined(URLDL_VECTOR)
+  for (; i + kLanes <= text.size(); i += kLanes) {
+    const Vec v = load(p + i);
+    const std::uint64_t m =
+        mask(either(either(eq(v, ' '), eq(v, '\t')), either(either(eq(v, '\n'), eq(v, '\f')), eq(v, '\r'))));
+    if (m != 0) {
+      return i + lowestBit(m) / kBitsPerLane;
+    }
+  }
+#endif
+  while (i < text.size() && !isRegexSpace(p[i])) {
+    ++i;
+  }
+  return i;
+}
+
+// Character classes for normalizeSimpleURL: bytes that url.Parse accepts
+// and String writes back unchanged in each part.
+enum : std::uint8_t {
+  kQueryByte = 1,  // kept by QueryEscape
+  kHostByte = 2,
+  kPathByte = 4,  // kept by PathEscape-style path encoding
+};
+
+struct ByteClasses {
+  std::uint8_t of[256] = {};
+
+  constexpr ByteClasses() {
+    for (int c = 0; c < 256; ++c) {
+      const bool alnum = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+      const bool unreserved = alnum || c == '-' || c == '_' || c == '.' || c == '~';
+      std::uint8_t bits = 0;
+      if (unreserved) {
+        bits |= kQueryByte | kHostByte | kPathByte;
+      }
+      switch (c) {
+        case '$': case '&': case '+': case ',': case '/': case ':': case ';': case '=': case '@':
+          bits |= kPathByte;
+          break;
+        default:
+          break;
+      }
+      of[c] = bits;
+    }
+  }
+
+  bool is(char c, std::uint8_t cls) const { return (of[static_cast<unsigned char>(c)] & cls) != 0; }
+};
+
+constexpr ByteClasses kClasses;
+
+bool allOf(std::string_view s, std::uint8_t cls) {
+  for (const char c : s) {
+    if (!kClasses.is(c, cls)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// simpleHost accepts a registered name with an optional numeric port.
+bool simpleHost(std::string_view host) {
+  const std::size_t colon = host.find(':');
+  const std::string_view name = host.substr(0, colon);
+  if (name.empty() || !allOf(name, kHostByte)) {
+    return false;
+  }
+  if (colon == std::string_view::npos) {
+    return true;
+  }
+  for (const char c : host.substr(colon + 1)) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string_view findURLToken(std::string_view text) {
+  const std::size_t n = text.size();
+  std::size_t i = 0;
+#if defined(URLDL_VECTOR)
+  // Every match starts with 'h' and has '/' 6 or 7 bytes later, or starts
+  // with 'v' and has '/' 15 bytes later; only those lanes are checked fully.
+  const char* p = text.data();
+  for (; i + 15 + kLanes <= n; i += kLanes) {
+    const Vec first = load(p + i);
+    const Vec http = both(eq(first, 'h'), either(eq(load(p + i + 6), '/'), eq(load(p + i + 7), '/')));
+    const Vec twimg = both(eq(first, 'v'), eq(load(p + i + 15), '/'));
+    for (std::uint64_t m = mask(either(http, twimg)); m != 0;) {
+      const std::size_t at = i + nextLane(m);
+      if (const std::size_t body = bodyStart(text, at)) {
+        return text.substr(at, spaceAt(text, body) - at);
+      }
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    if (const std::size_t body = bodyStart(text, i)) {
+      return text.substr(i, spaceAt(text, body) - i);
+    }
+  }
+  return {};
+}
+
+bool normalizeSimpleURL(std::string& url) {
+  const std::string_view s = url;
+  const std::size_t authority = s.compare(0, 8, "https://") == 0 ? 8 : s.compare(0, 7, "http://") == 0 ? 7 : 0;
+  if (authority == 0) {
+    return false;
+  }
+
+  // url.Parse only rejects a fragment for bad escapes; String drops it.
+  std::size_t end = s.find('#');
+  if (end != std::string_view::npos) {
+    if (s.find('%', end) != std::string_view::npos) {
+      return false;
+    }
+  } else {
+    end = s.size();
+  }
+
+  const std::string_view rest = s.substr(0, end);
+  const std::size_t query = rest.find('?');
+  const std::size_t path = std::min(rest.find('/', authority), query);
+  if (!simpleHost(rest.substr(authority, std::min(path, end) - authority))) {
+    return false;
+  }
+  if (path < end && !allOf(rest.substr(path, std::min(query, end) - path), kPathByte)) {
+    return false;
+  }
+  if (query == std::string_view::npos) {
+    url.resize(end);
+    return true;
+  }
+
+  // Query().Encode() sorts by key and escapes; pairs that are already
+  // sorted and need no escaping come out as they went in, minus tag.
+  const std::string_view pairs = rest.substr(query + 1);
+  if (pairs.empty()) {
+    url.resize(query);  // a bare "?" goes in cleanURL's TrimSuffix
+    return true;
+  }
+  std::string_view prevKey;
+  for (std::size_t at = 0;;) {
+    const std::size_t amp = pairs.find('&', at);
+    const std::string_view pair = pairs.substr(at, amp == std::string_view::npos ? amp : amp - at);
+    const std::size_t eq = pair.find('=');
+    if (eq == std::string_view::npos || !allOf(pair.substr(0, eq), kQueryByte) ||
+        !allOf(pair.substr(eq + 1), kQueryByte)) {
+      return false;
+    }
+    const std::string_view key = pair.substr(0, eq);
+    if (key != "tag") {
+      if (key < prevKey) {
+        return false;
+      }
+      prevKey = key;
+    }
+    if (amp == std::string_view::npos) {
+      break;
+    }
+    at = amp + 1;
+  }
+
+  // Everything checks out: compact the kept pairs over the dropped ones.
+  std::size_t out = query + 1;
+  std::size_t in = query + 1;
+  while (in < end) {
+    std::size_t amp = url.find('&', in);
+    if (amp == std::string::npos || amp > end) {
+      amp = end;
+    }
+    if (url.compare(in, 4, "tag=") != 0) {
+      if (out > query + 1) {
+        url[out++] = '&';
+      }
+      std::memmove(&url[out], &url[in], amp - in);
+      out += amp - in;
+    }
+    in = amp + 1;
+  }
+  url.resize(out == query + 1 ? query : out);
+  return true;
+}
+
+}  // namespace urldl
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace urldl {
+
+// findURLToken returns the leftmost match of urlToken in main.go,
+// (https?://\S+|video\.twimg\.com/\S+), or an empty view. Candidate starts
+// are found a vector at a time, so text without URLs costs a few compares
+// per 16 or 32 bytes.
+std::string_view findURLToken(std::string_view text);
+
+// normalizeSimpleURL applies cleanURL's normalization in place to an
+// http(s) URL that url.Parse and String would leave byte for byte: plain
+// host, unescaped path, and a query of key=value pairs already in key
+// order. It drops the fragment and every tag pair. Anything else returns
+// false with url untouched, and needs the full net/url port.
+bool normalizeSimpleURL(std::string& url);
+
+}  // namespace urldl